@@ -0,0 +1,110 @@
+#ifndef BUILD_MANIFEST_INCLUDE
+#define BUILD_MANIFEST_INCLUDE
+#include <pthread.h>
+#include "dobjects.h"
+
+#define BUILD_MANIFEST_FILENAME "build-manifest"
+
+// The build manifest remembers, for every HTML file that was generated, a
+// hash of its contents along with its size and modification time, and is
+// saved in the /generating/ folder between runs. It lets
+// build_manifest_write_file_if_different decide whether a page has changed
+// without reading the existing file back in: if the file on disk still has
+// the size and modification time that were recorded, its contents must
+// still be the ones that were hashed. If the manifest has no entry for a
+// file, or the file has been touched since, the file is compared in full,
+// same as dstringbuilder_write_file_if_different.
+// Each entry also records a hash of the inputs that the file was generated
+// from (see html_page_creators), so that a page whose inputs haven't changed
+// doesn't even need to be put together; build_manifest_is_current checks
+// for this.
+// The manifest may be used from multiple threads at once.
+// Files are known to the manifest by their full paths, but are looked up
+// relative to a directory that's held open: the functions that check or
+// write files take the open directory (dir_fd), along with the length of
+// its path (dir_length); each filename must start with that path, followed
+// by a slash.
+
+// build_manifest_entry_struct is what the manifest knows about a single file.
+typedef struct build_manifest_entry_struct {
+	// The full path of the file.
+	dstring_struct filename;
+
+	// The dstringbuilder_get_hash hash of the file contents.
+	uint64_t hash;
+
+	// The hash of the inputs the file was generated from, or 0 if unknown.
+	uint64_t input_hash;
+
+	// The size and modification time of the file, as of when the hash was
+	// recorded.
+	off_t size;
+	struct timespec mtime;
+
+	// Whether the file was written or checked during this run; only these
+	// entries are saved, so that files that are no longer generated drop
+	// out of the manifest.
+	int seen;
+
+	// The file's current size and modification time, if they were stat()'d
+	// ahead of time by build_manifest_prefetch_stats: prefetched is 1 if
+	// they're set, -1 if the file doesn't exist, and 0 if it wasn't
+	// stat()'d. They're used up by the next build_manifest_is_current.
+	int prefetched;
+	off_t prefetched_size;
+	struct timespec prefetched_mtime;
+} build_manifest_entry_struct;
+
+typedef struct build_manifest_struct {
+	// A darray of build_manifest_entry_struct's.
+	darray_struct entries;
+
+	// Maps filenames to their position in entries.
+	dhashindex_struct index;
+
+	// Guards entries and index.
+	pthread_mutex_t lock;
+} build_manifest_struct;
+
+// =================================
+// = build_manifest_struct functions
+// =================================
+
+// Initializes an empty manifest.
+// Returns NULL on error.
+build_manifest_struct* build_manifest_init(build_manifest_struct* build_manifest);
+
+// Cleans up the resources used by the manifest; does not free the pointer
+// itself.
+void build_manifest_free(build_manifest_struct* build_manifest);
+
+// Loads the manifest saved in filename. It is not an error for the file
+// to not exist; if it can't be understood, a warning is printed and the
+// manifest is left empty, so that everything is compared in full.
+// Returns NULL on error.
+build_manifest_struct* build_manifest_load(build_manifest_struct* build_manifest, const char* filename);
+
+// Saves the entries that were seen during this run to filename.
+// Returns 0 on error.
+int build_manifest_save(build_manifest_struct* build_manifest, const char* filename);
+
+// Checks whether filename was generated from inputs with the given
+// input_hash, and hasn't been touched since; if so, it's marked as seen,
+// and doesn't need to be generated again. input_hash must not be 0.
+// Returns 1 if the file is current, 0 otherwise.
+int build_manifest_is_current(build_manifest_struct* build_manifest, int dir_fd, size_t dir_length, const char* filename, uint64_t input_hash);
+
+// If io_ring is in use, stat()'s those of the files that are in the
+// manifest as a single batch, so that build_manifest_is_current doesn't
+// have to stat() them one at a time. If the batch fails, they're just
+// stat()'d one at a time.
+void build_manifest_prefetch_stats(build_manifest_struct* build_manifest, int dir_fd, size_t dir_length, const char** filenames, size_t num_filenames);
+
+// Does the same thing as dstringbuilder_write_file_if_different, but uses
+// the manifest (if it isn't NULL) to avoid reading the existing file, and
+// records the file, along with input_hash (which may be 0 if unknown), in
+// the manifest.
+// Returns 0 on error.
+int build_manifest_write_file_if_different(build_manifest_struct* build_manifest, dstringbuilder_struct* dstringbuilder, int dir_fd, size_t dir_length, const char* filename, uint64_t input_hash, int* did_write);
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef CONTENT_BUNDLE_INCLUDE
+#define CONTENT_BUNDLE_INCLUDE
+#include "dobjects.h"
+
+#define CONTENT_BUNDLE_MAGIC "SPKBNDL1"
+
+// A content bundle is a single file holding everything in a site's content
+// directory that the site is loaded from (the posts, series, misc_pages,
+// components and themes folders), so that it can be copied around as one
+// file, and loaded with a single open() and mmap() instead of a walk over
+// thousands of small files.
+// The file is laid out as a content_bundle_header_struct, followed by the
+// content_bundle_entry_struct's (sorted by path, so that they can be
+// searched, and so that everything in a folder is together), followed by
+// each entry's path and contents, each with a '\0' after it, so that the
+// contents can be used in place as C strings.
+// Numbers are stored in the byte order of the machine that packed the
+// bundle; a bundle is meant to be used on the same kind of machine.
+// While a bundle is in use (see use_content_bundle in file_helpers),
+// anything under the configured content directory is looked up in the
+// bundle instead of on disk, and loaded files borrow their contents from
+// the mapping (see dstring_borrow). The mapping is private and writable, so
+// the loaders can change strings in place without changing the file.
+
+typedef struct content_bundle_header_struct {
+	char magic[8];
+	uint64_t num_entries;
+
+	// The size of the whole bundle file, to catch truncated bundles.
+	uint64_t total_length;
+} content_bundle_header_struct;
+
+typedef struct content_bundle_entry_struct {
+	// Offset of the entry's path, relative to the content directory (eg
+	// posts/my-post/title), from the start of the bundle.
+	uint64_t path_offset;
+
+	// Offset and length of the file's contents; both 0 for directories.
+	uint64_t data_offset;
+	uint64_t data_length;
+
+	// 1 for directories, 0 for files.
+	uint64_t is_dir;
+} content_bundle_entry_struct;
+
+typedef struct content_bundle_struct {
+	// The whole bundle file, mapped in.
+	char* mapping;
+	size_t mapping_length;
+
+	// Points into the mapping.
+	content_bundle_entry_struct* entries;
+	size_t num_entries;
+
+	// The directory the bundle stands in for (the configured content base
+	// directory), without a trailing slash.
+	dstring_struct content_base_dir;
+} content_bundle_struct;
+
+// =================================
+// = content_bundle_struct functions
+// =================================
+
+// Packs the content directory content_base_dir into the bundle file
+// bundle_filename, replacing it if it exists.
+// Returns 0 on error.
+int content_bundle_pack(const char* content_base_dir, const char* bundle_filename);
+
+// Maps in the bundle file, checking that it's valid, to stand in for the
+// content directory content_base_dir.
+// Returns NULL on error.
+content_bundle_struct* content_bundle_open(content_bundle_struct* bundle, const char* bundle_filename, const char* content_base_dir);
+
+// Unmaps the bundle. Nothing loaded from it may be used afterward.
+void content_bundle_close(content_bundle_struct* bundle);
+
+// Returns the entry for the given path, which must be relative to the
+// content directory, with no leading, trailing or doubled slashes;
+// NULL if there's no such entry.
+content_bundle_entry_struct* content_bundle_find(content_bundle_struct* bundle, const char* path);
+
+// Returns the path of the entry, relative to the content directory.
+static inline const char* content_bundle_get_path(content_bundle_struct* bundle, content_bundle_entry_struct* entry) {
+	return bundle->mapping + entry->path_offset;
+}
+
+// Returns the contents of a file entry; it is followed by a '\0'.
+static inline char* content_bundle_get_data(content_bundle_struct* bundle, content_bundle_entry_struct* entry) {
+	return bundle->mapping + entry->data_offset;
+}
+
+// Works out the path, relative to the content directory, of the full path
+// path, storing it in relative_path, which has room for size bytes. Doubled
+// and trailing slashes are removed; the content directory itself is "".
+// Returns 1 if path is in the content directory, 0 otherwise (or if it
+// doesn't fit).
+int content_bundle_get_relative_path(content_bundle_struct* bundle, const char* path, char* relative_path, size_t size);
+
+// Calls func with the name and whether it's a directory for each entry
+// directly inside of the directory at relative_path, in sorted order.
+// func should return 0 if processing should be aborted.
+// Returns 0 if the directory isn't in the bundle, or on error.
+int content_bundle_apply_function_to_directory_entries(content_bundle_struct* bundle, const char* relative_path, int (*func)(const char*, int, void*), void* context);
+
+#endif
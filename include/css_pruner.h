@@ -0,0 +1,148 @@
+#ifndef CSS_PRUNER_INCLUDE
+#define CSS_PRUNER_INCLUDE
+#include <pthread.h>
+#include "dobjects.h"
+
+// The kinds of rules in a parsed stylesheet.
+// A style rule, which is kept if any of its selectors can match the page.
+#define CSS_PRUNER_STYLE 0
+// A rule that's always kept, such as @font-face, @keyframes or @import.
+#define CSS_PRUNER_KEPT 1
+// The start and end of a conditional group (@media, @supports, ...), which
+// is kept if any of the rules in it are.
+#define CSS_PRUNER_GROUP_START 2
+#define CSS_PRUNER_GROUP_END 3
+
+// The css_pruner cuts a theme's CSS down to the rules that can match a
+// given page, so that each page only inlines the styles it can use.
+// The CSS is parsed once into a list of rules, and each selector into the
+// element names, classes and ids that it needs (its tokens); a selector can
+// match a page if the page has all of them. Anything in a selector that
+// doesn't need a particular element, class or id (*, attribute selectors,
+// pseudo-classes and whatever is inside them, like :not(.a)) isn't
+// required, so a selector is only ever dropped when it can't match.
+// Pages are scanned for the element names and class and id attributes they
+// have (their selectors), and the pruned CSS is cached by a fingerprint of
+// those, so that pages with the same shape (such as all of the tag pages)
+// share it.
+// Tokens are kept as hashes of the kind ('t' for element names, '.' or '#')
+// and the name, lowercased for element names.
+
+typedef struct css_pruner_rule_struct {
+	// One of the CSS_PRUNER_* kinds.
+	int type;
+
+	// Where the rule's text is in the stylesheet's CSS; for the start of a
+	// group, this is up to and including its {.
+	size_t start;
+	size_t length;
+
+	// For style rules, the range of its selectors in the stylesheet's
+	// selectors.
+	size_t first_selector;
+	size_t num_selectors;
+} css_pruner_rule_struct;
+
+typedef struct css_pruner_selector_struct {
+	// The range of the selector's tokens in the stylesheet's tokens.
+	size_t first_token;
+	size_t num_tokens;
+} css_pruner_selector_struct;
+
+typedef struct css_pruner_stylesheet_struct {
+	// The CSS that was parsed; not owned by the stylesheet, and must outlive
+	// it.
+	dstring_struct* css;
+
+	// A darray of css_pruner_rule_struct's, in the order they're in the CSS.
+	darray_struct rules;
+
+	// A darray of css_pruner_selector_struct's.
+	darray_struct selectors;
+
+	// A darray of uint64_t token hashes.
+	darray_struct tokens;
+} css_pruner_stylesheet_struct;
+
+// css_page_selectors_struct is the set of tokens that a page has.
+typedef struct css_page_selectors_struct {
+	// A darray of uint64_t token hashes; sorted, without duplicates, once
+	// css_page_selectors_finish is called.
+	darray_struct tokens;
+
+	// A hash of all of the tokens, set by css_page_selectors_finish.
+	uint64_t fingerprint;
+} css_page_selectors_struct;
+
+typedef struct css_pruner_cache_entry_struct {
+	// The hash of the page selectors' fingerprint and whether the page has
+	// code.
+	uint64_t key;
+
+	// The pruned CSS.
+	dstring_struct* css;
+} css_pruner_cache_entry_struct;
+
+typedef struct css_pruner_struct {
+	// The theme's main and syntax highlighting CSS.
+	css_pruner_stylesheet_struct main_css;
+	css_pruner_stylesheet_struct code_css;
+
+	// The selectors of the markup that the theme adds to every page (the
+	// page header), which every page has on top of its own.
+	css_page_selectors_struct theme_selectors;
+
+	// A darray of css_pruner_cache_entry_struct's, sorted by key.
+	darray_struct cache;
+
+	// Guards cache.
+	pthread_mutex_t lock;
+} css_pruner_struct;
+
+// =============================
+// = css_pruner_struct functions
+// =============================
+
+// Parses main_css and code_css (which must outlive the css_pruner), where
+// theme_html is the markup that the theme adds to every page.
+// Returns NULL on error.
+css_pruner_struct* css_pruner_init(css_pruner_struct* css_pruner, dstring_struct* main_css, dstring_struct* code_css, dstring_struct* theme_html);
+
+// Cleans up the resources used by the css_pruner, including the cached
+// CSS; does not free the pointer itself.
+void css_pruner_free(css_pruner_struct* css_pruner);
+
+// Returns the main CSS (followed by the syntax highlighting CSS, if has_code
+// is set) cut down to the rules that can match a page with the given
+// selectors (which must be finished). The returned dstring is owned by the
+// css_pruner, and lives as long as it does.
+// May be called from multiple threads at once.
+// Returns NULL on error.
+dstring_struct* css_pruner_get_css(css_pruner_struct* css_pruner, css_page_selectors_struct* page_selectors, int has_code);
+
+// =====================================
+// = css_page_selectors_struct functions
+// =====================================
+
+// Sets up an empty set of selectors.
+void css_page_selectors_init(css_page_selectors_struct* page_selectors);
+
+// Cleans up the resources used by the selectors; does not free the pointer
+// itself.
+void css_page_selectors_free(css_page_selectors_struct* page_selectors);
+
+// Adds the tokens of the length bytes of HTML at html. The contents of
+// <script>, <style> and <textarea> elements, and comments, are skipped.
+// Returns NULL on error.
+css_page_selectors_struct* css_page_selectors_scan(css_page_selectors_struct* page_selectors, const char* html, size_t length);
+
+// Same as css_page_selectors_scan, for the HTML described by the
+// dstringbuilder.
+// Returns NULL on error.
+css_page_selectors_struct* css_page_selectors_scan_dstringbuilder(css_page_selectors_struct* page_selectors, dstringbuilder_struct* html);
+
+// Sorts the tokens and takes out duplicates, and sets the fingerprint. Must
+// be called once everything is scanned.
+void css_page_selectors_finish(css_page_selectors_struct* page_selectors);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef DATE_PARSER_INCLUDE
+#define DATE_PARSER_INCLUDE
+#include "dobjects.h"
+
+// date_parser converts the human-readable date/time strings used in post
+// files (written-date, publish-after, updated-at) into unix timestamps,
+// without having to spawn a `date` process.
+// It understands the subset of GNU `date -d` syntax that is useful for
+// writing post dates, with the items in (mostly) any order:
+// - Times: "9:00AM", "9:00 pm", "17:30", "17:30:15", "9AM"
+// - Dates: "6/3/2018", "6/3/18", "2018-06-03", "June 3, 2018",
+//   "3 June 2018", "Jun 3 2018"; day-of-week names are ignored
+// - ISO 8601: "2018-06-03T17:30:00", "2018-06-03T17:30:00Z",
+//   "2018-06-03T17:30:00-05:00"
+// - Timezones: abbreviations such as "CDT", "EST", "UTC" or "GMT",
+//   numeric offsets such as "-0500" or "+05:30", and a leading
+//   TZ="America/Chicago" item, which is looked up in the system
+//   zoneinfo database.
+// - The special words "now" and "today".
+// Dates without a timezone are interpreted in the local timezone (as
+// determined by the TZ environment variable), same as `date` does.
+
+// =======================
+// = date_parser functions
+// =======================
+
+// Parses date_str into a unix timestamp, storing it in result.
+// now is used for "now", "today", and strings without a date part.
+// Prints out a message describing the problem if date_str can't be parsed,
+// which includes description (what the date is for, eg "written-date for
+// post my-post").
+// Returns 0 on error.
+int parse_date_string(const char* date_str, const char* description, time_t now, time_t* result);
+
+#endif
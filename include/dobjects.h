@@ -13,6 +13,12 @@
 #include <dirent.h>
 #include <time.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <limits.h>
 
 #define DSTRING_INITIAL_SIZE 1000
 #define DSTRING_INCREMENT_SIZE 2000
@@ -23,7 +29,53 @@
 #define DARRAY_INCREMENT_SIZE 100
 #define DARRAY_SMALL_INCREMENT_SIZE 5
 
+#define DHASHINDEX_INITIAL_SIZE 64
 
+#define DARENA_BLOCK_SIZE (1024 * 1024)
+#define DARENA_ALIGNMENT 16
+
+// Values that the *_write_file_if_different functions set did_write to.
+#define WRITE_IF_DIFFERENT_NOT_WRITTEN 0
+#define WRITE_IF_DIFFERENT_UPDATED 1
+#define WRITE_IF_DIFFERENT_CREATED 2
+
+
+
+// darena_block_struct is the header at the start of each block of memory
+// that a darena has mapped. It should not be used directly.
+typedef struct darena_block_struct {
+	struct darena_block_struct* next;
+
+	// The size of the mapping, including this header.
+	size_t size;
+
+	// How much of the mapping has been handed out, including this header.
+	size_t used;
+} darena_block_struct;
+
+// darena_struct is a region allocator: memory is handed out from a few
+// large mmap()'d blocks, and is only given back all at once, by darena_free.
+// Its use case is for lots of small dstrings and darrays that all live
+// exactly as long as each other, such as everything loaded for a site.
+// A darena can be bound to a thread with darena_bind; while it is bound,
+// any dstring or darray that allocates memory for the first time takes it
+// from the darena, and remembers that it did, so that resizing it later
+// also uses the darena, and dstring_free/darray_free don't free() it.
+// Memory given up by resizing or freeing such a dstring or darray is not
+// reused until the darena is freed.
+// A darena may be used (and bound) from multiple threads at once.
+typedef struct darena_struct {
+	// The mapped blocks; the first is the one being handed out from.
+	// NULL if nothing has been allocated yet.
+	darena_block_struct* blocks;
+
+	// The most recent allocation from the first block, which can be grown
+	// in place.
+	void* last_allocation;
+
+	// Guards everything above.
+	pthread_mutex_t lock;
+} darena_struct;
 
 // dstring_struct is a dynamic string object. Its primary use case is for
 // appending strings to it, as would be the case when constructing a file
@@ -39,6 +91,10 @@ typedef struct dstring_struct {
 	// How long the string is. Will always be the same as strlen(dstring->str),
 	// if the dstring is only modified by dstring_* functions.
 	size_t length;
+
+	// The darena that str was allocated from, or NULL if it was malloc()'d.
+	// Points to a private marker if str is borrowed (see dstring_borrow).
+	darena_struct* arena;
 } dstring_struct;
 
 // darray_struct is a dynamic array object. Its primary use case is for
@@ -62,6 +118,9 @@ typedef struct darray_struct {
 
 	// How much space is needed for each element in the array.
 	size_t elem_size;
+
+	// The darena that array was allocated from, or NULL if it was malloc()'d.
+	darena_struct* arena;
 } darray_struct;
 
 
@@ -92,6 +151,119 @@ typedef struct dstringbuilder_struct {
 	dstring_struct* current_dstring;
 } dstringbuilder_struct;
 
+// dhashindex_entry_struct is a single slot in a dhashindex. It should not be
+// used directly, only through the dhashindex functions.
+typedef struct dhashindex_entry_struct {
+	// The key for this slot, or NULL if the slot is empty. Points to a
+	// string owned by someone else.
+	const char* key;
+
+	// The hash of the key, saved so that the index can be resized
+	// without rehashing every key.
+	size_t hash;
+
+	// The value stored for the key; typically, a position in a darray.
+	size_t index;
+} dhashindex_entry_struct;
+
+// dhashindex_struct is an open-addressing (linear probing) hash index that
+// maps C string keys to a size_t, typically the position of an element in
+// a darray. It is meant to sit alongside a darray so that elements can be
+// looked up by name without scanning the whole darray.
+// Keys are NOT copied; the index stores the pointer it is given, so the
+// string must outlive the index (or the index must be cleared first).
+// Pointers to dstring contents are fine to use, even if the dstring itself
+// is inside of a darray that gets resized, as the string's memory doesn't
+// move. If the darray is reordered (eg with qsort), the index must be
+// cleared and rebuilt, as the positions will have changed.
+typedef struct dhashindex_struct {
+	// The slots; total_length of them. Will be NULL if nothing has been
+	// inserted yet.
+	dhashindex_entry_struct* entries;
+
+	// How many slots are allocated. Always a power of 2 (or 0).
+	size_t total_length;
+
+	// How many slots are in use.
+	size_t length;
+} dhashindex_struct;
+
+// dhash_struct calculates a fast 64-bit hash of a sequence of bytes, which
+// can be appended a piece at a time; the hash only depends on the bytes,
+// not on how they were split up. It is meant for noticing changes, not
+// for security.
+typedef struct dhash_struct {
+	// The hash of all full 8-byte words so far.
+	uint64_t hash;
+
+	// The bytes that don't make up a full word yet, and how many there are.
+	uint64_t pending;
+	size_t pending_length;
+
+	// How many bytes have been appended in total.
+	size_t total_length;
+} dhash_struct;
+
+// dmapped_file_struct is a whole file mapped into memory, read-only.
+// Mapping a file, rather than reading it into a buffer, means it can be
+// compared against without copying it, and without any system calls past
+// the initial mapping.
+typedef struct dmapped_file_struct {
+	// The file's contents; NOT null-terminated.
+	const char* contents;
+
+	// The length of the file.
+	size_t length;
+} dmapped_file_struct;
+
+// =========================
+// = darena_struct functions
+// =========================
+
+// Sets up a darena, but does not map any memory for it.
+// Will never fail.
+void darena_lazy_init(darena_struct* darena);
+
+// Unmaps all of the memory handed out by the darena, leaving it empty but
+// usable. Any dstring or darray still using the memory must not be used
+// afterward (not even to dstring_free/darray_free it).
+void darena_free(darena_struct* darena);
+
+// Returns a pointer to size bytes of memory, aligned to DARENA_ALIGNMENT.
+// Returns NULL if there's an error.
+void* darena_alloc(darena_struct* darena, size_t size);
+
+// Resizes memory that came from darena_alloc, from old_size to new_size
+// bytes. If it was the most recent allocation and there's room, it is
+// grown in place; otherwise, new memory is handed out and the contents
+// copied over. ptr may be NULL (with old_size 0).
+// Returns NULL if there's an error, leaving ptr as it was.
+void* darena_realloc(darena_struct* darena, void* ptr, size_t old_size, size_t new_size);
+
+// Binds the darena to the calling thread, so that dstrings and darrays
+// allocate from it (see darena_struct); NULL unbinds.
+// Returns the darena that was previously bound, so that it can be restored.
+darena_struct* darena_bind(darena_struct* darena);
+
+// Returns the darena bound to the calling thread, or NULL if none is.
+darena_struct* darena_get_bound();
+
+// ===============================
+// = dmapped_file_struct functions
+// ===============================
+
+// Maps the file into memory. Empty files are fine.
+// Returns NULL on error.
+dmapped_file_struct* dmapped_file_open(dmapped_file_struct* mapped_file, const char* filename);
+
+// Same as dmapped_file_open, but a relative filename is looked up in the
+// directory open as dir_fd (see openat).
+// Returns NULL on error.
+dmapped_file_struct* dmapped_file_open_at(dmapped_file_struct* mapped_file, int dir_fd, const char* filename);
+
+// Unmaps the file.
+void dmapped_file_close(dmapped_file_struct* mapped_file);
+
 // =========================
 // = darray_struct functions
 // =========================
@@ -111,7 +283,8 @@ darray_struct* darray_init(darray_struct* darray, size_t elem_size);
 // Will never fail.
 void darray_lazy_init(darray_struct* darray, size_t elem_size);
 
-// Will free the space used for the darray. Note, though, that the elements
+// Will free the space used for the darray (unless it came from a darena,
+// in which case the darena owns it). Note, though, that the elements
 // themselves are not free()'d, if any cleanup must be done of the elements
 // in the darray, it must be done prior to calling darray_free()
 void darray_free(darray_struct* darray);
@@ -121,8 +294,9 @@ void darray_free(darray_struct* darray);
 // Returns NULL if there's an error.
 darray_struct* darray_increase_size_specific_amount(darray_struct* darray, size_t additional_elems);
 
-// Increases the array size by either DARRAY_SMALL_INCREMENT_SIZE or
-// DARRAY_INCREMENT_SIZE, depending on how big the array is.
+// Increases the array size by either DARRAY_SMALL_INCREMENT_SIZE,
+// DARRAY_INCREMENT_SIZE, or half of its current size, depending on how big
+// the array is.
 // Returns NULL if there's an error.
 darray_struct* darray_increase_size(darray_struct* darray);
 
@@ -146,6 +320,58 @@ darray_struct* darray_clone(darray_struct* darray);
 
 
 
+// =============================
+// = dhashindex_struct functions
+// =============================
+
+// Sets up a dhashindex, but does not allocate any memory for it.
+// Will never fail.
+void dhashindex_lazy_init(dhashindex_struct* dhashindex);
+
+// Frees the space used by the dhashindex. The keys are not freed, as they
+// are not owned by the dhashindex.
+void dhashindex_free(dhashindex_struct* dhashindex);
+
+// Removes all keys from the dhashindex, keeping its memory allocated
+// so that it can be refilled.
+void dhashindex_clear(dhashindex_struct* dhashindex);
+
+// Adds the key to the dhashindex with the given index. If the key is already
+// present, the existing index is kept, so that lookups behave the same way
+// as a front-to-back scan of the darray would.
+// Returns NULL on error.
+dhashindex_struct* dhashindex_insert(dhashindex_struct* dhashindex, const char* key, size_t index);
+
+// Looks up the key, storing its index in (*index) if it is found.
+// Returns 1 if the key was found, 0 otherwise.
+int dhashindex_find(dhashindex_struct* dhashindex, const char* key, size_t* index);
+
+// =======================
+// = dhash_struct functions
+// =======================
+
+// Sets up a dhash with nothing appended to it.
+void dhash_init(dhash_struct* dhash);
+
+// Appends length bytes to the hash.
+void dhash_append_bytes(dhash_struct* dhash, const void* bytes, size_t length);
+
+// Appends a string to the hash, including its terminating '\0' so that
+// consecutive strings can't run together.
+void dhash_append_string(dhash_struct* dhash, const char* str);
+void dhash_append_dstring(dhash_struct* dhash, dstring_struct* dstring);
+
+// Appends the string described by the dstringbuilder, without its '\0'
+// (unlike dhash_append_dstring).
+void dhash_append_dstringbuilder(dhash_struct* dhash, dstringbuilder_struct* dstringbuilder);
+
+// Appends a number to the hash.
+void dhash_append_uint64(dhash_struct* dhash, uint64_t value);
+
+// Returns the hash of everything appended so far; more can still be
+// appended afterwards.
+uint64_t dhash_get(dhash_struct* dhash);
+
 // ==========================
 // = dstring_struct functions
 // ==========================
@@ -165,8 +391,16 @@ dstring_struct* dstring_init(dstring_struct* dstring);
 // Will never fail.
 void dstring_lazy_init(dstring_struct* dstring);
 
-// Frees the space used by the dstring. Note, it does not free
-// the pointer itself.
+// Points the dstring at length bytes of memory that it doesn't own, such as
+// part of a mapped file; str[length] must be '\0', and the memory must be
+// writable, and outlive the dstring. The dstring can be changed in place;
+// the first time it needs to grow, the string is copied into memory of its
+// own. dstring_free won't free borrowed memory.
+// Will never fail.
+void dstring_borrow(dstring_struct* dstring, char* str, size_t length);
+
+// Frees the space used by the dstring (unless it came from a darena, in
+// which case the darena owns it). Note, it does not free the pointer itself.
 void dstring_free(dstring_struct* dstring);
 
 // Frees each dstring in the specified darray, as well as the
@@ -190,6 +424,11 @@ dstring_struct* dstring_resize(dstring_struct* dstring, size_t min_additional_by
 // Returns NULL on error.
 dstring_struct* dstring_append(dstring_struct* dstring, const char* text);
 
+// Appends text_len bytes of text to the dstring, resizing as necessary; for
+// when the length is already known.
+// Returns NULL on error.
+dstring_struct* dstring_append_length(dstring_struct* dstring, const char* text, size_t text_len);
+
 // Appends to the dstring in a printf style fashion, resizing as necessary.
 // Returns NULL on error.
 dstring_struct* dstring_append_printf(dstring_struct* dstring, const char* format, ...);
@@ -203,6 +442,11 @@ void dstring_remove_num_chars_in_text(dstring_struct* dstring, const char* text)
 // Returns NULL on error.
 dstring_struct* dstring_read_file(dstring_struct* dstring, const char* filename);
 
+// Same as dstring_read_file, but a relative filename is looked up in the
+// directory open as dir_fd (see openat).
+// Returns NULL on error.
+dstring_struct* dstring_read_file_at(dstring_struct* dstring, int dir_fd, const char* filename);
+
 // Reads the specified process output file into a dstring.
 // Note, because this calls pclose, it is an error to pass a non-process-file
 // (ie a regular file).
@@ -217,7 +461,8 @@ int dstring_write_file(dstring_struct* dstring, const char* filename);
 // If the file doesn't exist, or the contents are different than the dstring,
 // writes the dstring to the specified file.
 // Returns 0 on error; otherwise, check did_write to see if the file was
-// actually written.
+// actually written; it is set to one of the WRITE_IF_DIFFERENT_* values,
+// so it can also be treated as a flag.
 int dstring_write_file_if_different(dstring_struct* dstring, const char* filename, int* did_write);
 
 // A helper function; will attempt to load the file in the specified base
@@ -294,6 +539,10 @@ dstringbuilder_struct* dstringbuilder_new_dstringbuilder(dstringbuilder_struct*
 // Calculates the total length of the string described by the dstringbuilder.
 size_t dstringbuilder_get_length(dstringbuilder_struct* dstringbuilder);
 
+// Calculates the dhash of the string described by the dstringbuilder,
+// without forming the string.
+uint64_t dstringbuilder_get_hash(dstringbuilder_struct* dstringbuilder);
+
 // Creates and returns a pointer to a new dstring, the content of which is the
 // string described by the dstringbuilder.
 // Calling code is responsible for freeing both the dstring and the pointer
@@ -301,12 +550,40 @@ size_t dstringbuilder_get_length(dstringbuilder_struct* dstringbuilder);
 // Returns NULL on error.
 dstring_struct* dstringbuilder_form(dstringbuilder_struct* dstringbuilder);
 
+// Writes the string described by the dstringbuilder to the file with a
+// single writev() call (or a few, for very long dstringbuilders), straight
+// from the dstrings it's made of, without forming the string.
+// Returns 0 on error.
+int dstringbuilder_write_file(dstringbuilder_struct* dstringbuilder, const char* filename);
+
+// Same as dstringbuilder_write_file, but a relative filename is looked up in
+// the directory open as dir_fd (see openat).
+// Returns 0 on error.
+int dstringbuilder_write_file_at(dstringbuilder_struct* dstringbuilder, int dir_fd, const char* filename);
+
+// Compares the file to the string described by the dstringbuilder, a dstring
+// at a time, without forming the string.
+// Returns 1 if different, -1 if error, 0 if the same.
+int dstringbuilder_compare_to_file(dstringbuilder_struct* dstringbuilder, const char* filename);
+
+// Same as dstringbuilder_compare_to_file, but a relative filename is looked
+// up in the directory open as dir_fd (see openat).
+// Returns 1 if different, -1 if error, 0 if the same.
+int dstringbuilder_compare_to_file_at(dstringbuilder_struct* dstringbuilder, int dir_fd, const char* filename);
+
 // Efficiently checks to see if the file is different from the string
-// described by the dstringbuilder, and will only form the dstring to write
-// it out if the file is different.
+// described by the dstringbuilder, and will only write it out (with
+// dstringbuilder_write_file) if the file is different.
 // If there was an error, 0 is returned; if there is no error, 1 is returned,
 // and the int pointed to by did_write should be checked to see if the
-// file was written.
+// file was written; it is set to one of the WRITE_IF_DIFFERENT_* values.
+// Nothing is printed unless there is an error, so this is safe to call
+// from multiple threads for different files.
 int dstringbuilder_write_file_if_different(dstringbuilder_struct* dstringbuilder, const char* filename, int* did_write);
 
+// Same as dstringbuilder_write_file_if_different, but a relative filename is
+// looked up in the directory open as dir_fd (see openat).
+// Returns 0 on error.
+int dstringbuilder_write_file_if_different_at(dstringbuilder_struct* dstringbuilder, int dir_fd, const char* filename, int* did_write);
+
 #endif
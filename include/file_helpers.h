@@ -1,6 +1,7 @@
 #ifndef FILE_HELPERS_INCLUDE
 #define FILE_HELPERS_INCLUDE
 #include "dobjects.h"
+#include "content_bundle.h"
 
 // file_helpers contains a variety of useful helper functions
 // for dealing with files and directories.
@@ -10,6 +11,33 @@
 // the dstring will be modified, but it will always be reverted
 // back to its previous state before returning (though if more
 // memory was allocated, that is not undone).
+// While a content bundle is in use (see use_content_bundle), paths in the
+// content directory are looked up in the bundle instead of on disk by
+// check_if_file_exists, check_is_dir, try_check_dir_exists,
+// apply_function_to_directory_entries and load_content_file.
+// A directory that many files are looked up in can be held open instead
+// (see open_directory), and the *_at functions then look the files up
+// relative to it, so that their full paths don't need to be put together,
+// and the kernel doesn't walk the whole path for each of them; everything
+// also comes from the same directory, even if it's renamed partway through.
+// The *_at functions take both the open directory (dir_fd) and its path
+// (base_dir, which is only used for messages); if dir_fd is -1, they fall
+// back to the path, which is what's needed while a content bundle is in use.
+
+// A file for load_content_files to load, or just check for.
+typedef struct content_file_request_struct {
+	// The file, relative to the base directory (eg "/title").
+	const char* file;
+
+	// Where to load the file to; NULL to only check that it exists.
+	dstring_struct* destination;
+
+	// Whether it's an error for the file to not exist.
+	int required;
+
+	// Set to whether the file exists.
+	int exists;
+} content_file_request_struct;
 
 // ========================
 // = file_helpers functions
@@ -19,6 +47,10 @@
 // Returns 1 if it does, 0 otherwise.
 int check_if_file_exists(dstring_struct* base_dir, const char* filename);
 
+// Same as check_if_file_exists, but relative to the open directory dir_fd.
+// Returns 1 if it does, 0 otherwise.
+int check_if_file_exists_at(int dir_fd, dstring_struct* base_dir, const char* filename);
+
 // Checks to see if the item at the specified path is a directory.
 // Returns 1 if it is, 0 otherwise.
 int check_is_dir(const char* path);
@@ -34,6 +66,22 @@ int try_check_dir_exists(dstring_struct* base_dir, const char* dir, const char*
 // Returns 0 if there was an error, 1 otherwise.
 int make_directory(dstring_struct* base_dir, const char* dir);
 
+// Same as make_directory, but relative to the open directory dir_fd.
+// Returns 0 if there was an error, 1 otherwise.
+int make_directory_at(int dir_fd, dstring_struct* base_dir, const char* dir);
+
+// Opens the directory at path, for the *_at functions.
+// Returns -1 on error.
+int open_directory(const char* path);
+
+// Opens the directory dir in the open directory dir_fd (or in base_dir, if
+// dir_fd is -1), for the *_at functions.
+// Returns -1 on error.
+int open_directory_at(int dir_fd, dstring_struct* base_dir, const char* dir);
+
+// Closes the directory, if it's open, and sets (*dir_fd) to -1.
+void close_directory(int* dir_fd);
+
 // Returns 1 if the filename ends in ".html", 0 otherwise.
 int is_html_filename(const char* filename);
 
@@ -48,6 +96,11 @@ darray_struct* get_html_filenames_in_directory(const char* directory);
 // Returns 0 on error.
 int remove_file_in_directory(dstring_struct* base_dir, const char* file);
 
+// Same as remove_file_in_directory, but relative to the open directory
+// dir_fd.
+// Returns 0 on error.
+int remove_file_at(int dir_fd, dstring_struct* base_dir, const char* file);
+
 // Returns the start of the file extension, or 0 or the length of the string
 // if it wasn't found.
 size_t get_file_extension_start(const char*);
@@ -59,4 +112,34 @@ size_t get_file_extension_start(const char*);
 // Returns 0 on error.
 int apply_function_to_directory_entries(dstring_struct* directory, int include_dot_files, unsigned char dirent_types, int (*func)(dstring_struct*, struct dirent*, void*), void* context);
 
+// Same as apply_function_to_directory_entries, but reads the open
+// directory dir_fd; func is still given its path.
+// Returns 0 on error.
+int apply_function_to_directory_entries_at(int dir_fd, dstring_struct* directory, int include_dot_files, unsigned char dirent_types, int (*func)(dstring_struct*, struct dirent*, void*), void* context);
+
+// Makes the functions above look up paths in the content directory in the
+// bundle, instead of on disk; NULL goes back to using the disk. The bundle
+// must stay open while anything loaded from it is in use.
+void use_content_bundle(content_bundle_struct* bundle);
+
+// Returns the content bundle in use, or NULL if the disk is being used.
+content_bundle_struct* get_content_bundle();
+
+// Loads the file in base_dir into destination, like dstring_try_load_file,
+// but from the content bundle, if one is in use. If destination is empty,
+// it borrows the file's contents from the bundle rather than copying them.
+// Returns 0 on error.
+int load_content_file(dstring_struct* destination, dstring_struct* base_dir, const char* file, const char* filetype);
+
+// Same as load_content_file, but relative to the open directory dir_fd.
+// Returns 0 on error.
+int load_content_file_at(dstring_struct* destination, int dir_fd, dstring_struct* base_dir, const char* file, const char* filetype);
+
+// Loads (or checks for) each of the requested files in the open directory
+// dir_fd, like load_content_file_at and check_if_file_exists_at. If
+// io_ring is in use (and dir_fd isn't -1), the files are all read as a
+// single batch.
+// Returns 0 on error, including if a required file doesn't exist.
+int load_content_files(int dir_fd, dstring_struct* base_dir, content_file_request_struct* requests, size_t num_requests, const char* filetype);
+
 #endif
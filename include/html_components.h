@@ -1,6 +1,36 @@
 #ifndef HTML_COMPONENTS_STRUCT_INCLUDE
 #define HTML_COMPONENTS_STRUCT_INCLUDE
 #include "dobjects.h"
+#include "page_template.h"
+
+// The fields of the page templates, in the order that their values are
+// given to page_template_render.
+// The head template: the rest of each page's <head>, after the header.
+#define HEAD_TEMPLATE_AUTHOR 0
+#define HEAD_TEMPLATE_KEYWORDS 1
+#define HEAD_TEMPLATE_DESCRIPTION 2
+#define HEAD_TEMPLATE_TITLE 3
+#define HEAD_TEMPLATE_HOST 4
+#define HEAD_TEMPLATE_URL_PATH 5
+#define HEAD_TEMPLATE_NUM_FIELDS 6
+// The post template: the <article> in a post's page.
+#define POST_TEMPLATE_TITLE 0
+#define POST_TEMPLATE_PREVIOUS_READINGS 1
+#define POST_TEMPLATE_CONTENT 2
+#define POST_TEMPLATE_NEXT_READINGS 3
+#define POST_TEMPLATE_SERIES_NAME 4
+#define POST_TEMPLATE_SERIES_TITLE 5
+#define POST_TEMPLATE_AUTHOR 6
+#define POST_TEMPLATE_TAG_LINKS 7
+#define POST_TEMPLATE_WRITTEN_DATE 8
+#define POST_TEMPLATE_UPDATED_AT 9
+#define POST_TEMPLATE_NUM_FIELDS 10
+// The card templates: a post's entry on the tag pages, and on the series
+// pages and the sitemap.
+#define CARD_TEMPLATE_FOLDER_NAME 0
+#define CARD_TEMPLATE_TITLE 1
+#define CARD_TEMPLATE_LONG_DESCRIPTION 2
+#define CARD_TEMPLATE_NUM_FIELDS 3
 
 // html_components_struct holds the contents of the files defined in the
 // components/ directory of a site.
@@ -13,6 +43,21 @@ typedef struct html_components_struct {
 
 	// The HTML trailer (with closing </html> tag)
 	dstring_struct trailer;
+
+	// The sources of the page templates, from the optional
+	// head-template.html, post-template.html, tag-card-template.html and
+	// series-card-template.html files; empty if the file isn't there, in
+	// which case the built-in template is used.
+	dstring_struct head_template_source;
+	dstring_struct post_template_source;
+	dstring_struct tag_card_template_source;
+	dstring_struct series_card_template_source;
+
+	// The compiled page templates; see html_components_compile_templates.
+	page_template_struct head_template;
+	page_template_struct post_template;
+	page_template_struct tag_card_template;
+	page_template_struct series_card_template;
 } html_components_struct;
 
 // ==================================
@@ -30,4 +75,14 @@ void html_components_init(html_components_struct* html_components);
 // Returns NULL on error.
 html_components_struct* html_components_load(html_components_struct* html_components, dstring_struct* components_dir);
 
+// Minifies the header, footer and trailer (see minify.h).
+// Returns NULL on error.
+html_components_struct* html_components_minify(html_components_struct* html_components);
+
+// Compiles the page templates, from their sources or the built-in ones.
+// Must be called once the components are loaded (or restored from the site
+// snapshot), before any pages are created.
+// Returns NULL on error.
+html_components_struct* html_components_compile_templates(html_components_struct* html_components);
+
 #endif
@@ -14,20 +14,46 @@
 // disk writes, but also (and primarily) to allow the webserver to properly
 // cache pages that don't change (nginx uses 'date last modified' in its
 // caching behavior, and I imagine other webservers do as well).
+// Messages about pages that were created or updated are either printed
+// out immediately, or, if a log dstring is given, appended to the log;
+// the latter allows pages to be created from multiple threads, with the
+// messages printed out in order afterwards. Apart from the log, these
+// functions only read from site_content, so different pages can be
+// created at the same time.
+
+// If site_content has a build manifest, pages are skipped entirely when
+// the manifest shows that both versions were already generated from the
+// same inputs, and haven't been touched since. The inputs of a page are
+// hashed from exactly what goes into it: for a post, its own fields, the
+// titles of its recommended readings, and its series title; for a misc page
+// (including the tag and series pages), its filename, title, description
+// and content; and for every page, the HTML components and themes (see
+// calculate_page_layout_hash). So, for instance, changing a post's content
+// only regenerates that post, while changing its long description also
+// regenerates the tag and series pages that list it, since their content
+// changes.
 
 // ==============================
 // = html_page_creators functions
 // ==============================
 
+// Calculates site_content->page_layout_hash from the HTML components and
+// themes, which every page depends on. Must be called after the site is
+// loaded, and before any pages are created.
+void calculate_page_layout_hash(site_content_struct* site_content);
+
 // Creates a misc page. Note, the misc page can either be a 'static' one
 // (one that was defined in the folder/file structure of the site), or
 // a 'dynamic' one (one created by Spark, such as a tag page), it
 // does not matter, there is no distinction between the two.
+// log may be NULL.
 // Returns one of the PAGE_GENERATION_* values.
-int create_misc_page(site_content_struct* site_content, misc_page_struct* misc_page);
+int create_misc_page(site_content_struct* site_content, misc_page_struct* misc_page, dstring_struct* log);
 
-// Creates a post page.
+// Creates a post page, loading the post's content if the page needs to be
+// written; see post_release_content.
+// log may be NULL.
 // Returns one of the PAGE_GENERATION_* values.
-int create_post_page(site_content_struct* site_content, post_struct* post);
+int create_post_page(site_content_struct* site_content, post_struct* post, dstring_struct* log);
 
 #endif
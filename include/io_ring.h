@@ -0,0 +1,106 @@
+#ifndef IO_RING_INCLUDE
+#define IO_RING_INCLUDE
+#include "dobjects.h"
+
+// The number of submission queue entries in each ring.
+#define IO_RING_ENTRIES 256
+
+// io_ring submits batches of file operations (reads and stats) through
+// io_uring, so that a whole batch costs one system call instead of a few
+// per file, and the device gets the whole batch at once instead of one
+// request at a time. The ring is set up with the raw system calls; there's
+// no dependency on liburing.
+// It's only used once it's turned on with io_ring_use. Each thread gets its
+// own ring, the first time it calls io_ring_get; if io_uring isn't
+// available (an old kernel, or it's been disabled), io_ring_get returns
+// NULL, and callers should do their I/O the regular way.
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+typedef struct io_ring_struct {
+	int fd;
+
+	// The mappings of the submission and completion rings, and of the
+	// submission queue entries.
+	void* sq_ring;
+	size_t sq_ring_length;
+	void* cq_ring;
+	size_t cq_ring_length;
+	struct io_uring_sqe* sqes;
+	size_t sqes_length;
+
+	// Point into the rings.
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	struct io_uring_cqe* cqes;
+
+	// The submission queue tail, as far as it's been filled in.
+	unsigned sq_local_tail;
+	unsigned sq_entries;
+} io_ring_struct;
+
+// A file to be read by io_ring_read_files.
+typedef struct io_ring_read_struct {
+	// A relative filename is looked up in the directory open as dir_fd
+	// (which may be AT_FDCWD), as with openat.
+	int dir_fd;
+	const char* filename;
+
+	// Where to read the file to; at most buffer_size bytes are read, so
+	// if result is buffer_size, there may be more of the file.
+	char* buffer;
+	size_t buffer_size;
+
+	// Set to the number of bytes read, or to -errno if the file couldn't
+	// be opened or read.
+	ssize_t result;
+} io_ring_read_struct;
+
+// A file to be stat()'d by io_ring_stat_files.
+typedef struct io_ring_stat_struct {
+	// A relative filename is looked up in the directory open as dir_fd
+	// (which may be AT_FDCWD), as with fstatat.
+	int dir_fd;
+	const char* filename;
+
+	// Set to the size and modification time of the file, if result is 0.
+	off_t size;
+	struct timespec mtime;
+
+	// Set to 0, or to -errno if the file couldn't be stat()'d.
+	int result;
+} io_ring_stat_struct;
+
+// ==========================
+// = io_ring_struct functions
+// ==========================
+
+// Turns batching file operations through io_uring on or off. Turning it
+// off frees the calling thread's ring; other threads' rings are freed when
+// the threads exit.
+void io_ring_use(int enabled);
+
+// Returns the calling thread's ring, setting it up if need be; NULL if
+// io_ring isn't in use, or io_uring isn't available.
+io_ring_struct* io_ring_get();
+
+// Opens, reads and closes each of the files, as a batch.
+// Returns 0 if the ring itself failed, in which case the results can't be
+// used, and the ring has been freed (once nothing in the batch is still
+// using the buffers); a file that can't be read is not an error (see
+// result).
+int io_ring_read_files(io_ring_struct* ring, io_ring_read_struct* reads, size_t num_reads);
+
+// stat()'s each of the files, as a batch.
+// Returns 0 if the ring itself failed, in which case the results can't be
+// used, and the ring has been freed (once nothing in the batch is still
+// using the buffers); a file that can't be stat()'d is not an error (see
+// result).
+int io_ring_stat_files(io_ring_struct* ring, io_ring_stat_struct* stats, size_t num_stats);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef JOB_POOL_INCLUDE
+#define JOB_POOL_INCLUDE
+#include "dobjects.h"
+
+// job_pool runs a fixed number of independent jobs across a pool of
+// threads. Jobs are identified by their index (0 to num_jobs - 1), and
+// are handed out one at a time to whichever thread is free next, so that
+// a few slow jobs don't hold up the rest.
+// Jobs must not depend on each other, and must only write to memory
+// that belongs to their own index (eg a slot in a results array); any
+// merging of results should be done by the caller once job_pool_run
+// returns, so that the result doesn't depend on thread scheduling.
+
+// ====================
+// = job_pool functions
+// ====================
+
+// Calls job_func(index, context) for every index from 0 to num_jobs - 1,
+// using up to num_threads threads (including the calling thread). If
+// num_threads is 1 (or there's only 1 job), everything is run on the
+// calling thread, and no threads are created.
+// job_func should return 0 on error; once a job has failed, no new jobs
+// are started, though jobs that are already running will finish.
+// Returns 0 if any job failed, or if the threads couldn't be started.
+int job_pool_run(size_t num_jobs, int num_threads, int (*job_func)(size_t, void*), void* context);
+
+// Returns the number of processors that are online, or 1 if it can't be
+// determined.
+int job_pool_get_num_processors();
+
+#endif
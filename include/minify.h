@@ -0,0 +1,35 @@
+#ifndef MINIFY_INCLUDE
+#define MINIFY_INCLUDE
+#include "dobjects.h"
+
+// minify shrinks the CSS and HTML that's repeated on every page (the
+// themes' CSS and the HTML components), by taking out what the browser
+// ignores. It's meant to be run once, when those are loaded, so it doesn't
+// cost anything per page.
+// CSS loses its comments, and its whitespace is collapsed, and taken out
+// entirely next to { } ; , > and after :. Strings are left as they are.
+// HTML loses its comments (but not conditional comments), and each run of
+// whitespace is collapsed to a single character, or taken out entirely if
+// it's between two tags and one of them is a block-level or <head> tag.
+// The contents of <pre>, <code>, <textarea>, <script> and <style> elements
+// and quoted attribute values are left as they are.
+// The minified text is never longer than the original.
+
+// ==================
+// = minify functions
+// ==================
+
+// Sets dest (which must be empty) to a minified copy of the css.
+// Returns NULL on error.
+dstring_struct* minify_css(dstring_struct* dest, dstring_struct* css);
+
+// Sets dest (which must be empty) to a minified copy of the html.
+// Returns NULL on error.
+dstring_struct* minify_html(dstring_struct* dest, dstring_struct* html);
+
+// Replaces the dstring with a minified copy of itself, using minify_css or
+// minify_html.
+// Returns NULL on error.
+dstring_struct* minify_replace(dstring_struct* dstring, dstring_struct* (*minify)(dstring_struct*, dstring_struct*));
+
+#endif
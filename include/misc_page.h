@@ -11,6 +11,12 @@ typedef struct misc_page_struct {
 	// The page content.
 	dstring_struct content;
 
+	// More of the page content, which comes after content. Generated pages
+	// (eg the tag listings) are put together here instead, so that they can
+	// share pieces with other pages (eg the posts' listing cards) rather
+	// than copying them; it's empty for pages loaded from misc_pages/.
+	dstringbuilder_struct content_builder;
+
 	// The title of the page, as will be used in the <title> HTML tag.
 	dstring_struct title;
 
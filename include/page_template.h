@@ -0,0 +1,79 @@
+#ifndef PAGE_TEMPLATE_INCLUDE
+#define PAGE_TEMPLATE_INCLUDE
+#include "dobjects.h"
+
+// The kinds of ops in a compiled template.
+#define PAGE_TEMPLATE_LITERAL 0
+#define PAGE_TEMPLATE_FIELD 1
+#define PAGE_TEMPLATE_SECTION 2
+
+// Field values at least this long are appended to a dstringbuilder by
+// reference rather than copied (see page_template_render).
+#define PAGE_TEMPLATE_REFERENCE_LENGTH 256
+
+// A page template is a piece of HTML with slots for fields, like
+// <h1>{{title}}</h1>. {{?name}}...{{/name}} is a section, which is only
+// rendered if the field is set; sections can be nested.
+// Templates are compiled once, when they're loaded, into a flat list of ops
+// (the literal text between the slots, the fields, and the sections), so
+// rendering one is just a walk over the list, with no parsing.
+// The fields a template may use are fixed by the code that renders it,
+// which gives page_template_compile their names; values are given to
+// page_template_render as an array of dstring pointers in the same order,
+// where NULL means the field isn't set (it renders as nothing, and its
+// sections are skipped).
+
+typedef struct page_template_op_struct {
+	// One of the PAGE_TEMPLATE_* kinds.
+	int type;
+
+	// For literals, the offset of the text in the template's literals; for
+	// fields and sections, the index of the field.
+	size_t first;
+
+	// For literals, the length of the text; for sections, the index of the
+	// op right after the end of the section.
+	size_t second;
+} page_template_op_struct;
+
+typedef struct page_template_struct {
+	// The text of all of the literal ops, one after the other.
+	dstring_struct literals;
+
+	// A darray of page_template_op_struct's.
+	darray_struct ops;
+} page_template_struct;
+
+// ================================
+// = page_template_struct functions
+// ================================
+
+// Sets up an empty template, which renders as nothing.
+void page_template_init(page_template_struct* page_template);
+
+// Cleans up the resources used by the template; does not free the pointer
+// itself.
+void page_template_free(page_template_struct* page_template);
+
+// Compiles source into page_template (which must be empty), where the
+// fields are the num_fields names in field_names. name is only used in
+// error messages.
+// Returns NULL on error, including a slot with an unknown field, or a
+// section that isn't closed.
+page_template_struct* page_template_compile(page_template_struct* page_template, const char* name, const char* source, const char* const* field_names, size_t num_fields);
+
+// Appends what the template compiled to (its literal text and its ops) to
+// the dhash, so that a change to the template changes the hash.
+void page_template_hash(page_template_struct* page_template, dhash_struct* dhash);
+
+// Renders the template, with the given field values, to the end of the
+// dstringbuilder. Long values are appended by reference, so they must not
+// change or go away while the dstringbuilder is in use.
+// Returns NULL on error.
+dstringbuilder_struct* page_template_render(page_template_struct* page_template, dstring_struct** values, dstringbuilder_struct* dstringbuilder);
+
+// Renders the template, with the given field values, to the end of dest.
+// Returns NULL on error.
+dstring_struct* page_template_render_to_dstring(page_template_struct* page_template, dstring_struct** values, dstring_struct* dest);
+
+#endif
@@ -3,6 +3,11 @@
 #include "dobjects.h"
 #include "series.h"
 #include "file_helpers.h"
+#include "html_components.h"
+
+// A post folder may have all of its fields in this one file instead of a
+// file per field; see post_load.
+#define POST_SINGLE_FILE_NAME "post.html"
 
 // post_struct contains all of the information about a post. Some fields are
 // calculated after loading in all of the post files. Not all fields will have
@@ -17,9 +22,22 @@ typedef struct post_struct {
 	// The title of the post, as it will appear throughout the site.
 	dstring_struct title;
 
-	// The content.html file; the body of the post.
+	// The content.html file; the body of the post. It's by far the largest
+	// part of a post, so it isn't loaded along with the rest of it; see
+	// post_load_content and post_release_content.
 	dstring_struct content;
 
+	// The file the content is loaded from: content.html, or post.html, in
+	// which case the content is everything after the header.
+	dstring_struct content_filename;
+
+	// Identifies the version of the content file (a hash of its inode, size
+	// and modification time, as of when the post was loaded), so that pages
+	// can tell whether the content changed without loading it. 0 if the
+	// content was loaded along with the rest of the post (as it is from a
+	// content bundle, where it costs nothing), in which case it stays loaded.
+	uint64_t content_version;
+
 	// Who wrote the article.
 	dstring_struct author;
 
@@ -102,6 +120,14 @@ typedef struct post_struct {
 
 	// The series the post belongs in.
 	series_struct* series;
+
+	// The post's entries on the listing pages: tag_card on the tag pages,
+	// and series_card on the series pages and the sitemap. They're rendered
+	// once per run by post_build_cards, and shared by every listing page
+	// the post is on (see dstringbuilder_append_dstring), rather than being
+	// formatted again for each one.
+	dstring_struct tag_card;
+	dstring_struct series_card;
 } post_struct;
 
 // =======================
@@ -130,6 +156,12 @@ static inline post_struct* post_get_from_darray_of_post_pointers(darray_struct*
 
 // Loads a post in from the given post directory. The folder name is passed in
 // as well, to save from having to recalculate it.
+// The post's content isn't loaded; see post_load_content.
+// If the folder has a post.html file, the whole post is loaded from it
+// (with a single read); it starts with a header of field=value lines and
+// flag lines, named the same as the files of the folder layout (a repeated
+// field continues on another line), and the rest of the file, after a line
+// of ---, is the content. Otherwise, each field is loaded from its own file.
 // Sets (*generate_flag_missing) to 1 if the generate-post flag file is
 // missing, 0 otherwise.
 // Returns NULL on error, or if the generate-post flag file is missing; check
@@ -137,4 +169,20 @@ static inline post_struct* post_get_from_darray_of_post_pointers(darray_struct*
 // error if the flag file is missing.
 post_struct* post_load(post_struct* post, dstring_struct* post_dir, const char* folder_name, int* generate_flag_missing);
 
+// Loads the post's content, if it isn't loaded.
+// Returns NULL on error.
+post_struct* post_load_content(post_struct* post);
+
+// Frees the post's content, if it isn't needed anymore and can be loaded
+// again.
+void post_release_content(post_struct* post);
+
+// Renders the post's tag_card and series_card from the card templates in
+// html_components, replacing any that were rendered before.
+// Returns NULL on error.
+post_struct* post_build_cards(post_struct* post, html_components_struct* html_components);
+
+// Frees the post's tag_card and series_card.
+void post_release_cards(post_struct* post);
+
 #endif
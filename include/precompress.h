@@ -0,0 +1,43 @@
+#ifndef PRECOMPRESS_INCLUDE
+#define PRECOMPRESS_INCLUDE
+#include "dobjects.h"
+
+// The formats that pages can be precompressed in, as bit flags.
+#define PRECOMPRESS_GZIP 1
+#define PRECOMPRESS_BROTLI 2
+
+// precompress writes compressed copies of generated files next to them
+// (page.html.gz, and page.html.br if Spark is built with BROTLI=1), at the
+// highest compression levels, so that the webserver can send them as they
+// are (nginx's gzip_static and brotli_static) instead of compressing every
+// response.
+// Siblings are only written when their file has changed, or when they're
+// missing; siblings in formats that aren't in use are removed whenever their
+// file changes, so that a stale one is never left next to a newer file.
+
+// ========================
+// = precompress functions
+// ========================
+
+// Parses a comma-separated list of formats (gzip, br) into formats.
+// Returns 0 if a format isn't known, or isn't supported by this build.
+int precompress_parse_formats(const char* formats_list, int* formats);
+
+// Brings the precompressed siblings of filename (looked up relative to
+// dir_fd, as with openat) up to date with contents, the file's contents.
+// If changed is set, the file was just written, so every sibling in formats
+// is written, and the siblings in other formats are removed; otherwise,
+// only missing siblings in formats are written.
+// Returns 0 on error.
+int precompress_update_siblings_at(dstringbuilder_struct* contents, int dir_fd, const char* filename, int formats, int changed);
+
+// Removes all of the precompressed siblings of filename (looked up relative
+// to dir_fd), in any format; it is not an error for there to be none.
+// Returns 0 on error.
+int precompress_remove_siblings_at(int dir_fd, const char* filename);
+
+// Returns the length of the name of the file that filename is a
+// precompressed sibling of, or 0 if filename isn't a sibling.
+size_t precompress_get_original_length(const char* filename);
+
+#endif
@@ -36,6 +36,45 @@ typedef struct configuration_struct {
 	// The description to put in the RSS file.
 	char* rss_description;
 
+	// Which precompressed siblings to write next to each generated page and
+	// the RSS feed, as PRECOMPRESS_* flags (see precompress.h). Read from
+	// the optional PRECOMPRESS setting, a comma-separated list of formats
+	// (gzip, br); none by default.
+	int precompress_formats;
+
+	// Whether to minify the themes' CSS and the HTML components (see
+	// minify.h), which are on every page. Read from the optional MINIFY
+	// setting (1 or 0); off by default.
+	int minify;
+
+	// Whether each page only gets the theme CSS rules that can match it
+	// (see css_pruner.h), rather than all of it. Read from the optional
+	// PRUNE_CSS setting (1 or 0); off by default.
+	int prune_css;
+
+	// Whether the themes' CSS is written to stylesheet files of its own
+	// that the pages link to (see theme_write_stylesheets), rather than put
+	// into every page. Read from the optional STYLESHEETS setting (inline or
+	// external); inline by default.
+	int external_stylesheets;
+
+	// Whether the bright and dark themes are combined into a single site,
+	// which follows the visitor's prefers-color-scheme and has a button to
+	// switch between them (see theme_build_page_segments), rather than being
+	// generated as two sites. Read from the optional THEMES setting
+	// (separate or combined); separate by default.
+	int combined_themes;
+
+	// How many threads to use when loading and generating the site.
+	// This is not read from the config file; it defaults to 1, and is
+	// set from the --jobs command line parameter.
+	int num_jobs;
+
+	// Whether to generate the site in bounded memory: pages are built and
+	// created a batch at a time, instead of all at once. Not read from the
+	// config file either; it's set by the --streaming command line parameter.
+	int streaming;
+
 	// The loaded configuration file; by default, all configuration strings
 	// will point to strings in this dstring (the dstring itself will
 	// be modified, and shouldn't be used directly).
@@ -6,6 +6,8 @@
 #include "html_components.h"
 #include "theme.h"
 #include "tag_posts.h"
+#include "build_manifest.h"
+#include "site_snapshot.h"
 
 // site_content_struct holds all of the content for a site. See the
 // README file for details about the folder and file structures
@@ -41,6 +43,45 @@ typedef struct site_content_struct {
 	// Contains a mapping of tags to posts. It is a darray that holds
 	// tag_posts_struct's (not tag_posts_struct*'s).
 	darray_struct tags;
+
+	// Hash indexes for looking up entries in the above darrays by name
+	// (misc pages by filename, series and posts by folder name, and tags
+	// by tag). They map to positions in their darray, and are kept up
+	// to date by the site_content_add_* functions; if a darray is
+	// modified or reordered directly, site_content_rebuild_indexes()
+	// must be called.
+	dhashindex_struct misc_pages_index;
+	dhashindex_struct series_index;
+	dhashindex_struct posts_index;
+	dhashindex_struct tags_index;
+
+	// The manifest of previously generated files, used to avoid reading
+	// back unchanged pages. Not owned by the site_content; may be NULL, in
+	// which case pages are always compared in full.
+	build_manifest_struct* build_manifest;
+
+	// A hash of the parts of the site that every page depends on (the HTML
+	// components and themes); see calculate_page_layout_hash.
+	uint64_t page_layout_hash;
+
+	// Which precompressed siblings to write next to each page (see
+	// precompress.h); copied from the configuration before generating.
+	int precompress_formats;
+
+	// How many of the themes pages are generated for: both, or just the
+	// bright theme, when the themes are combined into one site (its pages
+	// have the dark theme's styles too); copied from the configuration
+	// before generating.
+	size_t num_themes;
+
+	// The snapshot that load_site_content restores unchanged folders from,
+	// and saves what it loaded to (see site_snapshot.h). Restored strings
+	// borrow from it.
+	site_snapshot_struct snapshot;
+
+	// Holds everything that load_site_content loads in, so that it can be
+	// freed all at once by site_content_free.
+	darena_struct arena;
 } site_content_struct;
 
 // ===============================
@@ -56,6 +97,24 @@ void site_content_free(site_content_struct* site_content);
 // Initializes the darrays and other properties of the site.
 void site_content_init(site_content_struct* site_content);
 
+// Appends a copy of the misc page to the site, and indexes it.
+// Returns NULL on error, otherwise a pointer to the site's copy.
+misc_page_struct* site_content_add_misc_page(site_content_struct* site_content, misc_page_struct* misc_page);
+
+// Appends a copy of the series to the site, and indexes it.
+// Returns NULL on error, otherwise a pointer to the site's copy.
+series_struct* site_content_add_series(site_content_struct* site_content, series_struct* series);
+
+// Appends a copy of the post to the site, and indexes it.
+// Returns NULL on error, otherwise a pointer to the site's copy.
+post_struct* site_content_add_post(site_content_struct* site_content, post_struct* post);
+
+// Rebuilds all of the lookup indexes from scratch. Must be called after
+// the misc_pages, series, posts, or tags darrays are reordered (eg sorted)
+// or otherwise modified directly.
+// Returns 0 on error.
+int site_content_rebuild_indexes(site_content_struct* site_content);
+
 // Tries to find a tag_posts_struct for the given tag.
 // Returns NULL if no such tag_posts_struct exists in the site.
 tag_posts_struct* find_tag_posts_by_tag(site_content_struct* site_content, const char* tag);
@@ -73,6 +132,11 @@ series_struct* find_series_by_folder_name(site_content_struct* site_content, con
 // Returns NULL if no such misc page exists in the site.
 misc_page_struct* find_misc_page_by_filename(site_content_struct* site_content, const char* filename);
 
+// Returns the earliest publish-after time, later than
+// site_content->current_time, of the posts that are waiting to be
+// published, or 0 if there aren't any.
+time_t site_content_get_next_publish_time(site_content_struct* site_content);
+
 // Sets up the list of tags for the site. Must be called after all posts have
 // been loaded.
 // Returns 0 on error.
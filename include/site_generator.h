@@ -21,21 +21,26 @@
 // -----------------------------------------------------------
 
 // Generates a page for each tag, as well as the tag listing page.
+// The tag pages are created using up to configuration->num_jobs threads;
+// the listing page is created after all of them.
 // Returns 0 on error.
-int generate_tags(site_content_struct* site_content);
+int generate_tags(configuration_struct* configuration, site_content_struct* site_content);
 
 // Generates all misc_pages on the site, including the index page (home page).
 // Returns 0 on error.
 int generate_misc_pages(site_content_struct* site_content);
 
-// Generates all posts on the site.
+// Generates all posts on the site, using up to configuration->num_jobs
+// threads.
 // Returns 0 on error.
-int generate_posts(site_content_struct* site_content);
+int generate_posts(configuration_struct* configuration, site_content_struct* site_content);
 
 // Generates each series landing page, as well as the page which lists
-// all series.
+// all series. The landing pages are created using up to
+// configuration->num_jobs threads; the listing page is created after all
+// of them.
 // Returns 0 on error.
-int generate_series(site_content_struct* site_content);
+int generate_series(configuration_struct* configuration, site_content_struct* site_content);
 
 // Generates an HTML page with links to every (publishable) post.
 // Note, this function may be deprecated or changed significantly
@@ -47,6 +52,27 @@ int generate_sitemap(site_content_struct* site_content);
 // Returns 0 on error.
 int generate_main_rss(configuration_struct* configuration, site_content_struct* site_content);
 
+// Generates every page of an already-loaded site. If
+// site_content->build_manifest is set, pages that are already up to date
+// are skipped.
+// Returns 0 on error.
+int generate_loaded_site(configuration_struct* configuration, site_content_struct* site_content);
+
+// Initializes build_manifest, and loads the site's saved manifest (from the
+// /generating/ folder) into it; manifest_filename is set to where it's
+// saved, so that it can be saved again afterwards with build_manifest_save.
+// Returns 0 on error.
+int load_site_build_manifest(configuration_struct* configuration, build_manifest_struct* build_manifest, dstring_struct* manifest_filename);
+
+// Takes the generation lock (the /generating/gen.lock file), so that only
+// one Spark process generates the site at a time. lock_filename is set to
+// the lock file's name, for release_generation_lock.
+// Returns 0 if the lock couldn't be taken.
+int acquire_generation_lock(configuration_struct* configuration, dstring_struct* lock_filename);
+
+// Releases the lock taken by acquire_generation_lock.
+void release_generation_lock(dstring_struct* lock_filename);
+
 // --------------------------------------------------
 // - Entry functions; these generate the entire site.
 // --------------------------------------------------
@@ -6,6 +6,26 @@
 // site_loader contains functions for loading a site's files into memory.
 // Files are loaded based off of the CONTENT_BASE_DIR configuration variable.
 
+// site_changes_struct describes which parts of a site's content directory
+// have changed since it was loaded, so that only those parts need to be
+// reloaded; see reload_site_content.
+typedef struct site_changes_struct {
+	// Whether the themes, components, misc pages, or series changed. These
+	// are small, so they're reloaded as a whole.
+	int themes;
+	int html_components;
+	int misc_pages;
+	int series;
+
+	// Set if every post needs to be reloaded (eg if it's not known which
+	// posts changed).
+	int all_posts;
+
+	// The folder names of the posts that were changed, added, or removed;
+	// a darray of dstring_struct's.
+	darray_struct post_folder_names;
+} site_changes_struct;
+
 // =======================
 // = site_loader functions
 // =======================
@@ -33,14 +53,21 @@ int load_series(configuration_struct* configuration, site_content_struct* site_c
 int load_misc_pages(configuration_struct* configuration, site_content_struct* site_content);
 
 // Calculates all post dates and determines which posts can be published.
-// It does this by spawning a `date` process.
+// Dates are parsed with date_parser; see date_parser.h for supported formats.
 // Returns 0 on error.
 int load_post_dates(configuration_struct* configuration, site_content_struct* site_content);
 
-// Loads all posts in that have the generate-post flag file present.
+// Loads all posts in that have the generate-post flag file present,
+// and links them (see link_posts).
+// Posts are loaded using up to configuration->num_jobs threads.
 // Returns 0 on error.
 int load_posts(configuration_struct* configuration, site_content_struct* site_content);
 
+// Works out the post dates and which posts can be published, sorts the
+// posts, and links them to their series and suggested readings.
+// Returns 0 on error.
+int link_posts(configuration_struct* configuration, site_content_struct* site_content);
+
 // -------------------
 // - load_site_content
 // -------------------
@@ -50,4 +77,30 @@ int load_posts(configuration_struct* configuration, site_content_struct* site_co
 // Returns 0 on error.
 int load_site_content(configuration_struct* configuration, site_content_struct* site_content);
 
+// --------------------------------------
+// - Reloading parts of an existing site
+// --------------------------------------
+
+// Sets up a site_changes_struct with nothing marked as changed.
+void site_changes_init(site_changes_struct* changes);
+
+// Cleans up the changes, and resets them to nothing marked as changed.
+void site_changes_free(site_changes_struct* changes);
+
+// Marks everything in the site as changed.
+void site_changes_set_all(site_changes_struct* changes);
+
+// Marks the post in folder_name as changed (or added, or removed).
+// Returns NULL on error.
+site_changes_struct* site_changes_add_post(site_changes_struct* changes, const char* folder_name);
+
+// Reloads the parts of an already-loaded site that are marked as changed,
+// and then re-links everything, including re-checking which posts can be
+// published as of now (so this can be called with nothing marked as
+// changed to publish posts whose publish-after time has passed).
+// If this fails, site_content may be left partly loaded, and should be
+// freed and loaded again from scratch.
+// Returns 0 on error.
+int reload_site_content(configuration_struct* configuration, site_content_struct* site_content, site_changes_struct* changes);
+
 #endif
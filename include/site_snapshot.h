@@ -0,0 +1,183 @@
+#ifndef SITE_SNAPSHOT_INCLUDE
+#define SITE_SNAPSHOT_INCLUDE
+#include <pthread.h>
+#include "dobjects.h"
+
+#define SITE_SNAPSHOT_FILENAME "site-snapshot"
+#define SITE_SNAPSHOT_MAGIC "SPKSNAP3"
+
+// The kinds of things that a snapshot unit can hold.
+#define SITE_SNAPSHOT_THEME 1
+#define SITE_SNAPSHOT_HTML_COMPONENTS 2
+#define SITE_SNAPSHOT_MISC_PAGE 3
+#define SITE_SNAPSHOT_SERIES 4
+#define SITE_SNAPSHOT_POST 5
+// A post folder that isn't loaded, because it has no generate-post flag.
+#define SITE_SNAPSHOT_SKIPPED_POST 6
+
+// What site_snapshot_restore did.
+#define SITE_SNAPSHOT_NOT_RESTORED 0
+#define SITE_SNAPSHOT_RESTORED 1
+// Only for SITE_SNAPSHOT_POST; the folder holds a post that's skipped.
+#define SITE_SNAPSHOT_RESTORED_SKIPPED 2
+
+// The site snapshot is a copy of everything that was loaded from the
+// content directory (one unit per theme, components, misc page, series, and
+// post folder), saved in the /generating/ folder, so that the next run can
+// skip reading the folders that haven't changed.
+// Each unit records the stat of its folder, and of every file in it, as of
+// just before the folder was loaded; if they are all the same, the folder
+// hasn't changed since (adding, removing, or renaming a file changes the
+// folder's modification time, and writing a file changes its own), so the
+// unit can be restored instead of loading the folder.
+// The file is laid out as a site_snapshot_header_struct followed by the
+// units, each of which is a block that starts with a
+// site_snapshot_unit_struct. Offsets in a block are from the start of the
+// block, so that unchanged blocks can be copied from one snapshot to the
+// next as they are. Strings are followed by a '\0', so that restored
+// strings can borrow from the mapping (see dstring_borrow); the mapping is
+// private and writable, like a content bundle's.
+// Numbers are stored in the byte order of the machine that saved the
+// snapshot.
+
+typedef struct site_snapshot_header_struct {
+	char magic[8];
+	uint64_t num_units;
+
+	// The size of the whole snapshot file, to catch truncated snapshots.
+	uint64_t total_length;
+} site_snapshot_header_struct;
+
+// The parts of a stat() result that show whether a file has changed.
+typedef struct site_snapshot_stat_struct {
+	uint64_t inode;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+} site_snapshot_stat_struct;
+
+typedef struct site_snapshot_file_struct {
+	// The name of the file, within its folder.
+	uint64_t name_offset;
+	site_snapshot_stat_struct stat;
+} site_snapshot_file_struct;
+
+// A loaded field. For strings, first is the offset of the string and
+// second its length; for numbers, first is the number; for lists of
+// strings, first is the offset of an array of offsets into the string the
+// list points into, and second is the number of strings.
+typedef struct site_snapshot_value_struct {
+	uint64_t first;
+	uint64_t second;
+} site_snapshot_value_struct;
+
+typedef struct site_snapshot_unit_struct {
+	// The length of the whole block, a multiple of 8.
+	uint64_t length;
+
+	// One of the SITE_SNAPSHOT_* kinds.
+	uint64_t kind;
+
+	// The path of the folder that was loaded.
+	uint64_t path_offset;
+	site_snapshot_stat_struct dir_stat;
+
+	// An array of site_snapshot_file_struct's, one per file in the folder.
+	uint64_t files_offset;
+	uint64_t num_files;
+
+	// An array of site_snapshot_value_struct's, one per field of the kind.
+	uint64_t values_offset;
+	uint64_t num_values;
+} site_snapshot_unit_struct;
+
+// The stat of a folder and of the files in it, taken before loading it,
+// for the unit that's saved for it.
+typedef struct site_snapshot_fingerprint_struct {
+	dstring_struct path;
+	site_snapshot_stat_struct dir_stat;
+
+	// A darray of site_snapshot_fingerprint_file_struct's.
+	darray_struct files;
+} site_snapshot_fingerprint_struct;
+
+typedef struct site_snapshot_fingerprint_file_struct {
+	dstring_struct name;
+	site_snapshot_stat_struct stat;
+} site_snapshot_fingerprint_file_struct;
+
+typedef struct site_snapshot_struct {
+	// Whether the snapshot is in use; if not, nothing is restored, recorded
+	// or saved.
+	int enabled;
+
+	// Where the snapshot is saved.
+	dstring_struct filename;
+
+	// The snapshot from the last run, mapped in; NULL if there wasn't one.
+	char* mapping;
+	size_t mapping_length;
+	size_t num_units;
+
+	// Maps folder paths to the offsets of their units in the mapping.
+	dhashindex_struct index;
+
+	// The unit blocks for everything loaded during this run, to be saved;
+	// a darray of dstring_struct's (borrowed from the mapping for the units
+	// that were restored).
+	darray_struct records;
+
+	// Whether any folder was loaded rather than restored.
+	int changed;
+
+	// Guards records and changed, as posts are loaded from multiple threads.
+	pthread_mutex_t lock;
+} site_snapshot_struct;
+
+// ================================
+// = site_snapshot_struct functions
+// ================================
+
+// Sets up a snapshot that isn't in use.
+void site_snapshot_init(site_snapshot_struct* snapshot);
+
+// Cleans up the resources used by the snapshot. Nothing restored from it
+// may be used afterward.
+void site_snapshot_free(site_snapshot_struct* snapshot);
+
+// Starts using the snapshot saved in filename, mapping it in if it exists.
+// It is not an error for the file to not exist; if it can't be understood,
+// a warning is printed and nothing is restored from it.
+// Returns NULL on error.
+site_snapshot_struct* site_snapshot_open(site_snapshot_struct* snapshot, const char* filename);
+
+// Sets up an empty fingerprint.
+void site_snapshot_fingerprint_init(site_snapshot_fingerprint_struct* fingerprint);
+
+// Cleans up the resources used by the fingerprint.
+void site_snapshot_fingerprint_free(site_snapshot_fingerprint_struct* fingerprint);
+
+// If the folder at dir hasn't changed since the snapshot was saved,
+// restores object (which must be freshly initialized, and of the given
+// kind) from it, and records its unit to be saved again. Otherwise, takes
+// the folder's fingerprint, to be passed to site_snapshot_record once the
+// folder has been loaded.
+// Sets (*result) to one of the SITE_SNAPSHOT_*RESTORED* values.
+// May be called from multiple threads at once.
+// Returns 0 on error.
+int site_snapshot_restore(site_snapshot_struct* snapshot, dstring_struct* dir, int kind, void* object, site_snapshot_fingerprint_struct* fingerprint, int* result);
+
+// Records object (which may be NULL for SITE_SNAPSHOT_SKIPPED_POST), loaded
+// from the folder the fingerprint was taken of, to be saved.
+// May be called from multiple threads at once.
+// Returns 0 on error.
+int site_snapshot_record(site_snapshot_struct* snapshot, site_snapshot_fingerprint_struct* fingerprint, int kind, void* object);
+
+// Saves everything recorded to the snapshot file, if anything is different
+// from the snapshot that was opened, and then stops using the snapshot;
+// nothing more is restored or recorded, but what was restored from it can
+// still be used, until site_snapshot_free.
+// Returns 0 on error.
+int site_snapshot_save(site_snapshot_struct* snapshot);
+
+#endif
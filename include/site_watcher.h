@@ -0,0 +1,37 @@
+#ifndef SITE_WATCHER_INCLUDE
+#define SITE_WATCHER_INCLUDE
+#include "dobjects.h"
+#include "site_configuration.h"
+
+// How long to wait after the last change before rebuilding, so that a
+// burst of changes (eg saving several files, or a git checkout) only causes
+// one rebuild.
+#define SITE_WATCHER_DEBOUNCE_MS 250
+
+// The longest to go without checking the time, in case the system clock
+// is changed while waiting for a post's publish-after time.
+#define SITE_WATCHER_MAX_SLEEP_MS (60 * 60 * 1000)
+
+// site_watcher keeps a site loaded in memory, and regenerates it whenever
+// its content directory changes. It uses inotify to watch the posts/,
+// series/, misc_pages/, components/ and themes/ folders (and each post,
+// series and misc page folder), and only reloads the parts of the site that
+// changed; with the build manifest kept in memory between rebuilds, only
+// the pages that are affected are regenerated.
+// It also wakes up at the next publish-after time of any post that is
+// waiting to be published, so that scheduled posts go live on time.
+// The generation lock is held the whole time the site is being watched.
+
+// ========================
+// = site_watcher functions
+// ========================
+
+// Generates the site, and then keeps regenerating it as it changes, until
+// SIGINT or SIGTERM is received. If a rebuild fails (eg because a post is
+// only partly written), the errors are printed out and the site is
+// reloaded in full on the next change.
+// Returns 0 if the site couldn't be generated to begin with, or if
+// watching failed.
+int watch_site(configuration_struct* configuration);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef THEME_STRUCT_INCLUDE
 #define THEME_STRUCT_INCLUDE
 #include "dobjects.h"
+#include "css_pruner.h"
 
 
 // theme_struct stores the CSS files for the theme, as well as configuration
@@ -14,6 +15,23 @@ typedef struct theme_struct {
 	// marked as having code.
 	dstring_struct syntax_highlighting_css;
 
+	// Whether the CSS is linked to as stylesheet files of its own (see
+	// theme_write_stylesheets), rather than put into every page; set before
+	// theme_build_page_segments.
+	int external_stylesheets;
+
+	// When the themes are combined into one site (see
+	// theme_build_page_segments), the color scheme that this theme's styles
+	// are for, "light" or "dark"; NULL otherwise. Set before
+	// theme_build_page_segments.
+	const char* color_scheme;
+
+	// The names of the main and syntax highlighting stylesheet files, in
+	// html_base_dir, when the stylesheets are external. They're named after
+	// a hash of their contents, so that they can be cached for good.
+	dstring_struct main_css_filename;
+	dstring_struct code_css_filename;
+
 	// The hostname to use for all pages generated for this theme.
 	dstring_struct host;
 
@@ -26,9 +44,35 @@ typedef struct theme_struct {
 	// The HTML output directory for all of the pages for this theme.
 	dstring_struct html_base_dir;
 
+	// The HTML output directory, held open while the site is generated, so
+	// that pages are looked up and written relative to it; -1 when it isn't
+	// open. See theme_open_html_base_dir.
+	int html_base_dir_fd;
+
 	// A pointer to the alternate theme, so that links can be generated to
 	// the alternate-theme pages.
 	theme_struct* alt_theme;
+
+	// The themed parts of every page, built once by theme_build_page_segments
+	// so that they don't have to be re-created for each page.
+	// A page is made up of the (theme-independent) head, then page_prelude
+	// (or code_page_prelude, for posts with code), then the page's URL path
+	// (for the link to the alt-themed version of the page), then
+	// page_postlude, then the (theme-independent) body.
+	// The preludes contain the styles (or the links to the stylesheets) and
+	// the start of the page header; page_header is the same, without the
+	// styles. style_start is the tag that the theme's inline styles start
+	// with.
+	dstring_struct page_prelude;
+	dstring_struct code_page_prelude;
+	dstring_struct page_header;
+	dstring_struct page_postlude;
+	dstring_struct style_start;
+
+	// Cuts the CSS down to what each page can use, when the CSS is pruned
+	// (see theme_build_css_pruner); NULL otherwise, in which case each page
+	// gets all of it.
+	css_pruner_struct* css_pruner;
 } theme_struct;
 
 // ========================
@@ -46,4 +90,46 @@ void theme_init(theme_struct* theme);
 // Returns NULL on error.
 theme_struct* theme_load(theme_struct* theme, dstring_struct* theme_dir);
 
+// Minifies the theme's CSS (see minify.h). Must be called before
+// theme_build_page_segments.
+// Returns NULL on error.
+theme_struct* theme_minify(theme_struct* theme);
+
+// Builds the page_prelude, code_page_prelude, page_header, page_postlude
+// and style_start of the theme.
+// If the theme has a color_scheme, the pages are for both it and its
+// alt_theme: the preludes have both themes' styles, each only applying
+// under its prefers-color-scheme media query, and a script, and the link to
+// the alt-themed page is replaced by a button that switches between them.
+// Must be called after the CSS has been loaded and the host, name and
+// alt_theme have been set for both this theme and its alt_theme.
+// Returns NULL on error.
+theme_struct* theme_build_page_segments(theme_struct* theme);
+
+// Writes the theme's stylesheet files into its (open) html_base_dir, if
+// they're external and have changed, along with their precompressed
+// siblings in precompress_formats (see precompress.h). If the theme has a
+// color_scheme, its alt_theme's stylesheets are written there too.
+// Returns NULL on error.
+theme_struct* theme_write_stylesheets(theme_struct* theme, int precompress_formats);
+
+// Removes the stylesheet files (and their precompressed siblings) in the
+// theme's (open) html_base_dir that its pages no longer link to: those of
+// earlier versions of the CSS, or all of them once the CSS is inline again.
+// Should be called once the pages have been generated.
+// Returns NULL on error.
+theme_struct* theme_remove_old_stylesheets(theme_struct* theme);
+
+// Sets up the theme's css_pruner, so that pages only get the CSS rules that
+// can match them. Must be called after theme_build_page_segments.
+// Returns NULL on error.
+theme_struct* theme_build_css_pruner(theme_struct* theme);
+
+// Opens the theme's HTML output directory, as html_base_dir_fd.
+// Returns NULL on error.
+theme_struct* theme_open_html_base_dir(theme_struct* theme);
+
+// Closes html_base_dir_fd, if it's open.
+void theme_close_html_base_dir(theme_struct* theme);
+
 #endif
@@ -0,0 +1,325 @@
+#include "dobjects.h"
+#include <inttypes.h>
+#include "build_manifest.h"
+#include "io_ring.h"
+
+#define BUILD_MANIFEST_HEADER "spark-build-manifest 2\n"
+
+build_manifest_struct* build_manifest_init(build_manifest_struct* build_manifest) {
+	darray_lazy_init(&build_manifest->entries, sizeof(build_manifest_entry_struct));
+	dhashindex_lazy_init(&build_manifest->index);
+	if(pthread_mutex_init(&build_manifest->lock, NULL)) {
+		fprintf(stderr, "Error initializing build manifest, couldn't create mutex\n");
+		return NULL;
+	}
+	return build_manifest;
+}
+// Removes all entries, leaving the manifest empty but usable.
+void build_manifest_clear(build_manifest_struct* build_manifest) {
+	for(size_t i = 0; i < build_manifest->entries.length; i++) {
+		build_manifest_entry_struct* entry = (build_manifest_entry_struct*) darray_get_elem(&build_manifest->entries, i);
+		dstring_free(&entry->filename);
+	}
+	build_manifest->entries.length = 0;
+	dhashindex_clear(&build_manifest->index);
+}
+void build_manifest_free(build_manifest_struct* build_manifest) {
+	build_manifest_clear(build_manifest);
+	darray_free(&build_manifest->entries);
+	dhashindex_free(&build_manifest->index);
+	pthread_mutex_destroy(&build_manifest->lock);
+}
+// Adds or updates the entry for filename, and marks it as seen.
+// Must be called with the lock held.
+// Returns NULL on error.
+build_manifest_struct* build_manifest_record(build_manifest_struct* build_manifest, const char* filename, uint64_t hash, uint64_t input_hash, off_t size, struct timespec* mtime) {
+	size_t position;
+	build_manifest_entry_struct* entry;
+	if(dhashindex_find(&build_manifest->index, filename, &position)) {
+		entry = (build_manifest_entry_struct*) darray_get_elem(&build_manifest->entries, position);
+	} else {
+		build_manifest_entry_struct new_entry;
+		new_entry.prefetched = 0;
+		dstring_lazy_init(&new_entry.filename);
+		if(!dstring_append(&new_entry.filename, filename)) {
+			fprintf(stderr, "Error recording %s in build manifest, dstring append error\n", filename);
+			return NULL;
+		}
+		if(!darray_append(&build_manifest->entries, &new_entry)) {
+			fprintf(stderr, "Error recording %s in build manifest, darray append error\n", filename);
+			dstring_free(&new_entry.filename);
+			return NULL;
+		}
+		position = build_manifest->entries.length - 1;
+		entry = (build_manifest_entry_struct*) darray_get_elem(&build_manifest->entries, position);
+		// The key points to the dstring's contents, which don't move when
+		// the darray is resized.
+		if(!dhashindex_insert(&build_manifest->index, entry->filename.str, position)) {
+			fprintf(stderr, "Error recording %s in build manifest, dhashindex insert error\n", filename);
+			dstring_free(&entry->filename);
+			build_manifest->entries.length--;
+			return NULL;
+		}
+	}
+	entry->hash = hash;
+	entry->input_hash = input_hash;
+	entry->size = size;
+	entry->mtime = (*mtime);
+	entry->seen = 1;
+	return build_manifest;
+}
+build_manifest_struct* build_manifest_load(build_manifest_struct* build_manifest, const char* filename) {
+	if(access(filename, F_OK)) {
+		return build_manifest;
+	}
+	dstring_struct contents;
+	dstring_lazy_init(&contents);
+	if(!dstring_read_file(&contents, filename)) {
+		fprintf(stderr, "Error loading build manifest %s, couldn't read file\n", filename);
+		return NULL;
+	}
+	if(strncmp(contents.str, BUILD_MANIFEST_HEADER, strlen(BUILD_MANIFEST_HEADER))) {
+		fprintf(stderr, "Warning, build manifest %s is not in a known format, ignoring it\n", filename);
+		dstring_free(&contents);
+		return build_manifest;
+	}
+	// Each line is: hash input_hash size mtime_seconds mtime_nanoseconds filename
+	char* line = contents.str + strlen(BUILD_MANIFEST_HEADER);
+	while(*line) {
+		char* line_end = strchr(line, '\n');
+		if(line_end == NULL) {
+			fprintf(stderr, "Warning, build manifest %s is truncated, ignoring it\n", filename);
+			build_manifest_clear(build_manifest);
+			break;
+		}
+		(*line_end) = '\0';
+		uint64_t hash;
+		uint64_t input_hash;
+		long long size;
+		long long mtime_sec;
+		long mtime_nsec;
+		int filename_start = 0;
+		if(sscanf(line, "%" SCNx64 " %" SCNx64 " %lld %lld %ld %n", &hash, &input_hash, &size, &mtime_sec, &mtime_nsec, &filename_start) != 5
+			|| filename_start == 0
+			|| line[filename_start] == '\0') {
+			fprintf(stderr, "Warning, build manifest %s has an invalid line, ignoring it\n", filename);
+			build_manifest_clear(build_manifest);
+			break;
+		}
+		struct timespec mtime;
+		mtime.tv_sec = (time_t) mtime_sec;
+		mtime.tv_nsec = mtime_nsec;
+		if(!build_manifest_record(build_manifest, line + filename_start, hash, input_hash, (off_t) size, &mtime)) {
+			fprintf(stderr, "Error loading build manifest %s\n", filename);
+			dstring_free(&contents);
+			return NULL;
+		}
+		line = line_end + 1;
+	}
+	dstring_free(&contents);
+	// Nothing has been seen during this run yet.
+	for(size_t i = 0; i < build_manifest->entries.length; i++) {
+		((build_manifest_entry_struct*) darray_get_elem(&build_manifest->entries, i))->seen = 0;
+	}
+	return build_manifest;
+}
+int build_manifest_save(build_manifest_struct* build_manifest, const char* filename) {
+	dstring_struct temp_filename;
+	dstring_lazy_init(&temp_filename);
+	if(!dstring_append_printf(&temp_filename, "%s.tmp", filename)) {
+		fprintf(stderr, "Error saving build manifest, dstring append error\n");
+		return 0;
+	}
+	// Written to a temporary file first, so that the manifest is never
+	// left half-written.
+	FILE* fd = fopen(temp_filename.str, "w");
+	if(!fd) {
+		fprintf(stderr, "Error saving build manifest, unable to open file %s\n", temp_filename.str);
+		dstring_free(&temp_filename);
+		return 0;
+	}
+	fputs(BUILD_MANIFEST_HEADER, fd);
+	pthread_mutex_lock(&build_manifest->lock);
+	for(size_t i = 0; i < build_manifest->entries.length; i++) {
+		build_manifest_entry_struct* entry = (build_manifest_entry_struct*) darray_get_elem(&build_manifest->entries, i);
+		if(!entry->seen) continue;
+		fprintf(fd, "%016" PRIx64 " %016" PRIx64 " %lld %lld %ld %s\n",
+				entry->hash,
+				entry->input_hash,
+				(long long) entry->size,
+				(long long) entry->mtime.tv_sec,
+				(long) entry->mtime.tv_nsec,
+				entry->filename.str);
+	}
+	pthread_mutex_unlock(&build_manifest->lock);
+	int write_error = ferror(fd);
+	if(fclose(fd) || write_error) {
+		fprintf(stderr, "Error saving build manifest, couldn't write file %s\n", temp_filename.str);
+		unlink(temp_filename.str);
+		dstring_free(&temp_filename);
+		return 0;
+	}
+	if(rename(temp_filename.str, filename)) {
+		fprintf(stderr, "Error saving build manifest, couldn't rename %s to %s\n", temp_filename.str, filename);
+		unlink(temp_filename.str);
+		dstring_free(&temp_filename);
+		return 0;
+	}
+	dstring_free(&temp_filename);
+	return 1;
+}
+// Returns filename relative to the directory whose path is the first
+// dir_length characters of it; see build_manifest_struct.
+const char* build_manifest_get_relative_filename(size_t dir_length, const char* filename) {
+	return filename + dir_length + 1;
+}
+// Returns the entry for filename, if it exists and matches the size and
+// modification time in file_stat, or NULL otherwise.
+// Must be called with the lock held.
+build_manifest_entry_struct* build_manifest_find_unchanged(build_manifest_struct* build_manifest, const char* filename, struct stat* file_stat) {
+	size_t position;
+	if(!dhashindex_find(&build_manifest->index, filename, &position)) {
+		return NULL;
+	}
+	build_manifest_entry_struct* entry = (build_manifest_entry_struct*) darray_get_elem(&build_manifest->entries, position);
+	if(entry->size != file_stat->st_size
+		|| entry->mtime.tv_sec != file_stat->st_mtim.tv_sec
+		|| entry->mtime.tv_nsec != file_stat->st_mtim.tv_nsec) {
+		return NULL;
+	}
+	return entry;
+}
+int build_manifest_is_current(build_manifest_struct* build_manifest, int dir_fd, size_t dir_length, const char* filename, uint64_t input_hash) {
+	// Nothing to stat() if the file wasn't generated from these inputs.
+	// Entries never move within the darray once added, so position stays
+	// good after the lock is released.
+	size_t position;
+	int prefetched = 0;
+	struct stat file_stat;
+	pthread_mutex_lock(&build_manifest->lock);
+	int have_entry = dhashindex_find(&build_manifest->index, filename, &position);
+	if(have_entry) {
+		build_manifest_entry_struct* entry = (build_manifest_entry_struct*) darray_get_elem(&build_manifest->entries, position);
+		have_entry = entry->input_hash == input_hash;
+		prefetched = entry->prefetched;
+		if(prefetched == 1) {
+			file_stat.st_size = entry->prefetched_size;
+			file_stat.st_mtim = entry->prefetched_mtime;
+		}
+		entry->prefetched = 0;
+	}
+	pthread_mutex_unlock(&build_manifest->lock);
+	if(!have_entry || prefetched == -1) {
+		return 0;
+	}
+	if(!prefetched && fstatat(dir_fd, build_manifest_get_relative_filename(dir_length, filename), &file_stat, 0)) {
+		return 0;
+	}
+	int is_current = 0;
+	pthread_mutex_lock(&build_manifest->lock);
+	build_manifest_entry_struct* entry = build_manifest_find_unchanged(build_manifest, filename, &file_stat);
+	if(entry != NULL) {
+		entry->seen = 1;
+		is_current = 1;
+	}
+	pthread_mutex_unlock(&build_manifest->lock);
+	return is_current;
+}
+void build_manifest_prefetch_stats(build_manifest_struct* build_manifest, int dir_fd, size_t dir_length, const char** filenames, size_t num_filenames) {
+	io_ring_struct* ring = io_ring_get();
+	if(ring == NULL || num_filenames == 0) {
+		return;
+	}
+	io_ring_stat_struct* stats = malloc(num_filenames * sizeof(io_ring_stat_struct));
+	size_t* positions = malloc(num_filenames * sizeof(size_t));
+	if(stats == NULL || positions == NULL) {
+		free(stats);
+		free(positions);
+		return;
+	}
+	// Files that aren't in the manifest would be generated either way
+	size_t num_stats = 0;
+	pthread_mutex_lock(&build_manifest->lock);
+	for(size_t i = 0; i < num_filenames; i++) {
+		if(dhashindex_find(&build_manifest->index, filenames[i], &positions[num_stats])) {
+			stats[num_stats].dir_fd = dir_fd;
+			stats[num_stats++].filename = build_manifest_get_relative_filename(dir_length, filenames[i]);
+		}
+	}
+	pthread_mutex_unlock(&build_manifest->lock);
+	if(!io_ring_stat_files(ring, stats, num_stats)) {
+		free(stats);
+		free(positions);
+		return;
+	}
+	pthread_mutex_lock(&build_manifest->lock);
+	for(size_t i = 0; i < num_stats; i++) {
+		build_manifest_entry_struct* entry = (build_manifest_entry_struct*) darray_get_elem(&build_manifest->entries, positions[i]);
+		if(stats[i].result == 0) {
+			entry->prefetched = 1;
+			entry->prefetched_size = stats[i].size;
+			entry->prefetched_mtime = stats[i].mtime;
+		} else if(stats[i].result == -ENOENT) {
+			entry->prefetched = -1;
+		}
+	}
+	pthread_mutex_unlock(&build_manifest->lock);
+	free(stats);
+	free(positions);
+}
+int build_manifest_write_file_if_different(build_manifest_struct* build_manifest, dstringbuilder_struct* dstringbuilder, int dir_fd, size_t dir_length, const char* filename, uint64_t input_hash, int* did_write) {
+	const char* relative_filename = build_manifest_get_relative_filename(dir_length, filename);
+	if(build_manifest == NULL) {
+		return dstringbuilder_write_file_if_different_at(dstringbuilder, dir_fd, relative_filename, did_write);
+	}
+	(*did_write) = WRITE_IF_DIFFERENT_NOT_WRITTEN;
+
+	uint64_t hash = dstringbuilder_get_hash(dstringbuilder);
+	size_t length = dstringbuilder_get_length(dstringbuilder);
+	struct stat file_stat;
+	int exists = 1;
+	if(fstatat(dir_fd, relative_filename, &file_stat, 0)) {
+		if(errno != ENOENT) {
+			fprintf(stderr, "Error checking file %s, stat error\n", filename);
+			return 0;
+		}
+		exists = 0;
+	}
+
+	int need_to_write = 1;
+	if(exists) {
+		int have_hash = 0;
+		uint64_t recorded_hash = 0;
+		pthread_mutex_lock(&build_manifest->lock);
+		build_manifest_entry_struct* entry = build_manifest_find_unchanged(build_manifest, filename, &file_stat);
+		if(entry != NULL) {
+			have_hash = 1;
+			recorded_hash = entry->hash;
+		}
+		pthread_mutex_unlock(&build_manifest->lock);
+		if(have_hash) {
+			need_to_write = (recorded_hash != hash || (size_t) file_stat.st_size != length);
+		} else {
+			int res = dstringbuilder_compare_to_file_at(dstringbuilder, dir_fd, relative_filename);
+			if(res == -1) {
+				return 0;
+			}
+			need_to_write = res;
+		}
+	}
+	if(need_to_write) {
+		if(!dstringbuilder_write_file_at(dstringbuilder, dir_fd, relative_filename)) {
+			fprintf(stderr, "Error writing file %s\n", filename);
+			return 0;
+		}
+		(*did_write) = exists ? WRITE_IF_DIFFERENT_UPDATED : WRITE_IF_DIFFERENT_CREATED;
+		if(fstatat(dir_fd, relative_filename, &file_stat, 0)) {
+			fprintf(stderr, "Error checking file %s after writing it, stat error\n", filename);
+			return 0;
+		}
+	}
+	pthread_mutex_lock(&build_manifest->lock);
+	build_manifest_struct* record_res = build_manifest_record(build_manifest, filename, hash, input_hash, file_stat.st_size, &file_stat.st_mtim);
+	pthread_mutex_unlock(&build_manifest->lock);
+	return record_res != NULL;
+}
@@ -0,0 +1,324 @@
+#include "dobjects.h"
+#include "content_bundle.h"
+#include "file_helpers.h"
+
+// A file or folder found while packing a bundle.
+typedef struct content_bundle_pack_entry_struct {
+	// Relative to the content directory.
+	dstring_struct path;
+	int is_dir;
+	dstring_struct contents;
+} content_bundle_pack_entry_struct;
+
+typedef struct content_bundle_pack_context_struct {
+	// The length of the content directory's path, plus the slash after it.
+	size_t base_length;
+
+	// A darray of content_bundle_pack_entry_struct's.
+	darray_struct entries;
+} content_bundle_pack_context_struct;
+
+// Adds the file or folder at full_path to the entries, reading its contents
+// if it's a file.
+// Returns 0 on error.
+int content_bundle_pack_add_entry(content_bundle_pack_context_struct* context, const char* full_path, int is_dir) {
+	content_bundle_pack_entry_struct entry;
+	dstring_lazy_init(&entry.path);
+	dstring_lazy_init(&entry.contents);
+	entry.is_dir = is_dir;
+	if(!dstring_append(&entry.path, full_path + context->base_length)) {
+		fprintf(stderr, "Error packing %s, dstring append error\n", full_path);
+		return 0;
+	}
+	if(!is_dir && !dstring_read_file(&entry.contents, full_path)) {
+		fprintf(stderr, "Error packing %s, couldn't read file\n", full_path);
+		dstring_free(&entry.path);
+		dstring_free(&entry.contents);
+		return 0;
+	}
+	if(!darray_append(&context->entries, &entry)) {
+		fprintf(stderr, "Error packing %s, darray append error\n", full_path);
+		dstring_free(&entry.path);
+		dstring_free(&entry.contents);
+		return 0;
+	}
+	return 1;
+}
+int content_bundle_pack_directory(dstring_struct* directory, content_bundle_pack_context_struct* context);
+
+int content_bundle_pack_directory_entry(dstring_struct* directory, struct dirent* dir_ent, void* context_void_ptr) {
+	content_bundle_pack_context_struct* context = context_void_ptr;
+	int is_dir = dir_ent->d_type == DT_DIR;
+	if(!dstring_append(directory, "/") || !dstring_append(directory, dir_ent->d_name)) {
+		fprintf(stderr, "Error packing %s, dstring append error\n", dir_ent->d_name);
+		return 0;
+	}
+	int res = content_bundle_pack_add_entry(context, directory->str, is_dir)
+		&& (!is_dir || content_bundle_pack_directory(directory, context));
+	dstring_remove_num_chars_in_text(directory, dir_ent->d_name);
+	dstring_remove_num_chars_in_text(directory, "/");
+	return res;
+}
+// Adds everything in the directory, and its subdirectories, to the entries.
+// Returns 0 on error.
+int content_bundle_pack_directory(dstring_struct* directory, content_bundle_pack_context_struct* context) {
+	return apply_function_to_directory_entries(directory, 0, DT_DIR | DT_REG, content_bundle_pack_directory_entry, context);
+}
+int content_bundle_pack_entry_compare(const void* a, const void* b) {
+	return strcmp(((content_bundle_pack_entry_struct*) a)->path.str, ((content_bundle_pack_entry_struct*) b)->path.str);
+}
+// Writes the sorted entries out to the (open) bundle file.
+// Returns 0 on error.
+int content_bundle_write(content_bundle_pack_context_struct* context, FILE* fd) {
+	size_t num_entries = context->entries.length;
+	content_bundle_header_struct header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CONTENT_BUNDLE_MAGIC, sizeof(header.magic));
+	header.num_entries = num_entries;
+
+	content_bundle_entry_struct* entries = calloc(num_entries > 0 ? num_entries : 1, sizeof(content_bundle_entry_struct));
+	if(entries == NULL) {
+		fprintf(stderr, "Error writing content bundle, calloc error\n");
+		return 0;
+	}
+	uint64_t offset = sizeof(header) + num_entries * sizeof(content_bundle_entry_struct);
+	for(size_t i = 0; i < num_entries; i++) {
+		content_bundle_pack_entry_struct* pack_entry = (content_bundle_pack_entry_struct*) darray_get_elem(&context->entries, i);
+		entries[i].path_offset = offset;
+		offset += pack_entry->path.length + 1;
+		entries[i].is_dir = pack_entry->is_dir;
+		if(!pack_entry->is_dir) {
+			entries[i].data_offset = offset;
+			entries[i].data_length = pack_entry->contents.length;
+			offset += pack_entry->contents.length + 1;
+		}
+	}
+	header.total_length = offset;
+
+	fwrite(&header, sizeof(header), 1, fd);
+	fwrite(entries, sizeof(content_bundle_entry_struct), num_entries, fd);
+	free(entries);
+	for(size_t i = 0; i < num_entries; i++) {
+		content_bundle_pack_entry_struct* pack_entry = (content_bundle_pack_entry_struct*) darray_get_elem(&context->entries, i);
+		fwrite(pack_entry->path.str, 1, pack_entry->path.length + 1, fd);
+		if(!pack_entry->is_dir) {
+			fwrite(pack_entry->contents.str, 1, pack_entry->contents.length + 1, fd);
+		}
+	}
+	return !ferror(fd);
+}
+int content_bundle_pack(const char* content_base_dir, const char* bundle_filename) {
+	static const char* top_level_dirs[] = {"posts", "series", "misc_pages", "components", "themes"};
+
+	content_bundle_pack_context_struct context;
+	dstring_struct directory;
+	dstring_struct temp_filename;
+
+	context.base_length = strlen(content_base_dir) + 1;
+	darray_lazy_init(&context.entries, sizeof(content_bundle_pack_entry_struct));
+	dstring_lazy_init(&directory);
+	dstring_lazy_init(&temp_filename);
+
+	int res = 1;
+	for(size_t i = 0; res && i < sizeof(top_level_dirs) / sizeof(top_level_dirs[0]); i++) {
+		directory.length = 0;
+		if(!dstring_append_printf(&directory, "%s/%s", content_base_dir, top_level_dirs[i])) {
+			fprintf(stderr, "Error packing content bundle, dstring append error\n");
+			res = 0;
+			break;
+		}
+		res = content_bundle_pack_add_entry(&context, directory.str, 1)
+			&& content_bundle_pack_directory(&directory, &context);
+	}
+	if(res) {
+		qsort(context.entries.array, context.entries.length, context.entries.elem_size, content_bundle_pack_entry_compare);
+		// Written to a temporary file first, so that the bundle is never
+		// left half-written.
+		FILE* fd = NULL;
+		if(!dstring_append_printf(&temp_filename, "%s.tmp", bundle_filename)
+			|| (fd = fopen(temp_filename.str, "w")) == NULL) {
+			fprintf(stderr, "Error packing content bundle, unable to open file %s\n", temp_filename.str);
+			res = 0;
+		} else {
+			int write_res = content_bundle_write(&context, fd);
+			if(fclose(fd) || !write_res) {
+				fprintf(stderr, "Error packing content bundle, couldn't write file %s\n", temp_filename.str);
+				unlink(temp_filename.str);
+				res = 0;
+			} else if(rename(temp_filename.str, bundle_filename)) {
+				fprintf(stderr, "Error packing content bundle, couldn't rename %s to %s\n", temp_filename.str, bundle_filename);
+				unlink(temp_filename.str);
+				res = 0;
+			}
+		}
+	}
+	if(res) {
+		printf("Packed %zu files and folders into %s\n", context.entries.length, bundle_filename);
+	}
+	for(size_t i = 0; i < context.entries.length; i++) {
+		content_bundle_pack_entry_struct* pack_entry = (content_bundle_pack_entry_struct*) darray_get_elem(&context.entries, i);
+		dstring_free(&pack_entry->path);
+		dstring_free(&pack_entry->contents);
+	}
+	darray_free(&context.entries);
+	dstring_free(&directory);
+	dstring_free(&temp_filename);
+	return res;
+}
+
+// Checks that every offset in the bundle is within it, and that every path
+// and file is followed by a '\0'.
+// Returns 0 if the bundle is invalid.
+int content_bundle_validate(content_bundle_struct* bundle) {
+	content_bundle_header_struct* header = (content_bundle_header_struct*) bundle->mapping;
+	if(bundle->mapping_length < sizeof(content_bundle_header_struct)
+		|| memcmp(header->magic, CONTENT_BUNDLE_MAGIC, sizeof(header->magic))
+		|| header->total_length != bundle->mapping_length
+		|| header->num_entries > (bundle->mapping_length - sizeof(content_bundle_header_struct)) / sizeof(content_bundle_entry_struct)) {
+		return 0;
+	}
+	bundle->entries = (content_bundle_entry_struct*) (bundle->mapping + sizeof(content_bundle_header_struct));
+	bundle->num_entries = header->num_entries;
+	for(size_t i = 0; i < bundle->num_entries; i++) {
+		content_bundle_entry_struct* entry = &bundle->entries[i];
+		if(entry->path_offset >= bundle->mapping_length
+			|| memchr(bundle->mapping + entry->path_offset, '\0', bundle->mapping_length - entry->path_offset) == NULL) {
+			return 0;
+		}
+		if(!entry->is_dir && (entry->data_offset >= bundle->mapping_length
+			|| entry->data_length >= bundle->mapping_length - entry->data_offset
+			|| bundle->mapping[entry->data_offset + entry->data_length] != '\0')) {
+			return 0;
+		}
+		// Lookups depend on the entries being sorted
+		if(i > 0 && strcmp(content_bundle_get_path(bundle, &bundle->entries[i - 1]), content_bundle_get_path(bundle, entry)) >= 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+content_bundle_struct* content_bundle_open(content_bundle_struct* bundle, const char* bundle_filename, const char* content_base_dir) {
+	dstring_lazy_init(&bundle->content_base_dir);
+	bundle->mapping = NULL;
+	bundle->mapping_length = 0;
+	bundle->entries = NULL;
+	bundle->num_entries = 0;
+	if(!dstring_append(&bundle->content_base_dir, content_base_dir)) {
+		fprintf(stderr, "Error opening content bundle %s, dstring append error\n", bundle_filename);
+		return NULL;
+	}
+	while(bundle->content_base_dir.length > 1 && bundle->content_base_dir.str[bundle->content_base_dir.length - 1] == '/') {
+		dstring_remove_num_chars_in_text(&bundle->content_base_dir, "/");
+	}
+
+	int fd = open(bundle_filename, O_RDONLY | O_CLOEXEC);
+	if(fd == -1) {
+		fprintf(stderr, "Error opening content bundle %s, open error: %s\n", bundle_filename, strerror(errno));
+		dstring_free(&bundle->content_base_dir);
+		return NULL;
+	}
+	struct stat file_stat;
+	if(fstat(fd, &file_stat) || file_stat.st_size == 0) {
+		fprintf(stderr, "Error opening content bundle %s, couldn't get its size, or it's empty\n", bundle_filename);
+		close(fd);
+		dstring_free(&bundle->content_base_dir);
+		return NULL;
+	}
+	bundle->mapping_length = (size_t) file_stat.st_size;
+	// Private and writable, so that loaded strings can be changed in place
+	// (only the pages that are changed get copied).
+	void* mapping = mmap(NULL, bundle->mapping_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED) {
+		fprintf(stderr, "Error opening content bundle %s, mmap error: %s\n", bundle_filename, strerror(errno));
+		dstring_free(&bundle->content_base_dir);
+		return NULL;
+	}
+	bundle->mapping = mapping;
+	if(!content_bundle_validate(bundle)) {
+		fprintf(stderr, "Error opening content bundle %s, it's not a valid content bundle\n", bundle_filename);
+		content_bundle_close(bundle);
+		return NULL;
+	}
+	return bundle;
+}
+void content_bundle_close(content_bundle_struct* bundle) {
+	if(bundle->mapping != NULL) {
+		munmap(bundle->mapping, bundle->mapping_length);
+	}
+	bundle->mapping = NULL;
+	bundle->mapping_length = 0;
+	bundle->entries = NULL;
+	bundle->num_entries = 0;
+	dstring_free(&bundle->content_base_dir);
+}
+// Returns the position of the first entry whose path is not less than path.
+size_t content_bundle_lower_bound(content_bundle_struct* bundle, const char* path) {
+	size_t low = 0;
+	size_t high = bundle->num_entries;
+	while(low < high) {
+		size_t middle = low + (high - low) / 2;
+		if(strcmp(content_bundle_get_path(bundle, &bundle->entries[middle]), path) < 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+content_bundle_entry_struct* content_bundle_find(content_bundle_struct* bundle, const char* path) {
+	size_t position = content_bundle_lower_bound(bundle, path);
+	if(position < bundle->num_entries && !strcmp(content_bundle_get_path(bundle, &bundle->entries[position]), path)) {
+		return &bundle->entries[position];
+	}
+	return NULL;
+}
+int content_bundle_get_relative_path(content_bundle_struct* bundle, const char* path, char* relative_path, size_t size) {
+	size_t base_length = bundle->content_base_dir.length;
+	if(strncmp(path, bundle->content_base_dir.str, base_length) || (path[base_length] != '/' && path[base_length] != '\0')) {
+		return 0;
+	}
+	size_t length = 0;
+	for(const char* current = path + base_length; *current; current++) {
+		if(*current == '/' && (length == 0 || relative_path[length - 1] == '/')) {
+			continue;
+		}
+		if(length + 1 >= size) {
+			return 0;
+		}
+		relative_path[length++] = *current;
+	}
+	if(length > 0 && relative_path[length - 1] == '/') {
+		length--;
+	}
+	relative_path[length] = '\0';
+	return 1;
+}
+int content_bundle_apply_function_to_directory_entries(content_bundle_struct* bundle, const char* relative_path, int (*func)(const char*, int, void*), void* context) {
+	content_bundle_entry_struct* directory = content_bundle_find(bundle, relative_path);
+	if(directory == NULL || !directory->is_dir) {
+		return 0;
+	}
+	char prefix[PATH_MAX];
+	int prefix_length = snprintf(prefix, sizeof(prefix), "%s/", relative_path);
+	if(prefix_length < 0 || (size_t) prefix_length >= sizeof(prefix)) {
+		return 0;
+	}
+	// Everything in the directory is together, as it all starts with the
+	// prefix.
+	for(size_t i = content_bundle_lower_bound(bundle, prefix); i < bundle->num_entries; i++) {
+		const char* path = content_bundle_get_path(bundle, &bundle->entries[i]);
+		if(strncmp(path, prefix, prefix_length)) {
+			break;
+		}
+		const char* name = path + prefix_length;
+		// Skip anything in subdirectories
+		if(strchr(name, '/') != NULL) {
+			continue;
+		}
+		if(!func(name, (int) bundle->entries[i].is_dir, context)) {
+			return 0;
+		}
+	}
+	return 1;
+}
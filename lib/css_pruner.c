@@ -0,0 +1,644 @@
+#include "dobjects.h"
+#include <ctype.h>
+#include <strings.h>
+#include "css_pruner.h"
+
+// The at-rules that hold other rules, which are pruned along with them.
+static const char* const css_pruner_group_rules[] = { "media", "supports", "container", "layer", "document", "-moz-document" };
+
+// The elements whose contents aren't markup.
+static const char* const css_pruner_raw_elements[] = { "script", "style", "textarea" };
+
+// Whether c can be part of a CSS identifier (or an HTML tag name).
+static inline int css_pruner_is_name_char(char c) {
+	return isalnum((unsigned char) c) || c == '-' || c == '_' || (unsigned char) c >= 0x80;
+}
+// Returns the hash of a token of the given kind ('t', '.' or '#').
+uint64_t css_pruner_hash_token(char kind, const char* name, size_t length) {
+	dhash_struct dhash;
+	dhash_init(&dhash);
+	dhash_append_bytes(&dhash, &kind, 1);
+	if(kind != 't') {
+		dhash_append_bytes(&dhash, name, length);
+		return dhash_get(&dhash);
+	}
+	// Element names are matched ignoring case
+	char lowercased[32];
+	while(length > 0) {
+		size_t chunk_length = length < sizeof(lowercased) ? length : sizeof(lowercased);
+		for(size_t i = 0; i < chunk_length; i++) {
+			lowercased[i] = tolower((unsigned char) name[i]);
+		}
+		dhash_append_bytes(&dhash, lowercased, chunk_length);
+		name += chunk_length;
+		length -= chunk_length;
+	}
+	return dhash_get(&dhash);
+}
+// Whether the length characters at name are name_to_match, ignoring case.
+int css_pruner_name_is(const char* name, size_t length, const char* name_to_match) {
+	return strlen(name_to_match) == length && !strncasecmp(name, name_to_match, length);
+}
+// Returns the position just after the first occurrence of end in text from
+// start on, or length if there isn't one.
+size_t css_pruner_skip_past(const char* text, size_t start, size_t length, const char* end) {
+	size_t end_length = strlen(end);
+	for(size_t i = start; i + end_length <= length; i++) {
+		if(!strncmp(text + i, end, end_length)) {
+			return i + end_length;
+		}
+	}
+	return length;
+}
+// Returns the position just after the quoted string that starts at
+// text[start].
+size_t css_pruner_skip_quoted(const char* text, size_t start, size_t length) {
+	char quote = text[start];
+	size_t i = start + 1;
+	while(i < length && text[i] != quote) {
+		i += text[i] == '\\' ? 2 : 1;
+	}
+	return i < length ? i + 1 : length;
+}
+// Skips over a comment or string at text[i], if there is one.
+// Returns 1 (having moved i past it) if there was.
+int css_pruner_skip_comment_or_string(const char* text, size_t* i, size_t length) {
+	if(text[*i] == '/' && (*i) + 1 < length && text[(*i) + 1] == '*') {
+		(*i) = css_pruner_skip_past(text, (*i) + 2, length, "*/");
+		return 1;
+	}
+	if(text[*i] == '"' || text[*i] == '\'') {
+		(*i) = css_pruner_skip_quoted(text, *i, length);
+		return 1;
+	}
+	return 0;
+}
+// Returns the position of the first {, ; or } from start on that isn't in
+// brackets, a string or a comment, or length if there isn't one.
+size_t css_pruner_find_prelude_end(const char* text, size_t start, size_t length) {
+	int depth = 0;
+	size_t i = start;
+	while(i < length) {
+		if(css_pruner_skip_comment_or_string(text, &i, length)) {
+			continue;
+		}
+		char c = text[i];
+		if(c == '(' || c == '[') {
+			depth++;
+		} else if((c == ')' || c == ']') && depth > 0) {
+			depth--;
+		} else if(depth == 0 && (c == '{' || c == ';' || c == '}')) {
+			return i;
+		}
+		i++;
+	}
+	return length;
+}
+// Returns the position just after the } that closes the block whose {
+// is just before start, or length if it isn't closed.
+size_t css_pruner_find_block_end(const char* text, size_t start, size_t length) {
+	int depth = 1;
+	size_t i = start;
+	while(i < length) {
+		if(css_pruner_skip_comment_or_string(text, &i, length)) {
+			continue;
+		}
+		if(text[i] == '{') {
+			depth++;
+		} else if(text[i] == '}' && --depth == 0) {
+			return i + 1;
+		}
+		i++;
+	}
+	return length;
+}
+// Returns the position just after the brackets that start at text[start].
+size_t css_pruner_skip_brackets(const char* text, size_t start, size_t length) {
+	int depth = 0;
+	size_t i = start;
+	while(i < length) {
+		if(css_pruner_skip_comment_or_string(text, &i, length)) {
+			continue;
+		}
+		if(text[i] == '(' || text[i] == '[') {
+			depth++;
+		} else if((text[i] == ')' || text[i] == ']') && --depth == 0) {
+			return i + 1;
+		}
+		i++;
+	}
+	return length;
+}
+// Returns the end of the identifier that starts at text[start], setting
+// has_escape if it has any escapes in it (which aren't worked out, so the
+// identifier can't be matched).
+size_t css_pruner_skip_name(const char* text, size_t start, size_t end, int* has_escape) {
+	size_t i = start;
+	(*has_escape) = 0;
+	while(i < end) {
+		if(text[i] == '\\') {
+			(*has_escape) = 1;
+			i += 2;
+		} else if(css_pruner_is_name_char(text[i])) {
+			i++;
+		} else {
+			break;
+		}
+	}
+	return i < end ? i : end;
+}
+// Adds the tokens that the selector between start and end needs to
+// stylesheet's tokens, and the selector itself to its selectors.
+// Returns 0 on error.
+int css_pruner_parse_selector(css_pruner_stylesheet_struct* stylesheet, size_t start, size_t end) {
+	const char* text = stylesheet->css->str;
+	css_pruner_selector_struct selector;
+	selector.first_token = stylesheet->tokens.length;
+	// Whether the next name is an element name, at the start of a compound
+	// selector
+	int at_compound_start = 1;
+	size_t i = start;
+	while(i < end) {
+		char c = text[i];
+		if(css_pruner_skip_comment_or_string(text, &i, end)) {
+			continue;
+		}
+		if(isspace((unsigned char) c) || c == '>' || c == '+' || c == '~') {
+			at_compound_start = 1;
+			i++;
+			continue;
+		}
+		if(c == '[' || c == '(') {
+			i = css_pruner_skip_brackets(text, i, end);
+		} else if(c == ':') {
+			// A pseudo-class or pseudo-element; whatever's in its brackets
+			// (like the .a in :not(.a)) doesn't have to be there
+			while(i < end && text[i] == ':') {
+				i++;
+			}
+			int has_escape;
+			i = css_pruner_skip_name(text, i, end, &has_escape);
+			if(i < end && text[i] == '(') {
+				i = css_pruner_skip_brackets(text, i, end);
+			}
+		} else if(c == '.' || c == '#' || (at_compound_start && css_pruner_is_name_char(c))) {
+			size_t name_start = c == '.' || c == '#' ? i + 1 : i;
+			int has_escape;
+			i = css_pruner_skip_name(text, name_start, end, &has_escape);
+			// A namespace prefix (like svg|a) isn't an element name
+			int is_namespace = i < end && text[i] == '|';
+			if(!has_escape && !is_namespace && i > name_start) {
+				uint64_t token = css_pruner_hash_token(c == '.' || c == '#' ? c : 't', text + name_start, i - name_start);
+				if(!darray_append(&stylesheet->tokens, &token)) {
+					return 0;
+				}
+			}
+		} else {
+			// *, &, | and anything else that doesn't need a token
+			i++;
+		}
+		at_compound_start = 0;
+	}
+	selector.num_tokens = stylesheet->tokens.length - selector.first_token;
+	return darray_append(&stylesheet->selectors, &selector) != NULL;
+}
+// Adds a rule of the given type to the stylesheet. For style rules, its
+// selectors run from its start to selectors_end.
+// Returns 0 on error.
+int css_pruner_add_rule(css_pruner_stylesheet_struct* stylesheet, int type, size_t start, size_t end, size_t selectors_end) {
+	css_pruner_rule_struct rule;
+	rule.type = type;
+	rule.start = start;
+	rule.length = end - start;
+	rule.first_selector = stylesheet->selectors.length;
+	if(type == CSS_PRUNER_STYLE) {
+		const char* text = stylesheet->css->str;
+		size_t selector_start = start;
+		size_t i = start;
+		while(i <= selectors_end) {
+			if(i < selectors_end && css_pruner_skip_comment_or_string(text, &i, selectors_end)) {
+				continue;
+			}
+			if(i < selectors_end && (text[i] == '(' || text[i] == '[')) {
+				i = css_pruner_skip_brackets(text, i, selectors_end);
+				continue;
+			}
+			if(i == selectors_end || text[i] == ',') {
+				if(!css_pruner_parse_selector(stylesheet, selector_start, i)) {
+					return 0;
+				}
+				selector_start = i + 1;
+			}
+			i++;
+		}
+	}
+	rule.num_selectors = stylesheet->selectors.length - rule.first_selector;
+	return darray_append(&stylesheet->rules, &rule) != NULL;
+}
+// Parses the rules from start on, up to the end of the CSS or, if depth is
+// more than 0, the } that ends the group they're in.
+// Returns the position just after them, or 0 on error.
+size_t css_pruner_parse_rules(css_pruner_stylesheet_struct* stylesheet, size_t start, int depth) {
+	const char* text = stylesheet->css->str;
+	size_t length = stylesheet->css->length;
+	size_t i = start;
+	while(1) {
+		while(i < length && (isspace((unsigned char) text[i]) || (text[i] == '/' && i + 1 < length && text[i + 1] == '*'))) {
+			if(!css_pruner_skip_comment_or_string(text, &i, length)) {
+				i++;
+			}
+		}
+		if(i >= length) {
+			return length;
+		}
+		if(text[i] == '}') {
+			if(depth > 0) {
+				return i;
+			}
+			// A stray }, which the browser ignores
+			i++;
+			continue;
+		}
+		size_t rule_start = i;
+		size_t prelude_end = css_pruner_find_prelude_end(text, i, length);
+		if(prelude_end == length || text[prelude_end] != '{') {
+			// A statement like @import, or something that isn't understood;
+			// either way, it's kept
+			size_t rule_end = prelude_end < length && text[prelude_end] == ';' ? prelude_end + 1 : prelude_end;
+			if(!css_pruner_add_rule(stylesheet, CSS_PRUNER_KEPT, rule_start, rule_end, rule_end)) {
+				return 0;
+			}
+			i = rule_end;
+			continue;
+		}
+		if(text[rule_start] == '@') {
+			int has_escape;
+			size_t name_end = css_pruner_skip_name(text, rule_start + 1, prelude_end, &has_escape);
+			int is_group = 0;
+			for(size_t j = 0; j < sizeof(css_pruner_group_rules) / sizeof(css_pruner_group_rules[0]); j++) {
+				is_group = is_group || css_pruner_name_is(text + rule_start + 1, name_end - rule_start - 1, css_pruner_group_rules[j]);
+			}
+			if(is_group) {
+				if(!css_pruner_add_rule(stylesheet, CSS_PRUNER_GROUP_START, rule_start, prelude_end + 1, prelude_end + 1)) {
+					return 0;
+				}
+				i = css_pruner_parse_rules(stylesheet, prelude_end + 1, depth + 1);
+				if(i == 0 || !css_pruner_add_rule(stylesheet, CSS_PRUNER_GROUP_END, i, i, i)) {
+					return 0;
+				}
+				if(i < length) {
+					i++;
+				}
+				continue;
+			}
+		}
+		size_t rule_end = css_pruner_find_block_end(text, prelude_end + 1, length);
+		if(!css_pruner_add_rule(stylesheet, text[rule_start] == '@' ? CSS_PRUNER_KEPT : CSS_PRUNER_STYLE, rule_start, rule_end, prelude_end)) {
+			return 0;
+		}
+		i = rule_end;
+	}
+}
+void css_pruner_stylesheet_free(css_pruner_stylesheet_struct* stylesheet) {
+	darray_free(&stylesheet->rules);
+	darray_free(&stylesheet->selectors);
+	darray_free(&stylesheet->tokens);
+}
+// Parses css into stylesheet.
+// Returns NULL on error.
+css_pruner_stylesheet_struct* css_pruner_stylesheet_init(css_pruner_stylesheet_struct* stylesheet, dstring_struct* css) {
+	stylesheet->css = css;
+	darray_lazy_init(&stylesheet->rules, sizeof(css_pruner_rule_struct));
+	darray_lazy_init(&stylesheet->selectors, sizeof(css_pruner_selector_struct));
+	darray_lazy_init(&stylesheet->tokens, sizeof(uint64_t));
+	if(css->length > 0 && css_pruner_parse_rules(stylesheet, 0, 0) == 0) {
+		return NULL;
+	}
+	return stylesheet;
+}
+int css_pruner_compare_tokens(const void* token_a, const void* token_b) {
+	uint64_t a = *((const uint64_t*) token_a);
+	uint64_t b = *((const uint64_t*) token_b);
+	return a < b ? -1 : a > b;
+}
+// Whether the (finished) page selectors have the token.
+int css_page_selectors_has(css_page_selectors_struct* page_selectors, uint64_t token) {
+	return bsearch(&token, page_selectors->tokens.array, page_selectors->tokens.length, sizeof(uint64_t), css_pruner_compare_tokens) != NULL;
+}
+// Appends the rules of the stylesheet that can match a page with
+// page_selectors to dest.
+// Returns 0 on error.
+int css_pruner_prune_stylesheet(css_pruner_struct* css_pruner, css_pruner_stylesheet_struct* stylesheet, css_page_selectors_struct* page_selectors, dstring_struct* dest) {
+	const char* text = stylesheet->css->str;
+	// The length of dest after the start of each of the groups that are open,
+	// so that groups that end up empty can be taken back out
+	size_t group_lengths[64];
+	size_t group_starts[64];
+	size_t depth = 0;
+	for(size_t i = 0; i < stylesheet->rules.length; i++) {
+		css_pruner_rule_struct* rule = (css_pruner_rule_struct*) darray_get_elem(&stylesheet->rules, i);
+		int keep = rule->type != CSS_PRUNER_STYLE;
+		for(size_t j = 0; j < rule->num_selectors && !keep; j++) {
+			css_pruner_selector_struct* selector = (css_pruner_selector_struct*) darray_get_elem(&stylesheet->selectors, rule->first_selector + j);
+			keep = 1;
+			for(size_t k = 0; k < selector->num_tokens && keep; k++) {
+				uint64_t token = *((uint64_t*) darray_get_elem(&stylesheet->tokens, selector->first_token + k));
+				keep = css_page_selectors_has(page_selectors, token) || css_page_selectors_has(&css_pruner->theme_selectors, token);
+			}
+		}
+		if(!keep) {
+			continue;
+		}
+		if(rule->type == CSS_PRUNER_GROUP_START) {
+			if(depth < sizeof(group_lengths) / sizeof(group_lengths[0])) {
+				group_starts[depth] = dest->length;
+				group_lengths[depth] = dest->length + rule->length;
+			}
+			depth++;
+		} else if(rule->type == CSS_PRUNER_GROUP_END) {
+			depth--;
+			if(depth < sizeof(group_lengths) / sizeof(group_lengths[0]) && dest->length == group_lengths[depth]) {
+				// Nothing in the group was kept
+				dest->length = group_starts[depth];
+				dest->str[dest->length] = '\0';
+				continue;
+			}
+			if(!dstring_append(dest, "}")) {
+				return 0;
+			}
+			continue;
+		}
+		if(!dstring_append_length(dest, text + rule->start, rule->length)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+css_pruner_struct* css_pruner_init(css_pruner_struct* css_pruner, dstring_struct* main_css, dstring_struct* code_css, dstring_struct* theme_html) {
+	darray_lazy_init(&css_pruner->cache, sizeof(css_pruner_cache_entry_struct));
+	css_page_selectors_init(&css_pruner->theme_selectors);
+	if(!css_pruner_stylesheet_init(&css_pruner->main_css, main_css)
+		|| !css_pruner_stylesheet_init(&css_pruner->code_css, code_css)
+		|| !css_page_selectors_scan(&css_pruner->theme_selectors, theme_html->str, theme_html->length)) {
+		fprintf(stderr, "Error parsing theme CSS for pruning\n");
+		css_pruner_stylesheet_free(&css_pruner->main_css);
+		css_pruner_stylesheet_free(&css_pruner->code_css);
+		css_page_selectors_free(&css_pruner->theme_selectors);
+		return NULL;
+	}
+	css_page_selectors_finish(&css_pruner->theme_selectors);
+	if(pthread_mutex_init(&css_pruner->lock, NULL)) {
+		fprintf(stderr, "Error initializing CSS pruner, couldn't create mutex\n");
+		css_pruner_stylesheet_free(&css_pruner->main_css);
+		css_pruner_stylesheet_free(&css_pruner->code_css);
+		css_page_selectors_free(&css_pruner->theme_selectors);
+		return NULL;
+	}
+	return css_pruner;
+}
+void css_pruner_free(css_pruner_struct* css_pruner) {
+	for(size_t i = 0; i < css_pruner->cache.length; i++) {
+		css_pruner_cache_entry_struct* entry = (css_pruner_cache_entry_struct*) darray_get_elem(&css_pruner->cache, i);
+		dstring_free(entry->css);
+		free(entry->css);
+	}
+	darray_free(&css_pruner->cache);
+	css_pruner_stylesheet_free(&css_pruner->main_css);
+	css_pruner_stylesheet_free(&css_pruner->code_css);
+	css_page_selectors_free(&css_pruner->theme_selectors);
+	pthread_mutex_destroy(&css_pruner->lock);
+}
+// Returns the position in the cache that the key is at, or would go at;
+// sets found if it's there.
+// Must be called with the lock held.
+size_t css_pruner_find_cache_entry(css_pruner_struct* css_pruner, uint64_t key, int* found) {
+	size_t low = 0;
+	size_t high = css_pruner->cache.length;
+	while(low < high) {
+		size_t middle = low + (high - low) / 2;
+		uint64_t middle_key = ((css_pruner_cache_entry_struct*) darray_get_elem(&css_pruner->cache, middle))->key;
+		if(middle_key < key) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	(*found) = low < css_pruner->cache.length && ((css_pruner_cache_entry_struct*) darray_get_elem(&css_pruner->cache, low))->key == key;
+	return low;
+}
+// Prunes the CSS for the page selectors, and adds it to the cache at
+// position.
+// Must be called with the lock held.
+// Returns the pruned CSS, or NULL on error.
+dstring_struct* css_pruner_add_cache_entry(css_pruner_struct* css_pruner, css_page_selectors_struct* page_selectors, int has_code, uint64_t key, size_t position) {
+	css_pruner_cache_entry_struct entry;
+	entry.key = key;
+	entry.css = (dstring_struct*) malloc(sizeof(dstring_struct));
+	if(entry.css == NULL) {
+		fprintf(stderr, "Error pruning CSS, couldn't allocate memory\n");
+		return NULL;
+	}
+	dstring_lazy_init(entry.css);
+	if(!css_pruner_prune_stylesheet(css_pruner, &css_pruner->main_css, page_selectors, entry.css)
+		|| (has_code && !css_pruner_prune_stylesheet(css_pruner, &css_pruner->code_css, page_selectors, entry.css))
+		|| !darray_append(&css_pruner->cache, &entry)) {
+		fprintf(stderr, "Error pruning CSS, dstring append error\n");
+		dstring_free(entry.css);
+		free(entry.css);
+		return NULL;
+	}
+	// Moved into place, to keep the cache sorted
+	css_pruner_cache_entry_struct* entries = (css_pruner_cache_entry_struct*) css_pruner->cache.array;
+	memmove(entries + position + 1, entries + position, (css_pruner->cache.length - 1 - position) * sizeof(css_pruner_cache_entry_struct));
+	entries[position] = entry;
+	return entry.css;
+}
+dstring_struct* css_pruner_get_css(css_pruner_struct* css_pruner, css_page_selectors_struct* page_selectors, int has_code) {
+	dhash_struct dhash;
+	dhash_init(&dhash);
+	dhash_append_uint64(&dhash, page_selectors->fingerprint);
+	dhash_append_uint64(&dhash, (uint64_t) has_code);
+	uint64_t key = dhash_get(&dhash);
+
+	pthread_mutex_lock(&css_pruner->lock);
+	// The cache lives as long as the css_pruner, not whatever's loading
+	darena_struct* previous_arena = darena_bind(NULL);
+	int found;
+	size_t position = css_pruner_find_cache_entry(css_pruner, key, &found);
+	dstring_struct* css;
+	if(found) {
+		css = ((css_pruner_cache_entry_struct*) darray_get_elem(&css_pruner->cache, position))->css;
+	} else {
+		css = css_pruner_add_cache_entry(css_pruner, page_selectors, has_code, key, position);
+	}
+	darena_bind(previous_arena);
+	pthread_mutex_unlock(&css_pruner->lock);
+	return css;
+}
+
+void css_page_selectors_init(css_page_selectors_struct* page_selectors) {
+	darray_lazy_init(&page_selectors->tokens, sizeof(uint64_t));
+	page_selectors->fingerprint = 0;
+}
+void css_page_selectors_free(css_page_selectors_struct* page_selectors) {
+	darray_free(&page_selectors->tokens);
+}
+// Adds the token to the page selectors.
+// Returns 0 on error.
+int css_page_selectors_add(css_page_selectors_struct* page_selectors, char kind, const char* name, size_t length) {
+	uint64_t token = css_pruner_hash_token(kind, name, length);
+	if(!darray_append(&page_selectors->tokens, &token)) {
+		fprintf(stderr, "Error scanning page for CSS selectors, darray append error\n");
+		return 0;
+	}
+	return 1;
+}
+// Adds the tokens of an attribute's value: each of the classes in a class
+// attribute, or an id.
+// Returns 0 on error.
+int css_page_selectors_add_attribute(css_page_selectors_struct* page_selectors, const char* name, size_t name_length, const char* value, size_t value_length) {
+	if(css_pruner_name_is(name, name_length, "id")) {
+		return value_length == 0 || css_page_selectors_add(page_selectors, '#', value, value_length);
+	}
+	if(!css_pruner_name_is(name, name_length, "class")) {
+		return 1;
+	}
+	size_t i = 0;
+	while(i < value_length) {
+		while(i < value_length && isspace((unsigned char) value[i])) {
+			i++;
+		}
+		size_t class_start = i;
+		while(i < value_length && !isspace((unsigned char) value[i])) {
+			i++;
+		}
+		if(i > class_start && !css_page_selectors_add(page_selectors, '.', value + class_start, i - class_start)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+// Scans the attributes of the tag from start on, up to its >.
+// Returns the position just after the tag, or 0 on error.
+size_t css_page_selectors_scan_attributes(css_page_selectors_struct* page_selectors, const char* html, size_t start, size_t length) {
+	size_t i = start;
+	while(i < length) {
+		while(i < length && (isspace((unsigned char) html[i]) || html[i] == '/')) {
+			i++;
+		}
+		if(i >= length || html[i] == '>') {
+			break;
+		}
+		size_t name_start = i;
+		while(i < length && !isspace((unsigned char) html[i]) && html[i] != '=' && html[i] != '>' && html[i] != '/') {
+			i++;
+		}
+		size_t name_length = i - name_start;
+		while(i < length && isspace((unsigned char) html[i])) {
+			i++;
+		}
+		if(i >= length || html[i] != '=') {
+			continue;
+		}
+		i++;
+		while(i < length && isspace((unsigned char) html[i])) {
+			i++;
+		}
+		size_t value_start = i;
+		size_t value_end;
+		if(i < length && (html[i] == '"' || html[i] == '\'')) {
+			const char* quote_end = memchr(html + i + 1, html[i], length - i - 1);
+			value_start = i + 1;
+			value_end = quote_end != NULL ? (size_t) (quote_end - html) : length;
+			i = value_end < length ? value_end + 1 : length;
+		} else {
+			while(i < length && !isspace((unsigned char) html[i]) && html[i] != '>') {
+				i++;
+			}
+			value_end = i;
+		}
+		if(!css_page_selectors_add_attribute(page_selectors, html + name_start, name_length, html + value_start, value_end - value_start)) {
+			return 0;
+		}
+	}
+	return i < length ? i + 1 : length;
+}
+css_page_selectors_struct* css_page_selectors_scan(css_page_selectors_struct* page_selectors, const char* html, size_t length) {
+	size_t i = 0;
+	while(i < length) {
+		const char* tag = memchr(html + i, '<', length - i);
+		if(tag == NULL) {
+			break;
+		}
+		i = tag - html;
+		if(i + 1 >= length) {
+			break;
+		}
+		if(i + 4 <= length && !strncmp(html + i, "<!--", 4)) {
+			i = css_pruner_skip_past(html, i + 4, length, "-->");
+			continue;
+		}
+		if(!isalpha((unsigned char) html[i + 1])) {
+			// Closing tags, doctypes and a < that isn't a tag at all
+			i++;
+			continue;
+		}
+		size_t name_start = i + 1;
+		i = name_start;
+		while(i < length && (css_pruner_is_name_char(html[i]) || html[i] == ':')) {
+			i++;
+		}
+		size_t name_length = i - name_start;
+		if(!css_page_selectors_add(page_selectors, 't', html + name_start, name_length)) {
+			return NULL;
+		}
+		i = css_page_selectors_scan_attributes(page_selectors, html, i, length);
+		if(i == 0) {
+			return NULL;
+		}
+		for(size_t j = 0; j < sizeof(css_pruner_raw_elements) / sizeof(css_pruner_raw_elements[0]); j++) {
+			if(!css_pruner_name_is(html + name_start, name_length, css_pruner_raw_elements[j])) {
+				continue;
+			}
+			// Skipped up to the closing tag
+			size_t raw_name_length = strlen(css_pruner_raw_elements[j]);
+			while(i + 2 + raw_name_length <= length && !(html[i] == '<' && html[i + 1] == '/' && !strncasecmp(html + i + 2, css_pruner_raw_elements[j], raw_name_length))) {
+				i++;
+			}
+			if(i + 2 + raw_name_length > length) {
+				i = length;
+			}
+		}
+	}
+	return page_selectors;
+}
+css_page_selectors_struct* css_page_selectors_scan_dstringbuilder(css_page_selectors_struct* page_selectors, dstringbuilder_struct* html) {
+	// Tags may be split across the dstringbuilder's pieces
+	dstring_struct* formed = dstringbuilder_form(html);
+	if(formed == NULL) {
+		fprintf(stderr, "Error scanning page for CSS selectors, dstringbuilder form error\n");
+		return NULL;
+	}
+	css_page_selectors_struct* res = css_page_selectors_scan(page_selectors, formed->str, formed->length);
+	dstring_free(formed);
+	free(formed);
+	return res;
+}
+void css_page_selectors_finish(css_page_selectors_struct* page_selectors) {
+	darray_struct* tokens = &page_selectors->tokens;
+	if(tokens->length > 0) {
+		qsort(tokens->array, tokens->length, sizeof(uint64_t), css_pruner_compare_tokens);
+	}
+	uint64_t* token_array = (uint64_t*) tokens->array;
+	size_t unique_length = 0;
+	for(size_t i = 0; i < tokens->length; i++) {
+		if(unique_length == 0 || token_array[unique_length - 1] != token_array[i]) {
+			token_array[unique_length++] = token_array[i];
+		}
+	}
+	tokens->length = unique_length;
+	dhash_struct dhash;
+	dhash_init(&dhash);
+	dhash_append_bytes(&dhash, token_array, unique_length * sizeof(uint64_t));
+	page_selectors->fingerprint = dhash_get(&dhash);
+}
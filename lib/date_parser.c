@@ -0,0 +1,593 @@
+#include "dobjects.h"
+#include <ctype.h>
+#include "date_parser.h"
+
+#define DATE_PARSER_UNSET -1
+#define DATE_PARSER_MAX_WORD_LENGTH 16
+#define DATE_PARSER_MAX_TZ_NAME_LENGTH 256
+#define DATE_PARSER_DEFAULT_ZONEINFO_DIR "/usr/share/zoneinfo"
+
+// Holds all of the items that have been read from a date string so far.
+// Any of year, month, day, hour, minute, and second will be
+// DATE_PARSER_UNSET if they haven't been read in.
+typedef struct date_parser_state_struct {
+	// The string being parsed, and what it is, for error messages.
+	const char* date_str;
+	const char* description;
+
+	int year;
+	int month;
+	int day;
+	int hour;
+	int minute;
+	int second;
+
+	// Whether or not an am/pm item has been applied to the time.
+	int meridian_applied;
+
+	// Whether or not a timezone abbreviation or numeric offset was given,
+	// and the offset from UTC, in minutes, if so.
+	int has_offset;
+	int offset_minutes;
+
+	// Whether or not the offset came from a "UTC"/"GMT"/"Z" item; a
+	// numeric offset is allowed to follow these (eg "UTC-05:00").
+	int offset_is_utc_word;
+
+	// Whether or not the offset came from a timezone abbreviation, as
+	// only those can be followed by "DST".
+	int offset_is_abbreviation;
+
+	// The TZ="..." zone name, or an empty string if none was given.
+	char tz_name[DATE_PARSER_MAX_TZ_NAME_LENGTH];
+
+	// Whether the string was (or contained) "now".
+	int is_now;
+} date_parser_state_struct;
+
+typedef struct date_parser_zone_struct {
+	const char* abbreviation;
+	int offset_minutes;
+} date_parser_zone_struct;
+
+// Same idea as the table in GNU's parse-datetime; these are the
+// abbreviations that are in common enough use to not be ambiguous.
+static const date_parser_zone_struct DATE_PARSER_ZONES[] = {
+	{ "utc", 0 }, { "ut", 0 }, { "gmt", 0 }, { "z", 0 },
+	{ "wet", 0 }, { "west", 60 }, { "bst", 60 },
+	{ "cet", 60 }, { "cest", 120 }, { "met", 60 }, { "mez", 60 }, { "mesz", 120 },
+	{ "eet", 120 }, { "eest", 180 }, { "msk", 180 },
+	{ "ist", 330 }, { "sgt", 480 }, { "hkt", 480 }, { "awst", 480 },
+	{ "jst", 540 }, { "kst", 540 }, { "acst", 570 }, { "aest", 600 }, { "aedt", 660 },
+	{ "nzst", 720 }, { "nzdt", 780 },
+	{ "nst", -210 }, { "ndt", -150 },
+	{ "ast", -240 }, { "adt", -180 },
+	{ "est", -300 }, { "edt", -240 },
+	{ "cst", -360 }, { "cdt", -300 },
+	{ "mst", -420 }, { "mdt", -360 },
+	{ "pst", -480 }, { "pdt", -420 },
+	{ "akst", -540 }, { "akdt", -480 },
+	{ "hst", -600 },
+	{ NULL, 0 }
+};
+
+static const char* DATE_PARSER_MONTHS[] = {
+	"january", "february", "march", "april", "may", "june",
+	"july", "august", "september", "october", "november", "december"
+};
+
+static const char* DATE_PARSER_WEEKDAYS[] = {
+	"sunday", "monday", "tuesday", "wednesday", "thursday", "friday", "saturday"
+};
+
+static int date_parser_is_leap_year(int year) {
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+static int date_parser_days_in_month(int year, int month) {
+	static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	if(month == 2 && date_parser_is_leap_year(year)) {
+		return 29;
+	}
+	return days[month - 1];
+}
+
+// Two-digit years are treated the same way `date` treats them:
+// 69-99 are 1969-1999, 00-68 are 2000-2068.
+static int date_parser_expand_year(int year, int num_digits) {
+	if(num_digits > 2) {
+		return year;
+	}
+	return year >= 69 ? year + 1900 : year + 2000;
+}
+
+// Reads up to 9 digits at (*p), advancing (*p) past them.
+// Returns 0 if there were no digits.
+static int date_parser_read_number(const char** p, int* value, int* num_digits) {
+	(*value) = 0;
+	(*num_digits) = 0;
+	while(isdigit((unsigned char) **p) && (*num_digits) < 9) {
+		(*value) = (*value) * 10 + (**p - '0');
+		(*num_digits)++;
+		(*p)++;
+	}
+	return (*num_digits) > 0;
+}
+
+// Reads a word of letters (and periods, for "a.m."/"p.m.") at (*p),
+// lowercasing it and dropping periods, advancing (*p) past it.
+// Returns 0 if the word is too long.
+static int date_parser_read_word(const char** p, char* word) {
+	size_t length = 0;
+	while(isalpha((unsigned char) **p) || **p == '.') {
+		if(**p != '.') {
+			if(length >= DATE_PARSER_MAX_WORD_LENGTH) {
+				return 0;
+			}
+			word[length++] = tolower((unsigned char) **p);
+		}
+		(*p)++;
+	}
+	word[length] = '\0';
+	return 1;
+}
+
+// Returns 1 if the next item at p (after any whitespace) is am or pm.
+static int date_parser_is_meridian_next(const char* p) {
+	char word[DATE_PARSER_MAX_WORD_LENGTH + 1];
+	while(isspace((unsigned char) *p)) {
+		p++;
+	}
+	if(!isalpha((unsigned char) *p) || !date_parser_read_word(&p, word)) {
+		return 0;
+	}
+	return !strcmp(word, "am") || !strcmp(word, "pm");
+}
+
+static int date_parser_set_time(date_parser_state_struct* state, int hour, int minute, int second) {
+	if(state->hour != DATE_PARSER_UNSET) {
+		fprintf(stderr, "Error parsing date '%s' (%s), more than one time given\n", state->date_str, state->description);
+		return 0;
+	}
+	state->hour = hour;
+	state->minute = minute;
+	state->second = second;
+	return 1;
+}
+static int date_parser_set_date(date_parser_state_struct* state, int year, int month, int day) {
+	if(state->month != DATE_PARSER_UNSET || state->day != DATE_PARSER_UNSET
+		|| (year != DATE_PARSER_UNSET && state->year != DATE_PARSER_UNSET)) {
+		fprintf(stderr, "Error parsing date '%s' (%s), more than one date given\n", state->date_str, state->description);
+		return 0;
+	}
+	state->year = year;
+	state->month = month;
+	state->day = day;
+	return 1;
+}
+static int date_parser_set_offset(date_parser_state_struct* state, int offset_minutes, int is_utc_word, int is_abbreviation) {
+	if(state->tz_name[0] != '\0') {
+		fprintf(stderr, "Error parsing date '%s' (%s), can't use a timezone offset with TZ=\n", state->date_str, state->description);
+		return 0;
+	}
+	// "UTC-05:00" and the like are allowed, anything else is ambiguous.
+	if(state->has_offset && !(state->offset_is_utc_word && !is_utc_word && !is_abbreviation)) {
+		fprintf(stderr, "Error parsing date '%s' (%s), more than one timezone given\n", state->date_str, state->description);
+		return 0;
+	}
+	state->has_offset = 1;
+	state->offset_minutes = offset_minutes;
+	state->offset_is_utc_word = is_utc_word;
+	state->offset_is_abbreviation = is_abbreviation;
+	return 1;
+}
+
+// Handles an item starting with a digit: a time, a numeric date, or a lone
+// number that is part of a date with a month name (or an hour, if followed
+// by am/pm).
+static int date_parser_parse_number_item(date_parser_state_struct* state, const char** p) {
+	int value;
+	int num_digits;
+	date_parser_read_number(p, &value, &num_digits);
+
+	if(**p == ':') {
+		// H:MM[:SS[.fraction]]
+		int minute;
+		int second = 0;
+		int minute_digits;
+		int second_digits;
+		(*p)++;
+		if(!date_parser_read_number(p, &minute, &minute_digits) || minute_digits > 2) {
+			fprintf(stderr, "Error parsing date '%s' (%s), bad minutes in time\n", state->date_str, state->description);
+			return 0;
+		}
+		if(**p == ':') {
+			(*p)++;
+			if(!date_parser_read_number(p, &second, &second_digits) || second_digits > 2) {
+				fprintf(stderr, "Error parsing date '%s' (%s), bad seconds in time\n", state->date_str, state->description);
+				return 0;
+			}
+			// Fractional seconds are accepted, but ignored.
+			if(**p == '.' && isdigit((unsigned char) (*p)[1])) {
+				(*p)++;
+				while(isdigit((unsigned char) **p)) {
+					(*p)++;
+				}
+			}
+		}
+		if(num_digits > 2) {
+			fprintf(stderr, "Error parsing date '%s' (%s), bad hours in time\n", state->date_str, state->description);
+			return 0;
+		}
+		return date_parser_set_time(state, value, minute, second);
+	}
+	if(**p == '/') {
+		// M/D[/Y]
+		int day;
+		int day_digits;
+		int year = DATE_PARSER_UNSET;
+		(*p)++;
+		if(!date_parser_read_number(p, &day, &day_digits)) {
+			fprintf(stderr, "Error parsing date '%s' (%s), bad day in date\n", state->date_str, state->description);
+			return 0;
+		}
+		if(**p == '/') {
+			int year_digits;
+			(*p)++;
+			if(!date_parser_read_number(p, &year, &year_digits)) {
+				fprintf(stderr, "Error parsing date '%s' (%s), bad year in date\n", state->date_str, state->description);
+				return 0;
+			}
+			year = date_parser_expand_year(year, year_digits);
+		}
+		return date_parser_set_date(state, year, value, day);
+	}
+	if(**p == '-' && num_digits == 4 && isdigit((unsigned char) (*p)[1])) {
+		// YYYY-MM-DD, optionally followed by T and a time
+		int month;
+		int day;
+		int digits;
+		(*p)++;
+		if(!date_parser_read_number(p, &month, &digits) || **p != '-') {
+			fprintf(stderr, "Error parsing date '%s' (%s), bad month in date\n", state->date_str, state->description);
+			return 0;
+		}
+		(*p)++;
+		if(!date_parser_read_number(p, &day, &digits)) {
+			fprintf(stderr, "Error parsing date '%s' (%s), bad day in date\n", state->date_str, state->description);
+			return 0;
+		}
+		if((**p == 'T' || **p == 't') && isdigit((unsigned char) (*p)[1])) {
+			(*p)++;
+		}
+		return date_parser_set_date(state, value, month, day);
+	}
+	if(isalpha((unsigned char) **p) && !date_parser_is_meridian_next(*p)) {
+		fprintf(stderr, "Error parsing date '%s' (%s), unexpected text after number %d\n", state->date_str, state->description, value);
+		return 0;
+	}
+
+	// A lone number.
+	if(num_digits <= 2 && date_parser_is_meridian_next(*p)) {
+		return date_parser_set_time(state, value, 0, 0);
+	}
+	if(num_digits == 4 && state->year == DATE_PARSER_UNSET) {
+		state->year = value;
+		return 1;
+	}
+	if(num_digits <= 2 && state->day == DATE_PARSER_UNSET) {
+		state->day = value;
+		return 1;
+	}
+	if(num_digits <= 2 && state->year == DATE_PARSER_UNSET && state->month != DATE_PARSER_UNSET) {
+		state->year = date_parser_expand_year(value, num_digits);
+		return 1;
+	}
+	fprintf(stderr, "Error parsing date '%s' (%s), didn't expect number %d\n", state->date_str, state->description, value);
+	return 0;
+}
+
+// Handles an item starting with a letter: month and weekday names, am/pm,
+// timezone abbreviations, "now", and "today".
+static int date_parser_parse_word_item(date_parser_state_struct* state, const char** p) {
+	char word[DATE_PARSER_MAX_WORD_LENGTH + 1];
+	if(!date_parser_read_word(p, word)) {
+		fprintf(stderr, "Error parsing date '%s' (%s), unknown word\n", state->date_str, state->description);
+		return 0;
+	}
+	size_t word_length = strlen(word);
+
+	if(!strcmp(word, "am") || !strcmp(word, "pm")) {
+		if(state->hour == DATE_PARSER_UNSET || state->meridian_applied) {
+			fprintf(stderr, "Error parsing date '%s' (%s), %s without a time\n", state->date_str, state->description, word);
+			return 0;
+		}
+		if(state->hour < 1 || state->hour > 12) {
+			fprintf(stderr, "Error parsing date '%s' (%s), hour %d isn't valid with %s\n", state->date_str, state->description, state->hour, word);
+			return 0;
+		}
+		if(state->hour == 12) {
+			state->hour = 0;
+		}
+		if(word[0] == 'p') {
+			state->hour += 12;
+		}
+		state->meridian_applied = 1;
+		return 1;
+	}
+	if(!strcmp(word, "now")) {
+		state->is_now = 1;
+		return 1;
+	}
+	if(!strcmp(word, "today")) {
+		// The date is filled in from the current time later on.
+		return 1;
+	}
+	if(!strcmp(word, "dst")) {
+		if(!state->offset_is_abbreviation) {
+			fprintf(stderr, "Error parsing date '%s' (%s), DST without a timezone\n", state->date_str, state->description);
+			return 0;
+		}
+		state->offset_minutes += 60;
+		state->offset_is_abbreviation = 0;
+		return 1;
+	}
+	// Month names may be abbreviated to three letters (or "sept").
+	for(int i = 0; i < 12; i++) {
+		if((word_length == 3 || !strcmp(word, "sept") || word_length == strlen(DATE_PARSER_MONTHS[i]))
+			&& !strncmp(word, DATE_PARSER_MONTHS[i], word_length)) {
+			if(state->month != DATE_PARSER_UNSET) {
+				fprintf(stderr, "Error parsing date '%s' (%s), more than one month given\n", state->date_str, state->description);
+				return 0;
+			}
+			state->month = i + 1;
+			return 1;
+		}
+	}
+	// Weekday names don't change the date, but are allowed for readability.
+	for(int i = 0; i < 7; i++) {
+		if(word_length >= 3 && !strncmp(word, DATE_PARSER_WEEKDAYS[i], word_length)) {
+			return 1;
+		}
+	}
+	for(const date_parser_zone_struct* zone = DATE_PARSER_ZONES; zone->abbreviation; zone++) {
+		if(!strcmp(word, zone->abbreviation)) {
+			int is_utc_word = zone->offset_minutes == 0 && (word[0] == 'u' || word[0] == 'g' || word[0] == 'z');
+			return date_parser_set_offset(state, zone->offset_minutes, is_utc_word, !is_utc_word);
+		}
+	}
+	fprintf(stderr, "Error parsing date '%s' (%s), unknown word %s\n", state->date_str, state->description, word);
+	return 0;
+}
+
+// Handles a numeric timezone offset: +HH, +HHMM, or +HH:MM
+static int date_parser_parse_offset_item(date_parser_state_struct* state, const char** p) {
+	int sign = (**p == '-') ? -1 : 1;
+	int value;
+	int num_digits;
+	int hours;
+	int minutes = 0;
+	(*p)++;
+	date_parser_read_number(p, &value, &num_digits);
+	if(num_digits == 4) {
+		hours = value / 100;
+		minutes = value % 100;
+	} else if(num_digits <= 2) {
+		hours = value;
+		if(**p == ':') {
+			int minute_digits;
+			(*p)++;
+			if(!date_parser_read_number(p, &minutes, &minute_digits) || minute_digits != 2) {
+				fprintf(stderr, "Error parsing date '%s' (%s), bad timezone offset\n", state->date_str, state->description);
+				return 0;
+			}
+		}
+	} else {
+		fprintf(stderr, "Error parsing date '%s' (%s), bad timezone offset\n", state->date_str, state->description);
+		return 0;
+	}
+	if(hours > 24 || minutes > 59) {
+		fprintf(stderr, "Error parsing date '%s' (%s), timezone offset out of range\n", state->date_str, state->description);
+		return 0;
+	}
+	return date_parser_set_offset(state, sign * (hours * 60 + minutes), 0, 0);
+}
+
+// Reads a leading TZ="Area/Location" item, and checks that the zone exists
+// in the zoneinfo database.
+static int date_parser_parse_tz_item(date_parser_state_struct* state, const char** p) {
+	(*p) += 4;
+	const char* end = strchr(*p, '"');
+	if(end == NULL) {
+		fprintf(stderr, "Error parsing date '%s' (%s), missing closing quote for TZ\n", state->date_str, state->description);
+		return 0;
+	}
+	size_t length = end - (*p);
+	if(length == 0 || length >= DATE_PARSER_MAX_TZ_NAME_LENGTH) {
+		fprintf(stderr, "Error parsing date '%s' (%s), bad TZ value\n", state->date_str, state->description);
+		return 0;
+	}
+	memcpy(state->tz_name, *p, length);
+	state->tz_name[length] = '\0';
+	(*p) = end + 1;
+
+	const char* zone_name = state->tz_name[0] == ':' ? state->tz_name + 1 : state->tz_name;
+	if(zone_name[0] == '/' || strstr(zone_name, "..")) {
+		fprintf(stderr, "Error parsing date '%s' (%s), bad TZ value %s\n", state->date_str, state->description, state->tz_name);
+		return 0;
+	}
+	const char* zoneinfo_dir = getenv("TZDIR");
+	if(zoneinfo_dir == NULL || zoneinfo_dir[0] == '\0') {
+		zoneinfo_dir = DATE_PARSER_DEFAULT_ZONEINFO_DIR;
+	}
+	dstring_struct zone_file;
+	dstring_lazy_init(&zone_file);
+	if(!dstring_append_printf(&zone_file, "%s/%s", zoneinfo_dir, zone_name)) {
+		fprintf(stderr, "Error parsing date '%s' (%s), dstring append error\n", state->date_str, state->description);
+		dstring_free(&zone_file);
+		return 0;
+	}
+	int zone_exists = !access(zone_file.str, R_OK);
+	dstring_free(&zone_file);
+	if(!zone_exists) {
+		fprintf(stderr, "Error parsing date '%s' (%s), unknown timezone %s\n", state->date_str, state->description, state->tz_name);
+		return 0;
+	}
+	return 1;
+}
+
+// Converts the broken-down time to a timestamp in the named zone, by
+// temporarily pointing TZ at it. This lets the C library deal with the
+// zoneinfo file, including DST transitions.
+static int date_parser_mktime_in_zone(const char* tz_name, struct tm* time_struct, time_t* result) {
+	char* old_tz = getenv("TZ");
+	if(old_tz != NULL) {
+		old_tz = strdup(old_tz);
+		if(old_tz == NULL) {
+			fprintf(stderr, "Error converting date, strdup error\n");
+			return 0;
+		}
+	}
+	if(setenv("TZ", tz_name, 1)) {
+		fprintf(stderr, "Error converting date, couldn't set TZ\n");
+		free(old_tz);
+		return 0;
+	}
+	tzset();
+	(*result) = mktime(time_struct);
+
+	if(old_tz != NULL) {
+		setenv("TZ", old_tz, 1);
+		free(old_tz);
+	} else {
+		unsetenv("TZ");
+	}
+	tzset();
+	return 1;
+}
+
+int parse_date_string(const char* date_str, const char* description, time_t now, time_t* result) {
+	date_parser_state_struct state;
+	state.date_str = date_str;
+	state.description = description;
+	state.year = DATE_PARSER_UNSET;
+	state.month = DATE_PARSER_UNSET;
+	state.day = DATE_PARSER_UNSET;
+	state.hour = DATE_PARSER_UNSET;
+	state.minute = DATE_PARSER_UNSET;
+	state.second = DATE_PARSER_UNSET;
+	state.meridian_applied = 0;
+	state.has_offset = 0;
+	state.offset_minutes = 0;
+	state.offset_is_utc_word = 0;
+	state.offset_is_abbreviation = 0;
+	state.tz_name[0] = '\0';
+	state.is_now = 0;
+
+	const char* p = date_str;
+	while(isspace((unsigned char) *p)) {
+		p++;
+	}
+	if(!strncmp(p, "TZ=\"", 4)) {
+		if(!date_parser_parse_tz_item(&state, &p)) {
+			return 0;
+		}
+	}
+	int had_error = 0;
+	while(!had_error) {
+		while(isspace((unsigned char) *p) || *p == ',') {
+			p++;
+		}
+		if(*p == '\0') {
+			break;
+		}
+		if(isdigit((unsigned char) *p)) {
+			had_error = !date_parser_parse_number_item(&state, &p);
+		} else if(isalpha((unsigned char) *p)) {
+			had_error = !date_parser_parse_word_item(&state, &p);
+		} else if((*p == '+' || *p == '-') && isdigit((unsigned char) p[1])) {
+			had_error = !date_parser_parse_offset_item(&state, &p);
+		} else {
+			fprintf(stderr, "Error parsing date '%s' (%s), unexpected character '%c'\n", date_str, description, *p);
+			had_error = 1;
+		}
+	}
+	if(had_error) {
+		return 0;
+	}
+
+	int has_date_items = state.year != DATE_PARSER_UNSET || state.month != DATE_PARSER_UNSET || state.day != DATE_PARSER_UNSET;
+	if(state.is_now) {
+		if(has_date_items || state.hour != DATE_PARSER_UNSET) {
+			fprintf(stderr, "Error parsing date '%s' (%s), now can't be combined with a date or time\n", date_str, description);
+			return 0;
+		}
+		(*result) = now;
+		return 1;
+	}
+
+	// Fill in anything missing from the date with today's date (in the
+	// zone the date is in), the same as `date` does.
+	if(state.year == DATE_PARSER_UNSET || state.month == DATE_PARSER_UNSET || state.day == DATE_PARSER_UNSET) {
+		if(has_date_items && (state.month == DATE_PARSER_UNSET || state.day == DATE_PARSER_UNSET)) {
+			fprintf(stderr, "Error parsing date '%s' (%s), incomplete date\n", date_str, description);
+			return 0;
+		}
+		struct tm now_struct;
+		if(state.has_offset) {
+			time_t shifted_now = now + state.offset_minutes * 60;
+			gmtime_r(&shifted_now, &now_struct);
+		} else {
+			localtime_r(&now, &now_struct);
+		}
+		if(state.year == DATE_PARSER_UNSET) {
+			state.year = now_struct.tm_year + 1900;
+		}
+		if(state.month == DATE_PARSER_UNSET) {
+			state.month = now_struct.tm_mon + 1;
+			state.day = now_struct.tm_mday;
+		}
+	}
+	if(state.hour == DATE_PARSER_UNSET) {
+		state.hour = 0;
+		state.minute = 0;
+		state.second = 0;
+	}
+
+	if(state.month < 1 || state.month > 12) {
+		fprintf(stderr, "Error parsing date '%s' (%s), month %d out of range\n", date_str, description, state.month);
+		return 0;
+	}
+	if(state.day < 1 || state.day > date_parser_days_in_month(state.year, state.month)) {
+		fprintf(stderr, "Error parsing date '%s' (%s), day %d out of range\n", date_str, description, state.day);
+		return 0;
+	}
+	if(state.hour > 23 || state.minute > 59 || state.second > 60) {
+		fprintf(stderr, "Error parsing date '%s' (%s), time out of range\n", date_str, description);
+		return 0;
+	}
+
+	struct tm time_struct;
+	memset(&time_struct, 0, sizeof(struct tm));
+	time_struct.tm_year = state.year - 1900;
+	time_struct.tm_mon = state.month - 1;
+	time_struct.tm_mday = state.day;
+	time_struct.tm_hour = state.hour;
+	time_struct.tm_min = state.minute;
+	time_struct.tm_sec = state.second;
+	time_struct.tm_isdst = -1;
+
+	if(state.has_offset) {
+		(*result) = timegm(&time_struct) - (time_t) state.offset_minutes * 60;
+	} else if(state.tz_name[0] != '\0') {
+		if(!date_parser_mktime_in_zone(state.tz_name, &time_struct, result)) {
+			return 0;
+		}
+	} else {
+		(*result) = mktime(&time_struct);
+	}
+	if((*result) == (time_t) -1) {
+		fprintf(stderr, "Error parsing date '%s' (%s), couldn't convert to a timestamp\n", date_str, description);
+		return 0;
+	}
+	return 1;
+}
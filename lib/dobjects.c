@@ -10,10 +10,142 @@
 // as a dstring of length 0.
 static const char EMPTY_STRING[] = "";
 
+// The darena bound to each thread by darena_bind.
+static _Thread_local darena_struct* bound_darena = NULL;
+
+void darena_lazy_init(darena_struct* darena) {
+	darena->blocks = NULL;
+	darena->last_allocation = NULL;
+	// Can't fail with default attributes
+	pthread_mutex_init(&darena->lock, NULL);
+}
+void darena_free(darena_struct* darena) {
+	pthread_mutex_lock(&darena->lock);
+	darena_block_struct* block = darena->blocks;
+	while(block != NULL) {
+		darena_block_struct* next = block->next;
+		munmap(block, block->size);
+		block = next;
+	}
+	darena->blocks = NULL;
+	darena->last_allocation = NULL;
+	pthread_mutex_unlock(&darena->lock);
+}
+static size_t darena_align(size_t size) {
+	return (size + DARENA_ALIGNMENT - 1) & ~((size_t) DARENA_ALIGNMENT - 1);
+}
+// Maps a new block with room for at least size bytes after its header.
+// Must be called with the lock held.
+static darena_block_struct* darena_map_block(size_t size) {
+	size_t header_size = darena_align(sizeof(darena_block_struct));
+	size_t block_size = DARENA_BLOCK_SIZE;
+	if(header_size + size > block_size) {
+		size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+		block_size = (header_size + size + page_size - 1) / page_size * page_size;
+	}
+	void* mapping = mmap(NULL, block_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mapping == MAP_FAILED) {
+		fprintf(stderr, "Unable to map block for darena\n");
+		return NULL;
+	}
+	darena_block_struct* block = mapping;
+	block->next = NULL;
+	block->size = block_size;
+	block->used = header_size;
+	return block;
+}
+// Must be called with the lock held.
+static void* darena_alloc_locked(darena_struct* darena, size_t size) {
+	size = darena_align(size > 0 ? size : 1);
+	darena_block_struct* block = darena->blocks;
+	if(block != NULL && block->size - block->used >= size) {
+		void* allocation = (char*) block + block->used;
+		block->used += size;
+		darena->last_allocation = allocation;
+		return allocation;
+	}
+	darena_block_struct* new_block = darena_map_block(size);
+	if(new_block == NULL) {
+		return NULL;
+	}
+	void* allocation = (char*) new_block + new_block->used;
+	new_block->used += size;
+	if(block != NULL && new_block->size - new_block->used < block->size - block->used) {
+		// A large allocation that filled its own block; keep handing out
+		// from the current one.
+		new_block->next = block->next;
+		block->next = new_block;
+	} else {
+		new_block->next = block;
+		darena->blocks = new_block;
+		darena->last_allocation = allocation;
+	}
+	return allocation;
+}
+void* darena_alloc(darena_struct* darena, size_t size) {
+	pthread_mutex_lock(&darena->lock);
+	void* allocation = darena_alloc_locked(darena, size);
+	pthread_mutex_unlock(&darena->lock);
+	return allocation;
+}
+void* darena_realloc(darena_struct* darena, void* ptr, size_t old_size, size_t new_size) {
+	pthread_mutex_lock(&darena->lock);
+	darena_block_struct* block = darena->blocks;
+	if(ptr != NULL && ptr == darena->last_allocation) {
+		size_t offset = (char*) ptr - (char*) block;
+		size_t aligned_size = darena_align(new_size > 0 ? new_size : 1);
+		if(block->size - offset >= aligned_size) {
+			block->used = offset + aligned_size;
+			pthread_mutex_unlock(&darena->lock);
+			return ptr;
+		}
+	}
+	void* allocation = darena_alloc_locked(darena, new_size);
+	pthread_mutex_unlock(&darena->lock);
+	if(allocation != NULL && ptr != NULL) {
+		memcpy(allocation, ptr, old_size < new_size ? old_size : new_size);
+	}
+	return allocation;
+}
+darena_struct* darena_bind(darena_struct* darena) {
+	darena_struct* previous = bound_darena;
+	bound_darena = darena;
+	return previous;
+}
+darena_struct* darena_get_bound() {
+	return bound_darena;
+}
+
+// Stands in for the darena of a dstring that points to memory it doesn't
+// own; see dstring_borrow. Nothing is ever allocated from it.
+static darena_struct borrowed_memory;
+
+// Allocates, or resizes, the memory used by a dstring or darray. If it has
+// no memory yet (or only borrowed memory, which is copied over), it's taken
+// from the bound darena (if any), which is recorded in (*arena); otherwise
+// it comes from wherever it came from before.
+static void* dobjects_realloc(darena_struct** arena, void* ptr, size_t old_size, size_t new_size) {
+	if(ptr == NULL || (*arena) == &borrowed_memory) {
+		darena_struct* new_arena = bound_darena;
+		void* new_pointer = new_arena != NULL ? darena_alloc(new_arena, new_size) : malloc(new_size);
+		if(new_pointer == NULL) {
+			return NULL;
+		}
+		if(ptr != NULL) {
+			memcpy(new_pointer, ptr, old_size < new_size ? old_size : new_size);
+		}
+		(*arena) = new_arena;
+		return new_pointer;
+	}
+	if((*arena) != NULL) {
+		return darena_realloc(*arena, ptr, old_size, new_size);
+	}
+	return realloc(ptr, new_size);
+}
 
 // Will return NULL if unable to init
 darray_struct* darray_init_with_size(darray_struct* darray, size_t elem_size, size_t initial_size) {
-	darray->array = malloc(initial_size * elem_size);
+	darray->array = dobjects_realloc(&darray->arena, NULL, 0, initial_size * elem_size);
 
 	if(!darray->array) {
 		// malloc failed
@@ -34,6 +166,7 @@ void darray_lazy_init(darray_struct* darray, size_t elem_size) {
 	darray->length = 0;
 	darray->elem_size = elem_size;
 	darray->array = NULL;
+	darray->arena = NULL;
 }
 void darray_free(darray_struct* darray) {
 	darray->total_length = 0;
@@ -45,8 +178,11 @@ void darray_free(darray_struct* darray) {
 	if(darray->array == NULL) {
 		return;
 	}
-	free(darray->array);
+	if(darray->arena == NULL) {
+		free(darray->array);
+	}
 	darray->array = NULL;
+	darray->arena = NULL;
 }
 
 // Will return NULL if unable to resize
@@ -55,7 +191,7 @@ darray_struct* darray_increase_size_specific_amount(darray_struct* darray, size_
 
 	// Not immediately overwriting darray->array as in darray_init_with_size, as if
 	// realloc returns NULL, we then lose the original array.
-	void* new_pointer = realloc(darray->array, (new_elem_count * darray->elem_size));
+	void* new_pointer = dobjects_realloc(&darray->arena, darray->array, darray->total_length * darray->elem_size, new_elem_count * darray->elem_size);
 
 	if(new_pointer == NULL) {
 		fprintf(stderr, "Unable to increase size of darray\n");
@@ -70,9 +206,13 @@ darray_struct* darray_increase_size_specific_amount(darray_struct* darray, size_
 darray_struct* darray_increase_size(darray_struct* darray) {
 	size_t add_elems = 0;
 
-	// Smaller arrays are given less additional space
+	// Smaller arrays are given less additional space; large arrays grow
+	// by half of their size, so that appending many elements (such as
+	// every post on a big site) doesn't turn quadratic from reallocs.
 	if(darray->total_length < DARRAY_INCREMENT_SIZE) {
 		add_elems = DARRAY_SMALL_INCREMENT_SIZE;
+	} else if(darray->total_length / 2 > DARRAY_INCREMENT_SIZE) {
+		add_elems = darray->total_length / 2;
 	} else {
 		add_elems = DARRAY_INCREMENT_SIZE;
 	}
@@ -110,10 +250,148 @@ darray_struct* darray_clone(darray_struct* darray) {
 	return new_darray;
 }
 
+// FNV-1a; simple, and good enough for the short names used as keys.
+static size_t dhashindex_hash(const char* key) {
+	size_t hash = (size_t) 14695981039346656037ULL;
+	while(*key) {
+		hash ^= (unsigned char) *(key++);
+		hash *= (size_t) 1099511628211ULL;
+	}
+	return hash;
+}
+void dhashindex_lazy_init(dhashindex_struct* dhashindex) {
+	dhashindex->entries = NULL;
+	dhashindex->total_length = 0;
+	dhashindex->length = 0;
+}
+void dhashindex_free(dhashindex_struct* dhashindex) {
+	free(dhashindex->entries);
+	dhashindex_lazy_init(dhashindex);
+}
+void dhashindex_clear(dhashindex_struct* dhashindex) {
+	for(size_t i = 0; i < dhashindex->total_length; i++) {
+		dhashindex->entries[i].key = NULL;
+	}
+	dhashindex->length = 0;
+}
+// Places an entry in the first free slot of its probe sequence. There must
+// be at least one free slot.
+static void dhashindex_place(dhashindex_entry_struct* entries, size_t total_length, dhashindex_entry_struct* entry) {
+	size_t mask = total_length - 1;
+	size_t slot = entry->hash & mask;
+	while(entries[slot].key != NULL) {
+		slot = (slot + 1) & mask;
+	}
+	entries[slot] = (*entry);
+}
+// Will return NULL if unable to resize
+static dhashindex_struct* dhashindex_resize(dhashindex_struct* dhashindex, size_t new_total_length) {
+	dhashindex_entry_struct* new_entries = calloc(new_total_length, sizeof(dhashindex_entry_struct));
+	if(new_entries == NULL) {
+		fprintf(stderr, "Unable to allocate space for dhashindex\n");
+		return NULL;
+	}
+	for(size_t i = 0; i < dhashindex->total_length; i++) {
+		if(dhashindex->entries[i].key != NULL) {
+			dhashindex_place(new_entries, new_total_length, &dhashindex->entries[i]);
+		}
+	}
+	free(dhashindex->entries);
+	dhashindex->entries = new_entries;
+	dhashindex->total_length = new_total_length;
+	return dhashindex;
+}
+dhashindex_struct* dhashindex_insert(dhashindex_struct* dhashindex, const char* key, size_t index) {
+	size_t found_index;
+	if(dhashindex_find(dhashindex, key, &found_index)) {
+		return dhashindex;
+	}
+	// Keep the load factor at or below one half, so that probe sequences
+	// stay short.
+	if((dhashindex->length + 1) * 2 > dhashindex->total_length) {
+		size_t new_total_length = dhashindex->total_length == 0 ? DHASHINDEX_INITIAL_SIZE : dhashindex->total_length * 2;
+		if(!dhashindex_resize(dhashindex, new_total_length)) {
+			return NULL;
+		}
+	}
+	dhashindex_entry_struct entry;
+	entry.key = key;
+	entry.hash = dhashindex_hash(key);
+	entry.index = index;
+	dhashindex_place(dhashindex->entries, dhashindex->total_length, &entry);
+	dhashindex->length++;
+	return dhashindex;
+}
+int dhashindex_find(dhashindex_struct* dhashindex, const char* key, size_t* index) {
+	if(dhashindex->length == 0) {
+		return 0;
+	}
+	size_t hash = dhashindex_hash(key);
+	size_t mask = dhashindex->total_length - 1;
+	size_t slot = hash & mask;
+	while(dhashindex->entries[slot].key != NULL) {
+		if(dhashindex->entries[slot].hash == hash && !strcmp(dhashindex->entries[slot].key, key)) {
+			(*index) = dhashindex->entries[slot].index;
+			return 1;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return 0;
+}
+
+static inline uint64_t dhash_mix(uint64_t hash, uint64_t word) {
+	hash ^= word;
+	hash *= 0x9e3779b97f4a7c15ULL;
+	return hash ^ (hash >> 29);
+}
+void dhash_init(dhash_struct* dhash) {
+	dhash->hash = 14695981039346656037ULL;
+	dhash->pending = 0;
+	dhash->pending_length = 0;
+	dhash->total_length = 0;
+}
+void dhash_append_bytes(dhash_struct* dhash, const void* bytes, size_t length) {
+	const unsigned char* current = bytes;
+	dhash->total_length += length;
+	// Finish off the word left over from the last append
+	while(dhash->pending_length > 0 && length > 0) {
+		dhash->pending |= ((uint64_t) *(current++)) << (dhash->pending_length * 8);
+		length--;
+		if(++dhash->pending_length == 8) {
+			dhash->hash = dhash_mix(dhash->hash, dhash->pending);
+			dhash->pending = 0;
+			dhash->pending_length = 0;
+		}
+	}
+	for(; length >= 8; current += 8, length -= 8) {
+		uint64_t word;
+		memcpy(&word, current, 8);
+		dhash->hash = dhash_mix(dhash->hash, word);
+	}
+	for(; length > 0; length--) {
+		dhash->pending |= ((uint64_t) *(current++)) << (dhash->pending_length * 8);
+		dhash->pending_length++;
+	}
+}
+void dhash_append_string(dhash_struct* dhash, const char* str) {
+	// Includes the '\0', so that "ab" + "c" hashes differently than "a" + "bc"
+	dhash_append_bytes(dhash, str, strlen(str) + 1);
+}
+void dhash_append_dstring(dhash_struct* dhash, dstring_struct* dstring) {
+	dhash_append_bytes(dhash, dstring->str, dstring->length + 1);
+}
+void dhash_append_uint64(dhash_struct* dhash, uint64_t value) {
+	dhash_append_bytes(dhash, &value, sizeof(value));
+}
+uint64_t dhash_get(dhash_struct* dhash) {
+	uint64_t hash = dhash_mix(dhash->hash, dhash->pending);
+	return dhash_mix(hash, (uint64_t) dhash->total_length);
+}
+
 // Will return NULL if unable to init
 dstring_struct* dstring_init_with_size(dstring_struct* dstring, size_t initial_size) {
 	// +1 for null terminator
-	dstring->str = malloc(initial_size + 1);
+	dstring->str = dobjects_realloc(&dstring->arena, NULL, 0, initial_size + 1);
 
 	if(!dstring->str) {
 		// malloc failed
@@ -140,16 +418,31 @@ void dstring_lazy_init(dstring_struct* dstring) {
 	dstring->str = (char*) EMPTY_STRING;
 	dstring->total_length = 0;
 	dstring->length = 0;
+	dstring->arena = NULL;
+}
+void dstring_borrow(dstring_struct* dstring, char* str, size_t length) {
+	// There'd be nothing to borrow
+	if(length == 0) {
+		dstring_lazy_init(dstring);
+		return;
+	}
+	dstring->str = str;
+	dstring->total_length = length;
+	dstring->length = length;
+	dstring->arena = &borrowed_memory;
 }
 void dstring_free(dstring_struct* dstring) {
 	if(dstring->str == NULL || dstring->str == EMPTY_STRING || dstring->total_length == 0) {
 		return;
 	}
-	free(dstring->str);
+	if(dstring->arena == NULL) {
+		free(dstring->str);
+	}
 	// Point it back to EMPTY_STRING just to be nice
 	dstring->str = (char*) EMPTY_STRING;
 	dstring->total_length = 0;
 	dstring->length = 0;
+	dstring->arena = NULL;
 }
 // Will free the dstrings in a darray, AND the darray.
 // But it won't actually free the pointer itself.
@@ -164,15 +457,17 @@ dstring_struct* dstring_resize_no_extra(dstring_struct* dstring, size_t addition
 	size_t new_size = dstring->total_length + additional_bytes;
 
 	// Set it to NULL so that realloc works
+	size_t old_size = dstring->total_length + 1;
 	if(dstring->str == EMPTY_STRING) {
 		dstring->str = NULL;
+		old_size = 0;
 	}
 
 	// Don't immediately overwrite dstring->str so that if realloc returns
 	// NULL, we don't lose the string.
 	// Also, add 1 so that calling code doesn't have to account for the
 	// null terminator.
-	void* new_pointer = realloc(dstring->str, new_size + 1);
+	void* new_pointer = dobjects_realloc(&dstring->arena, dstring->str, old_size, new_size + 1);
 	if(new_pointer == NULL) {
 		fprintf(stderr, "Unable to allocate more space for dstring\n");
 		return NULL;
@@ -197,7 +492,9 @@ dstring_struct* dstring_resize(dstring_struct* dstring, size_t min_additional_by
 
 // Will return the dstring, or NULL if an error
 dstring_struct* dstring_append(dstring_struct* dstring, const char* text) {
-	size_t text_len = strlen(text);
+	return dstring_append_length(dstring, text, strlen(text));
+}
+dstring_struct* dstring_append_length(dstring_struct* dstring, const char* text, size_t text_len) {
 	// Resize if too small
 	if((dstring->total_length - dstring->length) < (text_len + 1)) {
 		if(!dstring_resize(dstring, text_len)) {
@@ -247,31 +544,86 @@ void dstring_remove_num_chars_in_text(dstring_struct* dstring, const char* text)
 	dstring->str[dstring->length] = '\0';
 }
 
+dmapped_file_struct* dmapped_file_open(dmapped_file_struct* mapped_file, const char* filename) {
+	return dmapped_file_open_at(mapped_file, AT_FDCWD, filename);
+}
+dmapped_file_struct* dmapped_file_open_at(dmapped_file_struct* mapped_file, int dir_fd, const char* filename) {
+	int fd = openat(dir_fd, filename, O_RDONLY | O_CLOEXEC);
+	if(fd == -1) {
+		fprintf(stderr, "Unable to open file %s\n", filename);
+		return NULL;
+	}
+	struct stat file_stat;
+	if(fstat(fd, &file_stat)) {
+		fprintf(stderr, "Unable to stat file %s\n", filename);
+		close(fd);
+		return NULL;
+	}
+	mapped_file->length = (size_t) file_stat.st_size;
+	// mmap() refuses to map nothing
+	if(mapped_file->length == 0) {
+		mapped_file->contents = EMPTY_STRING;
+		close(fd);
+		return mapped_file;
+	}
+	void* mapping = mmap(NULL, mapped_file->length, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping stays valid after the file is closed
+	close(fd);
+	if(mapping == MAP_FAILED) {
+		fprintf(stderr, "Unable to map file %s\n", filename);
+		return NULL;
+	}
+	mapped_file->contents = mapping;
+	return mapped_file;
+}
+void dmapped_file_close(dmapped_file_struct* mapped_file) {
+	if(mapped_file->length > 0) {
+		munmap((void*) mapped_file->contents, mapped_file->length);
+	}
+	mapped_file->contents = EMPTY_STRING;
+	mapped_file->length = 0;
+}
 // NULL on error. Should be called with a pre-init-ed dstring.
 dstring_struct* dstring_read_file(dstring_struct* dstring, const char* file) {
-	FILE* fd = fopen(file, "r");
-	if(!fd) {
+	return dstring_read_file_at(dstring, AT_FDCWD, file);
+}
+dstring_struct* dstring_read_file_at(dstring_struct* dstring, int dir_fd, const char* file) {
+	int fd = openat(dir_fd, file, O_RDONLY | O_CLOEXEC);
+	if(fd == -1) {
 		fprintf(stderr, "Unable to open file %s\n", file);
 		return NULL;
 	}
-	fseek(fd, 0L, SEEK_END);
-	size_t file_size = (size_t) ftell(fd);
-	rewind(fd);
+	struct stat file_stat;
+	if(fstat(fd, &file_stat)) {
+		fprintf(stderr, "Unable to stat file %s\n", file);
+		close(fd);
+		return NULL;
+	}
+	size_t file_size = (size_t) file_stat.st_size;
 	if((dstring->total_length - dstring->length) < (file_size + 1)) {
 		if(!dstring_resize_no_extra(dstring, file_size)) {
-			fclose(fd);
+			close(fd);
 			fprintf(stderr, "Bailing out of reading file %s into dstring because dstring couldn't resize\n", file);
 			return NULL;
 		}
 	}
-	size_t bytes_read = fread(dstring->str + dstring->length, 1, file_size, fd);
-	dstring->length += bytes_read;
-	if(ferror(fd)) {
-		fprintf(stderr, "Bailing out of reading file %s into dstring because error while reading file\n", file);
-		fclose(fd);
-		return NULL;
+	// Read straight into the dstring, never more than the size it had when
+	// it was checked (the file could be growing).
+	size_t bytes_read = 0;
+	while(bytes_read < file_size) {
+		ssize_t res = read(fd, dstring->str + dstring->length + bytes_read, file_size - bytes_read);
+		if(res == -1 && errno == EINTR) continue;
+		if(res == -1) {
+			fprintf(stderr, "Bailing out of reading file %s into dstring because error while reading file\n", file);
+			close(fd);
+			dstring->str[dstring->length] = '\0';
+			return NULL;
+		}
+		if(res == 0) break;
+		bytes_read += (size_t) res;
 	}
-	fclose(fd);
+	close(fd);
+	dstring->length += bytes_read;
 	dstring->str[dstring->length] = '\0';
 	return dstring;
 }
@@ -333,61 +685,29 @@ int dstring_write_file(dstring_struct* dstring, const char* file) {
 }
 // Returns 1 if different, -1 if error, 0 if the same.
 int dstring_compare_to_file(dstring_struct* dstring, const char* filename) {
-	FILE* fd = fopen(filename, "r");
-
-	if(!fd) {
-		fprintf(stderr, "Unable to open file %s\n", filename);
+	dmapped_file_struct mapped_file;
+	if(!dmapped_file_open(&mapped_file, filename)) {
 		return -1;
 	}
-
-	// Get the file size
-	fseek(fd, 0L, SEEK_END);
-	size_t file_size = (size_t) ftell(fd);
-	rewind(fd);
-
 	// If the file is not the same length as the string, then we don't have
 	// to compare their contents to know they're different
-	if(file_size != dstring->length) {
-		fclose(fd);
-		return 1;
-	}
-
-	// Compare the file a block at a time; there's no sense in consuming
-	// the extra memory needed to read the entire file into a dstring
-	char read_buffer[DSTRING_FILE_READ_BLOCK_SIZE];
-	char* current_location = dstring->str;
-	int different = 0;
-
-	do {
-		size_t bytes_read = fread(read_buffer, 1, DSTRING_FILE_READ_BLOCK_SIZE, fd);
-		if(bytes_read == 0) break;
-		if(strncmp(read_buffer, current_location, bytes_read)) {
-			different = 1;
-			break;
-		}
-		current_location += bytes_read;
-		if(bytes_read < DSTRING_FILE_READ_BLOCK_SIZE) {
-			break;
-		}
-	} while(1);
-
-	if(ferror(fd)) {
-		fprintf(stderr, "Bailing out of comparing file %s because error while reading\n", filename);
-		fclose(fd);
-		return -1;
+	int different = 1;
+	if(mapped_file.length == dstring->length) {
+		different = memcmp(mapped_file.contents, dstring->str, dstring->length) != 0;
 	}
-	fclose(fd);
+	dmapped_file_close(&mapped_file);
 	return different;
 }
 // Returns 0 if error, 1 otherwise; check did_write to see if the file was
 // actually written.
 int dstring_write_file_if_different(dstring_struct* dstring, const char* filename, int* did_write) {
-	(*did_write) = 0;
+	(*did_write) = WRITE_IF_DIFFERENT_NOT_WRITTEN;
 	dstring_struct file_contents;
 	dstring_lazy_init(&file_contents);
 
 	int need_to_write = 1;
-	if(!access(filename, F_OK)) {
+	int exists = !access(filename, F_OK);
+	if(exists) {
 		int res = dstring_compare_to_file(dstring, filename);
 		if(res == -1) {
 			return 0;
@@ -395,9 +715,6 @@ int dstring_write_file_if_different(dstring_struct* dstring, const char* filenam
 			need_to_write = res;
 		}
 		
-	} else {
-		// TODO: This belongs in calling code
-		printf("Creating file %s as it doesn't exist\n", filename);
 	}
 	if(need_to_write) {
 		if(!dstring_write_file(dstring, filename)) {
@@ -405,7 +722,7 @@ int dstring_write_file_if_different(dstring_struct* dstring, const char* filenam
 			dstring_free(&file_contents);
 			return 0;
 		}
-		(*did_write) = 1;
+		(*did_write) = exists ? WRITE_IF_DIFFERENT_UPDATED : WRITE_IF_DIFFERENT_CREATED;
 	}
 	dstring_free(&file_contents);
 	return 1;
@@ -662,12 +979,32 @@ size_t dstringbuilder_get_length(dstringbuilder_struct* dstringbuilder) {
 	}
 	return length;
 }
+void dstringbuilder_internal_get_hash(dstringbuilder_struct* dstringbuilder, dhash_struct* dhash) {
+	for(size_t i = 0; i < dstringbuilder->array.length; i++) {
+		dstringbuilder_internal_struct* dsbi = dstringbuilder_get_internal(dstringbuilder, i);
+
+		if(dsbi->type == DSTRINGBUILDER_INTERNAL_DSTRING) {
+			dhash_append_bytes(dhash, dsbi->dstring->str, dsbi->dstring->length);
+		} else {
+			dstringbuilder_internal_get_hash(dsbi->dstringbuilder, dhash);
+		}
+	}
+}
+void dhash_append_dstringbuilder(dhash_struct* dhash, dstringbuilder_struct* dstringbuilder) {
+	dstringbuilder_internal_get_hash(dstringbuilder, dhash);
+}
+uint64_t dstringbuilder_get_hash(dstringbuilder_struct* dstringbuilder) {
+	dhash_struct dhash;
+	dhash_init(&dhash);
+	dstringbuilder_internal_get_hash(dstringbuilder, &dhash);
+	return dhash_get(&dhash);
+}
 dstring_struct* dstringbuilder_internal_form(dstringbuilder_struct* dstringbuilder, dstring_struct* append_to_dstring) {
 	for(size_t i = 0; i < dstringbuilder->array.length; i++) {
 		dstringbuilder_internal_struct* dsbi = dstringbuilder_get_internal(dstringbuilder, i);
 
 		if(dsbi->type == DSTRINGBUILDER_INTERNAL_DSTRING) {
-			if(!dstring_append(append_to_dstring, dsbi->dstring->str)) {
+			if(!dstring_append_length(append_to_dstring, dsbi->dstring->str, dsbi->dstring->length)) {
 				return NULL;
 			}
 		} else {
@@ -695,94 +1032,139 @@ dstring_struct* dstringbuilder_form(dstringbuilder_struct* dstringbuilder) {
 	return dstring;
 }
 
-int dstringbuilder_internal_compare_to_file(dstringbuilder_struct* dstringbuilder, FILE* fd) {
+// Compares the dstringbuilder to contents, a whole dstring at a time,
+// starting at (*position), which is moved past what was compared. contents
+// must be at least as long as the dstringbuilder.
+// Returns 1 if different, 0 if the same.
+int dstringbuilder_internal_compare_to_memory(dstringbuilder_struct* dstringbuilder, const char* contents, size_t* position) {
 	for(size_t i = 0; i < dstringbuilder->array.length; i++) {
 		dstringbuilder_internal_struct* dsbi = dstringbuilder_get_internal(dstringbuilder, i);
 
 		if(dsbi->type == DSTRINGBUILDER_INTERNAL_DSTRING) {
-			char read_buffer[DSTRING_FILE_READ_BLOCK_SIZE];
-			char* current_location = dsbi->dstring->str;
-			size_t current_location_pos = 0;
-			do {
-				size_t bytes_to_read = DSTRING_FILE_READ_BLOCK_SIZE;
-				if((dsbi->dstring->length - current_location_pos) < DSTRING_FILE_READ_BLOCK_SIZE) {
-					bytes_to_read = (dsbi->dstring->length - current_location_pos);
-				}
-				size_t bytes_read = fread(read_buffer, 1, bytes_to_read, fd);
-				if(bytes_read == 0) break;
-				if(strncmp(read_buffer, current_location, bytes_read)) {
-					return 1;
-				}
-				current_location += bytes_read;
-				current_location_pos += bytes_read;
-				if(bytes_read < bytes_to_read) {
-					break;
-				}
-			} while(current_location_pos < dsbi->dstring->length);
-			if(ferror(fd)) {
-				return -1;
+			if(memcmp(contents + (*position), dsbi->dstring->str, dsbi->dstring->length)) {
+				return 1;
 			}
+			(*position) += dsbi->dstring->length;
 		} else {
-			int res = dstringbuilder_internal_compare_to_file(dsbi->dstringbuilder, fd);
-			if(res != 0) {
-				return res;
+			if(dstringbuilder_internal_compare_to_memory(dsbi->dstringbuilder, contents, position)) {
+				return 1;
 			}
 		}
 	}
 	return 0;
 }
-
-// Returns 1 if different, -1 if error, 0 if the same.
 int dstringbuilder_compare_to_file(dstringbuilder_struct* dstringbuilder, const char* filename) {
-	FILE* fd = fopen(filename, "r");
-	if(!fd) {
-		fprintf(stderr, "Unable to open file %s\n", filename);
+	return dstringbuilder_compare_to_file_at(dstringbuilder, AT_FDCWD, filename);
+}
+int dstringbuilder_compare_to_file_at(dstringbuilder_struct* dstringbuilder, int dir_fd, const char* filename) {
+	dmapped_file_struct mapped_file;
+	if(!dmapped_file_open_at(&mapped_file, dir_fd, filename)) {
 		return -1;
 	}
-	fseek(fd, 0L, SEEK_END);
-	size_t file_size = (size_t) ftell(fd);
-	rewind(fd);
-	if(file_size != dstringbuilder_get_length(dstringbuilder)) {
-		fclose(fd);
-		return 1;
+	int different = 1;
+	if(mapped_file.length == dstringbuilder_get_length(dstringbuilder)) {
+		size_t position = 0;
+		different = dstringbuilder_internal_compare_to_memory(dstringbuilder, mapped_file.contents, &position);
 	}
-	int res = dstringbuilder_internal_compare_to_file(dstringbuilder, fd);
-	fclose(fd);
-	return res;
+	dmapped_file_close(&mapped_file);
+	return different;
+}
+// Appends an iovec for each of the non-empty dstrings in the dstringbuilder,
+// in order, to the darray.
+// Returns NULL on error.
+darray_struct* dstringbuilder_internal_get_iovecs(dstringbuilder_struct* dstringbuilder, darray_struct* iovecs) {
+	for(size_t i = 0; i < dstringbuilder->array.length; i++) {
+		dstringbuilder_internal_struct* dsbi = dstringbuilder_get_internal(dstringbuilder, i);
+
+		if(dsbi->type == DSTRINGBUILDER_INTERNAL_DSTRING) {
+			if(dsbi->dstring->length == 0) continue;
+			struct iovec iov;
+			iov.iov_base = dsbi->dstring->str;
+			iov.iov_len = dsbi->dstring->length;
+			if(!darray_append(iovecs, &iov)) {
+				return NULL;
+			}
+		} else {
+			if(!dstringbuilder_internal_get_iovecs(dsbi->dstringbuilder, iovecs)) {
+				return NULL;
+			}
+		}
+	}
+	return iovecs;
+}
+int dstringbuilder_write_file(dstringbuilder_struct* dstringbuilder, const char* filename) {
+	return dstringbuilder_write_file_at(dstringbuilder, AT_FDCWD, filename);
+}
+int dstringbuilder_write_file_at(dstringbuilder_struct* dstringbuilder, int dir_fd, const char* filename) {
+	darray_struct iovecs;
+	darray_lazy_init(&iovecs, sizeof(struct iovec));
+	if(!dstringbuilder_internal_get_iovecs(dstringbuilder, &iovecs)) {
+		fprintf(stderr, "Error writing file %s, darray append error\n", filename);
+		darray_free(&iovecs);
+		return 0;
+	}
+	int fd = openat(dir_fd, filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if(fd == -1) {
+		fprintf(stderr, "Unable to open file %s\n", filename);
+		darray_free(&iovecs);
+		return 0;
+	}
+	struct iovec* iov = (struct iovec*) iovecs.array;
+	size_t iov_count = iovecs.length;
+	while(iov_count > 0) {
+		ssize_t written = writev(fd, iov, iov_count < IOV_MAX ? (int) iov_count : IOV_MAX);
+		if(written == -1) {
+			if(errno == EINTR) continue;
+			fprintf(stderr, "Error writing file %s\n", filename);
+			close(fd);
+			darray_free(&iovecs);
+			return 0;
+		}
+		// Skip past what was written; a short write may end partway
+		// through a segment.
+		size_t remaining = (size_t) written;
+		while(iov_count > 0 && remaining >= iov->iov_len) {
+			remaining -= iov->iov_len;
+			iov++;
+			iov_count--;
+		}
+		if(remaining > 0) {
+			iov->iov_base = (char*) iov->iov_base + remaining;
+			iov->iov_len -= remaining;
+		}
+	}
+	darray_free(&iovecs);
+	if(close(fd)) {
+		fprintf(stderr, "Error writing file %s\n", filename);
+		return 0;
+	}
+	return 1;
 }
 // Returns 0 if error, 1 otherwise; check did_write to see if the file was
 // actually written.
 int dstringbuilder_write_file_if_different(dstringbuilder_struct* dstringbuilder, const char* filename, int* did_write) {
-	(*did_write) = 0;
+	return dstringbuilder_write_file_if_different_at(dstringbuilder, AT_FDCWD, filename, did_write);
+}
+int dstringbuilder_write_file_if_different_at(dstringbuilder_struct* dstringbuilder, int dir_fd, const char* filename, int* did_write) {
+	(*did_write) = WRITE_IF_DIFFERENT_NOT_WRITTEN;
 
 	int need_to_write = 1;
-	if(!access(filename, F_OK)) {
-		int res = dstringbuilder_compare_to_file(dstringbuilder, filename);
+	int exists = !faccessat(dir_fd, filename, F_OK, 0);
+	if(exists) {
+		int res = dstringbuilder_compare_to_file_at(dstringbuilder, dir_fd, filename);
 		if(res == -1) {
 			return 0;
 		} else {
 			need_to_write = res;
 		}
 		
-	} else {
-		// TODO: Move this to calling code.
-		printf("Creating file %s as it doesn't exist\n", filename);
 	}
 	if(need_to_write) {
-		dstring_struct* formed_dstring = dstringbuilder_form(dstringbuilder);
-		if(formed_dstring == NULL) {
-			fprintf(stderr, "Error writing file %s, couldn't form the dstringbuilder\n", filename);
-			return 0;
-		}
-		if(!dstring_write_file(formed_dstring, filename)) {
+		if(!dstringbuilder_write_file_at(dstringbuilder, dir_fd, filename)) {
 			fprintf(stderr, "Error writing file %s\n", filename);
-			dstring_free(formed_dstring);
-			free(formed_dstring);
 			return 0;
 		}
-		(*did_write) = 1;
-		dstring_free(formed_dstring);
-		free(formed_dstring);
+		(*did_write) = exists ? WRITE_IF_DIFFERENT_UPDATED : WRITE_IF_DIFFERENT_CREATED;
 	}
 	return 1;
 }
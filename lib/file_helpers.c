@@ -11,8 +11,71 @@
 #include <time.h>
 #include <stdarg.h>
 #include "dobjects.h"
+#include "content_bundle.h"
 #include "file_helpers.h"
+#include "io_ring.h"
 
+// How much of each file load_content_files reads in its batch; anything
+// longer is read again in full. Most of the files it's used for are a
+// single line.
+#define CONTENT_FILE_BATCH_READ_SIZE 4096
+
+// The bundle that stands in for the content directory, if any; see
+// use_content_bundle.
+static content_bundle_struct* active_content_bundle = NULL;
+
+void use_content_bundle(content_bundle_struct* bundle) {
+	active_content_bundle = bundle;
+}
+content_bundle_struct* get_content_bundle() {
+	return active_content_bundle;
+}
+// If a content bundle is in use, and path is in the content directory,
+// stores the path relative to the content directory in relative_path
+// (which must have room for PATH_MAX bytes).
+// Returns 1 if the path should be looked up in the bundle, 0 otherwise.
+static int get_content_bundle_path(const char* path, char* relative_path) {
+	return active_content_bundle != NULL
+		&& content_bundle_get_relative_path(active_content_bundle, path, relative_path, PATH_MAX);
+}
+// Filenames are given relative to their base directory with a leading
+// slash (eg "/title"), so that they can be appended to its path; openat()
+// needs them without it.
+static const char* get_relative_filename(const char* filename) {
+	while(filename[0] == '/') {
+		filename++;
+	}
+	return filename;
+}
+int open_directory(const char* path) {
+	int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd == -1) {
+		fprintf(stderr, "Error opening directory %s\n", path);
+	}
+	return fd;
+}
+int open_directory_at(int dir_fd, dstring_struct* base_dir, const char* dir) {
+	if(dir_fd == -1) {
+		if(!dstring_append(base_dir, dir)) {
+			fprintf(stderr, "Error opening directory %s%s, dstring append error\n", base_dir->str, dir);
+			return -1;
+		}
+		int fd = open_directory(base_dir->str);
+		dstring_remove_num_chars_in_text(base_dir, dir);
+		return fd;
+	}
+	int fd = openat(dir_fd, get_relative_filename(dir), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd == -1) {
+		fprintf(stderr, "Error opening directory %s%s\n", base_dir->str, dir);
+	}
+	return fd;
+}
+void close_directory(int* dir_fd) {
+	if((*dir_fd) != -1) {
+		close(*dir_fd);
+		(*dir_fd) = -1;
+	}
+}
 
 
 // Technically, I maybe should return -1 on error, but right now it doesn't.
@@ -21,11 +84,31 @@ int check_if_file_exists(dstring_struct* base_dir, const char* filename) {
 		fprintf(stderr, "Error checking if file %s%s exists, dstring append error\n", base_dir->str, filename);
 		return 0;
 	}
-	int access_failure = access(base_dir->str, F_OK);
+	char relative_path[PATH_MAX];
+	int access_failure;
+	if(get_content_bundle_path(base_dir->str, relative_path)) {
+		access_failure = content_bundle_find(active_content_bundle, relative_path) == NULL;
+	} else {
+		access_failure = access(base_dir->str, F_OK);
+	}
 	dstring_remove_num_chars_in_text(base_dir, filename);
 	return !access_failure;
 }
+int check_if_file_exists_at(int dir_fd, dstring_struct* base_dir, const char* filename) {
+	if(dir_fd == -1) {
+		return check_if_file_exists(base_dir, filename);
+	}
+	return !faccessat(dir_fd, get_relative_filename(filename), F_OK, 0);
+}
 int check_is_dir(const char* dir) {
+	char relative_path[PATH_MAX];
+	if(get_content_bundle_path(dir, relative_path)) {
+		if(relative_path[0] == '\0') {
+			return 1;
+		}
+		content_bundle_entry_struct* entry = content_bundle_find(active_content_bundle, relative_path);
+		return entry != NULL && entry->is_dir;
+	}
 	struct stat buffer;
 	if(stat(dir, &buffer)) {
 		return 0;
@@ -60,6 +143,16 @@ int make_directory(dstring_struct* base_dir, const char* dir) {
 	dstring_remove_num_chars_in_text(base_dir, dir);
 	return !mkdir_failed;
 }
+int make_directory_at(int dir_fd, dstring_struct* base_dir, const char* dir) {
+	if(dir_fd == -1) {
+		return make_directory(base_dir, dir);
+	}
+	if(mkdirat(dir_fd, get_relative_filename(dir), 000755) && errno != EEXIST) {
+		fprintf(stderr, "Unable to create directory %s%s\n", base_dir->str, dir);
+		return 0;
+	}
+	return 1;
+}
 int is_html_filename(const char* filename) {
 	size_t len = strlen(filename);
 	return len >= 6
@@ -72,7 +165,48 @@ int is_html_filename(const char* filename) {
 }
 
 
+// What's needed to turn content bundle entries into directory entries.
+typedef struct bundle_directory_context_struct {
+	dstring_struct* directory;
+	int include_dot_files;
+	unsigned char dirent_types;
+	int (*func)(dstring_struct*, struct dirent*, void*);
+	void* context;
+} bundle_directory_context_struct;
+
+static int apply_function_to_bundle_directory_entry(const char* name, int is_dir, void* context_void_ptr) {
+	bundle_directory_context_struct* context = context_void_ptr;
+	if(!context->include_dot_files && name[0] == '.') {
+		return 1;
+	}
+	struct dirent dir_ent;
+	memset(&dir_ent, 0, sizeof(dir_ent));
+	dir_ent.d_type = is_dir ? DT_DIR : DT_REG;
+	if(!(dir_ent.d_type & context->dirent_types)) {
+		return 1;
+	}
+	if(strlen(name) >= sizeof(dir_ent.d_name)) {
+		fprintf(stderr, "Error applying function to directory entries, name %s in %s is too long\n", name, context->directory->str);
+		return 0;
+	}
+	strcpy(dir_ent.d_name, name);
+	return context->func(context->directory, &dir_ent, context->context);
+}
 int apply_function_to_directory_entries(dstring_struct* directory, int include_dot_files, unsigned char dirent_types, int (*func)(dstring_struct*, struct dirent*, void*), void* context) {
+	char relative_path[PATH_MAX];
+	if(get_content_bundle_path(directory->str, relative_path)) {
+		bundle_directory_context_struct bundle_context;
+		bundle_context.directory = directory;
+		bundle_context.include_dot_files = include_dot_files;
+		bundle_context.dirent_types = dirent_types;
+		bundle_context.func = func;
+		bundle_context.context = context;
+		if(!content_bundle_apply_function_to_directory_entries(active_content_bundle, relative_path, apply_function_to_bundle_directory_entry, &bundle_context)) {
+			fprintf(stderr, "Error applying function to directory entries in %s, in content bundle\n", directory->str);
+			return 0;
+		}
+		return 1;
+	}
 	DIR* dir = opendir(directory->str);
 	if(!dir) {
 		fprintf(stderr, "Error applying function to directory entries, error opening directory %s\n", directory->str);
@@ -98,6 +232,37 @@ int apply_function_to_directory_entries(dstring_struct* directory, int include_d
 	closedir(dir);
 	return !had_error;
 }
+int apply_function_to_directory_entries_at(int dir_fd, dstring_struct* directory, int include_dot_files, unsigned char dirent_types, int (*func)(dstring_struct*, struct dirent*, void*), void* context) {
+	if(dir_fd == -1) {
+		return apply_function_to_directory_entries(directory, include_dot_files, dirent_types, func, context);
+	}
+	// The directory is reopened, as the DIR* takes over its descriptor, and
+	// reading it moves the descriptor's position.
+	int fd = openat(dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR* dir = fd != -1 ? fdopendir(fd) : NULL;
+	if(!dir) {
+		fprintf(stderr, "Error applying function to directory entries, error opening directory %s\n", directory->str);
+		if(fd != -1) {
+			close(fd);
+		}
+		return 0;
+	}
+
+	struct dirent* dir_ent;
+	int had_error = 0;
+
+	while( !had_error && (dir_ent = readdir(dir)) ) {
+		if(!include_dot_files && dir_ent->d_name[0] == '.') {
+			continue;
+		}
+		if(!(dir_ent->d_type & dirent_types)) {
+			continue;
+		}
+		had_error = !func(directory, dir_ent, context);
+	}
+	closedir(dir);
+	return !had_error;
+}
 
 // Calling code must free the array when done.
 darray_struct* get_html_filenames_in_directory(const char* directory) {
@@ -171,6 +336,17 @@ int remove_file_in_directory(dstring_struct* base_dir, const char* filename) {
 	}
 	return unlink_res == 0;
 }
+int remove_file_at(int dir_fd, dstring_struct* base_dir, const char* filename) {
+	if(dir_fd == -1) {
+		return remove_file_in_directory(base_dir, filename);
+	}
+	if(unlinkat(dir_fd, get_relative_filename(filename), 0)) {
+		fprintf(stderr, "Error removing file %s in directory %s, unlink error\n", filename, base_dir->str);
+		return 0;
+	}
+	printf("Removed file %s%s\n", base_dir->str, filename);
+	return 1;
+}
 size_t get_file_extension_start(const char* filename) {
 	size_t len = strlen(filename);
 	if(len <= 2) {
@@ -184,3 +360,115 @@ size_t get_file_extension_start(const char* filename) {
 	}
 	return last_dot;
 }
+int load_content_file(dstring_struct* destination, dstring_struct* base_dir, const char* file, const char* filetype) {
+	if(active_content_bundle == NULL) {
+		return dstring_try_load_file(destination, base_dir, file, filetype);
+	}
+	if(!dstring_append(base_dir, file)) {
+		fprintf(stderr, "Unable to load %s file %s in dir %s, dstring append error\n", filetype, file, base_dir->str);
+		return 0;
+	}
+	char relative_path[PATH_MAX];
+	if(!get_content_bundle_path(base_dir->str, relative_path)) {
+		dstring_remove_num_chars_in_text(base_dir, file);
+		return dstring_try_load_file(destination, base_dir, file, filetype);
+	}
+	content_bundle_entry_struct* entry = content_bundle_find(active_content_bundle, relative_path);
+	if(entry == NULL || entry->is_dir) {
+		fprintf(stderr, "Unable to load %s file %s, not in content bundle\n", filetype, base_dir->str);
+		dstring_remove_num_chars_in_text(base_dir, file);
+		return 0;
+	}
+	dstring_remove_num_chars_in_text(base_dir, file);
+	char* data = content_bundle_get_data(active_content_bundle, entry);
+	// Nothing to copy if the destination is empty; it can just point into
+	// the bundle.
+	if(destination->length == 0 && destination->total_length == 0) {
+		dstring_borrow(destination, data, entry->data_length);
+		return 1;
+	}
+	if(!dstring_append_length(destination, data, entry->data_length)) {
+		fprintf(stderr, "Unable to load %s file %s%s, dstring append error\n", filetype, base_dir->str, file);
+		return 0;
+	}
+	return 1;
+}
+int load_content_file_at(dstring_struct* destination, int dir_fd, dstring_struct* base_dir, const char* file, const char* filetype) {
+	if(dir_fd == -1) {
+		return load_content_file(destination, base_dir, file, filetype);
+	}
+	if(!dstring_read_file_at(destination, dir_fd, get_relative_filename(file))) {
+		fprintf(stderr, "Unable to load %s file %s%s, dstring read file error\n", filetype, base_dir->str, file);
+		return 0;
+	}
+	return 1;
+}
+// Handles a single request of load_content_files, without io_ring.
+// Returns 0 on error.
+static int load_content_file_request(int dir_fd, dstring_struct* base_dir, content_file_request_struct* request, const char* filetype) {
+	request->exists = check_if_file_exists_at(dir_fd, base_dir, request->file);
+	if(!request->exists) {
+		if(request->required) {
+			fprintf(stderr, "Unable to load %s file %s%s, it doesn't exist\n", filetype, base_dir->str, request->file);
+			return 0;
+		}
+		return 1;
+	}
+	if(request->destination != NULL && !load_content_file_at(request->destination, dir_fd, base_dir, request->file, filetype)) {
+		return 0;
+	}
+	return 1;
+}
+int load_content_files(int dir_fd, dstring_struct* base_dir, content_file_request_struct* requests, size_t num_requests, const char* filetype) {
+	// Without an open directory (as with a content bundle), there's nothing
+	// for the batch to look the files up in.
+	io_ring_struct* ring = dir_fd != -1 ? io_ring_get() : NULL;
+	if(ring == NULL) {
+		for(size_t i = 0; i < num_requests; i++) {
+			if(!load_content_file_request(dir_fd, base_dir, &requests[i], filetype)) {
+				return 0;
+			}
+		}
+		return 1;
+	}
+	io_ring_read_struct* reads = malloc(num_requests * sizeof(io_ring_read_struct));
+	char* buffers = malloc(num_requests * CONTENT_FILE_BATCH_READ_SIZE);
+	if(reads == NULL || buffers == NULL) {
+		fprintf(stderr, "Unable to load %s files in dir %s, malloc error\n", filetype, base_dir->str);
+		free(reads);
+		free(buffers);
+		return 0;
+	}
+	for(size_t i = 0; i < num_requests; i++) {
+		reads[i].dir_fd = dir_fd;
+		reads[i].filename = get_relative_filename(requests[i].file);
+		reads[i].buffer = buffers + i * CONTENT_FILE_BATCH_READ_SIZE;
+		reads[i].buffer_size = requests[i].destination != NULL ? CONTENT_FILE_BATCH_READ_SIZE : 0;
+	}
+	int batch_res = io_ring_read_files(ring, reads, num_requests);
+	int res = 1;
+	for(size_t i = 0; i < num_requests && res; i++) {
+		content_file_request_struct* request = &requests[i];
+		ssize_t result = reads[i].result;
+		if(batch_res && (result == -ENOENT || result == -ENOTDIR)) {
+			request->exists = 0;
+			if(request->required) {
+				fprintf(stderr, "Unable to load %s file %s%s, it doesn't exist\n", filetype, base_dir->str, request->file);
+				res = 0;
+			}
+		} else if(batch_res && result >= 0 && (size_t) result < CONTENT_FILE_BATCH_READ_SIZE) {
+			request->exists = 1;
+			if(request->destination != NULL && !dstring_append_length(request->destination, reads[i].buffer, (size_t) result)) {
+				fprintf(stderr, "Unable to load %s file %s%s, dstring append error\n", filetype, base_dir->str, request->file);
+				res = 0;
+			}
+		} else {
+			// Too long for the batch, or some other error; load_content_file_at
+			// reads it in full, and reports the error if there is one.
+			res = load_content_file_request(dir_fd, base_dir, request, filetype);
+		}
+	}
+	free(reads);
+	free(buffers);
+	return res;
+}
@@ -1,20 +1,108 @@
 #include "dobjects.h"
+#include "file_helpers.h"
 #include "html_components.h"
+#include "minify.h"
+
+// The built-in page templates, used when the components directory doesn't
+// have its own.
+static const char* default_head_template =
+	"{{?author}}<meta name=\"author\" content=\"{{author}}\">\n{{/author}}"
+	"{{?keywords}}<meta name=\"keywords\" content=\"{{keywords}}\">\n{{/keywords}}"
+	"{{?description}}<meta name=\"description\" content=\"{{description}}\">\n{{/description}}"
+	"<title>{{title}}</title>\n"
+	"<link rel='canonical' href='https://{{host}}/{{url_path}}'>\n"
+	"</head>";
+static const char* default_post_template =
+	"<article>\n<header>\n<h1>{{title}}</h1>\n"
+	"{{previous_readings}}</header>\n"
+	"{{content}}"
+	"{{next_readings}}"
+	"<footer class=\"flexcontainer postfooter\">\n<div>\n"
+	"<div>Series: <a href=\"/series/{{series_name}}\">{{series_title}}</a></div>\n"
+	"<div>Author: @{{author}}</div>\n"
+	"<div>Tags: {{tag_links}}</div>\n</div>\n"
+	"<div>\n<div>Written: {{written_date}}</div>\n"
+	"{{?updated_at}}<div>Updated: {{updated_at}}</div>\n{{/updated_at}}"
+	"</div>\n</footer>\n</article>\n</main>\n";
+static const char* default_tag_card_template =
+	"<div><h3><a href='/posts/{{folder_name}}'>{{title}}</a></h3>\n<p>{{long_description}}</p>\n</div>\n";
+static const char* default_series_card_template =
+	"<div><h3><a href=\"/posts/{{folder_name}}\">{{title}}</a></h3>\n<p>\n{{long_description}}</p></div>\n";
+
+// The names of the templates' fields, in the order of their *_TEMPLATE_*
+// indexes.
+static const char* const head_template_fields[] = { "author", "keywords", "description", "title", "host", "url_path" };
+static const char* const post_template_fields[] = { "title", "previous_readings", "content", "next_readings", "series_name", "series_title", "author", "tag_links", "written_date", "updated_at" };
+static const char* const card_template_fields[] = { "folder_name", "title", "long_description" };
 
 void html_components_free(html_components_struct* html_components) {
 	dstring_free(&html_components->header);
 	dstring_free(&html_components->footer);
 	dstring_free(&html_components->trailer);
+	dstring_free(&html_components->head_template_source);
+	dstring_free(&html_components->post_template_source);
+	dstring_free(&html_components->tag_card_template_source);
+	dstring_free(&html_components->series_card_template_source);
+	page_template_free(&html_components->head_template);
+	page_template_free(&html_components->post_template);
+	page_template_free(&html_components->tag_card_template);
+	page_template_free(&html_components->series_card_template);
 }
 void html_components_init(html_components_struct* html_components) {
 	dstring_lazy_init(&html_components->header);
 	dstring_lazy_init(&html_components->footer);
 	dstring_lazy_init(&html_components->trailer);
+	dstring_lazy_init(&html_components->head_template_source);
+	dstring_lazy_init(&html_components->post_template_source);
+	dstring_lazy_init(&html_components->tag_card_template_source);
+	dstring_lazy_init(&html_components->series_card_template_source);
+	page_template_init(&html_components->head_template);
+	page_template_init(&html_components->post_template);
+	page_template_init(&html_components->tag_card_template);
+	page_template_init(&html_components->series_card_template);
+}
+// Loads the template file into source, if it's there.
+// Returns 0 on error.
+int html_components_load_template_source(dstring_struct* source, dstring_struct* base_dir, const char* file) {
+	if(!check_if_file_exists(base_dir, file)) {
+		return 1;
+	}
+	return load_content_file(source, base_dir, file, "page template");
 }
 html_components_struct* html_components_load(html_components_struct* html_components, dstring_struct* base_dir) {
-	if(!dstring_try_load_file(&html_components->header, base_dir, "/header.html", "HTML component")
-		|| !dstring_try_load_file(&html_components->footer, base_dir, "/footer.html", "HTML component")
-		|| !dstring_try_load_file(&html_components->trailer, base_dir, "/trailer.html", "HTML component")) {
+	if(!load_content_file(&html_components->header, base_dir, "/header.html", "HTML component")
+		|| !load_content_file(&html_components->footer, base_dir, "/footer.html", "HTML component")
+		|| !load_content_file(&html_components->trailer, base_dir, "/trailer.html", "HTML component")
+		|| !html_components_load_template_source(&html_components->head_template_source, base_dir, "/head-template.html")
+		|| !html_components_load_template_source(&html_components->post_template_source, base_dir, "/post-template.html")
+		|| !html_components_load_template_source(&html_components->tag_card_template_source, base_dir, "/tag-card-template.html")
+		|| !html_components_load_template_source(&html_components->series_card_template_source, base_dir, "/series-card-template.html")) {
+		return NULL;
+	}
+	return html_components;
+}
+// Compiles a template from its source, or from the built-in template if
+// there's no source.
+// Returns 0 on error.
+int html_components_compile_template(page_template_struct* page_template, const char* name, dstring_struct* source, const char* default_source, const char* const* field_names, size_t num_fields) {
+	page_template_free(page_template);
+	page_template_init(page_template);
+	return page_template_compile(page_template, name, source->length > 0 ? source->str : default_source, field_names, num_fields) != NULL;
+}
+html_components_struct* html_components_compile_templates(html_components_struct* html_components) {
+	if(!html_components_compile_template(&html_components->head_template, "head-template.html", &html_components->head_template_source, default_head_template, head_template_fields, HEAD_TEMPLATE_NUM_FIELDS)
+		|| !html_components_compile_template(&html_components->post_template, "post-template.html", &html_components->post_template_source, default_post_template, post_template_fields, POST_TEMPLATE_NUM_FIELDS)
+		|| !html_components_compile_template(&html_components->tag_card_template, "tag-card-template.html", &html_components->tag_card_template_source, default_tag_card_template, card_template_fields, CARD_TEMPLATE_NUM_FIELDS)
+		|| !html_components_compile_template(&html_components->series_card_template, "series-card-template.html", &html_components->series_card_template_source, default_series_card_template, card_template_fields, CARD_TEMPLATE_NUM_FIELDS)) {
+		return NULL;
+	}
+	return html_components;
+}
+html_components_struct* html_components_minify(html_components_struct* html_components) {
+	if(!minify_replace(&html_components->header, minify_html)
+		|| !minify_replace(&html_components->footer, minify_html)
+		|| !minify_replace(&html_components->trailer, minify_html)) {
+		fprintf(stderr, "Error minifying HTML components\n");
 		return NULL;
 	}
 	return html_components;
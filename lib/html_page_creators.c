@@ -1,5 +1,6 @@
 #include "dobjects.h"
 #include "html_page_creators.h"
+#include "precompress.h"
 
 #define GENMODE_POST 1
 #define GENMODE_STATIC 2
@@ -10,65 +11,174 @@ typedef struct page_generation_settings_struct {
 	char* description;
 	char* title;
 	char* author;
-	char* canonical_url;
 	char* url_path;
 	int has_code;
+
+	// The hash of everything that the page is generated from; see
+	// page_is_current.
+	uint64_t input_hash;
 } page_generation_settings_struct;
 
 
-int create_page(site_content_struct* site_content, dstringbuilder_struct* page_content, theme_struct* theme, page_generation_settings_struct* page_generation_settings) {
+// Prints out a message about a generated page, or, if log isn't NULL,
+// appends it to log so that calling code can print it later.
+// Returns 0 on error.
+int page_log_printf(dstring_struct* log, const char* format, ...) {
+	va_list argptr;
+	va_start(argptr, format);
+	int res = 1;
+	if(log == NULL) {
+		vprintf(format, argptr);
+	} else if(!dstring_append_vaprintf(log, format, argptr)) {
+		fprintf(stderr, "Error logging page generation, dstring append error\n");
+		res = 0;
+	}
+	va_end(argptr);
+	return res;
+}
+// Hashes everything that goes into every page besides its own content: the
+// HTML components, the templates, and each theme's page segments.
+void calculate_page_layout_hash(site_content_struct* site_content) {
+	dhash_struct dhash;
+	dhash_init(&dhash);
+	dhash_append_dstring(&dhash, &site_content->html_components.header);
+	dhash_append_dstring(&dhash, &site_content->html_components.footer);
+	dhash_append_dstring(&dhash, &site_content->html_components.trailer);
+	page_template_hash(&site_content->html_components.head_template, &dhash);
+	page_template_hash(&site_content->html_components.post_template, &dhash);
+	page_template_hash(&site_content->html_components.tag_card_template, &dhash);
+	page_template_hash(&site_content->html_components.series_card_template, &dhash);
+	dhash_append_dstring(&dhash, &site_content->bright_theme.host);
+	// So that pages are checked for missing siblings when formats are added
+	dhash_append_uint64(&dhash, (uint64_t) site_content->precompress_formats);
+	theme_struct* themes[] = { &site_content->bright_theme, &site_content->dark_theme };
+	for(size_t i = 0; i < 2; i++) {
+		dhash_append_dstring(&dhash, &themes[i]->html_base_dir);
+		dhash_append_dstring(&dhash, &themes[i]->page_prelude);
+		dhash_append_dstring(&dhash, &themes[i]->code_page_prelude);
+		dhash_append_dstring(&dhash, &themes[i]->page_postlude);
+		dhash_append_uint64(&dhash, (uint64_t) (themes[i]->css_pruner != NULL));
+	}
+	site_content->page_layout_hash = dhash_get(&dhash);
+}
+// Checks the build manifest to see if every version of the page was
+// already generated from the same inputs (input_hash), in which case the
+// page doesn't need to be created at all.
+// Returns 1 if the page is up to date, 0 otherwise.
+int page_is_current(site_content_struct* site_content, const char* filename, uint64_t input_hash) {
+	if(site_content->build_manifest == NULL) {
+		return 0;
+	}
 	dstring_struct dest_filename;
-	dstringbuilder_struct page_builder;
-
 	dstring_lazy_init(&dest_filename);
-	dstringbuilder_init(&page_builder);
-
-#define CREATE_PAGE_APPEND(appending, err_message) if(!dstringbuilder_append(&page_builder, appending)) { fprintf(stderr, "Error creating page, couldn't append %s\n", err_message); dstringbuilder_free(&page_builder); return PAGE_GENERATION_FAILURE; }
-#define CREATE_PAGE_APPEND_DSTRING(appending, err_message) if(!dstringbuilder_append_dstring(&page_builder, appending)) { fprintf(stderr, "Error creating page, couldn't append %s\n", err_message); dstringbuilder_free(&page_builder); return PAGE_GENERATION_FAILURE; }
-#define CREATE_PAGE_APPEND_DSTRINGBUILDER(appending, err_message) if(!dstringbuilder_append_dstringbuilder(&page_builder, appending)) { fprintf(stderr, "Error creating page, couldn't append %s\n", err_message); dstringbuilder_free(&page_builder); return PAGE_GENERATION_FAILURE; }
-#define CREATE_PAGE_PRINTF_APPEND(err_message, format, args...) if(!dstringbuilder_append_printf(&page_builder, format, args)) { fprintf(stderr, "Error creating page, couldn't append %s\n", err_message); dstringbuilder_free(&page_builder); return PAGE_GENERATION_FAILURE; }
-	CREATE_PAGE_APPEND_DSTRING(&site_content->html_components.header, "header")
-	if(page_generation_settings->author != NULL) {
-		CREATE_PAGE_PRINTF_APPEND("author header", "<meta name=\"author\" content=\"%s\">\n", page_generation_settings->author)
+	int is_current = 1;
+	theme_struct* themes[] = { &site_content->bright_theme, &site_content->dark_theme };
+	for(size_t i = 0; i < site_content->num_themes && is_current; i++) {
+		dstring_free(&dest_filename);
+		if(!dstring_append_printf(&dest_filename, "%s/%s", themes[i]->html_base_dir.str, filename)
+			|| !build_manifest_is_current(site_content->build_manifest, themes[i]->html_base_dir_fd, themes[i]->html_base_dir.length, dest_filename.str, input_hash)) {
+			// An append error just means the page gets generated.
+			is_current = 0;
+		}
 	}
-	if(page_generation_settings->keywords != NULL) {
-		CREATE_PAGE_PRINTF_APPEND("keywords header", "<meta name=\"keywords\" content=\"%s\">\n", page_generation_settings->keywords)
+	dstring_free(&dest_filename);
+	return is_current;
+}
+// Appends the parts of a recommended reading list that show up on a post.
+void hash_recommended_readings(dhash_struct* dhash, darray_struct* recommendations) {
+	for(size_t i = 0; i < recommendations->length; i++) {
+		post_struct* recommended_post = post_get_from_darray_of_post_pointers(recommendations, i);
+		dhash_append_uint64(dhash, (uint64_t) recommended_post->can_publish);
+		dhash_append_dstring(dhash, &recommended_post->folder_name);
+		dhash_append_dstring(dhash, &recommended_post->title);
 	}
-	if(page_generation_settings->description != NULL) {
-		CREATE_PAGE_PRINTF_APPEND("description header", "<meta name=\"description\" content=\"%s\">\n", page_generation_settings->description)
+	dhash_append_uint64(dhash, (uint64_t) recommendations->length);
+}
+// Calculates the hash of everything that a post page is generated from.
+// This must cover everything that create_post_page uses.
+uint64_t get_post_input_hash(site_content_struct* site_content, post_struct* post) {
+	dhash_struct dhash;
+	dhash_init(&dhash);
+	dhash_append_uint64(&dhash, site_content->page_layout_hash);
+	dhash_append_string(&dhash, "post");
+	dhash_append_dstring(&dhash, &post->folder_name);
+	dhash_append_dstring(&dhash, &post->title);
+	// The content isn't loaded yet; its version stands in for it
+	if(post->content_version != 0) {
+		dhash_append_uint64(&dhash, post->content_version);
+	} else {
+		dhash_append_dstring(&dhash, &post->content);
 	}
-	CREATE_PAGE_PRINTF_APPEND("title header", "<title>%s</title>\n", page_generation_settings->title)
-	
-	CREATE_PAGE_PRINTF_APPEND("canonical header", "<link rel='canonical' href='%s'>\n", page_generation_settings->canonical_url)
-
-	CREATE_PAGE_APPEND("</head>", "end head")
-
-	CREATE_PAGE_APPEND("<style>", "style section")
-	CREATE_PAGE_APPEND_DSTRING(&theme->main_css, "main css")
-	if(page_generation_settings->has_code) {
-		CREATE_PAGE_APPEND_DSTRING(&theme->syntax_highlighting_css, "syntax highlighting css")
+	dhash_append_dstring(&dhash, &post->author);
+	dhash_append_dstring(&dhash, &post->short_description);
+	dhash_append_dstring(&dhash, &post->series_name);
+	dhash_append_dstring(&dhash, &post->series->title);
+	dhash_append_dstring(&dhash, &post->written_date);
+	dhash_append_dstring(&dhash, &post->updated_at);
+	dhash_append_uint64(&dhash, (uint64_t) post->has_code);
+	for(size_t i = 0; i < post->tags.length; i++) {
+		dhash_append_string(&dhash, *((const char**) darray_get_elem(&post->tags, i)));
 	}
-	CREATE_PAGE_APPEND("</style>", "end style section")
-	
-	CREATE_PAGE_APPEND("<body>", "body begin")
-
-	// Page header
-	// TODO: I should probably have a setting that controls this, instead of just using the hostname.
-	// I only have it using the hostname so that it's no longer hard-coded to my site name.
-	// This will require passing in the configuration as parameter
-	// to every creation function, something that I removed previously... Oh well, it needs to be done.
-	CREATE_PAGE_PRINTF_APPEND("page header", "<header class='nheader'>\n<a class='leftfloat' href='/'>%s</a> <a class='rightfloat' href='https://%s/%s'>[%s]</a>\n</header>\n", theme->host.str, theme->alt_theme->host.str, page_generation_settings->url_path, theme->alt_theme->name.str)
-
-	CREATE_PAGE_APPEND_DSTRINGBUILDER(page_content, "page content")
-	CREATE_PAGE_APPEND_DSTRING(&site_content->html_components.footer, "page footer")
-	CREATE_PAGE_APPEND("</body>", "end body")
-	CREATE_PAGE_APPEND_DSTRING(&site_content->html_components.trailer, "page trailer")
+	dhash_append_uint64(&dhash, (uint64_t) post->tags.length);
+	hash_recommended_readings(&dhash, &post->suggested_prev_reading);
+	hash_recommended_readings(&dhash, &post->suggested_next_reading);
+	return dhash_get(&dhash);
+}
+// Calculates the hash of everything that a misc page is generated from.
+uint64_t get_misc_page_input_hash(site_content_struct* site_content, misc_page_struct* misc_page) {
+	dhash_struct dhash;
+	dhash_init(&dhash);
+	dhash_append_uint64(&dhash, site_content->page_layout_hash);
+	dhash_append_string(&dhash, "misc_page");
+	dhash_append_dstring(&dhash, &misc_page->filename);
+	dhash_append_dstring(&dhash, &misc_page->title);
+	dhash_append_dstring(&dhash, &misc_page->description);
+	// The same as hashing the whole content as one dstring
+	dhash_append_bytes(&dhash, misc_page->content.str, misc_page->content.length);
+	dhash_append_dstringbuilder(&dhash, &misc_page->content_builder);
+	dhash_append_bytes(&dhash, "", 1);
+	return dhash_get(&dhash);
+}
+// Appends the theme's pruned styles for a page with page_selectors.
+// Returns 0 on error.
+int append_pruned_styles(dstringbuilder_struct* page_builder, theme_struct* theme, css_page_selectors_struct* page_selectors, int has_code) {
+	dstring_struct* css = css_pruner_get_css(theme->css_pruner, page_selectors, has_code);
+	return css != NULL
+		&& dstringbuilder_append_dstring(page_builder, &theme->style_start)
+		&& dstringbuilder_append_dstring(page_builder, css)
+		&& dstringbuilder_append(page_builder, "</style>");
+}
+// Appends the theme's styles and the start of its page header: the whole
+// prelude, or if the CSS is pruned, just what page_selectors can use.
+// Returns 0 on error.
+int append_page_prelude(dstringbuilder_struct* page_builder, theme_struct* theme, css_page_selectors_struct* page_selectors, int has_code) {
+	if(theme->css_pruner == NULL) {
+		return dstringbuilder_append_dstring(page_builder, has_code ? &theme->code_page_prelude : &theme->page_prelude) != NULL;
+	}
+	return append_pruned_styles(page_builder, theme, page_selectors, has_code)
+		&& (theme->color_scheme == NULL || append_pruned_styles(page_builder, theme->alt_theme, page_selectors, has_code))
+		&& dstringbuilder_append_dstring(page_builder, &theme->page_header);
+}
+// Creates a single theme's version of a page, made up of page_head (the
+// theme-independent <head> contents), the theme's prelude, the link to the
+// alt-themed page, the theme's postlude, and page_body (the
+// theme-independent rest of the page).
+int create_page(site_content_struct* site_content, theme_struct* theme, dstringbuilder_struct* page_head, dstringbuilder_struct* page_body, css_page_selectors_struct* page_selectors, page_generation_settings_struct* page_generation_settings, dstring_struct* log) {
+	dstring_struct dest_filename;
+	dstringbuilder_struct page_builder;
 
-#undef CREATE_PAGE_APPEND
-#undef CREATE_PAGE_APPEND_DSTRING
-#undef CREATE_PAGE_APPEND_DSTRINGBUILDER
-#undef CREATE_PAGE_PRINTF_APPEND
+	dstring_lazy_init(&dest_filename);
+	dstringbuilder_init(&page_builder);
 
+	if(!dstringbuilder_append_dstringbuilder(&page_builder, page_head)
+		|| !append_page_prelude(&page_builder, theme, page_selectors, page_generation_settings->has_code)
+		|| !dstringbuilder_append(&page_builder, page_generation_settings->url_path)
+		|| !dstringbuilder_append_dstring(&page_builder, &theme->page_postlude)
+		|| !dstringbuilder_append_dstringbuilder(&page_builder, page_body)) {
+		fprintf(stderr, "Error creating page, dstringbuilder append error\n");
+		dstringbuilder_free(&page_builder);
+		return PAGE_GENERATION_FAILURE;
+	}
 	if(!dstring_append_printf(&dest_filename, "%s/%s", theme->html_base_dir.str, page_generation_settings->filename)) {
 		fprintf(stderr, "Error generating page, dstring append error\n");
 		dstringbuilder_free(&page_builder);
@@ -76,9 +186,20 @@ int create_page(site_content_struct* site_content, dstringbuilder_struct* page_c
 		return PAGE_GENERATION_FAILURE;
 	}
 	int did_write;
-	int write_res = dstringbuilder_write_file_if_different(&page_builder, dest_filename.str, &did_write);
+	int write_res = build_manifest_write_file_if_different(site_content->build_manifest, &page_builder, theme->html_base_dir_fd, theme->html_base_dir.length, dest_filename.str, page_generation_settings->input_hash, &did_write);
 	if(!write_res) {
 		fprintf(stderr, "Error generating page, couldn't write file %s\n", dest_filename.str);
+	} else if(did_write == WRITE_IF_DIFFERENT_CREATED) {
+		write_res = page_log_printf(log, "Creating file %s as it doesn't exist\n", dest_filename.str);
+	}
+	if(write_res) {
+		// The page's filename is relative to the held open directory
+		int dir_fd = theme->html_base_dir_fd;
+		write_res = precompress_update_siblings_at(&page_builder,
+				dir_fd != -1 ? dir_fd : AT_FDCWD,
+				dir_fd != -1 ? page_generation_settings->filename : dest_filename.str,
+				site_content->precompress_formats,
+				did_write != WRITE_IF_DIFFERENT_NOT_WRITTEN);
 	}
 	dstringbuilder_free(&page_builder);
 	dstring_free(&dest_filename);
@@ -93,59 +214,123 @@ int create_page(site_content_struct* site_content, dstringbuilder_struct* page_c
 		}
 	}
 }
-int create_page_wrapper(site_content_struct* site_content, dstringbuilder_struct* page_content, page_generation_settings_struct* page_generation_settings, int is_post) {
-	dstring_struct canonical_url;
-	dstringbuilder_struct page_builder;
+// Borrows setting into dstring, for a template's field value.
+// Returns dstring, or NULL if the setting isn't set.
+dstring_struct* borrow_page_setting(dstring_struct* dstring, char* setting) {
+	if(setting == NULL) {
+		return NULL;
+	}
+	dstring_borrow(dstring, setting, strlen(setting));
+	return dstring;
+}
+// Builds the parts of the page that are the same for both themes, and then
+// creates the bright and dark versions of the page from them.
+int create_page_wrapper(site_content_struct* site_content, dstringbuilder_struct* page_content, page_generation_settings_struct* page_generation_settings, int is_post, dstring_struct* log) {
+	dstringbuilder_struct page_head;
+	dstringbuilder_struct page_body;
 
-	dstring_lazy_init(&canonical_url);
-	dstringbuilder_init(&page_builder);
+	dstringbuilder_init(&page_head);
+	dstringbuilder_init(&page_body);
 
-	if(!dstringbuilder_append(&page_builder, "<main")
-		|| !dstringbuilder_append(&page_builder, is_post ? " class='post'>\n" : ">\n")
-		|| !dstringbuilder_append_dstringbuilder(&page_builder, page_content)
-		|| !dstringbuilder_append(&page_builder, "</main>\n")) {
-		fprintf(stderr, "Error creating page, dstring append error\n");
-		dstringbuilder_free(&page_builder);
-		dstring_free(&canonical_url);
-		return PAGE_GENERATION_FAILURE;
-	}
-	if(!dstring_append_printf(&canonical_url, "https://%s/%s", site_content->bright_theme.host.str, page_generation_settings->url_path)) {
-		fprintf(stderr, "Error creating page, canonical url dstring append error\n");
-		dstringbuilder_free(&page_builder);
-		dstring_free(&canonical_url);
-		return PAGE_GENERATION_FAILURE;
+#define CREATE_PAGE_FAIL(err_message) { fprintf(stderr, "Error creating page, couldn't append %s\n", err_message); dstringbuilder_free(&page_head); dstringbuilder_free(&page_body); return PAGE_GENERATION_FAILURE; }
+#define CREATE_PAGE_APPEND(builder, appending, err_message) if(!dstringbuilder_append(builder, appending)) CREATE_PAGE_FAIL(err_message)
+#define CREATE_PAGE_APPEND_DSTRING(builder, appending, err_message) if(!dstringbuilder_append_dstring(builder, appending)) CREATE_PAGE_FAIL(err_message)
+#define CREATE_PAGE_APPEND_DSTRINGBUILDER(builder, appending, err_message) if(!dstringbuilder_append_dstringbuilder(builder, appending)) CREATE_PAGE_FAIL(err_message)
+	CREATE_PAGE_APPEND_DSTRING(&page_head, &site_content->html_components.header, "header")
+
+	// The values borrow the settings, which outlive page_head.
+	dstring_struct author;
+	dstring_struct keywords;
+	dstring_struct description;
+	dstring_struct title;
+	dstring_struct url_path;
+	dstring_struct* values[HEAD_TEMPLATE_NUM_FIELDS];
+	values[HEAD_TEMPLATE_AUTHOR] = borrow_page_setting(&author, page_generation_settings->author);
+	values[HEAD_TEMPLATE_KEYWORDS] = borrow_page_setting(&keywords, page_generation_settings->keywords);
+	values[HEAD_TEMPLATE_DESCRIPTION] = borrow_page_setting(&description, page_generation_settings->description);
+	values[HEAD_TEMPLATE_TITLE] = borrow_page_setting(&title, page_generation_settings->title);
+	// Both versions of the page point at the bright one as canonical.
+	values[HEAD_TEMPLATE_HOST] = &site_content->bright_theme.host;
+	values[HEAD_TEMPLATE_URL_PATH] = borrow_page_setting(&url_path, page_generation_settings->url_path);
+	if(!page_template_render(&site_content->html_components.head_template, values, &page_head)) CREATE_PAGE_FAIL("head")
+
+	// The styles and page header come from the theme's prelude/postlude.
+
+	CREATE_PAGE_APPEND(&page_body, is_post ? "<main class='post'>\n" : "<main>\n", "main begin")
+	CREATE_PAGE_APPEND_DSTRINGBUILDER(&page_body, page_content, "page content")
+	CREATE_PAGE_APPEND(&page_body, "</main>\n", "main end")
+	CREATE_PAGE_APPEND_DSTRING(&page_body, &site_content->html_components.footer, "page footer")
+	CREATE_PAGE_APPEND(&page_body, "</body>", "end body")
+	CREATE_PAGE_APPEND_DSTRING(&page_body, &site_content->html_components.trailer, "page trailer")
+
+#undef CREATE_PAGE_FAIL
+#undef CREATE_PAGE_APPEND
+#undef CREATE_PAGE_APPEND_DSTRING
+#undef CREATE_PAGE_APPEND_DSTRINGBUILDER
+
+	// When the CSS is pruned, the page is scanned for the selectors it has;
+	// they're the same for both themes.
+	css_page_selectors_struct page_selectors;
+	css_page_selectors_init(&page_selectors);
+	if(site_content->bright_theme.css_pruner != NULL) {
+		if(!css_page_selectors_scan_dstringbuilder(&page_selectors, &page_head)
+			|| !css_page_selectors_scan_dstringbuilder(&page_selectors, &page_body)) {
+			fprintf(stderr, "Error creating page %s, couldn't scan it for CSS selectors\n", page_generation_settings->url_path);
+			css_page_selectors_free(&page_selectors);
+			dstringbuilder_free(&page_head);
+			dstringbuilder_free(&page_body);
+			return PAGE_GENERATION_FAILURE;
+		}
+		css_page_selectors_finish(&page_selectors);
 	}
-	page_generation_settings->canonical_url = canonical_url.str;
-	int bright_res = create_page(site_content, &page_builder, &site_content->bright_theme, page_generation_settings);
+
+	int bright_res = create_page(site_content, &site_content->bright_theme, &page_head, &page_body, &page_selectors, page_generation_settings, log);
 	if(!bright_res) {
-		fprintf(stderr, "Error creating bright version of page %s\n", canonical_url.str);
-		dstringbuilder_free(&page_builder);
-		dstring_free(&canonical_url);
+		fprintf(stderr, "Error creating bright version of page %s\n", page_generation_settings->url_path);
+		css_page_selectors_free(&page_selectors);
+		dstringbuilder_free(&page_head);
+		dstringbuilder_free(&page_body);
 		return PAGE_GENERATION_FAILURE;
 	}
 	if(bright_res == PAGE_GENERATION_UPDATED) {
-		printf("Updated bright page %s\n", page_generation_settings->filename);
-	}
-	int dark_res = create_page(site_content, &page_builder, &site_content->dark_theme, page_generation_settings);
-	if(!dark_res) {
-		fprintf(stderr, "Error creating dark version of page %s\n", canonical_url.str);
-		dstringbuilder_free(&page_builder);
-		dstring_free(&canonical_url);
-		return PAGE_GENERATION_FAILURE;
+		if(!page_log_printf(log, "Updated bright page %s\n", page_generation_settings->filename)) {
+			css_page_selectors_free(&page_selectors);
+			dstringbuilder_free(&page_head);
+			dstringbuilder_free(&page_body);
+			return PAGE_GENERATION_FAILURE;
+		}
 	}
-	if(dark_res == PAGE_GENERATION_UPDATED) {
-		printf("Updated dark page %s\n", page_generation_settings->filename);
+	// When the themes are combined, the bright version of the page is the
+	// only one.
+	int dark_res = PAGE_GENERATION_NO_UPDATE;
+	if(site_content->num_themes == 2) {
+		dark_res = create_page(site_content, &site_content->dark_theme, &page_head, &page_body, &page_selectors, page_generation_settings, log);
+		if(!dark_res) {
+			fprintf(stderr, "Error creating dark version of page %s\n", page_generation_settings->url_path);
+			css_page_selectors_free(&page_selectors);
+			dstringbuilder_free(&page_head);
+			dstringbuilder_free(&page_body);
+			return PAGE_GENERATION_FAILURE;
+		}
+		if(dark_res == PAGE_GENERATION_UPDATED) {
+			if(!page_log_printf(log, "Updated dark page %s\n", page_generation_settings->filename)) {
+				css_page_selectors_free(&page_selectors);
+				dstringbuilder_free(&page_head);
+				dstringbuilder_free(&page_body);
+				return PAGE_GENERATION_FAILURE;
+			}
+		}
 	}
-	page_generation_settings->canonical_url = NULL;
-	dstring_free(&canonical_url);
-	dstringbuilder_free(&page_builder);
+	css_page_selectors_free(&page_selectors);
+	dstringbuilder_free(&page_head);
+	dstringbuilder_free(&page_body);
 	if(bright_res > dark_res) {
 		return bright_res;
 	} else {
 		return dark_res;
 	}
 }
-int create_misc_page(site_content_struct* site_content, misc_page_struct* misc_page) {
+int create_misc_page(site_content_struct* site_content, misc_page_struct* misc_page, dstring_struct* log) {
 	// The URL path is derived from the filename by stripping out the file extension
 	char* url_path = strdup(misc_page->filename.str);
 	if(url_path == NULL) {
@@ -162,15 +347,21 @@ int create_misc_page(site_content_struct* site_content, misc_page_struct* misc_p
 	page_generation_settings.url_path = url_path;
 	page_generation_settings.has_code = 0;
 	page_generation_settings.description = misc_page->description.str;
+	page_generation_settings.input_hash = get_misc_page_input_hash(site_content, misc_page);
+	if(page_is_current(site_content, misc_page->filename.str, page_generation_settings.input_hash)) {
+		free(url_path);
+		return PAGE_GENERATION_NO_UPDATE;
+	}
 
 	dstringbuilder_struct page_builder;
 	dstringbuilder_init(&page_builder);
-	if(!dstringbuilder_append_dstring(&page_builder, &misc_page->content)) {
+	if(!dstringbuilder_append_dstring(&page_builder, &misc_page->content)
+		|| !dstringbuilder_append_dstringbuilder(&page_builder, &misc_page->content_builder)) {
 		fprintf(stderr, "Error creating page %s, dstringbuilder append dstring error\n", url_path);
 		dstringbuilder_free(&page_builder);
 		return PAGE_GENERATION_FAILURE;
 	}
-	int create_page_res = create_page_wrapper(site_content, &page_builder, &page_generation_settings, 0);
+	int create_page_res = create_page_wrapper(site_content, &page_builder, &page_generation_settings, 0, log);
 	if(!create_page_res) {
 		fprintf(stderr, "Error creating page %s, page create error\n", url_path);
 	}
@@ -178,138 +369,117 @@ int create_misc_page(site_content_struct* site_content, misc_page_struct* misc_p
 	free(url_path);
 	return create_page_res;
 }
-int create_post_page_append_recommended_readings(dstring_struct* page, darray_struct* recommendations, const char* recommendation_type) {
+// Appends a post's list of recommended readings, as it shows up on the
+// post, to readings; nothing if none of them are published.
+// Returns 0 on error.
+int create_post_page_append_recommended_readings(dstring_struct* readings, darray_struct* recommendations, const char* recommendation_type) {
 	int num_posts_added = 0;
 	for(size_t i = 0; i < recommendations->length; i++) {
 		post_struct* recommended_post = post_get_from_darray_of_post_pointers(recommendations, i);
 		if(!recommended_post->can_publish) continue;
+		int separator_res;
 		if(num_posts_added == 0) {
-			if(!dstring_append_printf(page, "<div class=\"s_p_reading\">Suggested %s reading: ", recommendation_type)) {
-				fprintf(stderr, "Error appending post recommendations\n");
-				return 0;
-			}
-		}
-		if(num_posts_added > 0) {
-			if(!dstring_append(page, ", ")) {
-				fprintf(stderr, "Error appending post recommendations\n");
-				return 0;
-			}
+			separator_res = dstring_append(readings, "<div class=\"s_p_reading\">Suggested ")
+				&& dstring_append(readings, recommendation_type)
+				&& dstring_append(readings, " reading: ");
+		} else {
+			separator_res = dstring_append(readings, ", ") != NULL;
 		}
-		if(!dstring_append_printf(page, "<a href=\"/posts/%s\">%s</a>",
-					recommended_post->folder_name.str,
-					recommended_post->title.str)) {
+		if(!separator_res
+			|| !dstring_append(readings, "<a href=\"/posts/")
+			|| !dstring_append_length(readings, recommended_post->folder_name.str, recommended_post->folder_name.length)
+			|| !dstring_append(readings, "\">")
+			|| !dstring_append_length(readings, recommended_post->title.str, recommended_post->title.length)
+			|| !dstring_append(readings, "</a>")) {
 			fprintf(stderr, "Error appending post recommendations\n");
 			return 0;
 		}
 		num_posts_added++;
 	}
 	if(num_posts_added > 0) {
-		if(!dstring_append(page, "</div>")) {
+		if(!dstring_append(readings, "</div>")) {
 			fprintf(stderr, "Error appending post recommendations\n");
 			return 0;
 		}
 	}
 	return 1;
 }
-int create_post_page(site_content_struct* site_content, post_struct* post) {
+// Appends a post's tags to tags (separated by commas, for the keywords
+// header) and to tag_links (as links to the tag pages).
+// Returns 0 on error.
+int create_post_page_append_tags(post_struct* post, dstring_struct* tags, dstring_struct* tag_links) {
+	for(size_t i = 0; i < post->tags.length; i++) {
+		const char* tag = *((const char**) darray_get_elem(&post->tags, i));
+		if((i > 0 && (!dstring_append(tags, ",") || !dstring_append(tag_links, ", ")))
+			|| !dstring_append(tags, tag)
+			|| !dstring_append(tag_links, "<a href=\"/tags/")
+			|| !dstring_append(tag_links, tag)
+			|| !dstring_append(tag_links, "\">")
+			|| !dstring_append(tag_links, tag)
+			|| !dstring_append(tag_links, "</a>")) {
+			fprintf(stderr, "Error appending post tags, dstring append error\n");
+			return 0;
+		}
+	}
+	return 1;
+}
+int create_post_page(site_content_struct* site_content, post_struct* post, dstring_struct* log) {
 	dstringbuilder_struct page_builder;
 	dstring_struct tags;
+	dstring_struct tag_links;
+	dstring_struct previous_readings;
+	dstring_struct next_readings;
 	dstring_struct url_path;
 	dstring_struct filename;
 
 	dstringbuilder_init(&page_builder);
 	dstring_lazy_init(&tags);
+	dstring_lazy_init(&tag_links);
+	dstring_lazy_init(&previous_readings);
+	dstring_lazy_init(&next_readings);
 	dstring_lazy_init(&url_path);
 	dstring_lazy_init(&filename);
 
-	if(!dstring_append_printf(&url_path, "posts/%s", post->folder_name.str)) {
+#define CREATE_POST_PAGE_CLEANUP() { dstringbuilder_free(&page_builder); dstring_free(&tags); dstring_free(&tag_links); dstring_free(&previous_readings); dstring_free(&next_readings); dstring_free(&url_path); dstring_free(&filename); }
+	if(!dstring_append_printf(&url_path, "posts/%s", post->folder_name.str)
+		|| !dstring_append_printf(&filename, "%s.html", url_path.str)) {
 		fprintf(stderr, "Error creating post page, dstring append error\n");
-		dstringbuilder_free(&page_builder);
-		dstring_free(&tags);
-		dstring_free(&url_path);
-		dstring_free(&filename);
+		CREATE_POST_PAGE_CLEANUP()
 		return PAGE_GENERATION_FAILURE;
 	}
-	if(!dstring_append_printf(&filename, "%s.html", url_path.str)) {
-		fprintf(stderr, "Error creating post page, dstring append error\n");
-		dstringbuilder_free(&page_builder);
-		dstring_free(&tags);
-		dstring_free(&url_path);
-		dstring_free(&filename);
-		return PAGE_GENERATION_FAILURE;
+	uint64_t input_hash = get_post_input_hash(site_content, post);
+	if(page_is_current(site_content, filename.str, input_hash)) {
+		CREATE_POST_PAGE_CLEANUP()
+		return PAGE_GENERATION_NO_UPDATE;
 	}
-#define CREATE_POST_PAGE_APPEND(appending, err_message) if(!dstringbuilder_append(&page_builder, appending)) { fprintf(stderr, "Error creating page, couldn't append %s\n", err_message); dstringbuilder_free(&page_builder); dstring_free(&tags); dstring_free(&url_path); dstring_free(&filename); return PAGE_GENERATION_FAILURE; }
-#define CREATE_POST_PAGE_APPEND_DSTRING(appending, err_message) if(!dstringbuilder_append_dstring(&page_builder, appending)) { fprintf(stderr, "Error creating page, couldn't append %s\n", err_message); dstringbuilder_free(&page_builder); dstring_free(&tags); dstring_free(&url_path); dstring_free(&filename); return PAGE_GENERATION_FAILURE; }
-#define CREATE_POST_PAGE_PRINTF_APPEND(err_message, format, args...) if(!dstringbuilder_append_printf(&page_builder, format, args)) { fprintf(stderr, "Error creating page, couldn't append %s\n", err_message); dstringbuilder_free(&page_builder); dstring_free(&tags); dstring_free(&url_path); dstring_free(&filename); return PAGE_GENERATION_FAILURE; }
-	CREATE_POST_PAGE_PRINTF_APPEND("article begin", "<article>\n<header>\n<h1>%s</h1>\n", post->title.str)
-	if(!create_post_page_append_recommended_readings(page_builder.current_dstring, &post->suggested_prev_reading, "previous")) {
-		fprintf(stderr, "Error creating post page, couldn't append suggested previous readings\n");
-		dstringbuilder_free(&page_builder);
-		dstring_free(&tags);
-		dstring_free(&url_path);
-		dstring_free(&filename);
+	if(!post_load_content(post)) {
+		fprintf(stderr, "Error creating post page, couldn't load the post's content\n");
+		CREATE_POST_PAGE_CLEANUP()
 		return PAGE_GENERATION_FAILURE;
 	}
-	CREATE_POST_PAGE_APPEND("</header>\n", "post header")
-	CREATE_POST_PAGE_APPEND_DSTRING(&post->content, "post content")
-	if(!dstringbuilder_new_dstring(&page_builder)) {
-		fprintf(stderr, "Error creating post page, couldn't make a new dstring\n");
-		dstringbuilder_free(&page_builder);
-		dstring_free(&tags);
-		dstring_free(&url_path);
-		dstring_free(&filename);
+	if(!create_post_page_append_recommended_readings(&previous_readings, &post->suggested_prev_reading, "previous")
+		|| !create_post_page_append_recommended_readings(&next_readings, &post->suggested_next_reading, "next")
+		|| !create_post_page_append_tags(post, &tags, &tag_links)) {
+		fprintf(stderr, "Error creating post page, couldn't build its recommended readings and tags\n");
+		CREATE_POST_PAGE_CLEANUP()
 		return PAGE_GENERATION_FAILURE;
 	}
-	if(!create_post_page_append_recommended_readings(page_builder.current_dstring, &post->suggested_next_reading, "next")) {
-		fprintf(stderr, "Error creating post page, couldn't append suggested next readings\n");
-		dstringbuilder_free(&page_builder);
-		dstring_free(&tags);
-		dstring_free(&url_path);
-		dstring_free(&filename);
+	dstring_struct* values[POST_TEMPLATE_NUM_FIELDS];
+	values[POST_TEMPLATE_TITLE] = &post->title;
+	values[POST_TEMPLATE_PREVIOUS_READINGS] = &previous_readings;
+	values[POST_TEMPLATE_CONTENT] = &post->content;
+	values[POST_TEMPLATE_NEXT_READINGS] = &next_readings;
+	values[POST_TEMPLATE_SERIES_NAME] = &post->series_name;
+	values[POST_TEMPLATE_SERIES_TITLE] = &post->series->title;
+	values[POST_TEMPLATE_AUTHOR] = &post->author;
+	values[POST_TEMPLATE_TAG_LINKS] = &tag_links;
+	values[POST_TEMPLATE_WRITTEN_DATE] = &post->written_date;
+	values[POST_TEMPLATE_UPDATED_AT] = post->updated_at.length > 0 ? &post->updated_at : NULL;
+	if(!page_template_render(&site_content->html_components.post_template, values, &page_builder)) {
+		fprintf(stderr, "Error creating post page, couldn't render the post template\n");
+		CREATE_POST_PAGE_CLEANUP()
 		return PAGE_GENERATION_FAILURE;
 	}
-	CREATE_POST_PAGE_APPEND("<footer class=\"flexcontainer postfooter\">\n", "post footer")
-	CREATE_POST_PAGE_APPEND("<div>\n", "post footer")
-	CREATE_POST_PAGE_PRINTF_APPEND("post footer series title", "<div>Series: <a href=\"/series/%s\">%s</a></div>\n", post->series_name.str, post->series->title.str)
-
-	CREATE_POST_PAGE_PRINTF_APPEND("post footer author", "<div>Author: @%s</div>\n", post->author.str)
-	
-	CREATE_POST_PAGE_APPEND("<div>Tags: ", "post footer tags")
-	for(size_t i = 0; i < post->tags.length; i++) {
-		const char* tag = *((const char**) darray_get_elem(&post->tags, i));
-		if(i > 0) {
-			CREATE_POST_PAGE_APPEND(", ", "post footer tags")
-			if(!dstring_append(&tags, ",")) {
-				fprintf(stderr, "Error generating post, dstring append error\n");
-				dstring_free(&tags);
-				dstringbuilder_free(&page_builder);
-				dstring_free(&url_path);
-				dstring_free(&filename);
-				return PAGE_GENERATION_FAILURE;
-			}
-		}
-		if(!dstring_append(&tags, tag)) {
-			fprintf(stderr, "Error generating post, dstring append error\n");
-			dstring_free(&tags);
-			dstringbuilder_free(&page_builder);
-			dstring_free(&url_path);
-			dstring_free(&filename);
-			return PAGE_GENERATION_FAILURE;
-		}
-		CREATE_POST_PAGE_PRINTF_APPEND("post footer tags", "<a href=\"/tags/%s\">%s</a>", tag, tag)
-	}
-	CREATE_POST_PAGE_APPEND("</div>\n</div>\n", "close post footer")
-
-	CREATE_POST_PAGE_PRINTF_APPEND("Post right footer", "<div>\n<div>Written: %s</div>\n", post->written_date.str)
-	
-	if(post->updated_at.length >0) {
-		CREATE_POST_PAGE_PRINTF_APPEND("post updated at", "<div>Updated: %s</div>\n", post->updated_at.str)
-	}
-	CREATE_POST_PAGE_APPEND("</div>\n</footer>\n</article>\n</main>\n", "post close")
-	
-
-#undef CREATE_POST_PAGE_APPEND
-#undef CREATE_POST_PAGE_PRINTF_APPEND
 	page_generation_settings_struct page_generation_settings;
 	page_generation_settings.filename = filename.str;
 	page_generation_settings.keywords = tags.str;
@@ -318,11 +488,10 @@ int create_post_page(site_content_struct* site_content, post_struct* post) {
 	page_generation_settings.author = post->author.str;
 	page_generation_settings.url_path = url_path.str;
 	page_generation_settings.has_code = post->has_code;
-	int create_page_res = create_page_wrapper(site_content, &page_builder, &page_generation_settings, 1);
-	dstring_free(&url_path);
-	dstring_free(&filename);
-	dstringbuilder_free(&page_builder);
-	dstring_free(&tags);
+	page_generation_settings.input_hash = input_hash;
+	int create_page_res = create_page_wrapper(site_content, &page_builder, &page_generation_settings, 1, log);
+	CREATE_POST_PAGE_CLEANUP()
+#undef CREATE_POST_PAGE_CLEANUP
 	if(!create_page_res) {
 		fprintf(stderr, "Error generating post %s, creation error\n", post->title.str);
 	}
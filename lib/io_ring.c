@@ -0,0 +1,348 @@
+#include "dobjects.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "io_ring.h"
+
+// Reads are an open, read and close chained together, each file going
+// through one of the ring's registered file slots, so that the read and
+// close can refer to the file the open made before it's been opened.
+#define IO_RING_OPS_PER_READ 3
+#define IO_RING_FILE_SLOTS (IO_RING_ENTRIES / IO_RING_OPS_PER_READ)
+
+static int io_ring_enabled = 0;
+
+// Set once a warning has been printed about io_uring not being available,
+// so that it's only printed once, not once per thread.
+static int io_ring_warned = 0;
+
+static pthread_key_t io_ring_key;
+static pthread_once_t io_ring_key_once = PTHREAD_ONCE_INIT;
+
+// Whether the calling thread already failed to set up its ring.
+static _Thread_local int io_ring_failed = 0;
+
+static int io_ring_setup(unsigned entries, struct io_uring_params* params) {
+	return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+static int io_ring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+static int io_ring_register(int fd, unsigned opcode, void* arg, unsigned num_args) {
+	return (int) syscall(__NR_io_uring_register, fd, opcode, arg, num_args);
+}
+static void io_ring_free(io_ring_struct* ring) {
+	if(ring->sqes != NULL) {
+		munmap(ring->sqes, ring->sqes_length);
+	}
+	if(ring->cq_ring != NULL) {
+		munmap(ring->cq_ring, ring->cq_ring_length);
+	}
+	if(ring->sq_ring != NULL) {
+		munmap(ring->sq_ring, ring->sq_ring_length);
+	}
+	if(ring->fd != -1) {
+		close(ring->fd);
+	}
+}
+static int io_ring_probe_file_slots(io_ring_struct* ring);
+// Returns NULL if io_uring isn't available.
+static io_ring_struct* io_ring_init(io_ring_struct* ring) {
+	ring->fd = -1;
+	ring->sq_ring = NULL;
+	ring->cq_ring = NULL;
+	ring->sqes = NULL;
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	ring->fd = io_ring_setup(IO_RING_ENTRIES, &params);
+	if(ring->fd == -1) {
+		return NULL;
+	}
+	ring->sq_entries = params.sq_entries;
+	ring->sq_ring_length = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_ring_length = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_length = params.sq_entries * sizeof(struct io_uring_sqe);
+	void* sq_ring = mmap(NULL, ring->sq_ring_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	void* cq_ring = mmap(NULL, ring->cq_ring_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	void* sqes = mmap(NULL, ring->sqes_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	ring->sq_ring = sq_ring != MAP_FAILED ? sq_ring : NULL;
+	ring->cq_ring = cq_ring != MAP_FAILED ? cq_ring : NULL;
+	ring->sqes = sqes != MAP_FAILED ? sqes : NULL;
+	if(ring->sq_ring == NULL || ring->cq_ring == NULL || ring->sqes == NULL) {
+		io_ring_free(ring);
+		return NULL;
+	}
+	ring->sq_tail = (unsigned*) ((char*) ring->sq_ring + params.sq_off.tail);
+	ring->sq_mask = (unsigned*) ((char*) ring->sq_ring + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned*) ((char*) ring->sq_ring + params.sq_off.array);
+	ring->cq_head = (unsigned*) ((char*) ring->cq_ring + params.cq_off.head);
+	ring->cq_tail = (unsigned*) ((char*) ring->cq_ring + params.cq_off.tail);
+	ring->cq_mask = (unsigned*) ((char*) ring->cq_ring + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*) ((char*) ring->cq_ring + params.cq_off.cqes);
+	ring->sq_local_tail = *ring->sq_tail;
+
+	// Empty slots for the files that reads open
+	int file_slots[IO_RING_FILE_SLOTS];
+	for(size_t i = 0; i < IO_RING_FILE_SLOTS; i++) {
+		file_slots[i] = -1;
+	}
+	if(io_ring_register(ring->fd, IORING_REGISTER_FILES, file_slots, IO_RING_FILE_SLOTS)
+		|| !io_ring_probe_file_slots(ring)) {
+		io_ring_free(ring);
+		return NULL;
+	}
+	return ring;
+}
+static void io_ring_destroy(void* ring_void_ptr) {
+	io_ring_free(ring_void_ptr);
+	free(ring_void_ptr);
+}
+static void io_ring_make_key() {
+	pthread_key_create(&io_ring_key, io_ring_destroy);
+}
+void io_ring_use(int enabled) {
+	pthread_once(&io_ring_key_once, io_ring_make_key);
+	io_ring_enabled = enabled;
+	if(!enabled) {
+		io_ring_struct* ring = pthread_getspecific(io_ring_key);
+		if(ring != NULL) {
+			pthread_setspecific(io_ring_key, NULL);
+			io_ring_destroy(ring);
+		}
+	}
+}
+io_ring_struct* io_ring_get() {
+	if(!io_ring_enabled || io_ring_failed) {
+		return NULL;
+	}
+	io_ring_struct* ring = pthread_getspecific(io_ring_key);
+	if(ring != NULL) {
+		return ring;
+	}
+	ring = malloc(sizeof(io_ring_struct));
+	if(ring != NULL && !io_ring_init(ring)) {
+		free(ring);
+		ring = NULL;
+	}
+	if(ring != NULL && pthread_setspecific(io_ring_key, ring)) {
+		io_ring_destroy(ring);
+		ring = NULL;
+	}
+	if(ring == NULL) {
+		io_ring_failed = 1;
+		if(!__atomic_exchange_n(&io_ring_warned, 1, __ATOMIC_RELAXED)) {
+			fprintf(stderr, "Warning, io_uring isn't available, using regular file I/O\n");
+		}
+	}
+	return ring;
+}
+// Returns the next submission queue entry to fill in, cleared. There must
+// be room for it; the functions below never queue more than the ring holds.
+static struct io_uring_sqe* io_ring_get_sqe(io_ring_struct* ring, unsigned char opcode, uint64_t user_data) {
+	unsigned index = ring->sq_local_tail & *ring->sq_mask;
+	struct io_uring_sqe* sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = opcode;
+	sqe->user_data = user_data;
+	ring->sq_array[index] = index;
+	ring->sq_local_tail++;
+	return sqe;
+}
+// Gives up on the calling thread's ring after io_uring_enter failed part
+// way through a batch. The in_flight ops that were already submitted still
+// point at the caller's buffers, which are freed once the batch fails, so
+// they're waited for first (closing the ring doesn't wait for them); the
+// ring is then closed, so that nothing left in it runs later, and isn't
+// handed out again.
+static void io_ring_abandon(io_ring_struct* ring, unsigned in_flight) {
+	while(in_flight > 0) {
+		int res = io_ring_enter(ring->fd, 0, in_flight, IORING_ENTER_GETEVENTS);
+		if(res == -1 && errno != EINTR && errno != EBUSY) {
+			break;
+		}
+		unsigned head = *ring->cq_head;
+		unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+		in_flight -= tail - head < in_flight ? tail - head : in_flight;
+		__atomic_store_n(ring->cq_head, tail, __ATOMIC_RELEASE);
+	}
+	io_ring_failed = 1;
+	// A ring that's still being set up is freed by io_ring_init
+	if(pthread_getspecific(io_ring_key) == ring) {
+		pthread_setspecific(io_ring_key, NULL);
+		io_ring_destroy(ring);
+	}
+}
+// Submits everything queued, and waits for all num_ops of them to complete,
+// calling handle_completion for each. On error, the ring is abandoned (see
+// io_ring_abandon), and must not be used again.
+// Returns 0 on error.
+static int io_ring_run(io_ring_struct* ring, unsigned num_ops, void (*handle_completion)(struct io_uring_cqe*, void*), void* context) {
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+	unsigned to_submit = num_ops;
+	unsigned completed = 0;
+	while(completed < num_ops) {
+		int res = io_ring_enter(ring->fd, to_submit, num_ops - completed, IORING_ENTER_GETEVENTS);
+		if(res == -1 && errno == EINTR) {
+			continue;
+		}
+		if(res == -1) {
+			fprintf(stderr, "Error running io_uring batch, io_uring_enter error\n");
+			io_ring_abandon(ring, num_ops - to_submit - completed);
+			return 0;
+		}
+		to_submit -= (unsigned) res < to_submit ? (unsigned) res : to_submit;
+		unsigned head = *ring->cq_head;
+		unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+		for(; head != tail; head++) {
+			handle_completion(&ring->cqes[head & *ring->cq_mask], context);
+			completed++;
+		}
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return 1;
+}
+static void io_ring_handle_probe(struct io_uring_cqe* cqe, void* result_void_ptr) {
+	*((int*) result_void_ptr) = cqe->res;
+}
+// Checks that the kernel can open a file straight into one of the ring's
+// registered file slots, and close it there, as reads do; that's only
+// there from Linux 5.15 on. Older kernels take the same ops, but ignore
+// the slot: the open makes a regular fd (which would leak), and the close
+// closes fd 0.
+// Returns 0 if it can't.
+static int io_ring_probe_file_slots(io_ring_struct* ring) {
+	// fd 0 is held open while probing, so that an open that ignored the
+	// slot can't return it, and be mistaken for one that used the slot
+	int placeholder_fd = -1;
+	if(fcntl(0, F_GETFD) == -1) {
+		placeholder_fd = open("/dev/null", O_RDONLY);
+		if(placeholder_fd != 0) {
+			if(placeholder_fd != -1) {
+				close(placeholder_fd);
+			}
+			return 0;
+		}
+	}
+	int res = -1;
+	struct io_uring_sqe* sqe = io_ring_get_sqe(ring, IORING_OP_OPENAT, 0);
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uint64_t) (uintptr_t) ".";
+	sqe->open_flags = O_RDONLY | O_DIRECTORY;
+	sqe->file_index = 1;
+	int supported = io_ring_run(ring, 1, io_ring_handle_probe, &res) && res == 0;
+	if(res > 0) {
+		close(res);
+	}
+	if(supported) {
+		res = -1;
+		sqe = io_ring_get_sqe(ring, IORING_OP_CLOSE, 0);
+		sqe->file_index = 1;
+		supported = io_ring_run(ring, 1, io_ring_handle_probe, &res) && res == 0;
+	}
+	if(placeholder_fd != -1) {
+		close(placeholder_fd);
+	}
+	return supported;
+}
+static void io_ring_handle_read(struct io_uring_cqe* cqe, void* reads_void_ptr) {
+	io_ring_read_struct* file_read = (io_ring_read_struct*) reads_void_ptr + cqe->user_data / IO_RING_OPS_PER_READ;
+	switch(cqe->user_data % IO_RING_OPS_PER_READ) {
+		case 0:
+			// The open; if it failed, the read is cancelled, so this is the
+			// error to keep.
+			if(cqe->res < 0) {
+				file_read->result = cqe->res;
+			}
+			break;
+		case 1:
+			if(file_read->result == 0) {
+				file_read->result = cqe->res;
+			}
+			break;
+	}
+}
+int io_ring_read_files(io_ring_struct* ring, io_ring_read_struct* reads, size_t num_reads) {
+	for(size_t start = 0; start < num_reads; start += IO_RING_FILE_SLOTS) {
+		size_t end = num_reads - start > IO_RING_FILE_SLOTS ? start + IO_RING_FILE_SLOTS : num_reads;
+		for(size_t i = start; i < end; i++) {
+			unsigned slot = (unsigned) (i - start);
+			reads[i].result = 0;
+
+			struct io_uring_sqe* sqe = io_ring_get_sqe(ring, IORING_OP_OPENAT, i * IO_RING_OPS_PER_READ);
+			sqe->fd = reads[i].dir_fd;
+			sqe->addr = (uint64_t) (uintptr_t) reads[i].filename;
+			// Not O_CLOEXEC, which the kernel rejects for files opened into a
+			// slot (they never get an fd that could be inherited).
+			sqe->open_flags = O_RDONLY;
+			sqe->file_index = slot + 1;
+			sqe->flags = IOSQE_IO_LINK;
+
+			// Hard linked, so that the file is closed even after a short
+			// read (which breaks a regular link).
+			sqe = io_ring_get_sqe(ring, IORING_OP_READ, i * IO_RING_OPS_PER_READ + 1);
+			sqe->fd = (int) slot;
+			sqe->addr = (uint64_t) (uintptr_t) reads[i].buffer;
+			sqe->len = (unsigned) reads[i].buffer_size;
+			sqe->off = 0;
+			sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+			sqe = io_ring_get_sqe(ring, IORING_OP_CLOSE, i * IO_RING_OPS_PER_READ + 2);
+			sqe->file_index = slot + 1;
+		}
+		if(!io_ring_run(ring, (unsigned) (end - start) * IO_RING_OPS_PER_READ, io_ring_handle_read, reads)) {
+			fprintf(stderr, "Error reading files through io_uring\n");
+			return 0;
+		}
+	}
+	return 1;
+}
+// What io_ring_handle_stat needs to fill in the results of a batch.
+typedef struct io_ring_stat_batch_struct {
+	io_ring_stat_struct* stats;
+
+	// Filled in by the kernel, one per stat in the batch.
+	struct statx* statx_buffers;
+	size_t start;
+} io_ring_stat_batch_struct;
+
+static void io_ring_handle_stat(struct io_uring_cqe* cqe, void* batch_void_ptr) {
+	io_ring_stat_batch_struct* batch = batch_void_ptr;
+	io_ring_stat_struct* file_stat = &batch->stats[cqe->user_data];
+	struct statx* statx_buffer = &batch->statx_buffers[cqe->user_data - batch->start];
+	file_stat->result = cqe->res < 0 ? cqe->res : 0;
+	if(file_stat->result == 0) {
+		file_stat->size = (off_t) statx_buffer->stx_size;
+		file_stat->mtime.tv_sec = (time_t) statx_buffer->stx_mtime.tv_sec;
+		file_stat->mtime.tv_nsec = (long) statx_buffer->stx_mtime.tv_nsec;
+	}
+}
+int io_ring_stat_files(io_ring_struct* ring, io_ring_stat_struct* stats, size_t num_stats) {
+	io_ring_stat_batch_struct batch;
+	batch.stats = stats;
+	batch.statx_buffers = malloc(ring->sq_entries * sizeof(struct statx));
+	if(batch.statx_buffers == NULL) {
+		fprintf(stderr, "Error stat()ing files through io_uring, malloc error\n");
+		return 0;
+	}
+	for(size_t start = 0; start < num_stats; start += ring->sq_entries) {
+		size_t end = num_stats - start > ring->sq_entries ? start + ring->sq_entries : num_stats;
+		batch.start = start;
+		for(size_t i = start; i < end; i++) {
+			struct io_uring_sqe* sqe = io_ring_get_sqe(ring, IORING_OP_STATX, i);
+			sqe->fd = stats[i].dir_fd;
+			sqe->addr = (uint64_t) (uintptr_t) stats[i].filename;
+			sqe->len = STATX_SIZE | STATX_MTIME;
+			sqe->off = (uint64_t) (uintptr_t) &batch.statx_buffers[i - start];
+		}
+		if(!io_ring_run(ring, (unsigned) (end - start), io_ring_handle_stat, &batch)) {
+			fprintf(stderr, "Error stat()ing files through io_uring\n");
+			free(batch.statx_buffers);
+			return 0;
+		}
+	}
+	free(batch.statx_buffers);
+	return 1;
+}
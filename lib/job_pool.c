@@ -0,0 +1,104 @@
+#include "dobjects.h"
+#include <pthread.h>
+#include "job_pool.h"
+
+// Shared state for all of the threads working through a job_pool_run call.
+typedef struct job_pool_struct {
+	int (*job_func)(size_t, void*);
+	void* context;
+	size_t num_jobs;
+
+	// The next job index to hand out; protected by lock.
+	size_t next_job;
+
+	// Set once any job fails; protected by lock.
+	int had_error;
+
+	pthread_mutex_t lock;
+} job_pool_struct;
+
+// Takes the next job, storing its index in (*job_index).
+// Returns 0 if there are no more jobs to do (or a job failed).
+static int job_pool_take_job(job_pool_struct* pool, size_t* job_index) {
+	int have_job = 0;
+	pthread_mutex_lock(&pool->lock);
+	if(!pool->had_error && pool->next_job < pool->num_jobs) {
+		(*job_index) = pool->next_job++;
+		have_job = 1;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return have_job;
+}
+static void* job_pool_worker(void* pool_void_ptr) {
+	job_pool_struct* pool = pool_void_ptr;
+	size_t job_index;
+	while(job_pool_take_job(pool, &job_index)) {
+		if(!pool->job_func(job_index, pool->context)) {
+			pthread_mutex_lock(&pool->lock);
+			pool->had_error = 1;
+			pthread_mutex_unlock(&pool->lock);
+		}
+	}
+	return NULL;
+}
+int job_pool_run(size_t num_jobs, int num_threads, int (*job_func)(size_t, void*), void* context) {
+	if(num_threads < 1) {
+		num_threads = 1;
+	}
+	if((size_t) num_threads > num_jobs) {
+		num_threads = num_jobs > 0 ? (int) num_jobs : 1;
+	}
+
+	// Nothing to gain from threads; don't pay to create them.
+	if(num_threads == 1) {
+		for(size_t i = 0; i < num_jobs; i++) {
+			if(!job_func(i, context)) {
+				return 0;
+			}
+		}
+		return 1;
+	}
+
+	job_pool_struct pool;
+	pool.job_func = job_func;
+	pool.context = context;
+	pool.num_jobs = num_jobs;
+	pool.next_job = 0;
+	pool.had_error = 0;
+	if(pthread_mutex_init(&pool.lock, NULL)) {
+		fprintf(stderr, "Error running jobs, couldn't create mutex\n");
+		return 0;
+	}
+
+	// The calling thread is one of the workers, so only num_threads - 1
+	// threads need to be created.
+	pthread_t* threads = malloc(sizeof(pthread_t) * (num_threads - 1));
+	if(threads == NULL) {
+		fprintf(stderr, "Error running jobs, malloc error\n");
+		pthread_mutex_destroy(&pool.lock);
+		return 0;
+	}
+	int num_started = 0;
+	for(; num_started < num_threads - 1; num_started++) {
+		if(pthread_create(&threads[num_started], NULL, job_pool_worker, &pool)) {
+			// Not fatal; the threads that did start (and this one)
+			// will still get through all of the jobs.
+			fprintf(stderr, "Warning, couldn't start job thread, continuing with %d threads\n", num_started + 1);
+			break;
+		}
+	}
+	job_pool_worker(&pool);
+	for(int i = 0; i < num_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_mutex_destroy(&pool.lock);
+	return !pool.had_error;
+}
+int job_pool_get_num_processors() {
+	long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+	if(num_processors < 1) {
+		return 1;
+	}
+	return (int) num_processors;
+}
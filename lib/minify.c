@@ -0,0 +1,243 @@
+#include "dobjects.h"
+#include <ctype.h>
+#include "minify.h"
+
+// The elements whose contents are left as they are.
+static const char* const minify_raw_elements[] = { "pre", "code", "textarea", "script", "style" };
+
+// The elements that whitespace next to doesn't show: block-level elements,
+// and those that go in the <head>.
+static const char* const minify_block_elements[] = {
+	"!doctype", "html", "head", "body", "meta", "link", "title", "base", "style", "script", "noscript",
+	"header", "footer", "nav", "main", "section", "article", "aside", "div", "p", "pre", "blockquote",
+	"ul", "ol", "dl", "dt", "dd", "h1", "h2", "h3", "h4", "h5", "h6", "hr", "br",
+	"table", "caption", "thead", "tbody", "tfoot", "tr", "form", "fieldset", "figure", "figcaption",
+};
+
+// Returns the one of the num_names (lowercase) names that the length
+// characters at name are, ignoring case; NULL if they aren't any of them.
+const char* minify_find_name(const char* name, size_t length, const char* const* names, size_t num_names) {
+	for(size_t i = 0; i < num_names; i++) {
+		size_t j = 0;
+		while(j < length && names[i][j] != '\0' && tolower((unsigned char) name[j]) == names[i][j]) {
+			j++;
+		}
+		if(j == length && names[i][j] == '\0') {
+			return names[i];
+		}
+	}
+	return NULL;
+}
+// Returns the position of the first "</name" (ignoring case) in text from
+// start on, or length if there isn't one.
+size_t minify_find_closing_tag(const char* text, size_t start, size_t length, const char* name, size_t name_length) {
+	for(size_t i = start; i + 2 + name_length <= length; i++) {
+		if(text[i] == '<' && text[i + 1] == '/' && minify_find_name(text + i + 2, name_length, &name, 1) != NULL) {
+			return i;
+		}
+	}
+	return length;
+}
+// Returns the position just after the first occurrence of end in text from
+// start on, or length if there isn't one.
+size_t minify_skip_past(const char* text, size_t start, size_t length, const char* end) {
+	size_t end_length = strlen(end);
+	for(size_t i = start; i + end_length <= length; i++) {
+		if(!strncmp(text + i, end, end_length)) {
+			return i + end_length;
+		}
+	}
+	return length;
+}
+// Copies the quoted string that starts at text[start] to out, returning the
+// position just after it.
+size_t minify_copy_quoted(const char* text, size_t start, size_t length, char* out, size_t* out_length) {
+	char quote = text[start];
+	size_t i = start;
+	out[(*out_length)++] = text[i++];
+	while(i < length && text[i] != quote) {
+		if(text[i] == '\\' && i + 1 < length) {
+			out[(*out_length)++] = text[i++];
+		}
+		out[(*out_length)++] = text[i++];
+	}
+	if(i < length) {
+		out[(*out_length)++] = text[i++];
+	}
+	return i;
+}
+// Sets dest up to hold a copy of a string of the given length.
+// Returns NULL on error.
+dstring_struct* minify_init_dest(dstring_struct* dest, size_t length) {
+	if(!dstring_init_with_size(dest, length + 1)) {
+		fprintf(stderr, "Error minifying, dstring init error\n");
+		return NULL;
+	}
+	return dest;
+}
+// Whether there's no need for whitespace before or after the character in
+// CSS.
+static inline int minify_css_is_tight_before(char c) {
+	return c == '{' || c == '}' || c == ';' || c == ',' || c == '>';
+}
+static inline int minify_css_is_tight_after(char c) {
+	return minify_css_is_tight_before(c) || c == ':';
+}
+dstring_struct* minify_css(dstring_struct* dest, dstring_struct* css) {
+	if(!minify_init_dest(dest, css->length)) {
+		return NULL;
+	}
+	const char* text = css->str;
+	size_t length = css->length;
+	char* out = dest->str;
+	size_t out_length = 0;
+	int pending_space = 0;
+	size_t i = 0;
+	while(i < length) {
+		char c = text[i];
+		if(c == '/' && i + 1 < length && text[i + 1] == '*') {
+			i = minify_skip_past(text, i + 2, length, "*/");
+			continue;
+		}
+		if(isspace((unsigned char) c)) {
+			pending_space = 1;
+			i++;
+			continue;
+		}
+		if(pending_space && out_length > 0 && !minify_css_is_tight_after(out[out_length - 1]) && !minify_css_is_tight_before(c)) {
+			out[out_length++] = ' ';
+		}
+		pending_space = 0;
+		if(c == '"' || c == '\'') {
+			i = minify_copy_quoted(text, i, length, out, &out_length);
+			continue;
+		}
+		// The last declaration in a block doesn't need its ;
+		if(c == '}' && out_length > 0 && out[out_length - 1] == ';') {
+			out_length--;
+		}
+		out[out_length++] = c;
+		i++;
+	}
+	out[out_length] = '\0';
+	dest->length = out_length;
+	return dest;
+}
+// Copies the tag that starts at text[start] to out, collapsing the
+// whitespace in it, and returns the position just after it.
+size_t minify_copy_tag(const char* text, size_t start, size_t length, char* out, size_t* out_length) {
+	size_t i = start;
+	int pending_space = 0;
+	while(i < length) {
+		char c = text[i];
+		if(isspace((unsigned char) c)) {
+			pending_space = 1;
+			i++;
+			continue;
+		}
+		if(pending_space && c != '>') {
+			out[(*out_length)++] = ' ';
+		}
+		pending_space = 0;
+		if(c == '"' || c == '\'') {
+			i = minify_copy_quoted(text, i, length, out, out_length);
+			continue;
+		}
+		out[(*out_length)++] = c;
+		i++;
+		if(c == '>') {
+			break;
+		}
+	}
+	return i;
+}
+dstring_struct* minify_html(dstring_struct* dest, dstring_struct* html) {
+	if(!minify_init_dest(dest, html->length)) {
+		return NULL;
+	}
+	const char* text = html->str;
+	size_t length = html->length;
+	char* out = dest->str;
+	size_t out_length = 0;
+	// The whitespace character that a run of whitespace collapses to, or 0
+	char pending_space = 0;
+	// Whether what came last was a block-level tag (or the start)
+	int after_block = 1;
+	size_t i = 0;
+	while(i < length) {
+		char c = text[i];
+		if(isspace((unsigned char) c)) {
+			if(c == '\n' || pending_space == 0) {
+				pending_space = c == '\n' ? '\n' : ' ';
+			}
+			i++;
+			continue;
+		}
+		if(c == '<' && !strncmp(text + i, "<!--", 4) && strncmp(text + i, "<!--[", 5)) {
+			i = minify_skip_past(text, i + 4, length, "-->");
+			continue;
+		}
+		int is_tag = c == '<' && i + 1 < length && (isalpha((unsigned char) text[i + 1]) || text[i + 1] == '/' || text[i + 1] == '!');
+		if(!is_tag) {
+			if(pending_space && !after_block) {
+				out[out_length++] = pending_space;
+			}
+			pending_space = 0;
+			after_block = 0;
+			out[out_length++] = c;
+			i++;
+			continue;
+		}
+		if(!strncmp(text + i, "<!--[", 5)) {
+			// A conditional comment, kept as it is
+			size_t end = minify_skip_past(text, i + 5, length, "-->");
+			if(pending_space && !after_block) {
+				out[out_length++] = pending_space;
+			}
+			pending_space = 0;
+			memcpy(out + out_length, text + i, end - i);
+			out_length += end - i;
+			after_block = 0;
+			i = end;
+			continue;
+		}
+		int is_closing = text[i + 1] == '/';
+		size_t name_start = i + 1 + is_closing;
+		size_t name_end = name_start;
+		while(name_end < length && (isalnum((unsigned char) text[name_end]) || text[name_end] == '!')) {
+			name_end++;
+		}
+		const char* name = text + name_start;
+		size_t name_length = name_end - name_start;
+		int is_block = minify_find_name(name, name_length, minify_block_elements, sizeof(minify_block_elements) / sizeof(minify_block_elements[0])) != NULL;
+		if(pending_space && !after_block && !is_block) {
+			out[out_length++] = pending_space;
+		}
+		pending_space = 0;
+		i = minify_copy_tag(text, i, length, out, &out_length);
+		after_block = is_block;
+		const char* raw_name = is_closing ? NULL : minify_find_name(name, name_length, minify_raw_elements, sizeof(minify_raw_elements) / sizeof(minify_raw_elements[0]));
+		if(raw_name != NULL) {
+			size_t end = minify_find_closing_tag(text, i, length, raw_name, name_length);
+			memcpy(out + out_length, text + i, end - i);
+			out_length += end - i;
+			if(end > i) {
+				after_block = 0;
+			}
+			i = end;
+		}
+	}
+	out[out_length] = '\0';
+	dest->length = out_length;
+	return dest;
+}
+dstring_struct* minify_replace(dstring_struct* dstring, dstring_struct* (*minify)(dstring_struct*, dstring_struct*)) {
+	dstring_struct minified;
+	dstring_lazy_init(&minified);
+	if(!minify(&minified, dstring)) {
+		return NULL;
+	}
+	dstring_free(dstring);
+	(*dstring) = minified;
+	return dstring;
+}
@@ -0,0 +1,187 @@
+#include "dobjects.h"
+#include "page_template.h"
+
+void page_template_init(page_template_struct* page_template) {
+	dstring_lazy_init(&page_template->literals);
+	darray_lazy_init(&page_template->ops, sizeof(page_template_op_struct));
+}
+void page_template_free(page_template_struct* page_template) {
+	dstring_free(&page_template->literals);
+	darray_free(&page_template->ops);
+}
+// Returns the index of the field that's named by the length characters at
+// name, or num_fields if there's no such field.
+size_t page_template_find_field(const char* name, size_t length, const char* const* field_names, size_t num_fields) {
+	for(size_t i = 0; i < num_fields; i++) {
+		if(strlen(field_names[i]) == length && !strncmp(field_names[i], name, length)) {
+			return i;
+		}
+	}
+	return num_fields;
+}
+// Appends an op to the template.
+// Returns 0 on error.
+int page_template_append_op(page_template_struct* page_template, int type, size_t first, size_t second) {
+	page_template_op_struct op;
+	op.type = type;
+	op.first = first;
+	op.second = second;
+	if(!darray_append(&page_template->ops, &op)) {
+		fprintf(stderr, "Error compiling template, darray append error\n");
+		return 0;
+	}
+	return 1;
+}
+// Appends a literal op for the length characters at text, if there are any.
+// Returns 0 on error.
+int page_template_append_literal(page_template_struct* page_template, const char* text, size_t length) {
+	if(length == 0) {
+		return 1;
+	}
+	size_t offset = page_template->literals.length;
+	if(!dstring_append_length(&page_template->literals, text, length)) {
+		fprintf(stderr, "Error compiling template, dstring append error\n");
+		return 0;
+	}
+	return page_template_append_op(page_template, PAGE_TEMPLATE_LITERAL, offset, length);
+}
+page_template_struct* page_template_compile(page_template_struct* page_template, const char* name, const char* source, const char* const* field_names, size_t num_fields) {
+	// The ops of the sections that are open, innermost last
+	darray_struct open_sections;
+	darray_lazy_init(&open_sections, sizeof(size_t));
+
+	const char* text = source;
+	const char* slot_start;
+	while((slot_start = strstr(text, "{{")) != NULL) {
+		if(!page_template_append_literal(page_template, text, slot_start - text)) {
+			darray_free(&open_sections);
+			return NULL;
+		}
+		const char* slot_name = slot_start + 2;
+		const char* slot_end = strstr(slot_name, "}}");
+		if(slot_end == NULL) {
+			fprintf(stderr, "Error compiling template %s, a {{ isn't closed with }}\n", name);
+			darray_free(&open_sections);
+			return NULL;
+		}
+		int type = PAGE_TEMPLATE_FIELD;
+		if(slot_name[0] == '?') {
+			type = PAGE_TEMPLATE_SECTION;
+			slot_name++;
+		} else if(slot_name[0] == '/') {
+			// The end of a section
+			type = -1;
+			slot_name++;
+		}
+		size_t field = page_template_find_field(slot_name, slot_end - slot_name, field_names, num_fields);
+		if(field == num_fields) {
+			fprintf(stderr, "Error compiling template %s, unknown field %.*s\n", name, (int) (slot_end - slot_name), slot_name);
+			darray_free(&open_sections);
+			return NULL;
+		}
+		if(type == -1) {
+			size_t* open_section = open_sections.length > 0 ? (size_t*) darray_get_elem(&open_sections, open_sections.length - 1) : NULL;
+			page_template_op_struct* section_op = open_section != NULL ? (page_template_op_struct*) darray_get_elem(&page_template->ops, *open_section) : NULL;
+			if(section_op == NULL || section_op->first != field) {
+				fprintf(stderr, "Error compiling template %s, {{/%s}} doesn't close the section that's open\n", name, field_names[field]);
+				darray_free(&open_sections);
+				return NULL;
+			}
+			section_op->second = page_template->ops.length;
+			open_sections.length--;
+		} else {
+			size_t op_index = page_template->ops.length;
+			if(!page_template_append_op(page_template, type, field, 0)) {
+				darray_free(&open_sections);
+				return NULL;
+			}
+			if(type == PAGE_TEMPLATE_SECTION && !darray_append(&open_sections, &op_index)) {
+				fprintf(stderr, "Error compiling template %s, darray append error\n", name);
+				darray_free(&open_sections);
+				return NULL;
+			}
+		}
+		text = slot_end + 2;
+	}
+	if(!page_template_append_literal(page_template, text, strlen(text))) {
+		darray_free(&open_sections);
+		return NULL;
+	}
+	if(open_sections.length > 0) {
+		size_t* open_section = (size_t*) darray_get_elem(&open_sections, open_sections.length - 1);
+		page_template_op_struct* section_op = (page_template_op_struct*) darray_get_elem(&page_template->ops, *open_section);
+		fprintf(stderr, "Error compiling template %s, the section {{?%s}} isn't closed\n", name, field_names[section_op->first]);
+		darray_free(&open_sections);
+		return NULL;
+	}
+	darray_free(&open_sections);
+	return page_template;
+}
+void page_template_hash(page_template_struct* page_template, dhash_struct* dhash) {
+	dhash_append_dstring(dhash, &page_template->literals);
+	for(size_t i = 0; i < page_template->ops.length; i++) {
+		page_template_op_struct* op = (page_template_op_struct*) darray_get_elem(&page_template->ops, i);
+		dhash_append_uint64(dhash, (uint64_t) op->type);
+		dhash_append_uint64(dhash, (uint64_t) op->first);
+		dhash_append_uint64(dhash, (uint64_t) op->second);
+	}
+	dhash_append_uint64(dhash, (uint64_t) page_template->ops.length);
+}
+// Renders the template to either the dstringbuilder or dest (the other
+// being NULL).
+// Returns 0 on error.
+int page_template_render_ops(page_template_struct* page_template, dstring_struct** values, dstringbuilder_struct* dstringbuilder, dstring_struct* dest) {
+	size_t i = 0;
+	while(i < page_template->ops.length) {
+		page_template_op_struct* op = (page_template_op_struct*) darray_get_elem(&page_template->ops, i);
+		const char* text = NULL;
+		size_t length = 0;
+		if(op->type == PAGE_TEMPLATE_LITERAL) {
+			text = page_template->literals.str + op->first;
+			length = op->second;
+		} else if(op->type == PAGE_TEMPLATE_SECTION) {
+			if(values[op->first] == NULL) {
+				i = op->second;
+				continue;
+			}
+		} else if(values[op->first] != NULL) {
+			dstring_struct* value = values[op->first];
+			if(dstringbuilder != NULL && value->length >= PAGE_TEMPLATE_REFERENCE_LENGTH) {
+				if(!dstringbuilder_append_dstring(dstringbuilder, value)) {
+					return 0;
+				}
+			} else {
+				text = value->str;
+				length = value->length;
+			}
+		}
+		if(length > 0) {
+			dstring_struct* target = dest;
+			if(dstringbuilder != NULL) {
+				if(dstringbuilder->current_dstring == NULL && !dstringbuilder_new_dstring(dstringbuilder)) {
+					return 0;
+				}
+				target = dstringbuilder->current_dstring;
+			}
+			if(!dstring_append_length(target, text, length)) {
+				return 0;
+			}
+		}
+		i++;
+	}
+	return 1;
+}
+dstringbuilder_struct* page_template_render(page_template_struct* page_template, dstring_struct** values, dstringbuilder_struct* dstringbuilder) {
+	if(!page_template_render_ops(page_template, values, dstringbuilder, NULL)) {
+		fprintf(stderr, "Error rendering template, dstringbuilder append error\n");
+		return NULL;
+	}
+	return dstringbuilder;
+}
+dstring_struct* page_template_render_to_dstring(page_template_struct* page_template, dstring_struct** values, dstring_struct* dest) {
+	if(!page_template_render_ops(page_template, values, NULL, dest)) {
+		fprintf(stderr, "Error rendering template, dstring append error\n");
+		return NULL;
+	}
+	return dest;
+}
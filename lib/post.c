@@ -1,3 +1,4 @@
+#define _BSD_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -8,13 +9,42 @@
 #include <errno.h>
 #include <dirent.h>
 #include <time.h>
+#include <stddef.h>
 #include "dobjects.h"
 #include "post.h"
 
+// A text field of a post, and where in the post_struct it goes.
+typedef struct post_file_field_struct {
+	// The field's name in a single-file post.
+	const char* key;
+
+	// The field's file in the folder layout.
+	const char* file;
+	size_t offset;
+	int required;
+} post_file_field_struct;
+
+// The fields have the same names as the files in the folder layout.
+static const post_file_field_struct post_file_fields[] = {
+	{"title", "/title", offsetof(post_struct, title), 1},
+	{"author", "/author", offsetof(post_struct, author), 1},
+	{"tags", "/tags", offsetof(post_struct, raw_tags), 1},
+	{"series", "/series", offsetof(post_struct, series_name), 1},
+	{"short-description", "/short-description", offsetof(post_struct, short_description), 1},
+	{"long-description", "/long-description", offsetof(post_struct, long_description), 1},
+	{"written-date", "/written-date", offsetof(post_struct, written_date), 1},
+	{"updated-at", "/updated-at", offsetof(post_struct, updated_at), 0},
+	{"publish-after", "/publish-after", offsetof(post_struct, publish_after), 0},
+	{"suggested-next-reading", "/suggested-next-reading", offsetof(post_struct, raw_suggested_next_reading), 0},
+	{"suggested-prev-reading", "/suggested-prev-reading", offsetof(post_struct, raw_suggested_prev_reading), 0},
+};
+#define NUM_POST_FILE_FIELDS (sizeof(post_file_fields) / sizeof(post_file_fields[0]))
+
 void post_free(post_struct* post) {
 	dstring_free(&post->folder_name);
 	dstring_free(&post->title);
 	dstring_free(&post->content);
+	dstring_free(&post->content_filename);
 	dstring_free(&post->author);
 	dstring_free(&post->raw_tags);
 	// I do NOT need to free the strings in tags, because they are pointing to
@@ -32,6 +62,8 @@ void post_free(post_struct* post) {
 	dstring_free(&post->written_date);
 	dstring_free(&post->publish_after);
 	dstring_free(&post->updated_at);
+	dstring_free(&post->tag_card);
+	dstring_free(&post->series_card);
 }
 void post_init(post_struct* post) {
 	post->publish_when_ready = 0;
@@ -41,9 +73,11 @@ void post_init(post_struct* post) {
 	post->publish_after_time = 0;
 	post->updated_at_time = 0;
 	post->series = NULL;
+	post->content_version = 0;
 	dstring_lazy_init(&post->folder_name);
 	dstring_lazy_init(&post->title);
 	dstring_lazy_init(&post->content);
+	dstring_lazy_init(&post->content_filename);
 	dstring_lazy_init(&post->author);
 	dstring_lazy_init(&post->raw_tags);
 	dstring_lazy_init(&post->series_name);
@@ -54,6 +88,8 @@ void post_init(post_struct* post) {
 	dstring_lazy_init(&post->written_date);
 	dstring_lazy_init(&post->publish_after);
 	dstring_lazy_init(&post->updated_at);
+	dstring_lazy_init(&post->tag_card);
+	dstring_lazy_init(&post->series_card);
 	darray_lazy_init(&post->tags, sizeof(char*));
 	darray_lazy_init(&post->suggested_next_reading_names, sizeof(char*));
 	darray_lazy_init(&post->suggested_prev_reading_names, sizeof(char*));
@@ -72,16 +108,178 @@ void post_print_debug(post_struct* post) {
 // GENERAL TODO: Perhaps if series and misc_pages can't be loaded properly,
 // that's an error?
 
-// This function takes a third parameter, compared to most of the others,
-// that is a pointer to an integer; this integer will be set to 1 if the
-// post failed to be loaded because the generate flag was missing (which is
-// not a critical failure, it should be ignored), and 0 if the post failed
-// to be loaded due to a critical failure.
-// base_dir, as always, shouldn't have a trailing slash.
-post_struct* post_load(post_struct* post, dstring_struct* base_dir, const char* folder_name, int* generate_flag_missing) {
-	(*generate_flag_missing) = 0;
+// Handles a single line of a post.html header.
+// Returns 0 on error.
+int post_load_header_line(post_struct* post, const char* line, size_t line_length, int* generate_flag) {
+	if(line_length == 0) {
+		return 1;
+	}
+	const char* equals = memchr(line, '=', line_length);
+	if(equals == NULL) {
+		if(line_length == strlen("generate-post") && !strncmp(line, "generate-post", line_length)) {
+			(*generate_flag) = 1;
+		} else if(line_length == strlen("publish-when-ready") && !strncmp(line, "publish-when-ready", line_length)) {
+			post->publish_when_ready = 1;
+		} else if(line_length == strlen("has-code") && !strncmp(line, "has-code", line_length)) {
+			post->has_code = 1;
+		} else {
+			fprintf(stderr, "Error loading post %s, unknown flag '%.*s' in %s\n", post->folder_name.str, (int) line_length, line, POST_SINGLE_FILE_NAME);
+			return 0;
+		}
+		return 1;
+	}
+	size_t key_length = equals - line;
+	for(size_t i = 0; i < NUM_POST_FILE_FIELDS; i++) {
+		if(key_length != strlen(post_file_fields[i].key) || strncmp(line, post_file_fields[i].key, key_length)) {
+			continue;
+		}
+		dstring_struct* field = (dstring_struct*) ((char*) post + post_file_fields[i].offset);
+		// A repeated key continues the value on another line
+		if(field->length > 0 && !dstring_append(field, "\n")) {
+			fprintf(stderr, "Error loading post %s, dstring append error\n", post->folder_name.str);
+			return 0;
+		}
+		if(!dstring_append_length(field, equals + 1, line_length - key_length - 1)) {
+			fprintf(stderr, "Error loading post %s, dstring append error\n", post->folder_name.str);
+			return 0;
+		}
+		return 1;
+	}
+	fprintf(stderr, "Error loading post %s, unknown field '%.*s' in %s\n", post->folder_name.str, (int) key_length, line, POST_SINGLE_FILE_NAME);
+	return 0;
+}
+// Returns the start of the body of a post.html file (the line after the
+// --- line), or NULL if it has no --- line.
+char* post_find_single_file_body(dstring_struct* file) {
+	char* line = file->str;
+	char* file_end = file->str + file->length;
+	while(line < file_end) {
+		char* line_end = memchr(line, '\n', file_end - line);
+		char* next_line = line_end != NULL ? line_end + 1 : file_end;
+		if(line_end == NULL) {
+			line_end = file_end;
+		}
+		if(line_end > line && line_end[-1] == '\r') {
+			line_end--;
+		}
+		if(line_end - line == 3 && !strncmp(line, "---", 3)) {
+			return next_line;
+		}
+		line = next_line;
+	}
+	return NULL;
+}
+// Works out the content version of file, in the post folder open as
+// dir_fd, which is the one at content_filename; see post_struct.
+// Returns 0 on error.
+uint64_t post_get_content_version(post_struct* post, int dir_fd, const char* file) {
+	struct stat file_stat;
+	if(fstatat(dir_fd, file, &file_stat, 0)) {
+		fprintf(stderr, "Error loading post %s, unable to stat %s\n", post->folder_name.str, post->content_filename.str);
+		return 0;
+	}
+	dhash_struct dhash;
+	dhash_init(&dhash);
+	dhash_append_uint64(&dhash, (uint64_t) file_stat.st_ino);
+	dhash_append_uint64(&dhash, (uint64_t) file_stat.st_size);
+	dhash_append_uint64(&dhash, (uint64_t) file_stat.st_mtim.tv_sec);
+	dhash_append_uint64(&dhash, (uint64_t) file_stat.st_mtim.tv_nsec);
+	uint64_t version = dhash_get(&dhash);
+	// 0 means the content is always loaded
+	return version != 0 ? version : 1;
+}
+// Loads a post from its post.html file, which is read in one go; the
+// header fields are copied out. From a content bundle, the body is moved to
+// the front of the same dstring to become the content; otherwise, the file
+// is let go of, and read again when the content is needed.
+post_struct* post_load_single_file(post_struct* post, int dir_fd, dstring_struct* base_dir, int* generate_flag_missing) {
+	if(!dstring_append_printf(&post->content_filename, "%s/%s", base_dir->str, POST_SINGLE_FILE_NAME)) {
+		fprintf(stderr, "Error loading post %s, content filename dstring append error\n", post->folder_name.str);
+		return NULL;
+	}
+	// Stat before reading, so that a change made while reading shows up as
+	// a new version next time.
+	if(dir_fd != -1) {
+		post->content_version = post_get_content_version(post, dir_fd, POST_SINGLE_FILE_NAME);
+		if(post->content_version == 0) {
+			return NULL;
+		}
+	}
+	// The file is let go of right after, so it's never read into an arena,
+	// where it would stay until the site is freed.
+	darena_struct* previous_arena = darena_bind(post->content_version != 0 ? NULL : darena_get_bound());
+	int res = load_content_file_at(&post->content, dir_fd, base_dir, "/" POST_SINGLE_FILE_NAME, "post");
+	darena_bind(previous_arena);
+	if(!res) {
+		return NULL;
+	}
+	int generate_flag = 0;
+	char* line = post->content.str;
+	char* body = post_find_single_file_body(&post->content);
+	if(body == NULL) {
+		fprintf(stderr, "Error loading post %s, %s has no --- line after its header\n", post->folder_name.str, POST_SINGLE_FILE_NAME);
+		return NULL;
+	}
+	while(line < body) {
+		char* line_end = memchr(line, '\n', body - line);
+		char* next_line = line_end != NULL ? line_end + 1 : body;
+		if(line_end == NULL) {
+			line_end = body;
+		}
+		if(line_end > line && line_end[-1] == '\r') {
+			line_end--;
+		}
+		// The --- line itself
+		if(next_line == body) {
+			break;
+		}
+		if(!post_load_header_line(post, line, line_end - line, &generate_flag)) {
+			return NULL;
+		}
+		line = next_line;
+	}
+	if(!generate_flag) {
+		(*generate_flag_missing) = 1;
+		return NULL;
+	}
+	for(size_t i = 0; i < NUM_POST_FILE_FIELDS; i++) {
+		dstring_struct* field = (dstring_struct*) ((char*) post + post_file_fields[i].offset);
+		if(post_file_fields[i].required && field->length == 0) {
+			fprintf(stderr, "Error loading post %s, %s is missing %s\n", post->folder_name.str, POST_SINGLE_FILE_NAME, post_file_fields[i].key);
+			return NULL;
+		}
+	}
+	if(post->content_version != 0) {
+		dstring_free(&post->content);
+		dstring_lazy_init(&post->content);
+	} else {
+		size_t body_length = post->content.str + post->content.length - body;
+		memmove(post->content.str, body, body_length);
+		post->content.length = body_length;
+		post->content.str[body_length] = '\0';
+	}
+
+	if(!dstring_split_to_darray(&post->raw_tags, &post->tags, ',')
+		|| !dstring_split_to_darray(&post->raw_suggested_next_reading, &post->suggested_next_reading_names, '\n')
+		|| !dstring_split_to_darray(&post->raw_suggested_prev_reading, &post->suggested_prev_reading_names, '\n')) {
+		fprintf(stderr, "Error loading post, couldn't split tags or suggested readings\n");
+		return NULL;
+	}
+	return post;
+}
+
+// Loads the post in the folder open as dir_fd (or at base_dir, if dir_fd is
+// -1); see post_load.
+post_struct* post_load_from_dir(post_struct* post, int dir_fd, dstring_struct* base_dir, const char* folder_name, int* generate_flag_missing) {
+	if(check_if_file_exists_at(dir_fd, base_dir, "/" POST_SINGLE_FILE_NAME)) {
+		if(!dstring_append(&post->folder_name, folder_name)) {
+			fprintf(stderr, "Error loading post, folder_name dstring append error\n");
+			return NULL;
+		}
+		return post_load_single_file(post, dir_fd, base_dir, generate_flag_missing);
+	}
 	// First, check for the existence of the generate flag.
-	if(!check_if_file_exists(base_dir, "/generate-post")) {
+	if(!check_if_file_exists_at(dir_fd, base_dir, "/generate-post")) {
 		// Post will not be loaded because it's not to be generated
 		(*generate_flag_missing) = 1;
 		return NULL;
@@ -94,14 +292,37 @@ post_struct* post_load(post_struct* post, dstring_struct* base_dir, const char*
 		fprintf(stderr, "Error loading post, folder_name dstring append error\n");
 		return NULL;
 	}
-	if(!dstring_try_load_file(&post->title, base_dir, "/title", "post")
-		|| !dstring_try_load_file(&post->content, base_dir, "/content.html", "post")
-		|| !dstring_try_load_file(&post->author, base_dir, "/author", "post")
-		|| !dstring_try_load_file(&post->raw_tags, base_dir, "/tags", "post")
-		|| !dstring_try_load_file(&post->series_name, base_dir, "/series", "post")
-		|| !dstring_try_load_file(&post->short_description, base_dir, "/short-description", "post")
-		|| !dstring_try_load_file(&post->long_description, base_dir, "/long-description", "post")
-		|| !dstring_try_load_file(&post->written_date, base_dir, "/written-date", "post")) {
+	if(!dstring_append_printf(&post->content_filename, "%s/content.html", base_dir->str)) {
+		fprintf(stderr, "Error loading post, content filename dstring append error\n");
+		return NULL;
+	}
+	// A content bundle has the content in memory already, so it's just
+	// borrowed; otherwise the file is only checked for.
+	if(dir_fd == -1) {
+		if(!load_content_file(&post->content, base_dir, "/content.html", "post")) {
+			return NULL;
+		}
+	} else {
+		post->content_version = post_get_content_version(post, dir_fd, "content.html");
+		if(post->content_version == 0) {
+			return NULL;
+		}
+	}
+	// The fields, and the flags, are all loaded together, so that they
+	// can be read as a single batch.
+	content_file_request_struct requests[NUM_POST_FILE_FIELDS + 2];
+	for(size_t i = 0; i < NUM_POST_FILE_FIELDS; i++) {
+		requests[i].file = post_file_fields[i].file;
+		requests[i].destination = (dstring_struct*) ((char*) post + post_file_fields[i].offset);
+		requests[i].required = post_file_fields[i].required;
+	}
+	content_file_request_struct* publish_when_ready_request = &requests[NUM_POST_FILE_FIELDS];
+	content_file_request_struct* has_code_request = &requests[NUM_POST_FILE_FIELDS + 1];
+	publish_when_ready_request->file = "/publish-when-ready";
+	has_code_request->file = "/has-code";
+	publish_when_ready_request->destination = has_code_request->destination = NULL;
+	publish_when_ready_request->required = has_code_request->required = 0;
+	if(!load_content_files(dir_fd, base_dir, requests, NUM_POST_FILE_FIELDS + 2, "post")) {
 		return NULL;
 	}
 	dstring_remove_trailing_newlines(&post->title);
@@ -111,56 +332,104 @@ post_struct* post_load(post_struct* post, dstring_struct* base_dir, const char*
 	dstring_remove_trailing_newlines(&post->short_description);
 	dstring_remove_trailing_newlines(&post->long_description);
 	dstring_remove_trailing_newlines(&post->written_date);
+	dstring_remove_trailing_newlines(&post->updated_at);
+	dstring_remove_trailing_newlines(&post->publish_after);
 	if(!dstring_split_to_darray(&post->raw_tags, &post->tags, ',')) {
 		fprintf(stderr, "Error loading post, couldn't split tags\n");
 		return NULL;
 	}
-	// Optional files now; if these fail to load, that is fine. Now, technically,
-	// I should probably check to see if the files exist first, and then if there's
-	// a file load error, then bail out because it would likely only fail if there was
-	// a memory issue or something. TODO for later, I suppose.
-	if(check_if_file_exists(base_dir, "/suggested-next-reading")) {
-		if(!dstring_try_load_file(&post->raw_suggested_next_reading, base_dir, "/suggested-next-reading", "post optional")) {
-			fprintf(stderr, "Error loading post, unable to read suggested-next-reading file\n");
-			return NULL;
-		}
-		if(!dstring_split_to_darray(&post->raw_suggested_next_reading, &post->suggested_next_reading_names, '\n')) {
-			fprintf(stderr, "Error loading post, couldn't split suggested next reading\n");
-			return NULL;
-		}
+	if(!dstring_split_to_darray(&post->raw_suggested_next_reading, &post->suggested_next_reading_names, '\n')) {
+		fprintf(stderr, "Error loading post, couldn't split suggested next reading\n");
+		return NULL;
 	}
-	if(check_if_file_exists(base_dir, "/suggested-prev-reading")) {
-		if(!dstring_try_load_file(&post->raw_suggested_prev_reading, base_dir, "/suggested-prev-reading", "post optional")) {
-			fprintf(stderr, "Error loading post, unable to read suggested-prev-reading file\n");
-			return NULL;
-		}
-		if(!dstring_split_to_darray(&post->raw_suggested_prev_reading, &post->suggested_prev_reading_names, '\n')) {
-			fprintf(stderr, "Error loading post, couldn't split suggested next reading\n");
-			return NULL;
-		}
-
+	if(!dstring_split_to_darray(&post->raw_suggested_prev_reading, &post->suggested_prev_reading_names, '\n')) {
+		fprintf(stderr, "Error loading post, couldn't split suggested next reading\n");
+		return NULL;
 	}
-	if(check_if_file_exists(base_dir, "/updated-at")) {
-		if(!dstring_try_load_file(&post->updated_at, base_dir, "/updated-at", "post optional")) {
-			fprintf(stderr, "Error loading post, unable to read updated-at file\n");
+	post->publish_when_ready = publish_when_ready_request->exists;
+	post->has_code = has_code_request->exists;
+	return post;	
+}
+// This function takes a third parameter, compared to most of the others,
+// that is a pointer to an integer; this integer will be set to 1 if the
+// post failed to be loaded because the generate flag was missing (which is
+// not a critical failure, it should be ignored), and 0 if the post failed
+// to be loaded due to a critical failure.
+// base_dir, as always, shouldn't have a trailing slash.
+// The post folder is held open while it's loaded (unless it's in a content
+// bundle), and everything in it is looked up relative to it.
+post_struct* post_load(post_struct* post, dstring_struct* base_dir, const char* folder_name, int* generate_flag_missing) {
+	(*generate_flag_missing) = 0;
+	int dir_fd = -1;
+	if(get_content_bundle() == NULL) {
+		dir_fd = open_directory(base_dir->str);
+		if(dir_fd == -1) {
+			fprintf(stderr, "Error loading post %s, couldn't open its folder\n", folder_name);
 			return NULL;
 		}
-		dstring_remove_trailing_newlines(&post->updated_at);
 	}
-	if(check_if_file_exists(base_dir, "/publish-after")) {
-		if(!dstring_try_load_file(&post->publish_after, base_dir, "/publish-after", "post optional")) {
-			fprintf(stderr, "Error loading post, unable to read publish-after file\n");
-			return NULL;
-		}
-		dstring_remove_trailing_newlines(&post->publish_after);
+	post_struct* res = post_load_from_dir(post, dir_fd, base_dir, folder_name, generate_flag_missing);
+	close_directory(&dir_fd);
+	return res;
+}
+post_struct* post_load_content(post_struct* post) {
+	if(post->content_version == 0 || post->content.length > 0) {
+		return post;
 	}
-	
-	if(check_if_file_exists(base_dir, "/publish-when-ready")) {
-		post->publish_when_ready = 1;
-		
+	// Not into an arena, so that post_release_content gives the memory back
+	darena_struct* previous_arena = darena_bind(NULL);
+	dstring_struct* res = dstring_read_file(&post->content, post->content_filename.str);
+	darena_bind(previous_arena);
+	if(res == NULL) {
+		fprintf(stderr, "Error loading content of post %s, unable to read %s\n", post->folder_name.str, post->content_filename.str);
+		return NULL;
 	}
-	if(check_if_file_exists(base_dir, "/has-code")) {
-		post->has_code = 1;
+	size_t name_length = strlen("/" POST_SINGLE_FILE_NAME);
+	if(post->content_filename.length <= name_length
+		|| strcmp(post->content_filename.str + post->content_filename.length - name_length, "/" POST_SINGLE_FILE_NAME)) {
+		return post;
 	}
-	return post;	
+	// Only the body of a post.html file is the content
+	char* body = post_find_single_file_body(&post->content);
+	if(body == NULL) {
+		fprintf(stderr, "Error loading content of post %s, %s has no --- line after its header\n", post->folder_name.str, POST_SINGLE_FILE_NAME);
+		post_release_content(post);
+		return NULL;
+	}
+	size_t body_length = post->content.str + post->content.length - body;
+	memmove(post->content.str, body, body_length);
+	post->content.length = body_length;
+	post->content.str[body_length] = '\0';
+	return post;
+}
+void post_release_content(post_struct* post) {
+	if(post->content_version == 0) {
+		return;
+	}
+	dstring_free(&post->content);
+	dstring_lazy_init(&post->content);
+}
+post_struct* post_build_cards(post_struct* post, html_components_struct* html_components) {
+	post_release_cards(post);
+	dstring_struct* values[CARD_TEMPLATE_NUM_FIELDS];
+	values[CARD_TEMPLATE_FOLDER_NAME] = &post->folder_name;
+	values[CARD_TEMPLATE_TITLE] = &post->title;
+	values[CARD_TEMPLATE_LONG_DESCRIPTION] = &post->long_description;
+	// Not into an arena, as they're rebuilt on every run in watch mode
+	darena_struct* previous_arena = darena_bind(NULL);
+	int res = page_template_render_to_dstring(&html_components->tag_card_template, values, &post->tag_card)
+		&& page_template_render_to_dstring(&html_components->series_card_template, values, &post->series_card);
+	darena_bind(previous_arena);
+	if(!res) {
+		fprintf(stderr, "Error building listing cards for post %s, template render error\n", post->folder_name.str);
+		post_release_cards(post);
+		return NULL;
+	}
+	return post;
+}
+void post_release_cards(post_struct* post) {
+	dstring_free(&post->tag_card);
+	dstring_free(&post->series_card);
+	dstring_lazy_init(&post->tag_card);
+	dstring_lazy_init(&post->series_card);
 }
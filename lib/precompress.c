@@ -0,0 +1,197 @@
+#include "dobjects.h"
+#include <zlib.h>
+#ifdef SPARK_BROTLI
+#include <brotli/encode.h>
+#endif
+#include "precompress.h"
+
+// A format that siblings can be written in.
+typedef struct precompress_format_struct {
+	int format;
+
+	// As it's named in the configuration.
+	const char* name;
+
+	// What's added to the end of a file's name for its sibling.
+	const char* extension;
+
+	// Compresses length bytes at data into dest, which is empty.
+	// Returns 0 on error.
+	int (*compress)(const char* data, size_t length, dstring_struct* dest);
+} precompress_format_struct;
+
+int precompress_gzip(const char* data, size_t length, dstring_struct* dest) {
+	z_stream stream;
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+	// 16 more window bits for a gzip header and trailer, rather than zlib's
+	if(deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+		fprintf(stderr, "Error gzipping, couldn't set up zlib\n");
+		return 0;
+	}
+	size_t bound = deflateBound(&stream, length);
+	if(!dstring_init_with_size(dest, bound + 1)) {
+		fprintf(stderr, "Error gzipping, dstring init error\n");
+		deflateEnd(&stream);
+		return 0;
+	}
+	stream.next_in = (Bytef*) data;
+	stream.avail_in = length;
+	stream.next_out = (Bytef*) dest->str;
+	stream.avail_out = bound;
+	int res = deflate(&stream, Z_FINISH);
+	dest->length = stream.total_out;
+	dest->str[dest->length] = '\0';
+	deflateEnd(&stream);
+	if(res != Z_STREAM_END) {
+		fprintf(stderr, "Error gzipping, deflate error\n");
+		return 0;
+	}
+	return 1;
+}
+#ifdef SPARK_BROTLI
+int precompress_brotli(const char* data, size_t length, dstring_struct* dest) {
+	size_t compressed_length = BrotliEncoderMaxCompressedSize(length);
+	if(compressed_length == 0 || !dstring_init_with_size(dest, compressed_length + 1)) {
+		fprintf(stderr, "Error compressing with brotli, dstring init error\n");
+		return 0;
+	}
+	if(!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, length, (const uint8_t*) data, &compressed_length, (uint8_t*) dest->str)) {
+		fprintf(stderr, "Error compressing with brotli, encoder error\n");
+		return 0;
+	}
+	dest->length = compressed_length;
+	dest->str[dest->length] = '\0';
+	return 1;
+}
+#endif
+
+static const precompress_format_struct precompress_formats[] = {
+	{PRECOMPRESS_GZIP, "gzip", ".gz", precompress_gzip},
+#ifdef SPARK_BROTLI
+	{PRECOMPRESS_BROTLI, "br", ".br", precompress_brotli},
+#else
+	{PRECOMPRESS_BROTLI, "br", ".br", NULL},
+#endif
+};
+#define PRECOMPRESS_NUM_FORMATS (sizeof(precompress_formats) / sizeof(precompress_formats[0]))
+
+int precompress_parse_formats(const char* formats_list, int* formats) {
+	(*formats) = 0;
+	const char* name = formats_list;
+	while(*name != '\0') {
+		size_t name_length = strcspn(name, ",");
+		size_t i;
+		for(i = 0; i < PRECOMPRESS_NUM_FORMATS; i++) {
+			if(strlen(precompress_formats[i].name) == name_length && !strncmp(precompress_formats[i].name, name, name_length)) {
+				break;
+			}
+		}
+		if(i == PRECOMPRESS_NUM_FORMATS) {
+			fprintf(stderr, "Error, unknown precompression format %.*s\n", (int) name_length, name);
+			return 0;
+		}
+		if(precompress_formats[i].compress == NULL) {
+			fprintf(stderr, "Error, precompression format %s isn't supported by this build of Spark\n", precompress_formats[i].name);
+			return 0;
+		}
+		(*formats) |= precompress_formats[i].format;
+		name += name_length;
+		if(*name == ',') {
+			name++;
+		}
+	}
+	return 1;
+}
+// Stores the name of filename's sibling in the format into sibling_name.
+// Returns 0 on error.
+int precompress_get_sibling_name(dstring_struct* sibling_name, const char* filename, const precompress_format_struct* format) {
+	dstring_free(sibling_name);
+	dstring_lazy_init(sibling_name);
+	if(!dstring_append(sibling_name, filename)
+		|| !dstring_append(sibling_name, format->extension)) {
+		fprintf(stderr, "Error naming precompressed file, dstring append error\n");
+		return 0;
+	}
+	return 1;
+}
+// Removes the file, if it's there.
+// Returns 0 on error.
+int precompress_remove_file_at(int dir_fd, const char* filename) {
+	if(unlinkat(dir_fd, filename, 0) && errno != ENOENT) {
+		fprintf(stderr, "Error removing precompressed file %s\n", filename);
+		return 0;
+	}
+	return 1;
+}
+int precompress_update_siblings_at(dstringbuilder_struct* contents, int dir_fd, const char* filename, int formats, int changed) {
+	dstring_struct sibling_name;
+	dstring_struct* formed = NULL;
+
+	dstring_lazy_init(&sibling_name);
+
+	int res = 1;
+	for(size_t i = 0; i < PRECOMPRESS_NUM_FORMATS && res; i++) {
+		const precompress_format_struct* format = &precompress_formats[i];
+		if(!(formats & format->format) && !changed) {
+			continue;
+		}
+		if(!precompress_get_sibling_name(&sibling_name, filename, format)) {
+			res = 0;
+			break;
+		}
+		if(!(formats & format->format)) {
+			res = precompress_remove_file_at(dir_fd, sibling_name.str);
+			continue;
+		}
+		if(!changed && !faccessat(dir_fd, sibling_name.str, F_OK, 0)) {
+			continue;
+		}
+		// The compressors want the contents in one piece
+		if(formed == NULL && (formed = dstringbuilder_form(contents)) == NULL) {
+			fprintf(stderr, "Error precompressing %s, dstringbuilder form error\n", filename);
+			res = 0;
+			break;
+		}
+		dstring_struct compressed;
+		dstringbuilder_struct compressed_builder;
+		dstring_lazy_init(&compressed);
+		dstringbuilder_init(&compressed_builder);
+		res = format->compress(formed->str, formed->length, &compressed)
+			&& dstringbuilder_append_dstring(&compressed_builder, &compressed)
+			&& dstringbuilder_write_file_at(&compressed_builder, dir_fd, sibling_name.str);
+		if(!res) {
+			fprintf(stderr, "Error precompressing %s, couldn't write %s\n", filename, sibling_name.str);
+		}
+		dstringbuilder_free(&compressed_builder);
+		dstring_free(&compressed);
+	}
+	if(formed != NULL) {
+		dstring_free(formed);
+		free(formed);
+	}
+	dstring_free(&sibling_name);
+	return res;
+}
+int precompress_remove_siblings_at(int dir_fd, const char* filename) {
+	dstring_struct sibling_name;
+	dstring_lazy_init(&sibling_name);
+	int res = 1;
+	for(size_t i = 0; i < PRECOMPRESS_NUM_FORMATS && res; i++) {
+		res = precompress_get_sibling_name(&sibling_name, filename, &precompress_formats[i])
+			&& precompress_remove_file_at(dir_fd, sibling_name.str);
+	}
+	dstring_free(&sibling_name);
+	return res;
+}
+size_t precompress_get_original_length(const char* filename) {
+	size_t length = strlen(filename);
+	for(size_t i = 0; i < PRECOMPRESS_NUM_FORMATS; i++) {
+		size_t extension_length = strlen(precompress_formats[i].extension);
+		if(length > extension_length && !strcmp(filename + length - extension_length, precompress_formats[i].extension)) {
+			return length - extension_length;
+		}
+	}
+	return 0;
+}
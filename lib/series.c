@@ -1,4 +1,5 @@
 #include "dobjects.h"
+#include "file_helpers.h"
 #include "series.h"
 #include "post.h"
 void series_free(series_struct* series) {
@@ -18,10 +19,10 @@ series_struct* series_load(series_struct* series, dstring_struct* base_dir, cons
 		return NULL;
 	}
 	
-	if(!dstring_try_load_file(&series->landing_desc_html, base_dir, "/landing-desc.html", "series")
-		|| !dstring_try_load_file(&series->short_description, base_dir, "/short-description", "series")
-		|| !dstring_try_load_file(&series->title, base_dir, "/title", "series")
-		|| !dstring_try_load_file(&order_string, base_dir, "/order", "series")) {
+	if(!load_content_file(&series->landing_desc_html, base_dir, "/landing-desc.html", "series")
+		|| !load_content_file(&series->short_description, base_dir, "/short-description", "series")
+		|| !load_content_file(&series->title, base_dir, "/title", "series")
+		|| !load_content_file(&order_string, base_dir, "/order", "series")) {
 		dstring_free(&order_string);
 		return NULL;
 	}
@@ -1,5 +1,6 @@
 #include "file_helpers.h"
 #include "site_configuration.h"
+#include "precompress.h"
 int try_get_config_value(int argc, char* argv[], const char* config_name, void* destination) {
 	if(!paramparser_get_string(argc, argv, config_name, destination, PARAMPARSER_REQUIRED)) {
 		fprintf(stderr, "Error, missing configuration setting %s\n", config_name);
@@ -12,6 +13,13 @@ int load_configuration(configuration_struct* configuration, const char* config_f
 
 	darray_lazy_init(&lines, sizeof(char*));
 	dstring_lazy_init(&configuration->raw_config_file);
+	configuration->num_jobs = 1;
+	configuration->streaming = 0;
+	configuration->precompress_formats = 0;
+	configuration->minify = 0;
+	configuration->prune_css = 0;
+	configuration->external_stylesheets = 0;
+	configuration->combined_themes = 0;
 
 	if(!dstring_read_file(&configuration->raw_config_file, config_file)) {
 		fprintf(stderr, "Error loading config file\n");
@@ -35,6 +43,59 @@ int load_configuration(configuration_struct* configuration, const char* config_f
 		&& try_get_config_value(lines.length, configv, "CONTENT_BASE_DIR", &configuration->content_base_dir)
 		&& try_get_config_value(lines.length, configv, "SITE_GROUP", &configuration->site_group)
 		&& try_get_config_value(lines.length, configv, "RSS_DESCRIPTION", &configuration->rss_description);
+	char* precompress = NULL;
+	did_load = did_load
+		&& paramparser_get_string(lines.length, configv, "PRECOMPRESS", &precompress, PARAMPARSER_OPTIONAL)
+		&& (precompress == NULL || precompress_parse_formats(precompress, &configuration->precompress_formats));
+	char* minify = NULL;
+	did_load = did_load
+		&& paramparser_get_string(lines.length, configv, "MINIFY", &minify, PARAMPARSER_OPTIONAL);
+	if(did_load && minify != NULL) {
+		if(!strcmp(minify, "1")) {
+			configuration->minify = 1;
+		} else if(strcmp(minify, "0")) {
+			fprintf(stderr, "Error, MINIFY must be 1 or 0\n");
+			did_load = 0;
+		}
+	}
+	char* prune_css = NULL;
+	did_load = did_load
+		&& paramparser_get_string(lines.length, configv, "PRUNE_CSS", &prune_css, PARAMPARSER_OPTIONAL);
+	if(did_load && prune_css != NULL) {
+		if(!strcmp(prune_css, "1")) {
+			configuration->prune_css = 1;
+		} else if(strcmp(prune_css, "0")) {
+			fprintf(stderr, "Error, PRUNE_CSS must be 1 or 0\n");
+			did_load = 0;
+		}
+	}
+	char* stylesheets = NULL;
+	did_load = did_load
+		&& paramparser_get_string(lines.length, configv, "STYLESHEETS", &stylesheets, PARAMPARSER_OPTIONAL);
+	if(did_load && stylesheets != NULL) {
+		if(!strcmp(stylesheets, "external")) {
+			configuration->external_stylesheets = 1;
+		} else if(strcmp(stylesheets, "inline")) {
+			fprintf(stderr, "Error, STYLESHEETS must be inline or external\n");
+			did_load = 0;
+		}
+	}
+	char* themes = NULL;
+	did_load = did_load
+		&& paramparser_get_string(lines.length, configv, "THEMES", &themes, PARAMPARSER_OPTIONAL);
+	if(did_load && themes != NULL) {
+		if(!strcmp(themes, "combined")) {
+			configuration->combined_themes = 1;
+		} else if(strcmp(themes, "separate")) {
+			fprintf(stderr, "Error, THEMES must be separate or combined\n");
+			did_load = 0;
+		}
+	}
+	// Pruned CSS is different for each page, so it can only be inline
+	if(did_load && configuration->prune_css && configuration->external_stylesheets) {
+		fprintf(stderr, "Error, PRUNE_CSS can't be used with external STYLESHEETS\n");
+		did_load = 0;
+	}
 
 	
 	darray_free(&lines);
@@ -63,13 +124,15 @@ int do_pre_validations(configuration_struct* configuration) {
 
 	int make_html_dirs_res = 
 		make_directory(&base_dir, "/bright")
-		&& make_directory(&base_dir, "/dark")
 		&& make_directory(&base_dir, "/bright/posts")
 		&& make_directory(&base_dir, "/bright/series")
 		&& make_directory(&base_dir, "/bright/tags")
-		&& make_directory(&base_dir, "/dark/posts")
-		&& make_directory(&base_dir, "/dark/series")
-		&& make_directory(&base_dir, "/dark/tags");
+		// With combined themes, the dark theme's directory isn't used
+		&& (configuration->combined_themes
+			|| (make_directory(&base_dir, "/dark")
+				&& make_directory(&base_dir, "/dark/posts")
+				&& make_directory(&base_dir, "/dark/series")
+				&& make_directory(&base_dir, "/dark/tags")));
 	if(!make_html_dirs_res) {
 		dstring_free(&base_dir);
 		return 0;
@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include "dobjects.h"
 #include "site_content.h"
 
@@ -22,13 +23,30 @@ void site_content_free(site_content_struct* site_content) {
 		tag_posts_free(&((tag_posts_struct*)site_content->tags.array)[i]);
 	}
 	darray_free(&site_content->tags);
+	dhashindex_free(&site_content->misc_pages_index);
+	dhashindex_free(&site_content->series_index);
+	dhashindex_free(&site_content->posts_index);
+	dhashindex_free(&site_content->tags_index);
+	site_snapshot_free(&site_content->snapshot);
+	// Last, as everything above may be using it.
+	darena_free(&site_content->arena);
 }
 void site_content_init(site_content_struct* site_content) {
 	site_content->current_time = 0;
+	site_content->build_manifest = NULL;
+	site_content->page_layout_hash = 0;
+	site_content->precompress_formats = 0;
+	site_content->num_themes = 2;
+	darena_lazy_init(&site_content->arena);
+	site_snapshot_init(&site_content->snapshot);
 	darray_lazy_init(&site_content->misc_pages, sizeof(misc_page_struct));
 	darray_lazy_init(&site_content->series, sizeof(series_struct));
 	darray_lazy_init(&site_content->posts, sizeof(post_struct));
 	darray_lazy_init(&site_content->tags, sizeof(tag_posts_struct));
+	dhashindex_lazy_init(&site_content->misc_pages_index);
+	dhashindex_lazy_init(&site_content->series_index);
+	dhashindex_lazy_init(&site_content->posts_index);
+	dhashindex_lazy_init(&site_content->tags_index);
 	html_components_init(&site_content->html_components);
 	theme_init(&site_content->dark_theme);
 	theme_init(&site_content->bright_theme);
@@ -54,9 +72,10 @@ int site_content_add_post_to_tag(site_content_struct* site_content, post_struct*
 			return 0;
 		}
 
-		tag_posts = find_tag_posts_by_tag(site_content, tag);
-		if(tag_posts == NULL) {
-			fprintf(stderr, "Error adding post to tag, couldn't find tag after it was created\n");
+		size_t tag_index = site_content->tags.length - 1;
+		tag_posts = (tag_posts_struct*) darray_get_elem(&site_content->tags, tag_index);
+		if(!dhashindex_insert(&site_content->tags_index, tag_posts->tag.str, tag_index)) {
+			fprintf(stderr, "Error adding post to tag, couldn't index tag\n");
 			return 0;
 		}
 	}
@@ -80,6 +99,18 @@ int site_content_add_post_to_tags(site_content_struct* site_content, post_struct
 	}
 	return 1;
 }
+time_t site_content_get_next_publish_time(site_content_struct* site_content) {
+	time_t next_publish_time = 0;
+	for(size_t i = 0; i < site_content->posts.length; i++) {
+		post_struct* post = post_get_from_darray(&site_content->posts, i);
+		if(post->can_publish || !post->publish_when_ready || post->publish_after.length == 0) continue;
+		if(post->publish_after_time <= site_content->current_time) continue;
+		if(next_publish_time == 0 || post->publish_after_time < next_publish_time) {
+			next_publish_time = post->publish_after_time;
+		}
+	}
+	return next_publish_time;
+}
 int site_content_setup_tags(site_content_struct* site_content) {
 	for(size_t i = 0; i < site_content->posts.length; i++) {
 		post_struct* post = post_get_from_darray(&site_content->posts, i);
@@ -90,38 +121,80 @@ int site_content_setup_tags(site_content_struct* site_content) {
 	}
 	return 1;
 }
-post_struct* find_post_by_folder_name(site_content_struct* site_content, const char* folder_name) {
-	for(size_t i = 0; i < site_content->posts.length; i++) {
-		post_struct* post = post_get_from_darray(&site_content->posts, i);
-		if(!strcmp(folder_name, post->folder_name.str)) {
-			return post;
+// Appends elem to darray, and indexes it under the key found at key_offset
+// bytes into the appended copy (the key must be a dstring).
+// Returns NULL on error, otherwise a pointer to the appended copy.
+void* site_content_append_indexed(darray_struct* darray, dhashindex_struct* index, const void* elem, size_t key_offset) {
+	if(!darray_append(darray, elem)) {
+		return NULL;
+	}
+	size_t elem_index = darray->length - 1;
+	void* appended = darray_get_elem(darray, elem_index);
+	if(!dhashindex_insert(index, ((dstring_struct*) (appended + key_offset))->str, elem_index)) {
+		// Don't leave an unindexed element behind; the caller still owns
+		// (and will free) the original.
+		darray->length--;
+		return NULL;
+	}
+	return appended;
+}
+misc_page_struct* site_content_add_misc_page(site_content_struct* site_content, misc_page_struct* misc_page) {
+	return site_content_append_indexed(&site_content->misc_pages, &site_content->misc_pages_index, misc_page, offsetof(misc_page_struct, filename));
+}
+series_struct* site_content_add_series(site_content_struct* site_content, series_struct* series) {
+	return site_content_append_indexed(&site_content->series, &site_content->series_index, series, offsetof(series_struct, folder_name));
+}
+post_struct* site_content_add_post(site_content_struct* site_content, post_struct* post) {
+	return site_content_append_indexed(&site_content->posts, &site_content->posts_index, post, offsetof(post_struct, folder_name));
+}
+// Clears the index, and re-adds every element in the darray to it.
+// Returns 0 on error.
+int site_content_rebuild_index(darray_struct* darray, dhashindex_struct* index, size_t key_offset) {
+	dhashindex_clear(index);
+	for(size_t i = 0; i < darray->length; i++) {
+		if(!dhashindex_insert(index, ((dstring_struct*) (darray_get_elem(darray, i) + key_offset))->str, i)) {
+			return 0;
 		}
 	}
-	return NULL;
+	return 1;
+}
+int site_content_rebuild_indexes(site_content_struct* site_content) {
+	if(!site_content_rebuild_index(&site_content->misc_pages, &site_content->misc_pages_index, offsetof(misc_page_struct, filename))
+		|| !site_content_rebuild_index(&site_content->series, &site_content->series_index, offsetof(series_struct, folder_name))
+		|| !site_content_rebuild_index(&site_content->posts, &site_content->posts_index, offsetof(post_struct, folder_name))
+		|| !site_content_rebuild_index(&site_content->tags, &site_content->tags_index, offsetof(tag_posts_struct, tag))) {
+		fprintf(stderr, "Error rebuilding site content indexes\n");
+		return 0;
+	}
+	return 1;
+}
+post_struct* find_post_by_folder_name(site_content_struct* site_content, const char* folder_name) {
+	size_t index;
+	if(!dhashindex_find(&site_content->posts_index, folder_name, &index)) {
+		return NULL;
+	}
+	return post_get_from_darray(&site_content->posts, index);
 }
 series_struct* find_series_by_folder_name(site_content_struct* site_content, const char* folder_name) {
-	for(size_t i = 0; i < site_content->series.length; i++) {
-		if(!strcmp(folder_name, ((series_struct*)site_content->series.array)[i].folder_name.str)) {
-			return &((series_struct*)site_content->series.array)[i];
-		}
+	size_t index;
+	if(!dhashindex_find(&site_content->series_index, folder_name, &index)) {
+		return NULL;
 	}
-	return NULL;
+	return (series_struct*) darray_get_elem(&site_content->series, index);
 }
 misc_page_struct* find_misc_page_by_filename(site_content_struct* site_content, const char* filename) {
-	for(size_t i = 0; i < site_content->misc_pages.length; i++) {
-		if(!strcmp(filename, ((misc_page_struct*)site_content->misc_pages.array)[i].filename.str)) {
-			return &((misc_page_struct*)site_content->misc_pages.array)[i];
-		}
+	size_t index;
+	if(!dhashindex_find(&site_content->misc_pages_index, filename, &index)) {
+		return NULL;
 	}
-	return NULL;
+	return (misc_page_struct*) darray_get_elem(&site_content->misc_pages, index);
 }
 tag_posts_struct* find_tag_posts_by_tag(site_content_struct* site_content, const char* tag) {
-	for(size_t i = 0; i < site_content->tags.length; i++) {
-		if(!strcmp(tag, ((tag_posts_struct*)site_content->tags.array)[i].tag.str)) {
-			return &((tag_posts_struct*)site_content->tags.array)[i];
-		}
+	size_t index;
+	if(!dhashindex_find(&site_content->tags_index, tag, &index)) {
+		return NULL;
 	}
-	return NULL;
+	return (tag_posts_struct*) darray_get_elem(&site_content->tags, index);
 }
 
 int populate_suggested_post_array(site_content_struct* site_content, darray_struct* suggested_post_names, darray_struct* suggested_posts_darray, const char* base_post_name, const char* suggested_post_type) {
@@ -1,26 +1,43 @@
 #include "site_generator.h"
+#include "job_pool.h"
+#include "io_ring.h"
+#include "precompress.h"
+
+// What remove_nonexistent_post_single needs.
+typedef struct remove_nonexistent_posts_context_struct {
+	site_content_struct* site_content;
+
+	// The theme's posts directory, held open.
+	int posts_dir_fd;
+} remove_nonexistent_posts_context_struct;
+
+int remove_nonexistent_post_single(dstring_struct* base_dir, struct dirent* dir_ent, void* context_void_ptr) {
+	// A precompressed sibling (eg my-post.html.gz) goes with its page
+	size_t page_name_length = precompress_get_original_length(dir_ent->d_name);
+	if(page_name_length == 0) {
+		page_name_length = strlen(dir_ent->d_name);
+	}
 
-int remove_nonexistent_post_single(dstring_struct* base_dir, struct dirent* dir_ent, void* site_content_void_ptr) {
 	// Skip processing of index.html file
-	if(!strcmp(dir_ent->d_name, "index.html")) {
+	if(page_name_length == strlen("index.html") && !strncmp(dir_ent->d_name, "index.html", page_name_length)) {
 		return 1;
 	}
 
 	// Skip non-HTML files
-	if(!is_html_filename(dir_ent->d_name)) {
+	if(page_name_length < 6 || strncmp(dir_ent->d_name + page_name_length - 5, ".html", 5)) {
 		return 1;
 	}
-	site_content_struct* site_content = site_content_void_ptr;
+	remove_nonexistent_posts_context_struct* context = context_void_ptr;
 
 	// -5 for the .html ending
-	char* post_name = strndup(dir_ent->d_name, strlen(dir_ent->d_name) - 5);
+	char* post_name = strndup(dir_ent->d_name, page_name_length - 5);
 	if(!post_name) {
 		fprintf(stderr, "Error removing single nonexistent post, strndup error\n");
 		return 0;
 	}
 
 	// Try to find the post
-	post_struct* post = find_post_by_folder_name(site_content, post_name);
+	post_struct* post = find_post_by_folder_name(context->site_content, post_name);
 	free(post_name);
 
 	// If we found it, we aren't going to remove the file
@@ -29,7 +46,7 @@ int remove_nonexistent_post_single(dstring_struct* base_dir, struct dirent* dir_
 	}
 
 	// Didn't find the post, remove the file
-	int res = remove_file_in_directory(base_dir, dir_ent->d_name);
+	int res = remove_file_at(context->posts_dir_fd, base_dir, dir_ent->d_name);
 	if(!res) {
 		fprintf(stderr, "Error removing single nonexistent post, unlink error\n");
 	}
@@ -44,7 +61,12 @@ int remove_nonexistent_posts_for_theme(site_content_struct* site_content, theme_
 		return 0;
 	}
 
-	int res = apply_function_to_directory_entries(&base_dir, 0, DT_REG, remove_nonexistent_post_single, site_content);
+	remove_nonexistent_posts_context_struct context;
+	context.site_content = site_content;
+	context.posts_dir_fd = open_directory_at(theme->html_base_dir_fd, &theme->html_base_dir, "/posts");
+	int res = context.posts_dir_fd != -1
+		&& apply_function_to_directory_entries_at(context.posts_dir_fd, &base_dir, 0, DT_REG, remove_nonexistent_post_single, &context);
+	close_directory(&context.posts_dir_fd);
 	dstring_free(&base_dir);
 
 	if(!res) {
@@ -62,9 +84,16 @@ int remove_old_tag_files(site_content_struct* site_content, theme_struct* theme)
 		dstring_free(&tag_dir);
 		return 0;
 	}
+	int tag_dir_fd = open_directory_at(theme->html_base_dir_fd, &theme->html_base_dir, "/tags");
+	if(tag_dir_fd == -1) {
+		fprintf(stderr, "Error generating tags, couldn't open tag directory\n");
+		dstring_free(&tag_dir);
+		return 0;
+	}
 	darray_struct* html_files = get_html_filenames_in_directory(tag_dir.str);
 	if(html_files == NULL) {
 		fprintf(stderr, "Error generating tags, couldn't get HTML filenames in tag directory\n");
+		close_directory(&tag_dir_fd);
 		dstring_free(&tag_dir);
 		return 0;
 	}
@@ -81,13 +110,16 @@ int remove_old_tag_files(site_content_struct* site_content, theme_struct* theme)
 			// Not found. Remove file.
 			if(!dstring_append((dstring_struct*) darray_get_elem(html_files, i), ".html")) {
 				fprintf(stderr, "Error generating tags, dstring append error\n");
+				close_directory(&tag_dir_fd);
 				dstring_free(&tag_dir);
 				darray_of_dstrings_free(html_files);
 				free(html_files);
 				return 0;
 			}
-			if(!remove_file_in_directory(&tag_dir, ((dstring_struct*) darray_get_elem(html_files, i))->str)) {
+			if(!remove_file_at(tag_dir_fd, &tag_dir, ((dstring_struct*) darray_get_elem(html_files, i))->str)
+				|| !precompress_remove_siblings_at(tag_dir_fd, ((dstring_struct*) darray_get_elem(html_files, i))->str)) {
 				fprintf(stderr, "Error generating tags, couldn't remove old file\n");
+				close_directory(&tag_dir_fd);
 				dstring_free(&tag_dir);
 				darray_of_dstrings_free(html_files);
 				free(html_files);
@@ -98,61 +130,187 @@ int remove_old_tag_files(site_content_struct* site_content, theme_struct* theme)
 	}
 	darray_of_dstrings_free(html_files);
 	free(html_files);
+	close_directory(&tag_dir_fd);
 	dstring_free(&tag_dir);
 	return 1;
 }
 
 
-int generate_tags(site_content_struct* site_content) {
-	// Remove files that won't be generated
-	if(!remove_old_tag_files(site_content, &site_content->bright_theme)
-		|| !remove_old_tag_files(site_content, &site_content->dark_theme)) {
-		fprintf(stderr, "Error removing old tag files\n");
+// A page to be created by run_page_jobs. Exactly one of post and misc_page
+// is set.
+typedef struct page_job_struct {
+	post_struct* post;
+	misc_page_struct* misc_page;
+
+	// The messages from creating the page; they are printed out once all
+	// of the pages are done, so that they come out in order.
+	dstring_struct log;
+} page_job_struct;
+
+typedef struct page_jobs_context_struct {
+	site_content_struct* site_content;
+	darray_struct* jobs;
+} page_jobs_context_struct;
+
+// Returns NULL on error.
+darray_struct* append_page_job(darray_struct* jobs, post_struct* post, misc_page_struct* misc_page) {
+	page_job_struct job;
+	job.post = post;
+	job.misc_page = misc_page;
+	dstring_lazy_init(&job.log);
+	if(!darray_append(jobs, &job)) {
+		fprintf(stderr, "Error adding page job, darray append error\n");
+		return NULL;
+	}
+	return jobs;
+}
+// A job_pool job; creates a single page.
+int create_page_job(size_t index, void* context_void_ptr) {
+	page_jobs_context_struct* context = context_void_ptr;
+	page_job_struct* job = (page_job_struct*) darray_get_elem(context->jobs, index);
+	if(job->post != NULL) {
+		int res = create_post_page(context->site_content, job->post, &job->log);
+		// The page is written, so the content can go until the next time
+		post_release_content(job->post);
+		if(!res) {
+			fprintf(stderr, "Error generating post %s\n", job->post->title.str);
+			return 0;
+		}
+	} else if(!create_misc_page(context->site_content, job->misc_page, &job->log)) {
+		fprintf(stderr, "Error generating page %s\n", job->misc_page->filename.str);
 		return 0;
 	}
-	// Generate each tag listing
-	for(size_t i = 0; i < site_content->tags.length; i++) {
+	return 1;
+}
+// Creates the pages described by jobs (a darray of page_job_struct's),
+// using up to configuration->num_jobs threads. Once they're all done,
+// the messages from each page are printed out in the order of the jobs,
+// so the output is the same as if the pages were created one at a time.
+// Frees the logs, but not the darray itself.
+// Returns 0 on error.
+int run_page_jobs(configuration_struct* configuration, site_content_struct* site_content, darray_struct* jobs) {
+	page_jobs_context_struct context;
+	context.site_content = site_content;
+	context.jobs = jobs;
+
+	int res = job_pool_run(jobs->length, configuration->num_jobs, create_page_job, &context);
+	for(size_t i = 0; i < jobs->length; i++) {
+		page_job_struct* job = (page_job_struct*) darray_get_elem(jobs, i);
+		fputs(job->log.str, stdout);
+		dstring_free(&job->log);
+	}
+	return res;
+}
+// In streaming mode, how many pages are built and created together for each
+// thread; enough to keep the threads busy, while only holding a handful of
+// pages at once.
+#define STREAMING_PAGES_PER_JOB 16
+
+// Returns how many of the num_pages pages of a kind are built and created
+// together: all of them, unless in streaming mode.
+size_t get_page_batch_size(configuration_struct* configuration, size_t num_pages) {
+	if(!configuration->streaming) {
+		return num_pages > 0 ? num_pages : 1;
+	}
+	return (size_t) configuration->num_jobs * STREAMING_PAGES_PER_JOB;
+}
+// Returns the end of the batch of pages that starts at start.
+size_t get_page_batch_end(size_t start, size_t batch_size, size_t num_pages) {
+	return num_pages - start > batch_size ? start + batch_size : num_pages;
+}
+// Frees each misc_page in the darray, as well as the darray itself.
+void darray_of_misc_pages_free(darray_struct* misc_pages) {
+	for(size_t i = 0; i < misc_pages->length; i++) {
+		misc_page_free((misc_page_struct*) darray_get_elem(misc_pages, i));
+	}
+	darray_free(misc_pages);
+}
+
+// Fills in tag_page with the listing page for a single tag.
+// Returns 0 on error.
+int build_tag_page(tag_posts_struct* tag_posts, misc_page_struct* tag_page) {
+	// Just a small note: The description is copied from the title.
+	// I'm calling this out because I had tried moving the description append
+	// to the top, to make things line up better, and was initially confused why
+	// the description was blank.
+	if(!dstring_append_printf(&tag_page->filename, "tags/%s.html", tag_posts->tag.str)
+		|| !dstring_append_printf(&tag_page->title, "%s tag listing", tag_posts->tag.str)
+		|| !dstring_append(&tag_page->description, tag_page->title.str)
+		|| !dstringbuilder_append_printf(&tag_page->content_builder, "<header><h1>Tag: %s</h1></header>\n<section>\n", tag_posts->tag.str)) {
+		fprintf(stderr, "Error generating tags, dstring append error\n");
+		return 0;
+	}
+	// The posts' cards were already rendered by build_post_cards
+	for(size_t j = 0; j < tag_posts->posts.length; j++) {
+		post_struct* post = post_get_from_darray_of_post_pointers(&tag_posts->posts, j);
+		if(!dstringbuilder_append_dstring(&tag_page->content_builder, &post->tag_card)) {
+			fprintf(stderr, "Error generating tags, post dstring append error\n");
+			return 0;
+		}
+	}
+	if(!dstringbuilder_append(&tag_page->content_builder, "</section>\n")) {
+		fprintf(stderr, "Error generating tags, dstring append error\n");
+		return 0;
+	}
+	return 1;
+}
+// Generates the listing pages for the tags from start up to (but not
+// including) end. The pages are all built first, and then created together.
+// Returns 0 on error.
+int generate_tag_pages(configuration_struct* configuration, site_content_struct* site_content, size_t start, size_t end) {
+	darray_struct tag_pages;
+	darray_struct jobs;
+
+	darray_lazy_init(&tag_pages, sizeof(misc_page_struct));
+	darray_lazy_init(&jobs, sizeof(page_job_struct));
+
+	for(size_t i = start; i < end; i++) {
 		tag_posts_struct* tag_posts = (tag_posts_struct*) darray_get_elem(&site_content->tags, i);
 		misc_page_struct tag_page;
 		misc_page_init(&tag_page);
-		// Just a small note: The description is copied from the title.
-		// I'm calling this out because I had tried moving the description append
-		// to the top, to make things line up better, and was initially confused why
-		// the description was blank.
-                if(!dstring_append_printf(&tag_page.filename, "tags/%s.html", tag_posts->tag.str)
-			|| !dstring_append_printf(&tag_page.title, "%s tag listing", tag_posts->tag.str)
-			|| !dstring_append(&tag_page.description, tag_page.title.str)
-			|| !dstring_append_printf(&tag_page.content, "<header><h1>Tag: %s</h1></header>\n<section>\n", tag_posts->tag.str)) {
-			fprintf(stderr, "Error generating tags, dstring append error\n");
+		if(!build_tag_page(tag_posts, &tag_page)) {
+			fprintf(stderr, "Error generating page for %s\n", tag_posts->tag.str);
 			misc_page_free(&tag_page);
+			darray_of_misc_pages_free(&tag_pages);
 			return 0;
 		}
-		for(size_t j = 0; j < tag_posts->posts.length; j++) {
-			post_struct* post = post_get_from_darray_of_post_pointers(&tag_posts->posts, j);
-			// Split this one up onto multiple lines to make it more readable because
-			// it is so long.
-			if(!dstring_append_printf(&tag_page.content,
-						"<div><h3><a href='/posts/%s'>%s</a></h3>\n<p>%s</p>\n</div>\n",
-						post->folder_name.str,
-						post->title.str,
-						post->long_description.str)) {
-				fprintf(stderr, "Error generating tags, post dstring append error\n");
-				misc_page_free(&tag_page);
-				return 0;
-			}
-		}
-		if(!dstring_append(&tag_page.content, "</section>\n")) {
-			fprintf(stderr, "Error generating tags, dstring append error\n");
+		if(!darray_append(&tag_pages, &tag_page)) {
+			fprintf(stderr, "Error generating tags, darray append error\n");
 			misc_page_free(&tag_page);
+			darray_of_misc_pages_free(&tag_pages);
 			return 0;
 		}
-		if(!create_misc_page(site_content, &tag_page)) {
-			fprintf(stderr, "Error generating page for %s\n", tag_posts->tag.str);
-			misc_page_free(&tag_page);
+	}
+	// tag_pages won't be resized from here on, so it's safe to point into it.
+	for(size_t i = 0; i < tag_pages.length; i++) {
+		if(!append_page_job(&jobs, NULL, (misc_page_struct*) darray_get_elem(&tag_pages, i))) {
+			darray_of_misc_pages_free(&tag_pages);
+			darray_free(&jobs);
+			return 0;
+		}
+	}
+	int jobs_res = run_page_jobs(configuration, site_content, &jobs);
+	darray_of_misc_pages_free(&tag_pages);
+	darray_free(&jobs);
+	if(!jobs_res) {
+		fprintf(stderr, "Error generating tags, couldn't create tag pages\n");
+		return 0;
+	}
+	return 1;
+}
+int generate_tags(configuration_struct* configuration, site_content_struct* site_content) {
+	// Remove files that won't be generated
+	if(!remove_old_tag_files(site_content, &site_content->bright_theme)
+		|| (site_content->num_themes == 2 && !remove_old_tag_files(site_content, &site_content->dark_theme))) {
+		fprintf(stderr, "Error removing old tag files\n");
+		return 0;
+	}
+	// Generate each tag listing; in streaming mode, a batch at a time.
+	size_t batch_size = get_page_batch_size(configuration, site_content->tags.length);
+	for(size_t start = 0; start < site_content->tags.length; start += batch_size) {
+		if(!generate_tag_pages(configuration, site_content, start, get_page_batch_end(start, batch_size, site_content->tags.length))) {
 			return 0;
 		}
-		misc_page_free(&tag_page);
-		
 	}
 	// Generate the index page last; this is so that if anything fails
 	// with generating the individual tag pages, the index page won't have
@@ -185,7 +343,7 @@ int generate_tags(site_content_struct* site_content) {
 		misc_page_free(&tags_page);
 		return 0;
 	}
-	if(!create_misc_page(site_content, &tags_page)) {
+	if(!create_misc_page(site_content, &tags_page, NULL)) {
 		fprintf(stderr, "Error generating tags, couldn't create tags listing page\n");
 		misc_page_free(&tags_page);
 		return 0;
@@ -194,38 +352,55 @@ int generate_tags(site_content_struct* site_content) {
 	return 1;
 	
 }
-// This is the sort function for the 'new and updated posts' list.
-int updated_post_sort_compare(const void* post_a, const void* post_b) {
-	time_t post_a_time = ((post_struct*)post_a)->written_date_time > ((post_struct*)post_a)->updated_at_time ? ((post_struct*)post_a)->written_date_time : ((post_struct*)post_a)->updated_at_time;
-	time_t post_b_time = ((post_struct*)post_b)->written_date_time > ((post_struct*)post_b)->updated_at_time ? ((post_struct*)post_b)->written_date_time : ((post_struct*)post_b)->updated_at_time;
-	return post_b_time - post_a_time;
+// This is the sort function for the 'new and updated posts' list, which
+// is a list of post pointers.
+int updated_post_sort_compare(const void* post_a_ptr, const void* post_b_ptr) {
+	post_struct* post_a = *((post_struct**) post_a_ptr);
+	post_struct* post_b = *((post_struct**) post_b_ptr);
+	time_t post_a_time = post_a->written_date_time > post_a->updated_at_time ? post_a->written_date_time : post_a->updated_at_time;
+	time_t post_b_time = post_b->written_date_time > post_b->updated_at_time ? post_b->written_date_time : post_b->updated_at_time;
+	if(post_a_time != post_b_time) {
+		return post_a_time < post_b_time ? 1 : -1;
+	}
+	// The same order as the posts themselves (see post_sort_compare), as
+	// qsort isn't stable
+	if(post_a->written_date_time != post_b->written_date_time) {
+		return post_a->written_date_time < post_b->written_date_time ? 1 : -1;
+	}
+	return strcmp(post_a->folder_name.str, post_b->folder_name.str);
 }
 int generate_index_page(site_content_struct* site_content, misc_page_struct* index_page_original) {
 	misc_page_struct index_page;
 	misc_page_init(&index_page);
 
-	darray_struct* new_posts = darray_clone(&site_content->posts);
-	if(new_posts == NULL) {
-		fprintf(stderr, "Error generating index page, couldn't clone posts\n");
-		misc_page_free(&index_page);
-		return 0;
+	// Pointers to the posts are sorted, rather than copies of the posts,
+	// which are much bigger.
+	darray_struct new_posts;
+	darray_lazy_init(&new_posts, sizeof(post_struct*));
+	for(size_t i = 0; i < site_content->posts.length; i++) {
+		post_struct* post = post_get_from_darray(&site_content->posts, i);
+		if(!darray_append(&new_posts, &post)) {
+			fprintf(stderr, "Error generating index page, couldn't make list of posts\n");
+			darray_free(&new_posts);
+			misc_page_free(&index_page);
+			return 0;
+		}
 	}
-	qsort(new_posts->array, new_posts->length, new_posts->elem_size, &updated_post_sort_compare);
+	qsort(new_posts.array, new_posts.length, new_posts.elem_size, &updated_post_sort_compare);
 	if(!dstring_append(&index_page.filename, "index.html")
 		|| !dstring_append(&index_page.title, index_page_original->title.str)
 		|| !dstring_append(&index_page.description, index_page_original->description.str)
 		|| !dstring_append_printf(&index_page.content, "<article>\n%s<section>\n<h2>New and updated posts</h2>\n", index_page_original->content.str)) {
 		fprintf(stderr, "Error generating index page, dstring append error\n");
 		misc_page_free(&index_page);
-		darray_free(new_posts);
-		free(new_posts);
+		darray_free(&new_posts);
 		return 0;
 	}
 	// TODO: This should be a configuration setting
 	const int SHOW_X_NEW_POSTS = 5;
 	int num_shown = 0;
-	for(size_t i = 0; i < new_posts->length; i++) {
-		post_struct* post = post_get_from_darray(new_posts, i);
+	for(size_t i = 0; i < new_posts.length; i++) {
+		post_struct* post = post_get_from_darray_of_post_pointers(&new_posts, i);
 		if(!post->can_publish) continue;
 		if(num_shown >= SHOW_X_NEW_POSTS) break;
 		if(!dstring_append_printf(&index_page.content,
@@ -236,8 +411,7 @@ int generate_index_page(site_content_struct* site_content, misc_page_struct* ind
 					post->written_date.str)) {
 			fprintf(stderr, "Error generating index page, dstring append error\n");
 			misc_page_free(&index_page);
-			darray_free(new_posts);	
-			free(new_posts);
+			darray_free(&new_posts);
 			return 0;
 		}
 		if(post->updated_at.length > 0) {
@@ -246,8 +420,7 @@ int generate_index_page(site_content_struct* site_content, misc_page_struct* ind
 						post->updated_at.str)) {
 				fprintf(stderr, "Error generating index page, dstring append error\n");
 				misc_page_free(&index_page);
-				darray_free(new_posts);
-				free(new_posts);
+				darray_free(&new_posts);
 				return 0;
 			}
 		}
@@ -257,8 +430,7 @@ int generate_index_page(site_content_struct* site_content, misc_page_struct* ind
 					post->series->title.str)) {
 			fprintf(stderr, "Error generating index page, dstring append error\n");
 			misc_page_free(&index_page);
-			darray_free(new_posts);
-			free(new_posts);
+			darray_free(&new_posts);
 			return 0;
 		}
 		num_shown++;
@@ -266,21 +438,18 @@ int generate_index_page(site_content_struct* site_content, misc_page_struct* ind
 	if(!dstring_append(&index_page.content, "</section>\n</article>\n")) {
 		fprintf(stderr, "Error generating index page, dstring append error\n");
 		misc_page_free(&index_page);
-		darray_free(new_posts);
-		free(new_posts);
+		darray_free(&new_posts);
 		return 0;
 	}
 
-	if(!create_misc_page(site_content, &index_page)) {
+	if(!create_misc_page(site_content, &index_page, NULL)) {
 		fprintf(stderr, "Error generating index page\n");
 		misc_page_free(&index_page);
-		darray_free(new_posts);
-		free(new_posts);
+		darray_free(&new_posts);
 		return 0;
 	}			
 	misc_page_free(&index_page);
-	darray_free(new_posts);
-	free(new_posts);
+	darray_free(&new_posts);
 	return 1;
 }
 int generate_misc_pages(site_content_struct* site_content) {
@@ -292,7 +461,7 @@ int generate_misc_pages(site_content_struct* site_content) {
 				return 0;
 			}
 		} else {
-			if(!create_misc_page(site_content, misc_page)) {
+			if(!create_misc_page(site_content, misc_page, NULL)) {
 				fprintf(stderr, "Error generating misc_page %s\n", misc_page->filename.str);
 				return 0;
 			}
@@ -300,18 +469,77 @@ int generate_misc_pages(site_content_struct* site_content) {
 	}
 	return 1;
 }
-int generate_posts(site_content_struct* site_content) {
+// Has the build manifest stat() the pages of the posts from start up to
+// (but not including) end as a single batch, when io_ring is in use, rather
+// than each page job stat()'ing them one at a time to check whether they're
+// current.
+void prefetch_post_page_stats(site_content_struct* site_content, size_t start, size_t end) {
+	if(site_content->build_manifest == NULL || io_ring_get() == NULL) {
+		return;
+	}
+	theme_struct* themes[] = { &site_content->bright_theme, &site_content->dark_theme };
+	size_t num_filenames = (end - start) * site_content->num_themes;
+	dstring_struct filenames;
+	size_t* offsets = malloc(num_filenames * sizeof(size_t));
+	const char** filename_ptrs = malloc(num_filenames * sizeof(char*));
+	dstring_lazy_init(&filenames);
+	if(offsets == NULL || filename_ptrs == NULL) {
+		free(offsets);
+		free(filename_ptrs);
+		return;
+	}
+	// Each theme's pages are together, as they're stat()'d relative to
+	// the theme's directory.
+	size_t num_posts = end - start;
+	for(size_t j = 0; j < site_content->num_themes; j++) {
+		for(size_t i = start; i < end; i++) {
+			post_struct* post = post_get_from_darray(&site_content->posts, i);
+			offsets[j * num_posts + (i - start)] = filenames.length;
+			if(!dstring_append_printf(&filenames, "%s/posts/%s.html", themes[j]->html_base_dir.str, post->folder_name.str)
+				|| !dstring_append_length(&filenames, "", 1)) {
+				// The pages just get stat()'d one at a time
+				dstring_free(&filenames);
+				free(offsets);
+				free(filename_ptrs);
+				return;
+			}
+		}
+	}
+	for(size_t i = 0; i < num_filenames; i++) {
+		filename_ptrs[i] = filenames.str + offsets[i];
+	}
+	for(size_t j = 0; j < site_content->num_themes; j++) {
+		build_manifest_prefetch_stats(site_content->build_manifest, themes[j]->html_base_dir_fd, themes[j]->html_base_dir.length, filename_ptrs + j * num_posts, num_posts);
+	}
+	dstring_free(&filenames);
+	free(offsets);
+	free(filename_ptrs);
+}
+int generate_posts(configuration_struct* configuration, site_content_struct* site_content) {
 	// Remove nonexistent posts
-	if(!remove_nonexistent_posts_for_theme(site_content, &site_content->dark_theme)
+	if((site_content->num_themes == 2 && !remove_nonexistent_posts_for_theme(site_content, &site_content->dark_theme))
 		|| !remove_nonexistent_posts_for_theme(site_content, &site_content->bright_theme)) {
 		fprintf(stderr, "Error generating posts, couldn't remove nonexistent posts\n");
 		return 0;
 	}
 
-	for(size_t i = 0; i < site_content->posts.length; i++) {
-		post_struct* post = post_get_from_darray(&site_content->posts, i);
-		if(!create_post_page(site_content, post)) {
-			fprintf(stderr, "Error generating post %s\n", post->title.str);
+	// Each post's content is only loaded while its page is being created, so
+	// in streaming mode, only a batch of posts' contents are loaded at once.
+	size_t batch_size = get_page_batch_size(configuration, site_content->posts.length);
+	for(size_t start = 0; start < site_content->posts.length; start += batch_size) {
+		size_t end = get_page_batch_end(start, batch_size, site_content->posts.length);
+		prefetch_post_page_stats(site_content, start, end);
+		darray_struct jobs;
+		darray_lazy_init(&jobs, sizeof(page_job_struct));
+		for(size_t i = start; i < end; i++) {
+			if(!append_page_job(&jobs, post_get_from_darray(&site_content->posts, i), NULL)) {
+				darray_free(&jobs);
+				return 0;
+			}
+		}
+		int res = run_page_jobs(configuration, site_content, &jobs);
+		darray_free(&jobs);
+		if(!res) {
 			return 0;
 		}
 	}
@@ -320,19 +548,96 @@ int generate_posts(site_content_struct* site_content) {
 	return 1;
 }
 int make_series_dir(series_struct* series, theme_struct* theme) {
-	if(!dstring_append(&theme->html_base_dir, "/series/")) {
+	dstring_struct series_dir;
+	dstring_lazy_init(&series_dir);
+	if(!dstring_append_printf(&series_dir, "/series/%s", series->folder_name.str)) {
 		fprintf(stderr, "Error making series dir, dstring append error\n");
 		return 0;
 	}
-	if(!make_directory(&theme->html_base_dir, series->folder_name.str)) {
+	int res = make_directory_at(theme->html_base_dir_fd, &theme->html_base_dir, series_dir.str);
+	if(!res) {
 		fprintf(stderr, "Error making series dir for %s\n", series->folder_name.str);
-		dstring_remove_num_chars_in_text(&theme->html_base_dir, "/series/");
+	}
+	dstring_free(&series_dir);
+	return res;
+}
+// Fills in series_page with the landing page for a single series.
+// Returns 0 on error.
+int build_series_page(series_struct* series, misc_page_struct* series_page) {
+	if(!dstring_append_printf(&series_page->filename, "series/%s/index.html", series->folder_name.str)
+		|| !dstring_append_printf(&series_page->description, "Landing page for %s", series->title.str)
+		|| !dstring_append_printf(&series_page->title, "%s listing", series->title.str)
+		|| !dstringbuilder_append_printf(&series_page->content_builder, "<header><h1>%s</h1></header>\n<p>%s</p><br />\n<section>\n", series->title.str, series->landing_desc_html.str)) {
+		fprintf(stderr, "Error generating series, dstring_append error\n");
+		return 0;
+	}
+	for(size_t j = 0; j < series->posts.length; j++) {
+		post_struct* post = post_get_from_darray_of_post_pointers(&series->posts, j);
+		if(!dstringbuilder_append_dstring(&series_page->content_builder, &post->series_card)) {
+			fprintf(stderr, "Error generating series, post dstring_append error\n");
+			return 0;
+		}
+	}
+	if(!dstringbuilder_append(&series_page->content_builder, "</section>\n")) {
+		fprintf(stderr, "Error generating series, dstring append error\n");
+		return 0;
+	}
+	return 1;
+}
+// Generates the landing pages for the series from start up to (but not
+// including) end. The pages are all built first, and then created together.
+// Returns 0 on error.
+int generate_series_pages(configuration_struct* configuration, site_content_struct* site_content, size_t start, size_t end) {
+	darray_struct series_pages;
+	darray_struct jobs;
+
+	darray_lazy_init(&series_pages, sizeof(misc_page_struct));
+	darray_lazy_init(&jobs, sizeof(page_job_struct));
+
+	for(size_t i = start; i < end; i++) {
+		series_struct* series = (series_struct*) darray_get_elem(&site_content->series, i);
+		misc_page_struct series_page;
+		misc_page_init(&series_page);
+
+		if(!build_series_page(series, &series_page)) {
+			misc_page_free(&series_page);
+			darray_of_misc_pages_free(&series_pages);
+			return 0;
+		}
+		// The directories are made here, rather than in the page jobs,
+		// because make_series_dir modifies the theme.
+		if(!make_series_dir(series, &site_content->bright_theme)
+			|| (site_content->num_themes == 2 && !make_series_dir(series, &site_content->dark_theme))) {
+			fprintf(stderr, "Error generating series, couldn't make series directories\n");
+			misc_page_free(&series_page);
+			darray_of_misc_pages_free(&series_pages);
+			return 0;
+		}
+		if(!darray_append(&series_pages, &series_page)) {
+			fprintf(stderr, "Error generating series, darray append error\n");
+			misc_page_free(&series_page);
+			darray_of_misc_pages_free(&series_pages);
+			return 0;
+		}
+	}
+	// series_pages won't be resized from here on, so it's safe to point into it.
+	for(size_t i = 0; i < series_pages.length; i++) {
+		if(!append_page_job(&jobs, NULL, (misc_page_struct*) darray_get_elem(&series_pages, i))) {
+			darray_of_misc_pages_free(&series_pages);
+			darray_free(&jobs);
+			return 0;
+		}
+	}
+	int jobs_res = run_page_jobs(configuration, site_content, &jobs);
+	darray_of_misc_pages_free(&series_pages);
+	darray_free(&jobs);
+	if(!jobs_res) {
+		fprintf(stderr, "Error generating series, couldn't generate pages\n");
 		return 0;
 	}
-	dstring_remove_num_chars_in_text(&theme->html_base_dir, "/series/");
 	return 1;
 }
-int generate_series(site_content_struct* site_content) {
+int generate_series(configuration_struct* configuration, site_content_struct* site_content) {
 	// TODO: Remove old series pages
 	misc_page_struct series_listing_page;
 	misc_page_init(&series_listing_page);
@@ -347,9 +652,6 @@ int generate_series(site_content_struct* site_content) {
 	}
 	for(size_t i = 0; i < site_content->series.length; i++) {
 		series_struct* series = (series_struct*) darray_get_elem(&site_content->series, i);
-		misc_page_struct series_page;
-		misc_page_init(&series_page);
-
 		if(!dstring_append_printf(&series_listing_page.content,
 					"<section>\n<h3><a href=\"/series/%s\">%s</a></h3>\n<p>%s</p>\n</section>\n",
 					series->folder_name.str,
@@ -357,53 +659,18 @@ int generate_series(site_content_struct* site_content) {
 					series->short_description.str)) {
 			fprintf(stderr, "Error generating series, error appending to series listing page\n");
 			misc_page_free(&series_listing_page);
-			misc_page_free(&series_page);
 			return 0;
 		}
-		if(!dstring_append_printf(&series_page.filename, "series/%s/index.html", series->folder_name.str)
-			|| !dstring_append_printf(&series_page.description, "Landing page for %s", series->title.str)
-			|| !dstring_append_printf(&series_page.title, "%s listing", series->title.str)
-			|| !dstring_append_printf(&series_page.content, "<header><h1>%s</h1></header>\n<p>%s</p><br />\n<section>\n", series->title.str, series->landing_desc_html.str)) {
-			fprintf(stderr, "Error generating series, dstring_append error\n");
-			misc_page_free(&series_page);
-			misc_page_free(&series_listing_page);
-			return 0;
-		}
-		for(size_t j = 0; j < series->posts.length; j++) {
-			post_struct* post = post_get_from_darray_of_post_pointers(&series->posts, j);
-			if(!dstring_append_printf(&series_page.content,
-						"<div><h3><a href=\"/posts/%s\">%s</a></h3>\n<p>\n%s</p></div>\n",
-						post->folder_name.str,
-						post->title.str,
-						post->long_description.str)) {
-				fprintf(stderr, "Error generating series, post dstring_append error\n");
-				misc_page_free(&series_page);
-				misc_page_free(&series_listing_page);
-				return 0;
-			}
-		}
-		if(!dstring_append(&series_page.content, "</section>\n")) {
-			fprintf(stderr, "Error generating series, dstring append error\n");
-			misc_page_free(&series_page);
-			misc_page_free(&series_listing_page);
-			return 0;
-		}
-		if(!make_series_dir(series, &site_content->bright_theme)
-			|| !make_series_dir(series, &site_content->dark_theme)) {
-			fprintf(stderr, "Error generating series, couldn't make series directories\n");
-			misc_page_free(&series_page);
-			misc_page_free(&series_listing_page);
-			return 0;
-		}
-		if(!create_misc_page(site_content, &series_page)) {
-			fprintf(stderr, "Error generating series, couldn't generate pages\n");
-			misc_page_free(&series_page);
+	}
+	// Each series' landing page; in streaming mode, a batch at a time.
+	size_t batch_size = get_page_batch_size(configuration, site_content->series.length);
+	for(size_t start = 0; start < site_content->series.length; start += batch_size) {
+		if(!generate_series_pages(configuration, site_content, start, get_page_batch_end(start, batch_size, site_content->series.length))) {
 			misc_page_free(&series_listing_page);
 			return 0;
 		}
-		misc_page_free(&series_page);
 	}
-	if(!create_misc_page(site_content, &series_listing_page)) {
+	if(!create_misc_page(site_content, &series_listing_page, NULL)) {
 		fprintf(stderr, "Error generating series, couldn't generate series_listing_page\n");
 		misc_page_free(&series_listing_page);
 		return 0;
@@ -422,7 +689,7 @@ int generate_sitemap(site_content_struct* site_content) {
 	if(!dstring_append(&sitemap.title, "Sitemap")
 		|| !dstring_append(&sitemap.description, "Sitemap")
 		|| !dstring_append(&sitemap.filename, "sitemap.html")
-		|| !dstring_append(&sitemap.content, "<header><h1>All posts</h1></header>\n")) {
+		|| !dstringbuilder_append(&sitemap.content_builder, "<header><h1>All posts</h1></header>\n")) {
 		fprintf(stderr, "Error generating sitemap, dstring append error\n");
 		misc_page_free(&sitemap);
 		return 0;
@@ -430,39 +697,29 @@ int generate_sitemap(site_content_struct* site_content) {
 	// TODO: Practically identical to generate_series
 	for(size_t i = 0; i < site_content->series.length; i++) {
 		series_struct* series = (series_struct*) darray_get_elem(&site_content->series, i);
-		if(!dstring_append(&sitemap.content, "<header><h2>")
-			|| !dstring_append(&sitemap.content, series->title.str)
-			|| !dstring_append(&sitemap.content, "</h2></header>\n")
-			|| !dstring_append(&sitemap.content, "<p>")
-			|| !dstring_append(&sitemap.content, series->landing_desc_html.str)
-			|| !dstring_append(&sitemap.content, "</p><br />\n")
-			|| !dstring_append(&sitemap.content, "<section>\n")) {
+		if(!dstringbuilder_append_printf(&sitemap.content_builder,
+					"<header><h2>%s</h2></header>\n<p>%s</p><br />\n<section>\n",
+					series->title.str,
+					series->landing_desc_html.str)) {
 			fprintf(stderr, "Error generating sitemap, dstring_append error\n");
 			misc_page_free(&sitemap);
 			return 0;
 		}
 		for(size_t j = 0; j < series->posts.length; j++) {
 			post_struct* post = post_get_from_darray_of_post_pointers(&series->posts, j);
-			if(!dstring_append(&sitemap.content, "<div><h3><a href=\"/posts/")
-				|| !dstring_append(&sitemap.content, post->folder_name.str)
-				|| !dstring_append(&sitemap.content, "\">")
-				|| !dstring_append(&sitemap.content, post->title.str)
-				|| !dstring_append(&sitemap.content, "</a></h3>\n")
-				|| !dstring_append(&sitemap.content, "<p>\n")
-				|| !dstring_append(&sitemap.content, post->long_description.str)
-				|| !dstring_append(&sitemap.content, "</p></div>\n")) {
+			if(!dstringbuilder_append_dstring(&sitemap.content_builder, &post->series_card)) {
 				fprintf(stderr, "Error generating series, post dstring_append error\n");
 				misc_page_free(&sitemap);
 				return 0;
 			}
 		}
-		if(!dstring_append(&sitemap.content, "</section>\n")) {
+		if(!dstringbuilder_append(&sitemap.content_builder, "</section>\n")) {
 			fprintf(stderr, "Error generating sitemap, dstring append error\n");
 			misc_page_free(&sitemap);
 			return 0;
 		}
 	}
-	if(!create_misc_page(site_content, &sitemap)) {
+	if(!create_misc_page(site_content, &sitemap, NULL)) {
 		fprintf(stderr, "Error generating sitemap, couldn't create page\n");
 		misc_page_free(&sitemap);
 		return 0;
@@ -471,6 +728,9 @@ int generate_sitemap(site_content_struct* site_content) {
 	return 1;
 }
 // TODO FIXME: This assumes that rss_dstring is a fully formed RSS object.
+// If the existing file is kept (because only its lastBuildDate would
+// change), rss_dstring is swapped for its contents, so that rss_dstring is
+// what's on disk either way.
 int write_rss_file_if_different(dstring_struct* rss_dstring, const char* filename, int* did_write) {
 	(*did_write) = 0;
 	dstring_struct file_contents;
@@ -513,6 +773,10 @@ int write_rss_file_if_different(dstring_struct* rss_dstring, const char* filenam
 			return 0;
 		}
 		(*did_write) = 1;
+	} else {
+		dstring_struct new_contents = (*rss_dstring);
+		(*rss_dstring) = file_contents;
+		file_contents = new_contents;
 	}
 	dstring_free(&file_contents);
 	return 1;
@@ -601,67 +865,133 @@ int generate_main_rss(configuration_struct* configuration, site_content_struct*
 	if(did_write) {
 		printf("Updated RSS feed\n");
 	}
+	// rss_feed now has what's in the file, even if it was kept, so that the
+	// siblings match it
+	dstringbuilder_struct rss_builder;
+	dstringbuilder_init(&rss_builder);
+	if(!dstringbuilder_append_dstring(&rss_builder, &rss_feed)
+		|| !precompress_update_siblings_at(&rss_builder, AT_FDCWD, rss_filename.str, site_content->precompress_formats, did_write)) {
+		fprintf(stderr, "Error generating RSS, couldn't precompress feed\n");
+		dstringbuilder_free(&rss_builder);
+		dstring_free(&rss_feed);
+		dstring_free(&rss_filename);
+		return 0;
+	}
+	dstringbuilder_free(&rss_builder);
 	dstring_free(&rss_feed);
 	dstring_free(&rss_filename);
 	return 1;
 		
 }
 
-int generate_site_internal(configuration_struct* configuration) {
-	site_content_struct site_content;
-	site_content_init(&site_content);
-	if(!load_site_content(configuration, &site_content)) {
-		fprintf(stderr, "Error loading site content\n");
-		site_content_free(&site_content);
-		return 0;
-	}
-	if(!generate_tags(&site_content)) {
+// Generates everything, once the themes' HTML directories are open.
+// Returns 0 on error.
+int generate_loaded_site_pages(configuration_struct* configuration, site_content_struct* site_content) {
+	if(!generate_tags(configuration, site_content)) {
 		fprintf(stderr, "Error generating tags\n");
-		site_content_free(&site_content);
 		return 0;
 	}
-	if(!generate_misc_pages(&site_content)) {
+	if(!generate_misc_pages(site_content)) {
 		fprintf(stderr, "Error generating misc_pages\n");
-		site_content_free(&site_content);
 		return 0;
 	}
-	if(!generate_posts(&site_content)) {
+	if(!generate_posts(configuration, site_content)) {
 		fprintf(stderr, "Error generating posts\n");
-		site_content_free(&site_content);
 		return 0;
 	}
-	if(!generate_series(&site_content)) {
+	if(!generate_series(configuration, site_content)) {
 		fprintf(stderr, "Error generating series\n");
-		site_content_free(&site_content);
 		return 0;
 	}
-	if(!generate_sitemap(&site_content)) {
+	if(!generate_sitemap(site_content)) {
 		fprintf(stderr, "Error generating sitemap\n");
-		site_content_free(&site_content);
 		return 0;
 	}
-	if(!generate_main_rss(configuration, &site_content)) {
+	if(!generate_main_rss(configuration, site_content)) {
 		fprintf(stderr, "Error generating RSS\n");
-		site_content_free(&site_content);
 		return 0;
 	}
-	site_content_free(&site_content);
 	return 1;
 }
-// TODO: I don't like how the site generator is also responsible for
-// loading in the site. Ideally, I'd have two public functions for
-// generating a site: one for where all the files are on disk,
-// and you present it a configuration and it loads everything in,
-// and the other where you present it a configuration and a
-// site_content_struct that's already got data loaded in, such as
-// if it were to be generated completely programmatically.
-// Now, in the latter case, you still need a place on disk for
-// the /generating/ folder, so that the lock file and the post dates
-// file can go in there; however, I may be able to get around that
-// requirement by piping the dates to `date`, if possible,
-// and by just not having a lock. Perhaps I'll wait to allow
-// the latter case until I figure that part out.
-int generate_site(configuration_struct* configuration) {
+// Renders every post's listing cards, for the tag and series pages and the
+// sitemap to share.
+// Returns 0 on error.
+int build_post_cards(site_content_struct* site_content) {
+	for(size_t i = 0; i < site_content->posts.length; i++) {
+		if(!post_build_cards(post_get_from_darray(&site_content->posts, i), &site_content->html_components)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+void release_post_cards(site_content_struct* site_content) {
+	for(size_t i = 0; i < site_content->posts.length; i++) {
+		post_release_cards(post_get_from_darray(&site_content->posts, i));
+	}
+}
+int generate_loaded_site(configuration_struct* configuration, site_content_struct* site_content) {
+	site_content->precompress_formats = configuration->precompress_formats;
+	site_content->num_themes = configuration->combined_themes ? 1 : 2;
+	calculate_page_layout_hash(site_content);
+	// The HTML directories are held open, so that the pages are looked up
+	// and written relative to them, rather than by their full paths. With
+	// combined themes, the dark theme's directory isn't touched at all.
+	int res = theme_open_html_base_dir(&site_content->bright_theme)
+		&& (site_content->num_themes == 1 || theme_open_html_base_dir(&site_content->dark_theme))
+		&& theme_write_stylesheets(&site_content->bright_theme, site_content->precompress_formats)
+		&& (site_content->num_themes == 1 || theme_write_stylesheets(&site_content->dark_theme, site_content->precompress_formats))
+		&& build_post_cards(site_content)
+		&& generate_loaded_site_pages(configuration, site_content)
+		&& theme_remove_old_stylesheets(&site_content->bright_theme)
+		&& (site_content->num_themes == 1 || theme_remove_old_stylesheets(&site_content->dark_theme));
+	release_post_cards(site_content);
+	theme_close_html_base_dir(&site_content->bright_theme);
+	theme_close_html_base_dir(&site_content->dark_theme);
+	return res;
+}
+int load_site_build_manifest(configuration_struct* configuration, build_manifest_struct* build_manifest, dstring_struct* manifest_filename) {
+	if(!build_manifest_init(build_manifest)) {
+		fprintf(stderr, "Error initializing build manifest\n");
+		return 0;
+	}
+	if(!dstring_append_printf(manifest_filename, "%s/generating/%s", configuration->content_base_dir, BUILD_MANIFEST_FILENAME)
+		|| !build_manifest_load(build_manifest, manifest_filename->str)) {
+		fprintf(stderr, "Error loading build manifest\n");
+		build_manifest_free(build_manifest);
+		return 0;
+	}
+	return 1;
+}
+int generate_site_internal(configuration_struct* configuration) {
+	site_content_struct site_content;
+	build_manifest_struct build_manifest;
+	dstring_struct manifest_filename;
+
+	site_content_init(&site_content);
+	dstring_lazy_init(&manifest_filename);
+	if(!load_site_build_manifest(configuration, &build_manifest, &manifest_filename)) {
+		dstring_free(&manifest_filename);
+		return 0;
+	}
+	int res = load_site_content(configuration, &site_content);
+	if(!res) {
+		fprintf(stderr, "Error loading site content\n");
+	} else {
+		site_content.build_manifest = &build_manifest;
+		res = generate_loaded_site(configuration, &site_content);
+	}
+	site_content_free(&site_content);
+	// Only saved if everything was generated, so that the manifest lists
+	// every page on the site.
+	if(res && !build_manifest_save(&build_manifest, manifest_filename.str)) {
+		fprintf(stderr, "Error saving build manifest\n");
+		res = 0;
+	}
+	build_manifest_free(&build_manifest);
+	dstring_free(&manifest_filename);
+	return res;
+}
+int acquire_generation_lock(configuration_struct* configuration, dstring_struct* lock_filename) {
 	dstring_struct cbase_dir;
 	dstring_lazy_init(&cbase_dir);
 	if(!dstring_append(&cbase_dir, configuration->content_base_dir)) {
@@ -670,27 +1000,51 @@ int generate_site(configuration_struct* configuration) {
 	}
 	if(!make_directory(&cbase_dir, "/generating")) {
 		fprintf(stderr, "Error making /generating directory\n");
+		dstring_free(&cbase_dir);
 		return 0;
 	}
+	dstring_free(&cbase_dir);
 
-	if(!dstring_append(&cbase_dir, "/generating/gen.lock")) {
+	if(!dstring_append_printf(lock_filename, "%s/generating/gen.lock", configuration->content_base_dir)) {
 		fprintf(stderr, "Error with lock directory\n");
 		return 0;
 	}
-	int fd = open(cbase_dir.str, O_CREAT | O_EXCL);
+	int fd = open(lock_filename->str, O_CREAT | O_EXCL | O_WRONLY, 0644);
 	if(fd == -1) {
 		fprintf(stderr, "Error getting lock!\n");
-		dstring_free(&cbase_dir);
 		return 0;
-	} else {
-		int res = generate_site_internal(configuration);
-		unlink(cbase_dir.str);
-		if(!res) {
-			fprintf(stderr, "Error generating site\n");
-			dstring_free(&cbase_dir);
-			return 0;
-		}
 	}
-	dstring_free(&cbase_dir);
+	close(fd);
+	return 1;
+}
+void release_generation_lock(dstring_struct* lock_filename) {
+	unlink(lock_filename->str);
+}
+// TODO: I don't like how the site generator is also responsible for
+// loading in the site. Ideally, I'd have two public functions for
+// generating a site: one for where all the files are on disk,
+// and you present it a configuration and it loads everything in,
+// and the other where you present it a configuration and a
+// site_content_struct that's already got data loaded in, such as
+// if it were to be generated completely programmatically.
+// Now, in the latter case, you still need a place on disk for
+// the /generating/ folder, so that the lock file can go in there;
+// however, I may be able to get around that requirement by just not
+// having a lock. Perhaps I'll wait to allow the latter case until I
+// figure that part out.
+int generate_site(configuration_struct* configuration) {
+	dstring_struct lock_filename;
+	dstring_lazy_init(&lock_filename);
+	if(!acquire_generation_lock(configuration, &lock_filename)) {
+		dstring_free(&lock_filename);
+		return 0;
+	}
+	int res = generate_site_internal(configuration);
+	release_generation_lock(&lock_filename);
+	dstring_free(&lock_filename);
+	if(!res) {
+		fprintf(stderr, "Error generating site\n");
+		return 0;
+	}
 	return 1;
 }
@@ -1,4 +1,20 @@
 #include "site_loader.h"
+#include "date_parser.h"
+#include "job_pool.h"
+// Loads the theme in theme_dir, unless it can be restored from the site
+// snapshot.
+// Returns 0 on error.
+int load_theme_folder(site_content_struct* site_content, theme_struct* theme, dstring_struct* theme_dir) {
+	site_snapshot_fingerprint_struct fingerprint;
+	int restored;
+	site_snapshot_fingerprint_init(&fingerprint);
+	int res = site_snapshot_restore(&site_content->snapshot, theme_dir, SITE_SNAPSHOT_THEME, theme, &fingerprint, &restored)
+		&& (restored
+			|| (theme_load(theme, theme_dir)
+				&& site_snapshot_record(&site_content->snapshot, &fingerprint, SITE_SNAPSHOT_THEME, theme)));
+	site_snapshot_fingerprint_free(&fingerprint);
+	return res;
+}
 int load_themes(configuration_struct* configuration, site_content_struct* site_content) {
 	dstring_struct base_dir;
 
@@ -10,7 +26,7 @@ int load_themes(configuration_struct* configuration, site_content_struct* site_c
 		dstring_free(&base_dir);
 		return 0;
 	}
-	if(!theme_load(&site_content->bright_theme, &base_dir)) {
+	if(!load_theme_folder(site_content, &site_content->bright_theme, &base_dir)) {
 		fprintf(stderr, "Error loading bright theme\n");
 		dstring_free(&base_dir);
 		return 0;
@@ -21,7 +37,7 @@ int load_themes(configuration_struct* configuration, site_content_struct* site_c
 		dstring_free(&base_dir);
 		return 0;
 	}
-	if(!theme_load(&site_content->dark_theme, &base_dir)) {
+	if(!load_theme_folder(site_content, &site_content->dark_theme, &base_dir)) {
 		fprintf(stderr, "Error loading dark theme\n");
 		dstring_free(&base_dir);
 		return 0;
@@ -44,6 +60,29 @@ int load_themes(configuration_struct* configuration, site_content_struct* site_c
 		fprintf(stderr, "Error configuring bright theme settings\n");
 		return 0;
 	}
+	// Minified after loading (rather than as they're loaded), so that the
+	// site snapshot keeps what's on disk, and MINIFY can be switched freely.
+	if(configuration->minify
+		&& (!theme_minify(&site_content->bright_theme)
+			|| !theme_minify(&site_content->dark_theme))) {
+		return 0;
+	}
+	site_content->bright_theme.external_stylesheets = configuration->external_stylesheets;
+	site_content->dark_theme.external_stylesheets = configuration->external_stylesheets;
+	if(configuration->combined_themes) {
+		site_content->bright_theme.color_scheme = "light";
+		site_content->dark_theme.color_scheme = "dark";
+	}
+	if(!theme_build_page_segments(&site_content->bright_theme)
+		|| !theme_build_page_segments(&site_content->dark_theme)) {
+		fprintf(stderr, "Error building theme page segments\n");
+		return 0;
+	}
+	if(configuration->prune_css
+		&& (!theme_build_css_pruner(&site_content->bright_theme)
+			|| !theme_build_css_pruner(&site_content->dark_theme))) {
+		return 0;
+	}
 	return 1;
 }
 int load_html_components(configuration_struct* configuration, site_content_struct* site_content) {
@@ -57,12 +96,21 @@ int load_html_components(configuration_struct* configuration, site_content_struc
 		dstring_free(&base_dir);
 		return 0;
 	}
-	if(!html_components_load(&site_content->html_components, &base_dir)) {
+	site_snapshot_fingerprint_struct fingerprint;
+	int restored;
+	site_snapshot_fingerprint_init(&fingerprint);
+	int res = site_snapshot_restore(&site_content->snapshot, &base_dir, SITE_SNAPSHOT_HTML_COMPONENTS, &site_content->html_components, &fingerprint, &restored)
+		&& (restored
+			|| (html_components_load(&site_content->html_components, &base_dir)
+				&& site_snapshot_record(&site_content->snapshot, &fingerprint, SITE_SNAPSHOT_HTML_COMPONENTS, &site_content->html_components)))
+		&& (!configuration->minify || html_components_minify(&site_content->html_components))
+		&& html_components_compile_templates(&site_content->html_components);
+	site_snapshot_fingerprint_free(&fingerprint);
+	dstring_free(&base_dir);
+	if(!res) {
 		fprintf(stderr, "Error loading HTML components\n");
-		dstring_free(&base_dir);
 		return 0;
 	}
-	dstring_free(&base_dir);
 	return 1;
 }
 
@@ -78,17 +126,35 @@ int load_single_series(dstring_struct* base_dir, struct dirent* dir_ent, void* s
 	}
 	series_struct tmp_series_entry;
 	series_init(&tmp_series_entry);
-	
-	if(!series_load(&tmp_series_entry, base_dir, dir_ent->d_name)) {
-		fprintf(stderr, "Warning, series folder %s doesn't contain a valid series. Skipping\n", dir_ent->d_name);
-		dstring_remove_num_chars_in_text(base_dir, dir_ent->d_name);
+	site_snapshot_fingerprint_struct fingerprint;
+	int restored;
+	site_snapshot_fingerprint_init(&fingerprint);
+	if(!site_snapshot_restore(&site_content->snapshot, base_dir, SITE_SNAPSHOT_SERIES, &tmp_series_entry, &fingerprint, &restored)) {
+		fprintf(stderr, "Error loading series %s from site snapshot\n", dir_ent->d_name);
+		site_snapshot_fingerprint_free(&fingerprint);
 		series_free(&tmp_series_entry);
-		return 1;
+		return 0;
+	}
+	if(!restored) {
+		if(!series_load(&tmp_series_entry, base_dir, dir_ent->d_name)) {
+			fprintf(stderr, "Warning, series folder %s doesn't contain a valid series. Skipping\n", dir_ent->d_name);
+			dstring_remove_num_chars_in_text(base_dir, dir_ent->d_name);
+			site_snapshot_fingerprint_free(&fingerprint);
+			series_free(&tmp_series_entry);
+			return 1;
+		}
+		if(!site_snapshot_record(&site_content->snapshot, &fingerprint, SITE_SNAPSHOT_SERIES, &tmp_series_entry)) {
+			fprintf(stderr, "Error recording series %s in site snapshot\n", dir_ent->d_name);
+			site_snapshot_fingerprint_free(&fingerprint);
+			series_free(&tmp_series_entry);
+			return 0;
+		}
 	}
+	site_snapshot_fingerprint_free(&fingerprint);
 	dstring_remove_num_chars_in_text(base_dir, dir_ent->d_name);
 	// OK, so we loaded the series in. Store it in the array, we'll
 	// sort it later.
-	if(!darray_append(&site_content->series, &tmp_series_entry)) {
+	if(!site_content_add_series(site_content, &tmp_series_entry)) {
 		fprintf(stderr, "Error reading series data, darray append error\n");
 		series_free(&tmp_series_entry);
 		return 0;
@@ -113,6 +179,10 @@ int load_series(configuration_struct* configuration, site_content_struct* site_c
 	}
 	// Series will be sorted using qsort, which sorts in-place.
 	qsort(site_content->series.array, site_content->series.length, site_content->series.elem_size, &series_sort_compare);
+	if(!site_content_rebuild_indexes(site_content)) {
+		fprintf(stderr, "Error loading all series, couldn't reindex series\n");
+		return 0;
+	}
 
 	return 1;
 	
@@ -125,7 +195,15 @@ int load_single_misc_page(dstring_struct* base_dir, struct dirent* dir_ent, void
 	}
 	misc_page_struct tmp_misc_page_entry;
 	misc_page_init(&tmp_misc_page_entry);
-	if(!misc_page_load(&tmp_misc_page_entry, base_dir)) {
+	site_snapshot_fingerprint_struct fingerprint;
+	int restored;
+	site_snapshot_fingerprint_init(&fingerprint);
+	int res = site_snapshot_restore(&site_content->snapshot, base_dir, SITE_SNAPSHOT_MISC_PAGE, &tmp_misc_page_entry, &fingerprint, &restored)
+		&& (restored
+			|| (misc_page_load(&tmp_misc_page_entry, base_dir)
+				&& site_snapshot_record(&site_content->snapshot, &fingerprint, SITE_SNAPSHOT_MISC_PAGE, &tmp_misc_page_entry)));
+	site_snapshot_fingerprint_free(&fingerprint);
+	if(!res) {
 		fprintf(stderr, "Error, misc_pages folder %s doesn't contain a valid misc page.\n", dir_ent->d_name);
 		dstring_remove_num_chars_in_text(base_dir, dir_ent->d_name);
 		misc_page_free(&tmp_misc_page_entry);
@@ -133,7 +211,7 @@ int load_single_misc_page(dstring_struct* base_dir, struct dirent* dir_ent, void
 	}
 	dstring_remove_num_chars_in_text(base_dir, dir_ent->d_name);
 	// OK, so we loaded the misc page in. Store it.
-	if(!darray_append(&site_content->misc_pages, &tmp_misc_page_entry)) {
+	if(!site_content_add_misc_page(site_content, &tmp_misc_page_entry)) {
 		fprintf(stderr, "Error reading misc_pages data, darray append error\n");
 		misc_page_free(&tmp_misc_page_entry);
 		return 0;
@@ -161,245 +239,232 @@ int load_misc_pages(configuration_struct* configuration, site_content_struct* si
 	
 }
 
+// Sorts the posts newest first. Posts written at the same time are sorted by
+// folder name, so that the order doesn't depend on the order they were
+// loaded in.
 int post_sort_compare(const void* post_a, const void* post_b) {
-	return ((post_struct*)post_b)->written_date_time - ((post_struct*)post_a)->written_date_time;
+	post_struct* a = (post_struct*) post_a;
+	post_struct* b = (post_struct*) post_b;
+	if(a->written_date_time != b->written_date_time) {
+		return a->written_date_time < b->written_date_time ? 1 : -1;
+	}
+	return strcmp(a->folder_name.str, b->folder_name.str);
 }
 
-// Returns 0 on failure...
-time_t read_time_from_str(const char* str) {
-	long long scanned_time = 0;
-	int num_read = sscanf(str, "%lld", &scanned_time);
-	if(num_read == 0 || num_read == EOF) {
-		return 0;
-	}
-	return scanned_time;
+// Parses a single post date field, printing out which post and field was
+// invalid if it couldn't be parsed.
+// Returns 0 on error.
+int load_post_date_field(post_struct* post, dstring_struct* date_string, const char* field_name, time_t now, time_t* result) {
+	dstring_struct description;
+	dstring_lazy_init(&description);
+	if(!dstring_append_printf(&description, "%s for post %s", field_name, post->folder_name.str)) {
+		fprintf(stderr, "Error with post dates, dstring append error\n");
+		return 0;
+	}
+	int res = parse_date_string(date_string->str, description.str, now, result);
+	dstring_free(&description);
+	return res;
 }
-/** NOTE ABOUT TIMEZONES:
- * C doesn't have great functions for dealing with timezones.
- *
- * So what I'll do is this. I'll read all of the posts in (doing validations).
- * I'll have my list of posts.
- * For every post, I'll write out the written-date, and if present, publish-after
- * values. I'll call `date -f $file +%s`. I'll read in the results, put into
- * a dstring. I'll split the dstring on '\n' into a darray. I should (will
- * need to validate) have a list that's got as many entries as I do dates
- * that were written out. I'll then go through the posts and the darray;
- * one line will be taken as the written-date, and if the publish-after
- * value is set, then another line will be taken as the publish-after value.
- * If a bad date is encountered, I'll know which post, and which field,
- * is invalid. Error messages will be printed out for all posts that have invalid
- * dates, because why not.
- * Ah, also, I can write out a line with the text "now", this will save me
- * some unpleasant work with gmtime and such. Huzzah!
- */
 
+// Dates are parsed in-process by date_parser, which handles timezones
+// by way of the system zoneinfo database. Every post is checked, so that
+// error messages are printed out for all posts that have invalid dates,
+// rather than only the first one.
 int load_post_dates(configuration_struct* configuration, site_content_struct* site_content) {
-	dstring_struct base_dir;
-	dstring_struct out_dates;
-	dstring_struct date_command;
-	dstring_struct date_output;
-	darray_struct read_dates;
-
-	dstring_lazy_init(&base_dir);
-	dstring_lazy_init(&out_dates);
-	dstring_lazy_init(&date_command);
-	dstring_lazy_init(&date_output);
-	darray_lazy_init(&read_dates, sizeof(char*));
-
-	if(!dstring_append(&base_dir, configuration->content_base_dir)
-		|| !dstring_append(&base_dir, "/generating/post_dates")) {
-		fprintf(stderr, "Error getting post dates, base_dir dstring append error\n");
-		dstring_free(&base_dir);
-		return 0;
-	}
-	if(!dstring_append(&out_dates, "now\n")) {
-		fprintf(stderr, "Error getting post dates, out_dates dstring append error\n");
-		dstring_free(&base_dir);
-		dstring_free(&out_dates);
+	time_t now_time = time(NULL);
+	if(now_time == (time_t) -1) {
+		fprintf(stderr, "Error with post dates, couldn't get the current time\n");
 		return 0;
 	}
+	site_content->current_time = now_time;
+
 	int had_error = 0;
-	size_t num_dates_written = 1;
 	for(size_t i = 0; i < site_content->posts.length; i++) {
 		post_struct* post = post_get_from_darray(&site_content->posts, i);
-		if(!dstring_append(&out_dates, post->written_date.str)
-			|| !dstring_append(&out_dates, "\n")) {
-			fprintf(stderr, "Error appending written_date\n");
+		if(!load_post_date_field(post, &post->written_date, "written-date", now_time, &post->written_date_time)) {
 			had_error = 1;
-			break;
 		}
-		num_dates_written++;
 		if(post->publish_after.length > 0) {
-			if(!dstring_append(&out_dates, post->publish_after.str)
-				|| !dstring_append(&out_dates, "\n")) {
-				fprintf(stderr, "Error appending publish_after\n");
+			if(!load_post_date_field(post, &post->publish_after, "publish-after time", now_time, &post->publish_after_time)) {
 				had_error = 1;
-				break;
+			} else if(post->publish_when_ready && post->publish_after_time <= now_time) {
+				post->can_publish = 1;
 			}
-			num_dates_written++;
+		} else if(post->publish_when_ready) {
+			post->can_publish = 1;
 		}
 		if(post->updated_at.length > 0) {
-			if(!dstring_append(&out_dates, post->updated_at.str)
-				|| !dstring_append(&out_dates, "\n")) {
-				fprintf(stderr, "Error appending updated_at\n");
+			if(!load_post_date_field(post, &post->updated_at, "updated-at time", now_time, &post->updated_at_time)) {
 				had_error = 1;
-				break;
 			}
-			num_dates_written++;
 		}
 	}
 	if(had_error) {
-		dstring_free(&base_dir);
-		dstring_free(&out_dates);
-		return 0;
-	}
-	// Now to write it out...
-	if(!dstring_write_file(&out_dates, base_dir.str)) {
-		fprintf(stderr, "Error writing post dates to file\n");
-		dstring_free(&base_dir);
-		dstring_free(&out_dates);
-		return 0;
-	}
-	if(!dstring_append(&date_command, "date 2>/dev/null -f ")
-		|| !dstring_append(&date_command, base_dir.str)
-		|| !dstring_append(&date_command, " +%s")) {
-		fprintf(stderr, "Error with post dates, date_command dstring append error\n");
-		dstring_free(&base_dir);
-		dstring_free(&out_dates);
-		dstring_free(&date_command);
-		return 0;
-	}
-	int process_exit_code;
-	if(!dstring_read_process_output(&date_output, popen(date_command.str, "r"), &process_exit_code)) {
-		fprintf(stderr, "Error running date command\n");
-		dstring_free(&date_output);
-		dstring_free(&base_dir);
-		dstring_free(&out_dates);
-		dstring_free(&date_command);
+		fprintf(stderr, "Error, not all post dates were valid.\n");
 		return 0;
 	}
-	if(!dstring_split_to_darray(&date_output, &read_dates, '\n')) {
-		fprintf(stderr, "Error with post dates, dstring split error\n");
-		dstring_free(&date_output);
-		dstring_free(&base_dir);
-		dstring_free(&out_dates);
-		dstring_free(&date_command);
-		darray_free(&read_dates);
+	return 1;
+}
+
+#define POST_LOAD_NOT_RUN 0
+#define POST_LOAD_LOADED 1
+#define POST_LOAD_SKIPPED 2
+#define POST_LOAD_FAILED 3
+
+// The shared state for loading posts with job_pool. Each job loads the post
+// folder at its index into its own slot in posts, and records what happened
+// in the same slot in results; nothing else is written to by the jobs.
+typedef struct post_load_context_struct {
+	// The posts directory, with a trailing slash.
+	const char* posts_dir;
+
+	// The folder names of the posts to load; a darray of dstring_struct's.
+	darray_struct folder_names;
+
+	// One loaded post per folder name.
+	post_struct* posts;
+
+	// One of the POST_LOAD_* values per folder name.
+	int* results;
+
+	// The darena the posts are loaded into (may be NULL); the job threads
+	// need to bind it themselves.
+	darena_struct* arena;
+
+	// The site snapshot that unchanged posts are restored from.
+	site_snapshot_struct* snapshot;
+} post_load_context_struct;
+
+int collect_post_folder_name(dstring_struct* base_dir, struct dirent* dir_ent, void* context_void_ptr) {
+	post_load_context_struct* context = context_void_ptr;
+	dstring_struct folder_name;
+	dstring_lazy_init(&folder_name);
+	if(!dstring_append(&folder_name, dir_ent->d_name)) {
+		fprintf(stderr, "Error loading posts, folder name dstring append error\n");
 		return 0;
 	}
-	// Now we have the lines, we need to figure out which, if any, failed...
-	if(num_dates_written != read_dates.length) {
-		fprintf(stderr, "Error with post dates, didn't read in the same number of dates as written out: Wrote %zu, read %zu\n", num_dates_written, read_dates.length);
-		dstring_free(&date_output);
-		dstring_free(&base_dir);
-		dstring_free(&out_dates);
-		dstring_free(&date_command);
-		darray_free(&read_dates);
+	if(!darray_append(&context->folder_names, &folder_name)) {
+		fprintf(stderr, "Error loading posts, folder name darray append error\n");
+		dstring_free(&folder_name);
 		return 0;
 	}
-	time_t now_time = read_time_from_str(((const char**)read_dates.array)[0]);
-	if(!now_time) {
-		fprintf(stderr, "Error with post dates, couldn't read now time\n");
-		dstring_free(&date_output);
-		dstring_free(&base_dir);
-		dstring_free(&out_dates);
-		dstring_free(&date_command);
-		darray_free(&read_dates);
-		return 0;
+	return 1;
+}
+
+// Loads the post at post_dir into the context, unless it was restored from
+// the site snapshot, and records it in the snapshot.
+// Returns 0 on error.
+int load_single_post_folder(post_load_context_struct* context, size_t index, dstring_struct* post_dir, site_snapshot_fingerprint_struct* fingerprint, int restored) {
+	const char* folder_name = ((dstring_struct*) darray_get_elem(&context->folder_names, index))->str;
+	post_struct* post = &context->posts[index];
+	if(restored == SITE_SNAPSHOT_RESTORED_SKIPPED) {
+		context->results[index] = POST_LOAD_SKIPPED;
+		return 1;
+	} else if(restored) {
+		context->results[index] = POST_LOAD_LOADED;
+		return 1;
 	}
-	site_content->current_time = now_time;
-	// Now, finally, we get to read in the post dates...
-	size_t date_index = 1;
-	const char** read_dates_strs = (const char**) read_dates.array;
-	// Note: We know that we won't go out of bounds of the array,
-	// because we already checked that we read in as many dates as we wrote out,
-	// and this is the exact same order/logic used for writing, and nothing
-	// has changed the data used for these conditions in the meantime.
-	// Also, we aren't bailing on errors here, because we already know
-	// if there are errors from the exit code.
-	for(size_t i = 0; i < site_content->posts.length; i++) {
-		time_t written_date_time = read_time_from_str(read_dates_strs[date_index++]);
-		post_struct* post = post_get_from_darray(&site_content->posts, i);
-		if(!written_date_time) {
-			fprintf(stderr, "Error, written-date %s for post %s invalid.\n", post->written_date.str, post->folder_name.str);
-		} else {
-			post->written_date_time = written_date_time;
-		}
-		if(post->publish_after.length > 0) {
-			time_t publish_after_time = read_time_from_str(read_dates_strs[date_index++]);
-			if(!publish_after_time) {
-				fprintf(stderr, "Error, publish-after time %s for post %s invalid.\n", post->publish_after.str, post->folder_name.str);
-			} else {
-				post->publish_after_time = publish_after_time;
-				if(post->publish_when_ready) {
-					if(publish_after_time <= now_time) {
-						post->can_publish = 1;
-					}
-				}
-			}
-		} else {
-			if(post->publish_when_ready) {
-				post->can_publish = 1;
-			}
+	int generate_flag_missing = 0;
+	if(!post_load(post, post_dir, folder_name, &generate_flag_missing)) {
+		if(!generate_flag_missing) {
+			fprintf(stderr, "Error loading post %s\n", folder_name);
+			return 0;
 		}
-		if(post->updated_at.length > 0) {
-			time_t updated_at_time = read_time_from_str(read_dates_strs[date_index++]);
-			if(!updated_at_time) {
-				fprintf(stderr, "Error, updated-at time %s for post %s invalid.\n", post->updated_at.str, post->folder_name.str);
-			} else {
-				post->updated_at_time = updated_at_time;
-			}
+		if(!site_snapshot_record(context->snapshot, fingerprint, SITE_SNAPSHOT_SKIPPED_POST, NULL)) {
+			fprintf(stderr, "Error recording post %s in site snapshot\n", folder_name);
+			return 0;
 		}
+		context->results[index] = POST_LOAD_SKIPPED;
+		return 1;
 	}
-	dstring_free(&date_output);
-	dstring_free(&base_dir);
-	dstring_free(&out_dates);
-	dstring_free(&date_command);
-	darray_free(&read_dates);
-	if(process_exit_code) {
-		fprintf(stderr, "Error, not all post dates were valid.\n");
+	if(!site_snapshot_record(context->snapshot, fingerprint, SITE_SNAPSHOT_POST, post)) {
+		fprintf(stderr, "Error recording post %s in site snapshot\n", folder_name);
 		return 0;
 	}
+	context->results[index] = POST_LOAD_LOADED;
 	return 1;
 }
+// A job_pool job; loads a single post.
+int load_single_post_into_context(size_t index, post_load_context_struct* context) {
+	const char* folder_name = ((dstring_struct*) darray_get_elem(&context->folder_names, index))->str;
+	post_struct* post = &context->posts[index];
+	dstring_struct base_dir;
 
-int load_single_post(dstring_struct* base_dir, struct dirent* dir_ent, void* site_content_void_ptr) {
-	site_content_struct* site_content = site_content_void_ptr;
-	if(!dstring_append(base_dir, dir_ent->d_name)) {
+	dstring_lazy_init(&base_dir);
+	post_init(post);
+	context->results[index] = POST_LOAD_FAILED;
+
+	if(!dstring_append(&base_dir, context->posts_dir)
+		|| !dstring_append(&base_dir, folder_name)) {
 		fprintf(stderr, "Error loading single post, dstring append error\n");
+		dstring_free(&base_dir);
 		return 0;
 	}
 
-	post_struct tmp_post_entry;
-	post_init(&tmp_post_entry);
-
-	int generate_flag_missing = 0;
-	if(!post_load(&tmp_post_entry, base_dir, dir_ent->d_name, &generate_flag_missing) && generate_flag_missing) {
-		fprintf(stderr, "Skipping post %s because generate flag is missing\n", dir_ent->d_name);
-		dstring_remove_num_chars_in_text(base_dir, dir_ent->d_name);
-		post_free(&tmp_post_entry);
-		return 1;
+	site_snapshot_fingerprint_struct fingerprint;
+	int restored;
+	site_snapshot_fingerprint_init(&fingerprint);
+	if(!site_snapshot_restore(context->snapshot, &base_dir, SITE_SNAPSHOT_POST, post, &fingerprint, &restored)) {
+		fprintf(stderr, "Error loading post %s from site snapshot\n", folder_name);
+		site_snapshot_fingerprint_free(&fingerprint);
+		dstring_free(&base_dir);
+		return 0;
 	}
+	int res = load_single_post_folder(context, index, &base_dir, &fingerprint, restored);
+	site_snapshot_fingerprint_free(&fingerprint);
+	dstring_free(&base_dir);
+	return res;
+}
+int load_single_post(size_t index, void* context_void_ptr) {
+	post_load_context_struct* context = context_void_ptr;
+	darena_struct* previous_arena = darena_bind(context->arena);
+	int res = load_single_post_into_context(index, context);
+	darena_bind(previous_arena);
+	return res;
+}
 
-	dstring_remove_num_chars_in_text(base_dir, dir_ent->d_name);
-
-	if(!darray_append(&site_content->posts, &tmp_post_entry)) {
-		fprintf(stderr, "Error reading post data, darray append error\n");
-		post_free(&tmp_post_entry);
-		return 0;
+// Adds the loaded posts to the site in directory order, so that the result
+// is the same no matter how many jobs were used, and frees any that won't
+// be kept.
+// Returns 0 on error.
+int merge_loaded_posts(post_load_context_struct* context, site_content_struct* site_content, int had_error) {
+	for(size_t i = 0; i < context->folder_names.length; i++) {
+		post_struct* post = &context->posts[i];
+		switch(context->results[i]) {
+			case POST_LOAD_NOT_RUN:
+				continue;
+			case POST_LOAD_SKIPPED:
+				fprintf(stderr, "Skipping post %s because generate flag is missing\n", ((dstring_struct*) darray_get_elem(&context->folder_names, i))->str);
+				post_free(post);
+				continue;
+			case POST_LOAD_LOADED:
+				if(!had_error) {
+					if(site_content_add_post(site_content, post)) {
+						continue;
+					}
+					fprintf(stderr, "Error reading post data, darray append error\n");
+					had_error = 1;
+				}
+				post_free(post);
+				continue;
+			default:
+				post_free(post);
+				continue;
+		}
 	}
-	return 1;
+	return !had_error;
 }
 
 // TODO: Consider putting posts into series even if they won't be published; then, check
 // whether or not a post can be published when printing it out
 int load_posts(configuration_struct* configuration, site_content_struct* site_content) {
-	// Posts will have their dates validated after all are loaded in.
-	// This is due to the timezone conversion stuff mentioned at the top
-	// of the program.
+	// Posts will have their dates validated after all are loaded in,
+	// so that every invalid date can be reported at once.
 	dstring_struct base_dir;
+	post_load_context_struct context;
 
 	dstring_lazy_init(&base_dir);
+	darray_lazy_init(&context.folder_names, sizeof(dstring_struct));
 
 	if(!dstring_append(&base_dir, configuration->content_base_dir)
 		|| !dstring_append(&base_dir, "/posts/")) {
@@ -407,26 +472,59 @@ int load_posts(configuration_struct* configuration, site_content_struct* site_co
 		dstring_free(&base_dir);
 		return 0;
 	}
-	int res = apply_function_to_directory_entries(&base_dir, 0, DT_DIR, load_single_post, site_content);
+	context.posts_dir = base_dir.str;
+	context.arena = darena_get_bound();
+	context.snapshot = &site_content->snapshot;
+
+	// The directory is read up front, so that the posts can be split up
+	// between the jobs.
+	if(!apply_function_to_directory_entries(&base_dir, 0, DT_DIR, collect_post_folder_name, &context)) {
+		darray_of_dstrings_free(&context.folder_names);
+		dstring_free(&base_dir);
+		return 0;
+	}
+	size_t num_folders = context.folder_names.length;
+	context.posts = malloc(sizeof(post_struct) * (num_folders > 0 ? num_folders : 1));
+	context.results = calloc(num_folders > 0 ? num_folders : 1, sizeof(int));
+	if(context.posts == NULL || context.results == NULL) {
+		fprintf(stderr, "Error loading all posts, malloc error\n");
+		free(context.posts);
+		free(context.results);
+		darray_of_dstrings_free(&context.folder_names);
+		dstring_free(&base_dir);
+		return 0;
+	}
+
+	int load_res = job_pool_run(num_folders, configuration->num_jobs, load_single_post, &context);
+	int res = merge_loaded_posts(&context, site_content, !load_res);
+
+	free(context.posts);
+	free(context.results);
+	darray_of_dstrings_free(&context.folder_names);
 	dstring_free(&base_dir);
 	if(!res) {
 		return 0;
 	}
+	return link_posts(configuration, site_content);
+}
+int link_posts(configuration_struct* configuration, site_content_struct* site_content) {
 	// OK... So now that they are all loaded, we need to validate dates.
-	// We do that by calling `date`.
 	if(!load_post_dates(configuration, site_content)) {
 		fprintf(stderr, "Error loading post dates\n");
 		return 0;
 	}
 	qsort(site_content->posts.array, site_content->posts.length, site_content->posts.elem_size, &post_sort_compare);
+	if(!site_content_rebuild_indexes(site_content)) {
+		fprintf(stderr, "Error loading posts, couldn't reindex posts\n");
+		return 0;
+	}
 	if(!validate_posts(site_content)) {
 		fprintf(stderr, "Error validating posts\n");
 		return 0;
 	}
 	return 1;
-	
 }
-int load_site_content(configuration_struct* configuration, site_content_struct* site_content) {
+int load_site_content_parts(configuration_struct* configuration, site_content_struct* site_content) {
 	if(!do_pre_validations(configuration)) {
 		return 0;
 	}
@@ -461,3 +559,229 @@ int load_site_content(configuration_struct* configuration, site_content_struct*
 	}
 	return 1;
 }
+// Starts using the site snapshot in the /generating/ folder, if there is
+// one; it isn't used when the site is loaded from a content bundle, which
+// is already quick to load.
+// Returns 0 on error.
+int open_site_snapshot(configuration_struct* configuration, site_content_struct* site_content) {
+	if(get_content_bundle() != NULL) {
+		return 1;
+	}
+	dstring_struct filename;
+	dstring_lazy_init(&filename);
+	if(!dstring_append_printf(&filename, "%s/generating", configuration->content_base_dir)) {
+		fprintf(stderr, "Error opening site snapshot, dstring append error\n");
+		return 0;
+	}
+	// The /generating/ folder is made when the site is first generated;
+	// until then, there's nowhere to keep the snapshot.
+	if(!check_is_dir(filename.str)) {
+		dstring_free(&filename);
+		return 1;
+	}
+	if(!dstring_append_printf(&filename, "/%s", SITE_SNAPSHOT_FILENAME)
+		|| !site_snapshot_open(&site_content->snapshot, filename.str)) {
+		fprintf(stderr, "Error opening site snapshot\n");
+		dstring_free(&filename);
+		return 0;
+	}
+	dstring_free(&filename);
+	return 1;
+}
+int load_site_content(configuration_struct* configuration, site_content_struct* site_content) {
+	// Everything loaded lives exactly as long as the site_content, so it
+	// all goes in the site_content's darena.
+	darena_struct* previous_arena = darena_bind(&site_content->arena);
+	int res = open_site_snapshot(configuration, site_content)
+		&& load_site_content_parts(configuration, site_content);
+	// The snapshot is only a shortcut, so the site can still be used if it
+	// can't be saved.
+	if(res && !site_snapshot_save(&site_content->snapshot)) {
+		fprintf(stderr, "Warning, couldn't save the site snapshot\n");
+	}
+	darena_bind(previous_arena);
+	return res;
+}
+
+void site_changes_init(site_changes_struct* changes) {
+	changes->themes = 0;
+	changes->html_components = 0;
+	changes->misc_pages = 0;
+	changes->series = 0;
+	changes->all_posts = 0;
+	darray_lazy_init(&changes->post_folder_names, sizeof(dstring_struct));
+}
+void site_changes_free(site_changes_struct* changes) {
+	darray_of_dstrings_free(&changes->post_folder_names);
+	site_changes_init(changes);
+}
+void site_changes_set_all(site_changes_struct* changes) {
+	changes->themes = 1;
+	changes->html_components = 1;
+	changes->misc_pages = 1;
+	changes->series = 1;
+	changes->all_posts = 1;
+}
+site_changes_struct* site_changes_add_post(site_changes_struct* changes, const char* folder_name) {
+	for(size_t i = 0; i < changes->post_folder_names.length; i++) {
+		if(!strcmp(((dstring_struct*) darray_get_elem(&changes->post_folder_names, i))->str, folder_name)) {
+			return changes;
+		}
+	}
+	dstring_struct dstring;
+	dstring_lazy_init(&dstring);
+	if(!dstring_append(&dstring, folder_name)) {
+		fprintf(stderr, "Error recording changed post, dstring append error\n");
+		return NULL;
+	}
+	if(!darray_append(&changes->post_folder_names, &dstring)) {
+		fprintf(stderr, "Error recording changed post, darray append error\n");
+		dstring_free(&dstring);
+		return NULL;
+	}
+	return changes;
+}
+
+// Undoes everything that link_posts and site_content_setup_tags did, so
+// that they can be run again after some of the site has been reloaded.
+void unlink_site_content(site_content_struct* site_content) {
+	for(size_t i = 0; i < site_content->tags.length; i++) {
+		tag_posts_free((tag_posts_struct*) darray_get_elem(&site_content->tags, i));
+	}
+	site_content->tags.length = 0;
+	dhashindex_clear(&site_content->tags_index);
+	for(size_t i = 0; i < site_content->series.length; i++) {
+		((series_struct*) darray_get_elem(&site_content->series, i))->posts.length = 0;
+	}
+	for(size_t i = 0; i < site_content->posts.length; i++) {
+		post_struct* post = post_get_from_darray(&site_content->posts, i);
+		post->suggested_prev_reading.length = 0;
+		post->suggested_next_reading.length = 0;
+		post->series = NULL;
+		post->can_publish = 0;
+	}
+}
+// Removes the post with the given folder name from the site, if it's there.
+// Returns 0 on error.
+int unload_post(site_content_struct* site_content, const char* folder_name) {
+	size_t index;
+	if(!dhashindex_find(&site_content->posts_index, folder_name, &index)) {
+		return 1;
+	}
+	post_free(post_get_from_darray(&site_content->posts, index));
+	memmove(darray_get_elem(&site_content->posts, index),
+			darray_get_elem(&site_content->posts, index + 1),
+			(site_content->posts.length - index - 1) * site_content->posts.elem_size);
+	site_content->posts.length--;
+	return site_content_rebuild_indexes(site_content);
+}
+// Loads the post in the given folder, if the folder (still) exists.
+// Returns 0 on error.
+int load_post_folder(configuration_struct* configuration, site_content_struct* site_content, const char* folder_name) {
+	dstring_struct base_dir;
+	dstring_lazy_init(&base_dir);
+	if(!dstring_append_printf(&base_dir, "%s/posts/%s", configuration->content_base_dir, folder_name)) {
+		fprintf(stderr, "Error loading post folder, dstring append error\n");
+		return 0;
+	}
+	if(!check_is_dir(base_dir.str)) {
+		dstring_free(&base_dir);
+		return 1;
+	}
+	post_struct post;
+	post_init(&post);
+	int generate_flag_missing = 0;
+	if(!post_load(&post, &base_dir, folder_name, &generate_flag_missing)) {
+		post_free(&post);
+		dstring_free(&base_dir);
+		if(generate_flag_missing) {
+			fprintf(stderr, "Skipping post %s because generate flag is missing\n", folder_name);
+			return 1;
+		}
+		fprintf(stderr, "Error loading post %s\n", folder_name);
+		return 0;
+	}
+	dstring_free(&base_dir);
+	if(!site_content_add_post(site_content, &post)) {
+		fprintf(stderr, "Error reading post data, darray append error\n");
+		post_free(&post);
+		return 0;
+	}
+	return 1;
+}
+int reload_site_content(configuration_struct* configuration, site_content_struct* site_content, site_changes_struct* changes) {
+	unlink_site_content(site_content);
+	if(changes->themes) {
+		theme_free(&site_content->bright_theme);
+		theme_free(&site_content->dark_theme);
+		theme_init(&site_content->bright_theme);
+		theme_init(&site_content->dark_theme);
+		if(!load_themes(configuration, site_content)) {
+			fprintf(stderr, "Error reloading themes\n");
+			return 0;
+		}
+	}
+	if(changes->html_components) {
+		html_components_free(&site_content->html_components);
+		html_components_init(&site_content->html_components);
+		if(!load_html_components(configuration, site_content)) {
+			fprintf(stderr, "Error reloading HTML components\n");
+			return 0;
+		}
+	}
+	if(changes->misc_pages) {
+		for(size_t i = 0; i < site_content->misc_pages.length; i++) {
+			misc_page_free((misc_page_struct*) darray_get_elem(&site_content->misc_pages, i));
+		}
+		site_content->misc_pages.length = 0;
+		dhashindex_clear(&site_content->misc_pages_index);
+		if(!load_misc_pages(configuration, site_content)) {
+			fprintf(stderr, "Error reloading misc_pages\n");
+			return 0;
+		}
+		if(!find_misc_page_by_filename(site_content, "index.html")) {
+			fprintf(stderr, "Error, missing index.html misc_page\n");
+			return 0;
+		}
+	}
+	if(changes->series) {
+		for(size_t i = 0; i < site_content->series.length; i++) {
+			series_free((series_struct*) darray_get_elem(&site_content->series, i));
+		}
+		site_content->series.length = 0;
+		dhashindex_clear(&site_content->series_index);
+		if(!load_series(configuration, site_content)) {
+			fprintf(stderr, "Error reloading series data\n");
+			return 0;
+		}
+	}
+	if(changes->all_posts) {
+		for(size_t i = 0; i < site_content->posts.length; i++) {
+			post_free(post_get_from_darray(&site_content->posts, i));
+		}
+		site_content->posts.length = 0;
+		dhashindex_clear(&site_content->posts_index);
+		if(!load_posts(configuration, site_content)) {
+			fprintf(stderr, "Error reloading posts\n");
+			return 0;
+		}
+	} else {
+		for(size_t i = 0; i < changes->post_folder_names.length; i++) {
+			const char* folder_name = ((dstring_struct*) darray_get_elem(&changes->post_folder_names, i))->str;
+			if(!unload_post(site_content, folder_name)
+				|| !load_post_folder(configuration, site_content, folder_name)) {
+				fprintf(stderr, "Error reloading post %s\n", folder_name);
+				return 0;
+			}
+		}
+		if(!link_posts(configuration, site_content)) {
+			fprintf(stderr, "Error linking posts\n");
+			return 0;
+		}
+	}
+	if(!site_content_setup_tags(site_content)) {
+		fprintf(stderr, "Error setting up tags\n");
+		return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,602 @@
+#include "dobjects.h"
+#include <stddef.h>
+#include "site_snapshot.h"
+#include "file_helpers.h"
+#include "post.h"
+#include "series.h"
+#include "misc_page.h"
+#include "theme.h"
+#include "html_components.h"
+
+#define SITE_SNAPSHOT_FIELD_DSTRING 0
+#define SITE_SNAPSHOT_FIELD_INT 1
+#define SITE_SNAPSHOT_FIELD_STRING_LIST 2
+#define SITE_SNAPSHOT_FIELD_UINT64 3
+
+// A field of a kind of unit, and where in its struct it goes.
+typedef struct site_snapshot_field_struct {
+	int type;
+	size_t offset;
+
+	// For lists of strings (darrays of char*'s), the dstring_struct that
+	// they point into, which must come earlier in the list of fields.
+	size_t source_offset;
+} site_snapshot_field_struct;
+
+static const site_snapshot_field_struct theme_fields[] = {
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(theme_struct, main_css), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(theme_struct, syntax_highlighting_css), 0},
+};
+static const site_snapshot_field_struct html_components_fields[] = {
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(html_components_struct, header), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(html_components_struct, footer), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(html_components_struct, trailer), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(html_components_struct, head_template_source), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(html_components_struct, post_template_source), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(html_components_struct, tag_card_template_source), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(html_components_struct, series_card_template_source), 0},
+};
+static const site_snapshot_field_struct misc_page_fields[] = {
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(misc_page_struct, content), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(misc_page_struct, title), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(misc_page_struct, filename), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(misc_page_struct, description), 0},
+};
+static const site_snapshot_field_struct series_fields[] = {
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(series_struct, folder_name), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(series_struct, landing_desc_html), 0},
+	{SITE_SNAPSHOT_FIELD_INT, offsetof(series_struct, order), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(series_struct, short_description), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(series_struct, title), 0},
+};
+// The dates are parsed again on every run, as they may depend on the
+// current time.
+static const site_snapshot_field_struct post_fields[] = {
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, folder_name), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, title), 0},
+	// The content itself is only loaded when it's needed
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, content_filename), 0},
+	{SITE_SNAPSHOT_FIELD_UINT64, offsetof(post_struct, content_version), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, author), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, raw_tags), 0},
+	{SITE_SNAPSHOT_FIELD_STRING_LIST, offsetof(post_struct, tags), offsetof(post_struct, raw_tags)},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, series_name), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, short_description), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, long_description), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, raw_suggested_next_reading), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, raw_suggested_prev_reading), 0},
+	{SITE_SNAPSHOT_FIELD_STRING_LIST, offsetof(post_struct, suggested_next_reading_names), offsetof(post_struct, raw_suggested_next_reading)},
+	{SITE_SNAPSHOT_FIELD_STRING_LIST, offsetof(post_struct, suggested_prev_reading_names), offsetof(post_struct, raw_suggested_prev_reading)},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, written_date), 0},
+	{SITE_SNAPSHOT_FIELD_INT, offsetof(post_struct, publish_when_ready), 0},
+	{SITE_SNAPSHOT_FIELD_INT, offsetof(post_struct, has_code), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, publish_after), 0},
+	{SITE_SNAPSHOT_FIELD_DSTRING, offsetof(post_struct, updated_at), 0},
+};
+
+// Returns the fields for the kind of unit, storing how many there are in
+// num_fields; NULL (with no fields) if the kind isn't known.
+const site_snapshot_field_struct* site_snapshot_get_fields(uint64_t kind, size_t* num_fields) {
+	(*num_fields) = 0;
+	switch(kind) {
+		case SITE_SNAPSHOT_THEME:
+			(*num_fields) = sizeof(theme_fields) / sizeof(theme_fields[0]);
+			return theme_fields;
+		case SITE_SNAPSHOT_HTML_COMPONENTS:
+			(*num_fields) = sizeof(html_components_fields) / sizeof(html_components_fields[0]);
+			return html_components_fields;
+		case SITE_SNAPSHOT_MISC_PAGE:
+			(*num_fields) = sizeof(misc_page_fields) / sizeof(misc_page_fields[0]);
+			return misc_page_fields;
+		case SITE_SNAPSHOT_SERIES:
+			(*num_fields) = sizeof(series_fields) / sizeof(series_fields[0]);
+			return series_fields;
+		case SITE_SNAPSHOT_POST:
+			(*num_fields) = sizeof(post_fields) / sizeof(post_fields[0]);
+			return post_fields;
+		case SITE_SNAPSHOT_SKIPPED_POST:
+			return post_fields;
+	}
+	return NULL;
+}
+static inline dstring_struct* site_snapshot_get_dstring_field(void* object, size_t offset) {
+	return (dstring_struct*) ((char*) object + offset);
+}
+static inline size_t site_snapshot_round_up(size_t length) {
+	return (length + 7) & ~((size_t) 7);
+}
+void site_snapshot_stat_from_stat(site_snapshot_stat_struct* snapshot_stat, struct stat* file_stat) {
+	snapshot_stat->inode = (uint64_t) file_stat->st_ino;
+	snapshot_stat->size = (uint64_t) file_stat->st_size;
+	snapshot_stat->mtime_sec = (int64_t) file_stat->st_mtim.tv_sec;
+	snapshot_stat->mtime_nsec = (int64_t) file_stat->st_mtim.tv_nsec;
+}
+int site_snapshot_stat_equal(site_snapshot_stat_struct* a, site_snapshot_stat_struct* b) {
+	return a->inode == b->inode
+		&& a->size == b->size
+		&& a->mtime_sec == b->mtime_sec
+		&& a->mtime_nsec == b->mtime_nsec;
+}
+// Stats the file in the folder open as dir_fd (or the folder itself, if
+// file is NULL). Files are looked up relative to the open folder, rather
+// than by their full path, as there can be tens of thousands of them.
+// Returns 0 if it couldn't be stat()'d.
+int site_snapshot_stat_at(int dir_fd, const char* file, site_snapshot_stat_struct* snapshot_stat) {
+	struct stat file_stat;
+	if(file == NULL ? fstat(dir_fd, &file_stat) : fstatat(dir_fd, file, &file_stat, 0)) {
+		return 0;
+	}
+	site_snapshot_stat_from_stat(snapshot_stat, &file_stat);
+	return 1;
+}
+// Opens the folder at path, to stat the files in it with
+// site_snapshot_stat_at.
+// Returns -1 if it couldn't be opened.
+int site_snapshot_open_dir(const char* path) {
+	return open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+// Checks that everything in the block is within it, and that every string
+// is followed by a '\0'.
+// Returns 0 if the block is invalid.
+int site_snapshot_validate_unit(site_snapshot_unit_struct* unit) {
+	char* block = (char*) unit;
+	uint64_t length = unit->length;
+	if(unit->path_offset >= length
+		|| memchr(block + unit->path_offset, '\0', length - unit->path_offset) == NULL
+		|| unit->files_offset > length
+		|| unit->num_files > (length - unit->files_offset) / sizeof(site_snapshot_file_struct)
+		|| unit->values_offset > length
+		|| unit->num_values > (length - unit->values_offset) / sizeof(site_snapshot_value_struct)) {
+		return 0;
+	}
+	site_snapshot_file_struct* files = (site_snapshot_file_struct*) (block + unit->files_offset);
+	for(size_t i = 0; i < unit->num_files; i++) {
+		if(files[i].name_offset >= length
+			|| memchr(block + files[i].name_offset, '\0', length - files[i].name_offset) == NULL) {
+			return 0;
+		}
+	}
+	size_t num_fields;
+	const site_snapshot_field_struct* fields = site_snapshot_get_fields(unit->kind, &num_fields);
+	if(fields == NULL || unit->num_values != num_fields) {
+		return 0;
+	}
+	site_snapshot_value_struct* values = (site_snapshot_value_struct*) (block + unit->values_offset);
+	for(size_t i = 0; i < num_fields; i++) {
+		if(fields[i].type == SITE_SNAPSHOT_FIELD_DSTRING) {
+			if(values[i].first >= length
+				|| values[i].second >= length - values[i].first
+				|| block[values[i].first + values[i].second] != '\0') {
+				return 0;
+			}
+		} else if(fields[i].type == SITE_SNAPSHOT_FIELD_STRING_LIST) {
+			if(values[i].first > length
+				|| values[i].second > (length - values[i].first) / sizeof(uint64_t)) {
+				return 0;
+			}
+			// The strings must be within the string the list points into
+			uint64_t source_length = 0;
+			for(size_t j = 0; j < i; j++) {
+				if(fields[j].offset == fields[i].source_offset) {
+					source_length = values[j].second;
+				}
+			}
+			uint64_t* string_offsets = (uint64_t*) (block + values[i].first);
+			for(size_t j = 0; j < values[i].second; j++) {
+				if(string_offsets[j] > source_length) {
+					return 0;
+				}
+			}
+		}
+	}
+	return 1;
+}
+// Finds all of the units in the mapping, and indexes them.
+// Returns 0 if the snapshot is invalid.
+int site_snapshot_index_units(site_snapshot_struct* snapshot) {
+	site_snapshot_header_struct* header = (site_snapshot_header_struct*) snapshot->mapping;
+	if(snapshot->mapping_length < sizeof(site_snapshot_header_struct)
+		|| memcmp(header->magic, SITE_SNAPSHOT_MAGIC, sizeof(header->magic))
+		|| header->total_length != snapshot->mapping_length) {
+		return 0;
+	}
+	size_t offset = sizeof(site_snapshot_header_struct);
+	for(uint64_t i = 0; i < header->num_units; i++) {
+		if(snapshot->mapping_length - offset < sizeof(site_snapshot_unit_struct)) {
+			return 0;
+		}
+		site_snapshot_unit_struct* unit = (site_snapshot_unit_struct*) (snapshot->mapping + offset);
+		if(unit->length < sizeof(site_snapshot_unit_struct)
+			|| unit->length % 8 != 0
+			|| unit->length > snapshot->mapping_length - offset
+			|| !site_snapshot_validate_unit(unit)) {
+			return 0;
+		}
+		if(!dhashindex_insert(&snapshot->index, (char*) unit + unit->path_offset, offset)) {
+			return 0;
+		}
+		offset += unit->length;
+	}
+	snapshot->num_units = header->num_units;
+	return offset == snapshot->mapping_length;
+}
+
+void site_snapshot_init(site_snapshot_struct* snapshot) {
+	snapshot->enabled = 0;
+	snapshot->mapping = NULL;
+	snapshot->mapping_length = 0;
+	snapshot->num_units = 0;
+	snapshot->changed = 0;
+	dstring_lazy_init(&snapshot->filename);
+	dhashindex_lazy_init(&snapshot->index);
+	darray_lazy_init(&snapshot->records, sizeof(dstring_struct));
+}
+// Stops restoring from and recording to the snapshot, keeping it mapped in
+// for the strings that were restored from it.
+void site_snapshot_stop(site_snapshot_struct* snapshot) {
+	if(snapshot->enabled) {
+		pthread_mutex_destroy(&snapshot->lock);
+	}
+	snapshot->enabled = 0;
+	darray_of_dstrings_free(&snapshot->records);
+	dhashindex_free(&snapshot->index);
+	dstring_free(&snapshot->filename);
+}
+void site_snapshot_free(site_snapshot_struct* snapshot) {
+	site_snapshot_stop(snapshot);
+	if(snapshot->mapping != NULL) {
+		munmap(snapshot->mapping, snapshot->mapping_length);
+	}
+	site_snapshot_init(snapshot);
+}
+// Maps in the snapshot file, leaving the snapshot empty if it can't be used.
+void site_snapshot_map(site_snapshot_struct* snapshot) {
+	int fd = open(snapshot->filename.str, O_RDONLY | O_CLOEXEC);
+	if(fd == -1) {
+		if(errno != ENOENT) {
+			fprintf(stderr, "Warning, couldn't open site snapshot %s, ignoring it\n", snapshot->filename.str);
+		}
+		return;
+	}
+	struct stat file_stat;
+	if(fstat(fd, &file_stat) || file_stat.st_size == 0) {
+		fprintf(stderr, "Warning, couldn't get the size of site snapshot %s, or it's empty, ignoring it\n", snapshot->filename.str);
+		close(fd);
+		return;
+	}
+	snapshot->mapping_length = (size_t) file_stat.st_size;
+	void* mapping = mmap(NULL, snapshot->mapping_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED) {
+		fprintf(stderr, "Warning, couldn't map site snapshot %s, ignoring it\n", snapshot->filename.str);
+		snapshot->mapping_length = 0;
+		return;
+	}
+	snapshot->mapping = mapping;
+	if(!site_snapshot_index_units(snapshot)) {
+		fprintf(stderr, "Warning, site snapshot %s is not valid, ignoring it\n", snapshot->filename.str);
+		dhashindex_clear(&snapshot->index);
+		munmap(snapshot->mapping, snapshot->mapping_length);
+		snapshot->mapping = NULL;
+		snapshot->mapping_length = 0;
+		snapshot->num_units = 0;
+	}
+}
+site_snapshot_struct* site_snapshot_open(site_snapshot_struct* snapshot, const char* filename) {
+	if(!dstring_append(&snapshot->filename, filename)) {
+		fprintf(stderr, "Error opening site snapshot, dstring append error\n");
+		return NULL;
+	}
+	if(pthread_mutex_init(&snapshot->lock, NULL)) {
+		fprintf(stderr, "Error opening site snapshot, couldn't create mutex\n");
+		return NULL;
+	}
+	snapshot->enabled = 1;
+	site_snapshot_map(snapshot);
+	return snapshot;
+}
+
+void site_snapshot_fingerprint_init(site_snapshot_fingerprint_struct* fingerprint) {
+	dstring_lazy_init(&fingerprint->path);
+	memset(&fingerprint->dir_stat, 0, sizeof(fingerprint->dir_stat));
+	darray_lazy_init(&fingerprint->files, sizeof(site_snapshot_fingerprint_file_struct));
+}
+void site_snapshot_fingerprint_free(site_snapshot_fingerprint_struct* fingerprint) {
+	for(size_t i = 0; i < fingerprint->files.length; i++) {
+		dstring_free(&((site_snapshot_fingerprint_file_struct*) darray_get_elem(&fingerprint->files, i))->name);
+	}
+	darray_free(&fingerprint->files);
+	dstring_free(&fingerprint->path);
+}
+typedef struct site_snapshot_fingerprint_context_struct {
+	site_snapshot_fingerprint_struct* fingerprint;
+	int dir_fd;
+} site_snapshot_fingerprint_context_struct;
+
+int site_snapshot_fingerprint_add_file(dstring_struct* dir, struct dirent* dir_ent, void* context_void_ptr) {
+	site_snapshot_fingerprint_context_struct* context = context_void_ptr;
+	site_snapshot_fingerprint_struct* fingerprint = context->fingerprint;
+	site_snapshot_fingerprint_file_struct file;
+	dstring_lazy_init(&file.name);
+	if(!site_snapshot_stat_at(context->dir_fd, dir_ent->d_name, &file.stat)) {
+		// It was removed in the meantime; the folder's stat will have changed
+		return 1;
+	}
+	if(!dstring_append(&file.name, dir_ent->d_name)) {
+		fprintf(stderr, "Error taking fingerprint of %s, dstring append error\n", dir->str);
+		return 0;
+	}
+	if(!darray_append(&fingerprint->files, &file)) {
+		fprintf(stderr, "Error taking fingerprint of %s, darray append error\n", dir->str);
+		dstring_free(&file.name);
+		return 0;
+	}
+	return 1;
+}
+// Stats the folder at dir, and everything in it.
+// Returns 0 on error.
+int site_snapshot_take_fingerprint(dstring_struct* dir, site_snapshot_fingerprint_struct* fingerprint) {
+	if(!dstring_append(&fingerprint->path, dir->str)) {
+		fprintf(stderr, "Error taking fingerprint of %s, dstring append error\n", dir->str);
+		return 0;
+	}
+	site_snapshot_fingerprint_context_struct context;
+	context.fingerprint = fingerprint;
+	context.dir_fd = site_snapshot_open_dir(dir->str);
+	if(context.dir_fd == -1 || !site_snapshot_stat_at(context.dir_fd, NULL, &fingerprint->dir_stat)) {
+		fprintf(stderr, "Error taking fingerprint of %s, stat error\n", dir->str);
+		if(context.dir_fd != -1) {
+			close(context.dir_fd);
+		}
+		return 0;
+	}
+	int res = apply_function_to_directory_entries(dir, 1, DT_REG | DT_DIR | DT_LNK, site_snapshot_fingerprint_add_file, &context);
+	close(context.dir_fd);
+	return res;
+}
+// Checks whether the folder and the files in it still have the stats that
+// were saved in the unit.
+// Returns 1 if they do, 0 otherwise.
+int site_snapshot_unit_is_current(site_snapshot_unit_struct* unit, dstring_struct* dir) {
+	int dir_fd = site_snapshot_open_dir(dir->str);
+	if(dir_fd == -1) {
+		return 0;
+	}
+	site_snapshot_stat_struct current_stat;
+	int is_current = site_snapshot_stat_at(dir_fd, NULL, &current_stat)
+		&& site_snapshot_stat_equal(&current_stat, &unit->dir_stat);
+	site_snapshot_file_struct* files = (site_snapshot_file_struct*) ((char*) unit + unit->files_offset);
+	for(size_t i = 0; is_current && i < unit->num_files; i++) {
+		is_current = site_snapshot_stat_at(dir_fd, (char*) unit + files[i].name_offset, &current_stat)
+			&& site_snapshot_stat_equal(&current_stat, &files[i].stat);
+	}
+	close(dir_fd);
+	return is_current;
+}
+// Fills in object from the unit.
+// Returns 0 on error.
+int site_snapshot_restore_object(site_snapshot_unit_struct* unit, void* object) {
+	char* block = (char*) unit;
+	size_t num_fields;
+	const site_snapshot_field_struct* fields = site_snapshot_get_fields(unit->kind, &num_fields);
+	site_snapshot_value_struct* values = (site_snapshot_value_struct*) (block + unit->values_offset);
+	for(size_t i = 0; i < num_fields; i++) {
+		void* field = (char*) object + fields[i].offset;
+		switch(fields[i].type) {
+			case SITE_SNAPSHOT_FIELD_DSTRING:
+				dstring_borrow((dstring_struct*) field, block + values[i].first, values[i].second);
+				break;
+			case SITE_SNAPSHOT_FIELD_INT:
+				(*((int*) field)) = (int) (int64_t) values[i].first;
+				break;
+			case SITE_SNAPSHOT_FIELD_UINT64:
+				(*((uint64_t*) field)) = values[i].first;
+				break;
+			case SITE_SNAPSHOT_FIELD_STRING_LIST: {
+				dstring_struct* source = site_snapshot_get_dstring_field(object, fields[i].source_offset);
+				uint64_t* string_offsets = (uint64_t*) (block + values[i].first);
+				for(size_t j = 0; j < values[i].second; j++) {
+					char* str = source->str + string_offsets[j];
+					if(!darray_append((darray_struct*) field, &str)) {
+						fprintf(stderr, "Error restoring %s from site snapshot, darray append error\n", block + unit->path_offset);
+						return 0;
+					}
+				}
+				break;
+			}
+		}
+	}
+	return 1;
+}
+// Adds the unit block to the records.
+// Returns 0 on error.
+int site_snapshot_add_record(site_snapshot_struct* snapshot, dstring_struct* block, int changed) {
+	pthread_mutex_lock(&snapshot->lock);
+	darray_struct* res = darray_append(&snapshot->records, block);
+	if(changed) {
+		snapshot->changed = 1;
+	}
+	pthread_mutex_unlock(&snapshot->lock);
+	if(!res) {
+		fprintf(stderr, "Error recording unit in site snapshot, darray append error\n");
+		return 0;
+	}
+	return 1;
+}
+int site_snapshot_restore(site_snapshot_struct* snapshot, dstring_struct* dir, int kind, void* object, site_snapshot_fingerprint_struct* fingerprint, int* result) {
+	(*result) = SITE_SNAPSHOT_NOT_RESTORED;
+	if(!snapshot->enabled) {
+		return 1;
+	}
+	size_t offset;
+	if(dhashindex_find(&snapshot->index, dir->str, &offset)) {
+		site_snapshot_unit_struct* unit = (site_snapshot_unit_struct*) (snapshot->mapping + offset);
+		int kind_matches = unit->kind == (uint64_t) kind
+			|| (kind == SITE_SNAPSHOT_POST && unit->kind == SITE_SNAPSHOT_SKIPPED_POST);
+		if(kind_matches && site_snapshot_unit_is_current(unit, dir)) {
+			if(unit->kind != SITE_SNAPSHOT_SKIPPED_POST && !site_snapshot_restore_object(unit, object)) {
+				return 0;
+			}
+			dstring_struct block;
+			dstring_borrow(&block, (char*) unit, unit->length);
+			if(!site_snapshot_add_record(snapshot, &block, 0)) {
+				return 0;
+			}
+			(*result) = unit->kind == SITE_SNAPSHOT_SKIPPED_POST ? SITE_SNAPSHOT_RESTORED_SKIPPED : SITE_SNAPSHOT_RESTORED;
+			return 1;
+		}
+	}
+	return site_snapshot_take_fingerprint(dir, fingerprint);
+}
+
+int site_snapshot_record(site_snapshot_struct* snapshot, site_snapshot_fingerprint_struct* fingerprint, int kind, void* object) {
+	if(!snapshot->enabled) {
+		return 1;
+	}
+	size_t num_fields;
+	const site_snapshot_field_struct* fields = site_snapshot_get_fields(kind, &num_fields);
+	size_t num_files = fingerprint->files.length;
+
+	// Works out where everything goes: the arrays first, then the strings.
+	size_t length = sizeof(site_snapshot_unit_struct)
+		+ num_files * sizeof(site_snapshot_file_struct)
+		+ num_fields * sizeof(site_snapshot_value_struct);
+	size_t strings_length = fingerprint->path.length + 1;
+	for(size_t i = 0; i < num_files; i++) {
+		strings_length += ((site_snapshot_fingerprint_file_struct*) darray_get_elem(&fingerprint->files, i))->name.length + 1;
+	}
+	for(size_t i = 0; i < num_fields; i++) {
+		if(fields[i].type == SITE_SNAPSHOT_FIELD_DSTRING) {
+			strings_length += site_snapshot_get_dstring_field(object, fields[i].offset)->length + 1;
+		} else if(fields[i].type == SITE_SNAPSHOT_FIELD_STRING_LIST) {
+			length += ((darray_struct*) ((char*) object + fields[i].offset))->length * sizeof(uint64_t);
+		}
+	}
+	size_t strings_offset = length;
+	length = site_snapshot_round_up(length + strings_length);
+
+	dstring_struct block;
+	dstring_lazy_init(&block);
+	if(!dstring_resize_no_extra(&block, length)) {
+		fprintf(stderr, "Error recording %s in site snapshot, dstring resize error\n", fingerprint->path.str);
+		return 0;
+	}
+	memset(block.str, 0, length + 1);
+	block.length = length;
+
+	site_snapshot_unit_struct* unit = (site_snapshot_unit_struct*) block.str;
+	unit->length = length;
+	unit->kind = kind;
+	unit->dir_stat = fingerprint->dir_stat;
+	unit->files_offset = sizeof(site_snapshot_unit_struct);
+	unit->num_files = num_files;
+	unit->values_offset = unit->files_offset + num_files * sizeof(site_snapshot_file_struct);
+	unit->num_values = num_fields;
+	size_t arrays_offset = unit->values_offset + num_fields * sizeof(site_snapshot_value_struct);
+
+	unit->path_offset = strings_offset;
+	memcpy(block.str + strings_offset, fingerprint->path.str, fingerprint->path.length);
+	strings_offset += fingerprint->path.length + 1;
+
+	site_snapshot_file_struct* files = (site_snapshot_file_struct*) (block.str + unit->files_offset);
+	for(size_t i = 0; i < num_files; i++) {
+		site_snapshot_fingerprint_file_struct* file = (site_snapshot_fingerprint_file_struct*) darray_get_elem(&fingerprint->files, i);
+		files[i].name_offset = strings_offset;
+		files[i].stat = file->stat;
+		memcpy(block.str + strings_offset, file->name.str, file->name.length);
+		strings_offset += file->name.length + 1;
+	}
+
+	site_snapshot_value_struct* values = (site_snapshot_value_struct*) (block.str + unit->values_offset);
+	for(size_t i = 0; i < num_fields; i++) {
+		void* field = (char*) object + fields[i].offset;
+		switch(fields[i].type) {
+			case SITE_SNAPSHOT_FIELD_DSTRING: {
+				dstring_struct* dstring = field;
+				values[i].first = strings_offset;
+				values[i].second = dstring->length;
+				memcpy(block.str + strings_offset, dstring->str, dstring->length);
+				strings_offset += dstring->length + 1;
+				break;
+			}
+			case SITE_SNAPSHOT_FIELD_INT:
+				values[i].first = (uint64_t) (int64_t) (*((int*) field));
+				break;
+			case SITE_SNAPSHOT_FIELD_UINT64:
+				values[i].first = (*((uint64_t*) field));
+				break;
+			case SITE_SNAPSHOT_FIELD_STRING_LIST: {
+				darray_struct* list = field;
+				dstring_struct* source = site_snapshot_get_dstring_field(object, fields[i].source_offset);
+				uint64_t* string_offsets = (uint64_t*) (block.str + arrays_offset);
+				values[i].first = arrays_offset;
+				values[i].second = list->length;
+				for(size_t j = 0; j < list->length; j++) {
+					string_offsets[j] = (*((char**) darray_get_elem(list, j))) - source->str;
+				}
+				arrays_offset += list->length * sizeof(uint64_t);
+				break;
+			}
+		}
+	}
+	if(!site_snapshot_add_record(snapshot, &block, 1)) {
+		dstring_free(&block);
+		return 0;
+	}
+	return 1;
+}
+
+// Writes out the snapshot file, if anything is different from the snapshot
+// that was opened.
+// Returns 0 on error.
+int site_snapshot_write(site_snapshot_struct* snapshot) {
+	if(!snapshot->changed && snapshot->mapping != NULL && snapshot->records.length == snapshot->num_units) {
+		return 1;
+	}
+	site_snapshot_header_struct header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SITE_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.num_units = snapshot->records.length;
+	header.total_length = sizeof(header);
+
+	dstringbuilder_struct dstringbuilder;
+	dstring_struct header_dstring;
+	dstring_struct temp_filename;
+	dstringbuilder_init(&dstringbuilder);
+	dstring_borrow(&header_dstring, (char*) &header, sizeof(header));
+	dstring_lazy_init(&temp_filename);
+
+	int res = dstringbuilder_append_dstring(&dstringbuilder, &header_dstring) != NULL;
+	for(size_t i = 0; res && i < snapshot->records.length; i++) {
+		dstring_struct* block = (dstring_struct*) darray_get_elem(&snapshot->records, i);
+		header.total_length += block->length;
+		res = dstringbuilder_append_dstring(&dstringbuilder, block) != NULL;
+	}
+	// Written to a temporary file first, so that the snapshot is never left
+	// half-written; it's named after the process, as the site may be
+	// validated while it's being generated.
+	if(!res || !dstring_append_printf(&temp_filename, "%s.%ld.tmp", snapshot->filename.str, (long) getpid())) {
+		fprintf(stderr, "Error saving site snapshot, dstring append error\n");
+		res = 0;
+	} else if(!dstringbuilder_write_file(&dstringbuilder, temp_filename.str)) {
+		fprintf(stderr, "Error saving site snapshot, couldn't write file %s\n", temp_filename.str);
+		unlink(temp_filename.str);
+		res = 0;
+	} else if(rename(temp_filename.str, snapshot->filename.str)) {
+		fprintf(stderr, "Error saving site snapshot, couldn't rename %s to %s\n", temp_filename.str, snapshot->filename.str);
+		unlink(temp_filename.str);
+		res = 0;
+	}
+	dstringbuilder_free(&dstringbuilder);
+	dstring_free(&temp_filename);
+	return res;
+}
+int site_snapshot_save(site_snapshot_struct* snapshot) {
+	if(!snapshot->enabled) {
+		return 1;
+	}
+	int res = site_snapshot_write(snapshot);
+	site_snapshot_stop(snapshot);
+	return res;
+}
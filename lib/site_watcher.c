@@ -0,0 +1,427 @@
+#include "dobjects.h"
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include "site_generator.h"
+#include "site_loader.h"
+#include "site_watcher.h"
+
+#define WATCH_KIND_THEMES 1
+#define WATCH_KIND_COMPONENTS 2
+#define WATCH_KIND_MISC_PAGES 3
+#define WATCH_KIND_SERIES 4
+#define WATCH_KIND_POSTS_DIR 5
+#define WATCH_KIND_POST 6
+
+#define WATCH_DIR_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+
+// A single inotify watch, and what part of the site it's for.
+typedef struct site_watch_struct {
+	int wd;
+	int kind;
+
+	// For WATCH_KIND_POST, the post's folder name.
+	dstring_struct folder_name;
+} site_watch_struct;
+
+typedef struct site_watcher_struct {
+	configuration_struct* configuration;
+	int inotify_fd;
+
+	// A darray of site_watch_struct's.
+	darray_struct watches;
+
+	// The changes seen since the last rebuild.
+	site_changes_struct changes;
+} site_watcher_struct;
+
+static volatile sig_atomic_t stop_watching = 0;
+
+static void site_watcher_handle_signal(int signal_number) {
+	stop_watching = 1;
+}
+
+// Returns the current time of the monotonic clock, in milliseconds.
+long long site_watcher_now_ms() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+site_watch_struct* site_watcher_find_watch(site_watcher_struct* watcher, int wd) {
+	for(size_t i = 0; i < watcher->watches.length; i++) {
+		site_watch_struct* watch = (site_watch_struct*) darray_get_elem(&watcher->watches, i);
+		if(watch->wd == wd) {
+			return watch;
+		}
+	}
+	return NULL;
+}
+// Returns the watch of the post folder folder_name, or NULL if it isn't
+// watched.
+site_watch_struct* site_watcher_find_post_watch(site_watcher_struct* watcher, const char* folder_name) {
+	for(size_t i = 0; i < watcher->watches.length; i++) {
+		site_watch_struct* watch = (site_watch_struct*) darray_get_elem(&watcher->watches, i);
+		if(watch->kind == WATCH_KIND_POST && strcmp(watch->folder_name.str, folder_name) == 0) {
+			return watch;
+		}
+	}
+	return NULL;
+}
+// Watches the directory content_base_dir/subdir, recording it as the given
+// kind. It is not an error for the directory to not exist (a folder could
+// be removed right after it's created).
+// Returns 0 on error.
+int site_watcher_add_watch(site_watcher_struct* watcher, const char* subdir, int kind, const char* folder_name) {
+	dstring_struct path;
+	dstring_lazy_init(&path);
+	if(!dstring_append_printf(&path, "%s/%s", watcher->configuration->content_base_dir, subdir)) {
+		fprintf(stderr, "Error watching %s, dstring append error\n", subdir);
+		return 0;
+	}
+	int wd = inotify_add_watch(watcher->inotify_fd, path.str, WATCH_DIR_MASK);
+	if(wd == -1) {
+		int missing = (errno == ENOENT || errno == ENOTDIR);
+		if(!missing) {
+			fprintf(stderr, "Error watching %s, inotify_add_watch error: %s\n", path.str, strerror(errno));
+		}
+		dstring_free(&path);
+		return missing;
+	}
+	dstring_free(&path);
+
+	site_watch_struct watch;
+	watch.wd = wd;
+	watch.kind = kind;
+	dstring_lazy_init(&watch.folder_name);
+	if(folder_name != NULL && !dstring_append(&watch.folder_name, folder_name)) {
+		fprintf(stderr, "Error watching %s, dstring append error\n", subdir);
+		return 0;
+	}
+	// inotify hands back the same wd if the directory is already watched,
+	// which it still is after being renamed, so the watch is updated to
+	// what the directory is now
+	site_watch_struct* existing_watch = site_watcher_find_watch(watcher, wd);
+	if(existing_watch != NULL) {
+		dstring_free(&existing_watch->folder_name);
+		(*existing_watch) = watch;
+		return 1;
+	}
+	if(!darray_append(&watcher->watches, &watch)) {
+		fprintf(stderr, "Error watching %s, darray append error\n", subdir);
+		dstring_free(&watch.folder_name);
+		return 0;
+	}
+	return 1;
+}
+// Watches the subfolder folder_name of the given parent directory.
+// Returns 0 on error.
+int site_watcher_add_subfolder_watch(site_watcher_struct* watcher, const char* parent_dir, const char* folder_name, int kind) {
+	dstring_struct subdir;
+	dstring_lazy_init(&subdir);
+	if(!dstring_append_printf(&subdir, "%s/%s", parent_dir, folder_name)) {
+		fprintf(stderr, "Error watching %s, dstring append error\n", folder_name);
+		return 0;
+	}
+	int res = site_watcher_add_watch(watcher, subdir.str, kind, kind == WATCH_KIND_POST ? folder_name : NULL);
+	dstring_free(&subdir);
+	return res;
+}
+
+typedef struct site_watcher_subfolder_context_struct {
+	site_watcher_struct* watcher;
+	const char* parent_dir;
+	int kind;
+} site_watcher_subfolder_context_struct;
+
+int site_watcher_add_subfolder_watch_for_entry(dstring_struct* base_dir, struct dirent* dir_ent, void* context_void_ptr) {
+	site_watcher_subfolder_context_struct* context = context_void_ptr;
+	return site_watcher_add_subfolder_watch(context->watcher, context->parent_dir, dir_ent->d_name, context->kind);
+}
+// Watches parent_dir, as well as each folder in it.
+// Returns 0 on error.
+int site_watcher_add_watches_for_folders(site_watcher_struct* watcher, const char* parent_dir, int parent_kind, int kind) {
+	if(!site_watcher_add_watch(watcher, parent_dir, parent_kind, NULL)) {
+		return 0;
+	}
+	dstring_struct dir;
+	dstring_lazy_init(&dir);
+	if(!dstring_append_printf(&dir, "%s/%s/", watcher->configuration->content_base_dir, parent_dir)) {
+		fprintf(stderr, "Error watching %s, dstring append error\n", parent_dir);
+		return 0;
+	}
+	site_watcher_subfolder_context_struct context;
+	context.watcher = watcher;
+	context.parent_dir = parent_dir;
+	context.kind = kind;
+	int res = apply_function_to_directory_entries(&dir, 0, DT_DIR, site_watcher_add_subfolder_watch_for_entry, &context);
+	dstring_free(&dir);
+	return res;
+}
+// Removes all watches, and then watches every folder of the site again.
+// Returns 0 on error.
+int site_watcher_add_all_watches(site_watcher_struct* watcher) {
+	for(size_t i = 0; i < watcher->watches.length; i++) {
+		site_watch_struct* watch = (site_watch_struct*) darray_get_elem(&watcher->watches, i);
+		inotify_rm_watch(watcher->inotify_fd, watch->wd);
+		dstring_free(&watch->folder_name);
+	}
+	watcher->watches.length = 0;
+	if(!site_watcher_add_watch(watcher, "themes/bright", WATCH_KIND_THEMES, NULL)
+		|| !site_watcher_add_watch(watcher, "themes/dark", WATCH_KIND_THEMES, NULL)
+		|| !site_watcher_add_watch(watcher, "components", WATCH_KIND_COMPONENTS, NULL)
+		|| !site_watcher_add_watches_for_folders(watcher, "misc_pages", WATCH_KIND_MISC_PAGES, WATCH_KIND_MISC_PAGES)
+		|| !site_watcher_add_watches_for_folders(watcher, "series", WATCH_KIND_SERIES, WATCH_KIND_SERIES)
+		|| !site_watcher_add_watches_for_folders(watcher, "posts", WATCH_KIND_POSTS_DIR, WATCH_KIND_POST)) {
+		fprintf(stderr, "Error setting up watches for the site\n");
+		return 0;
+	}
+	return 1;
+}
+void site_watcher_remove_watch(site_watcher_struct* watcher, site_watch_struct* watch) {
+	size_t index = ((void*) watch - watcher->watches.array) / watcher->watches.elem_size;
+	dstring_free(&watch->folder_name);
+	memmove(watch, darray_get_elem(&watcher->watches, index + 1), (watcher->watches.length - index - 1) * watcher->watches.elem_size);
+	watcher->watches.length--;
+}
+// Records what a single inotify event means for the site.
+// Returns 0 on error.
+int site_watcher_handle_event(site_watcher_struct* watcher, struct inotify_event* event) {
+	if(event->mask & IN_Q_OVERFLOW) {
+		// Some events were lost, so there's no telling what changed.
+		site_changes_set_all(&watcher->changes);
+		return site_watcher_add_all_watches(watcher);
+	}
+	site_watch_struct* watch = site_watcher_find_watch(watcher, event->wd);
+	if(watch == NULL) {
+		return 1;
+	}
+	if(event->mask & IN_IGNORED) {
+		// The folder was removed; its parent's watch reports the removal.
+		site_watcher_remove_watch(watcher, watch);
+		return 1;
+	}
+	int new_dir = (event->mask & (IN_CREATE | IN_MOVED_TO)) && (event->mask & IN_ISDIR);
+	switch(watch->kind) {
+		case WATCH_KIND_THEMES:
+			watcher->changes.themes = 1;
+			return 1;
+		case WATCH_KIND_COMPONENTS:
+			watcher->changes.html_components = 1;
+			return 1;
+		case WATCH_KIND_MISC_PAGES:
+			watcher->changes.misc_pages = 1;
+			if(new_dir && event->len > 0) {
+				return site_watcher_add_subfolder_watch(watcher, "misc_pages", event->name, WATCH_KIND_MISC_PAGES);
+			}
+			return 1;
+		case WATCH_KIND_SERIES:
+			watcher->changes.series = 1;
+			if(new_dir && event->len > 0) {
+				return site_watcher_add_subfolder_watch(watcher, "series", event->name, WATCH_KIND_SERIES);
+			}
+			return 1;
+		case WATCH_KIND_POSTS_DIR:
+			if(event->len == 0 || !(event->mask & IN_ISDIR)) {
+				return 1;
+			}
+			// The post folder was added, removed, or renamed.
+			if(!site_changes_add_post(&watcher->changes, event->name)) {
+				return 0;
+			}
+			if(event->mask & IN_MOVED_FROM) {
+				// The folder's watch moves with it, so it's dropped; if the
+				// folder was renamed within posts/, its IN_MOVED_TO watches it
+				// again under the new name.
+				site_watch_struct* post_watch = site_watcher_find_post_watch(watcher, event->name);
+				if(post_watch != NULL) {
+					inotify_rm_watch(watcher->inotify_fd, post_watch->wd);
+					site_watcher_remove_watch(watcher, post_watch);
+				}
+				return 1;
+			}
+			if(new_dir) {
+				return site_watcher_add_subfolder_watch(watcher, "posts", event->name, WATCH_KIND_POST);
+			}
+			return 1;
+		case WATCH_KIND_POST:
+			return site_changes_add_post(&watcher->changes, watch->folder_name.str) != NULL;
+		default:
+			return 1;
+	}
+}
+// Reads and handles all waiting inotify events.
+// Returns 0 on error.
+int site_watcher_read_events(site_watcher_struct* watcher) {
+	char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	while(1) {
+		ssize_t length = read(watcher->inotify_fd, buffer, sizeof(buffer));
+		if(length == -1) {
+			if(errno == EAGAIN) {
+				return 1;
+			}
+			if(errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error watching site, inotify read error: %s\n", strerror(errno));
+			return 0;
+		}
+		for(char* current = buffer; current < buffer + length; ) {
+			struct inotify_event* event = (struct inotify_event*) current;
+			if(!site_watcher_handle_event(watcher, event)) {
+				return 0;
+			}
+			current += sizeof(struct inotify_event) + event->len;
+		}
+	}
+}
+// Reloads whatever changed, and regenerates the site. If the site can't be
+// reloaded, it's left empty, and everything is marked as changed so that
+// the whole site is loaded on the next rebuild.
+// Returns 0 if the site couldn't be regenerated.
+int site_watcher_rebuild(site_watcher_struct* watcher, site_content_struct* site_content, int* loaded, build_manifest_struct* build_manifest, dstring_struct* manifest_filename) {
+	int res;
+	if(*loaded) {
+		res = reload_site_content(watcher->configuration, site_content, &watcher->changes);
+	} else {
+		res = load_site_content(watcher->configuration, site_content);
+	}
+	site_changes_free(&watcher->changes);
+	if(!res) {
+		fprintf(stderr, "Error loading site content, will reload the whole site on the next change\n");
+		site_content_free(site_content);
+		site_content_init(site_content);
+		(*loaded) = 0;
+		return 0;
+	}
+	(*loaded) = 1;
+	site_content->build_manifest = build_manifest;
+	if(!generate_loaded_site(watcher->configuration, site_content)) {
+		fprintf(stderr, "Error generating site\n");
+		return 0;
+	}
+	if(!build_manifest_save(build_manifest, manifest_filename->str)) {
+		fprintf(stderr, "Error saving build manifest\n");
+		return 0;
+	}
+	return 1;
+}
+// Works out how long to sleep for, in milliseconds (-1 to sleep until
+// something changes).
+int site_watcher_get_timeout(site_content_struct* site_content, int loaded, int changes_pending, long long rebuild_at_ms) {
+	if(changes_pending) {
+		long long remaining = rebuild_at_ms - site_watcher_now_ms();
+		return remaining > 0 ? (int) remaining : 0;
+	}
+	time_t next_publish_time = loaded ? site_content_get_next_publish_time(site_content) : 0;
+	if(next_publish_time == 0) {
+		return -1;
+	}
+	time_t now = time(NULL);
+	if(next_publish_time <= now) {
+		return 0;
+	}
+	long long remaining = ((long long) (next_publish_time - now)) * 1000;
+	return remaining > SITE_WATCHER_MAX_SLEEP_MS ? SITE_WATCHER_MAX_SLEEP_MS : (int) remaining;
+}
+// Watches the site until told to stop.
+// Returns 0 on error.
+int site_watcher_run(site_watcher_struct* watcher, site_content_struct* site_content, build_manifest_struct* build_manifest, dstring_struct* manifest_filename) {
+	int loaded = 0;
+	// Everything counts as changed to begin with, so that the whole site is
+	// loaded in.
+	site_changes_set_all(&watcher->changes);
+	if(!site_watcher_rebuild(watcher, site_content, &loaded, build_manifest, manifest_filename)) {
+		fprintf(stderr, "Error generating site, not watching it for changes\n");
+		return 0;
+	}
+	printf("Watching %s for changes\n", watcher->configuration->content_base_dir);
+	fflush(stdout);
+
+	int changes_pending = 0;
+	long long rebuild_at_ms = 0;
+	while(!stop_watching) {
+		struct pollfd poll_fd;
+		poll_fd.fd = watcher->inotify_fd;
+		poll_fd.events = POLLIN;
+		int timeout = site_watcher_get_timeout(site_content, loaded, changes_pending, rebuild_at_ms);
+		int poll_res = poll(&poll_fd, 1, timeout);
+		if(poll_res == -1) {
+			if(errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error watching site, poll error: %s\n", strerror(errno));
+			return 0;
+		}
+		if(poll_res > 0) {
+			if(!site_watcher_read_events(watcher)) {
+				return 0;
+			}
+			changes_pending = 1;
+			rebuild_at_ms = site_watcher_now_ms() + SITE_WATCHER_DEBOUNCE_MS;
+			continue;
+		}
+		// Timed out; either things have settled down after a change, or a
+		// post's publish-after time has come. Either way, rebuild; with
+		// nothing marked as changed, a rebuild just re-checks which posts
+		// can be published.
+		changes_pending = 0;
+		site_watcher_rebuild(watcher, site_content, &loaded, build_manifest, manifest_filename);
+		fflush(stdout);
+	}
+	return 1;
+}
+int watch_site(configuration_struct* configuration) {
+	site_watcher_struct watcher;
+	watcher.configuration = configuration;
+	darray_lazy_init(&watcher.watches, sizeof(site_watch_struct));
+	site_changes_init(&watcher.changes);
+
+	watcher.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(watcher.inotify_fd == -1) {
+		fprintf(stderr, "Error watching site, inotify_init1 error: %s\n", strerror(errno));
+		return 0;
+	}
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = site_watcher_handle_signal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	dstring_struct lock_filename;
+	dstring_struct manifest_filename;
+	build_manifest_struct build_manifest;
+	site_content_struct site_content;
+
+	dstring_lazy_init(&lock_filename);
+	dstring_lazy_init(&manifest_filename);
+	site_content_init(&site_content);
+
+	if(!acquire_generation_lock(configuration, &lock_filename)) {
+		dstring_free(&lock_filename);
+		close(watcher.inotify_fd);
+		return 0;
+	}
+	int res = 0;
+	if(load_site_build_manifest(configuration, &build_manifest, &manifest_filename)) {
+		// The watches are set up before the site is first loaded, so that
+		// nothing that changes while it's loading is missed.
+		res = site_watcher_add_all_watches(&watcher)
+			&& site_watcher_run(&watcher, &site_content, &build_manifest, &manifest_filename);
+		build_manifest_free(&build_manifest);
+	}
+	release_generation_lock(&lock_filename);
+
+	site_content_free(&site_content);
+	for(size_t i = 0; i < watcher.watches.length; i++) {
+		dstring_free(&((site_watch_struct*) darray_get_elem(&watcher.watches, i))->folder_name);
+	}
+	darray_free(&watcher.watches);
+	site_changes_free(&watcher.changes);
+	dstring_free(&lock_filename);
+	dstring_free(&manifest_filename);
+	close(watcher.inotify_fd);
+	return res;
+}
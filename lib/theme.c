@@ -1,26 +1,316 @@
 #include "dobjects.h"
+#include <inttypes.h>
+#include "file_helpers.h"
 #include "theme.h"
+#include "minify.h"
+#include "precompress.h"
 void theme_free(theme_struct* theme) {
 	dstring_free(&theme->main_css);
 	dstring_free(&theme->syntax_highlighting_css);
+	dstring_free(&theme->main_css_filename);
+	dstring_free(&theme->code_css_filename);
 	dstring_free(&theme->host);
 	dstring_free(&theme->name);
 	dstring_free(&theme->html_base_dir);
+	dstring_free(&theme->page_prelude);
+	dstring_free(&theme->code_page_prelude);
+	dstring_free(&theme->page_header);
+	dstring_free(&theme->page_postlude);
+	dstring_free(&theme->style_start);
+	if(theme->css_pruner != NULL) {
+		css_pruner_free(theme->css_pruner);
+		free(theme->css_pruner);
+		theme->css_pruner = NULL;
+	}
+	theme->external_stylesheets = 0;
+	theme->color_scheme = NULL;
+	close_directory(&theme->html_base_dir_fd);
 }
 void theme_init(theme_struct* theme) {
 	theme->alt_theme = NULL;
+	theme->html_base_dir_fd = -1;
+	theme->css_pruner = NULL;
+	theme->external_stylesheets = 0;
+	theme->color_scheme = NULL;
 	dstring_lazy_init(&theme->main_css);
 	dstring_lazy_init(&theme->syntax_highlighting_css);
+	dstring_lazy_init(&theme->main_css_filename);
+	dstring_lazy_init(&theme->code_css_filename);
 	dstring_lazy_init(&theme->host);
 	dstring_lazy_init(&theme->name);
 	dstring_lazy_init(&theme->html_base_dir);
+	dstring_lazy_init(&theme->page_prelude);
+	dstring_lazy_init(&theme->code_page_prelude);
+	dstring_lazy_init(&theme->page_header);
+	dstring_lazy_init(&theme->page_postlude);
+	dstring_lazy_init(&theme->style_start);
 }
 theme_struct* theme_load(theme_struct* theme, dstring_struct* base_dir) {
-	if(!dstring_try_load_file(&theme->main_css, base_dir, "/main.css", "theme")) {
+	if(!load_content_file(&theme->main_css, base_dir, "/main.css", "theme")) {
+		return NULL;
+	}
+	if(!load_content_file(&theme->syntax_highlighting_css, base_dir, "/syntax-highlighting.css", "theme")) {
+		return NULL;
+	}
+	return theme;
+}
+theme_struct* theme_minify(theme_struct* theme) {
+	if(!minify_replace(&theme->main_css, minify_css)
+		|| !minify_replace(&theme->syntax_highlighting_css, minify_css)) {
+		fprintf(stderr, "Error minifying theme CSS\n");
+		return NULL;
+	}
+	return theme;
+}
+// The media queries that the themes' styles apply under, when they're
+// combined.
+#define THEME_LIGHT_MEDIA "not all and (prefers-color-scheme: dark)"
+#define THEME_DARK_MEDIA "(prefers-color-scheme: dark)"
+
+// When the themes are combined, switches between them by changing the media
+// queries of their <style> and <link> elements, remembering the choice for
+// later pages. It runs before the page is shown, so the page doesn't flash
+// in the other theme first.
+static const char* theme_switcher_script =
+	"<script>"
+	"var sparkTheme;"
+	"function sparkSetTheme(t){sparkTheme=t;var m={light:\"" THEME_LIGHT_MEDIA "\",dark:\"" THEME_DARK_MEDIA "\"};"
+	"for(var s in m){var e=document.querySelectorAll('.spark-'+s);for(var i=0;i<e.length;i++){e[i].media=t?(t==s?'all':'not all'):m[s];}}}"
+	"function sparkToggleTheme(){var t=(sparkTheme||(matchMedia(\"" THEME_DARK_MEDIA "\").matches?'dark':'light'))=='dark'?'light':'dark';"
+	"try{localStorage.setItem('spark-theme',t);}catch(e){}sparkSetTheme(t);return false;}"
+	"try{sparkSetTheme(localStorage.getItem('spark-theme'));}catch(e){}"
+	"</script>";
+
+// Appends the attributes that the theme's <style> and <link> elements need
+// to dest: none, unless the themes are combined.
+// Returns NULL on error.
+dstring_struct* theme_append_style_attributes(theme_struct* theme, dstring_struct* dest) {
+	if(theme->color_scheme == NULL) {
+		return dest;
+	}
+	return dstring_append_printf(dest, " class='spark-%s' media='%s'", theme->color_scheme, !strcmp(theme->color_scheme, "dark") ? THEME_DARK_MEDIA : THEME_LIGHT_MEDIA);
+}
+// Appends the start of the page header to dest.
+// Returns NULL on error.
+dstring_struct* theme_build_header(theme_struct* theme, dstring_struct* dest) {
+	if(theme->color_scheme != NULL && !dstring_append(dest, theme_switcher_script)) {
+		return NULL;
+	}
+	// TODO: I should probably have a setting that controls the page header, instead of just using the hostname.
+	// I only have it using the hostname so that it's no longer hard-coded to my site name.
+	if(!dstring_append(dest, "<body>")
+		|| !dstring_append_printf(dest, "<header class='nheader'>\n<a class='leftfloat' href='/'>%s</a> <a class='rightfloat' href='", theme->host.str)) {
+		return NULL;
+	}
+	// The switcher's link goes to the same page, for when scripts are off
+	if(theme->color_scheme != NULL) {
+		return dstring_append(dest, "/");
+	}
+	return dstring_append_printf(dest, "https://%s/", theme->alt_theme->host.str);
+}
+// Appends the rest of the page header, after the page's URL path, to dest.
+// Returns NULL on error.
+dstring_struct* theme_build_postlude(theme_struct* theme, dstring_struct* dest) {
+	if(theme->color_scheme != NULL) {
+		return dstring_append_printf(dest, "' onclick='return sparkToggleTheme()'>[%s/%s]</a>\n</header>\n", theme->name.str, theme->alt_theme->name.str);
+	}
+	return dstring_append_printf(dest, "'>[%s]</a>\n</header>\n", theme->alt_theme->name.str);
+}
+// Appends the theme's styles (or the links to its stylesheets) to dest.
+// Returns NULL on error.
+dstring_struct* theme_build_styles(theme_struct* theme, dstring_struct* dest, int has_code) {
+	if(theme->external_stylesheets) {
+		if(!dstring_append(dest, "<link rel='stylesheet'")
+			|| !theme_append_style_attributes(theme, dest)
+			|| !dstring_append_printf(dest, " href='/%s'>", theme->main_css_filename.str)) {
+			return NULL;
+		}
+		if(has_code
+			&& (!dstring_append(dest, "<link rel='stylesheet'")
+				|| !theme_append_style_attributes(theme, dest)
+				|| !dstring_append_printf(dest, " href='/%s'>", theme->code_css_filename.str))) {
+			return NULL;
+		}
+		return dest;
+	}
+	if(!dstring_append(dest, "<style")
+		|| !theme_append_style_attributes(theme, dest)
+		|| !dstring_append(dest, ">")
+		|| !dstring_append(dest, theme->main_css.str)
+		|| (has_code && !dstring_append(dest, theme->syntax_highlighting_css.str))
+		|| !dstring_append(dest, "</style>")) {
+		return NULL;
+	}
+	return dest;
+}
+// Appends the styles (or the links to the stylesheets), of both themes if
+// they're combined, and the start of the page header to prelude.
+// Returns NULL on error.
+dstring_struct* theme_build_prelude(theme_struct* theme, dstring_struct* prelude, int has_code) {
+	if(!theme_build_styles(theme, prelude, has_code)
+		|| (theme->color_scheme != NULL && !theme_build_styles(theme->alt_theme, prelude, has_code))
+		|| !dstring_append(prelude, theme->page_header.str)) {
+		return NULL;
+	}
+	return prelude;
+}
+// Names the stylesheet file for css after a hash of its contents.
+// Returns NULL on error.
+dstring_struct* theme_name_stylesheet(dstring_struct* filename, dstring_struct* css) {
+	dhash_struct dhash;
+	dhash_init(&dhash);
+	dhash_append_dstring(&dhash, css);
+	dstring_free(filename);
+	dstring_lazy_init(filename);
+	return dstring_append_printf(filename, "%016" PRIx64 ".css", dhash_get(&dhash));
+}
+// Names the theme's stylesheet files, if they're external.
+// Returns 0 on error.
+int theme_name_stylesheets(theme_struct* theme) {
+	return !theme->external_stylesheets
+		|| (theme_name_stylesheet(&theme->main_css_filename, &theme->main_css)
+			&& theme_name_stylesheet(&theme->code_css_filename, &theme->syntax_highlighting_css));
+}
+theme_struct* theme_build_page_segments(theme_struct* theme) {
+	dstring_free(&theme->page_prelude);
+	dstring_free(&theme->code_page_prelude);
+	dstring_free(&theme->page_header);
+	dstring_free(&theme->page_postlude);
+	dstring_free(&theme->style_start);
+	// The alt_theme's stylesheets are named here too, as its segments may
+	// not be built yet
+	if(!theme_name_stylesheets(theme)
+		|| (theme->color_scheme != NULL && !theme_name_stylesheets(theme->alt_theme))
+		|| !dstring_append(&theme->style_start, "<style")
+		|| !theme_append_style_attributes(theme, &theme->style_start)
+		|| !dstring_append(&theme->style_start, ">")
+		|| !theme_build_header(theme, &theme->page_header)
+		|| !theme_build_prelude(theme, &theme->page_prelude, 0)
+		|| !theme_build_prelude(theme, &theme->code_page_prelude, 1)
+		|| !theme_build_postlude(theme, &theme->page_postlude)) {
+		fprintf(stderr, "Error building page segments for theme %s, dstring append error\n", theme->name.str);
+		return NULL;
+	}
+	return theme;
+}
+// Writes the stylesheet file for css, if it has changed.
+// Returns 0 on error.
+int theme_write_stylesheet(theme_struct* theme, dstring_struct* css, dstring_struct* filename, int precompress_formats) {
+	dstringbuilder_struct builder;
+	dstringbuilder_init(&builder);
+	int did_write;
+	int res = dstringbuilder_append_dstring(&builder, css)
+		&& dstringbuilder_write_file_if_different_at(&builder, theme->html_base_dir_fd, filename->str, &did_write)
+		&& precompress_update_siblings_at(&builder, theme->html_base_dir_fd, filename->str, precompress_formats, did_write);
+	dstringbuilder_free(&builder);
+	if(!res) {
+		fprintf(stderr, "Error writing stylesheet %s/%s\n", theme->html_base_dir.str, filename->str);
+		return 0;
+	}
+	if(did_write) {
+		printf("Updated stylesheet %s/%s\n", theme->html_base_dir.str, filename->str);
+	}
+	return 1;
+}
+theme_struct* theme_write_stylesheets(theme_struct* theme, int precompress_formats) {
+	if(!theme->external_stylesheets) {
+		return theme;
+	}
+	theme_struct* alt_theme = theme->alt_theme;
+	if(!theme_write_stylesheet(theme, &theme->main_css, &theme->main_css_filename, precompress_formats)
+		|| !theme_write_stylesheet(theme, &theme->syntax_highlighting_css, &theme->code_css_filename, precompress_formats)
+		|| (theme->color_scheme != NULL
+			&& (!theme_write_stylesheet(theme, &alt_theme->main_css, &alt_theme->main_css_filename, precompress_formats)
+				|| !theme_write_stylesheet(theme, &alt_theme->syntax_highlighting_css, &alt_theme->code_css_filename, precompress_formats)))) {
 		return NULL;
 	}
-	if(!dstring_try_load_file(&theme->syntax_highlighting_css, base_dir, "/syntax-highlighting.css", "theme")) {
+	return theme;
+}
+// Returns 1 if filename is named the way theme_name_stylesheet names
+// stylesheets.
+int theme_is_stylesheet_filename(const char* filename) {
+	for(size_t i = 0; i < 16; i++) {
+		if(!((filename[i] >= '0' && filename[i] <= '9') || (filename[i] >= 'a' && filename[i] <= 'f'))) {
+			return 0;
+		}
+	}
+	return strcmp(filename + 16, ".css") == 0;
+}
+// Returns 1 if filename is one of the stylesheets that the theme's pages
+// link to.
+int theme_uses_stylesheet(theme_struct* theme, const char* filename) {
+	if(!theme->external_stylesheets) {
+		return 0;
+	}
+	if(strcmp(filename, theme->main_css_filename.str) == 0 || strcmp(filename, theme->code_css_filename.str) == 0) {
+		return 1;
+	}
+	return theme->color_scheme != NULL
+		&& (strcmp(filename, theme->alt_theme->main_css_filename.str) == 0
+			|| strcmp(filename, theme->alt_theme->code_css_filename.str) == 0);
+}
+int theme_remove_old_stylesheet(dstring_struct* base_dir, struct dirent* dir_ent, void* theme_void_ptr) {
+	theme_struct* theme = theme_void_ptr;
+	if(!theme_is_stylesheet_filename(dir_ent->d_name) || theme_uses_stylesheet(theme, dir_ent->d_name)) {
+		return 1;
+	}
+	if(!remove_file_at(theme->html_base_dir_fd, base_dir, dir_ent->d_name)
+		|| !precompress_remove_siblings_at(theme->html_base_dir_fd, dir_ent->d_name)) {
+		fprintf(stderr, "Error removing old stylesheet %s/%s\n", theme->html_base_dir.str, dir_ent->d_name);
+		return 0;
+	}
+	return 1;
+}
+theme_struct* theme_remove_old_stylesheets(theme_struct* theme) {
+	dstring_struct base_dir;
+	dstring_lazy_init(&base_dir);
+	if(!dstring_append_printf(&base_dir, "%s/", theme->html_base_dir.str)) {
+		fprintf(stderr, "Error removing old stylesheets, dstring append error\n");
+		return NULL;
+	}
+	int res = apply_function_to_directory_entries_at(theme->html_base_dir_fd, &base_dir, 0, DT_REG, theme_remove_old_stylesheet, theme);
+	dstring_free(&base_dir);
+	if(!res) {
+		fprintf(stderr, "Error removing old stylesheets for %s theme\n", theme->name.str);
 		return NULL;
 	}
 	return theme;
 }
+theme_struct* theme_build_css_pruner(theme_struct* theme) {
+	dstring_struct theme_html;
+	dstring_lazy_init(&theme_html);
+	// The link to the alt-themed page is missing its URL path, but that
+	// doesn't change its selectors
+	if(!dstring_append(&theme_html, theme->page_header.str)
+		|| !dstring_append(&theme_html, theme->page_postlude.str)) {
+		fprintf(stderr, "Error setting up CSS pruning for theme %s, dstring append error\n", theme->name.str);
+		dstring_free(&theme_html);
+		return NULL;
+	}
+	css_pruner_struct* css_pruner = (css_pruner_struct*) malloc(sizeof(css_pruner_struct));
+	if(css_pruner == NULL || !css_pruner_init(css_pruner, &theme->main_css, &theme->syntax_highlighting_css, &theme_html)) {
+		fprintf(stderr, "Error setting up CSS pruning for theme %s\n", theme->name.str);
+		free(css_pruner);
+		dstring_free(&theme_html);
+		return NULL;
+	}
+	dstring_free(&theme_html);
+	if(theme->css_pruner != NULL) {
+		css_pruner_free(theme->css_pruner);
+		free(theme->css_pruner);
+	}
+	theme->css_pruner = css_pruner;
+	return theme;
+}
+theme_struct* theme_open_html_base_dir(theme_struct* theme) {
+	close_directory(&theme->html_base_dir_fd);
+	theme->html_base_dir_fd = open_directory(theme->html_base_dir.str);
+	if(theme->html_base_dir_fd == -1) {
+		fprintf(stderr, "Error opening HTML directory for %s theme\n", theme->name.str);
+		return NULL;
+	}
+	return theme;
+}
+void theme_close_html_base_dir(theme_struct* theme) {
+	close_directory(&theme->html_base_dir_fd);
+}
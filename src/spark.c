@@ -7,6 +7,10 @@
 #include "param_parser.h"
 #include "site_configuration.h"
 #include "site_generator.h"
+#include "site_watcher.h"
+#include "content_bundle.h"
+#include "job_pool.h"
+#include "io_ring.h"
 
 #define ERROR_BAD_PARAMETERS 1
 #define ERROR_BAD_CONFIGURATION 2
@@ -19,14 +23,26 @@
 
 typedef struct settings_struct {
 	char* config_file;
+	char* jobs;
+	char* pack;
+	char* content_bundle;
 	int show_help;
 	int generate_site;
 	int validate_site;
+	int watch;
+	int streaming;
+	int io_uring;
 } settings_struct;
 
 void show_help() {
-	printf("spark --config <config file> [--generate-site | --validate-site]\n\n");
-	printf("Spark is a dual-themed static blog site generator.\n");
+	printf("spark --config <config file> [--jobs <N>] [--streaming] [--io-uring] [--content-bundle <bundle file>] [--generate-site | --validate-site | --watch | --pack <bundle file>]\n\n");
+	printf("Spark is a dual-themed static blog site generator.\n\n");
+	printf("--jobs <N>: Use N threads for loading and generating the site (default 1, 0 for one per processor).\n");
+	printf("--streaming: Build and write pages a batch at a time, so memory use doesn't grow with the number of pages.\n");
+	printf("--io-uring: Batch file reads and checks through io_uring, if the kernel supports it.\n");
+	printf("--watch: Generate the site, then keep regenerating it as its content changes, until interrupted.\n");
+	printf("--pack <bundle file>: Pack the content directory into a single content bundle file.\n");
+	printf("--content-bundle <bundle file>: Load the site from a content bundle instead of the content directory.\n");
 }
 
 int get_parameters(settings_struct* settings, int argc, char* argv[]) {
@@ -39,13 +55,37 @@ int get_parameters(settings_struct* settings, int argc, char* argv[]) {
 		fprintf(stderr, "Missing required parameter --config\n");
 		return 0;
 	}
+	settings->jobs = NULL;
+	if(!paramparser_get_string(argc, argv, "--jobs", &settings->jobs, PARAMPARSER_OPTIONAL)) {
+		fprintf(stderr, "Missing value for parameter --jobs\n");
+		return 0;
+	}
 	paramparser_get_flag(argc, argv, "--generate-site", &settings->generate_site);
 	paramparser_get_flag(argc, argv, "--validate-site", &settings->validate_site);
+	paramparser_get_flag(argc, argv, "--watch", &settings->watch);
+	paramparser_get_flag(argc, argv, "--streaming", &settings->streaming);
+	paramparser_get_flag(argc, argv, "--io-uring", &settings->io_uring);
+	settings->pack = NULL;
+	settings->content_bundle = NULL;
+	if(!paramparser_get_string(argc, argv, "--pack", &settings->pack, PARAMPARSER_OPTIONAL)
+		|| !paramparser_get_string(argc, argv, "--content-bundle", &settings->content_bundle, PARAMPARSER_OPTIONAL)) {
+		fprintf(stderr, "Missing bundle file for --pack or --content-bundle\n");
+		return 0;
+	}
 	
-	// Presently this is the only action, so if it's not given,
-	// then that's a problem
-	if(!settings->generate_site && !settings->validate_site) {
-		fprintf(stderr, "Need either --generate-site or --validate-site\n");
+	// An action is required
+	if(!settings->generate_site && !settings->validate_site && !settings->watch && settings->pack == NULL) {
+		fprintf(stderr, "Need one of --generate-site, --validate-site, --watch or --pack\n");
+		return 0;
+	}
+	// A bundle doesn't change, so there's nothing to watch; and packing
+	// reads the content directory itself.
+	if(settings->content_bundle != NULL && (settings->watch || settings->pack != NULL)) {
+		fprintf(stderr, "--content-bundle can only be used with --generate-site or --validate-site\n");
+		return 0;
+	}
+	if(settings->streaming && !settings->generate_site && !settings->watch) {
+		fprintf(stderr, "--streaming can only be used with --generate-site or --watch\n");
 		return 0;
 	}
 	return 1;
@@ -82,16 +122,66 @@ int main(int argc, char* argv[]) {
 		fprintf(stderr, "Error, bad configuration\n");
 		return ERROR_BAD_CONFIGURATION;
 	}
+	if(settings.jobs != NULL) {
+		char* jobs_end;
+		long num_jobs = strtol(settings.jobs, &jobs_end, 10);
+		if(jobs_end == settings.jobs || *jobs_end != '\0' || num_jobs < 0 || num_jobs > 1024) {
+			fprintf(stderr, "Error, --jobs must be a number from 0 to 1024\n");
+			dstring_free(&configuration.raw_config_file);
+			return ERROR_BAD_PARAMETERS;
+		}
+		configuration.num_jobs = num_jobs == 0 ? job_pool_get_num_processors() : (int) num_jobs;
+	}
+	configuration.streaming = settings.streaming;
+	content_bundle_struct content_bundle;
+	if(settings.content_bundle != NULL) {
+		if(!content_bundle_open(&content_bundle, settings.content_bundle, configuration.content_base_dir)) {
+			fprintf(stderr, "Error, couldn't open content bundle\n");
+			dstring_free(&configuration.raw_config_file);
+			return ERROR_BAD_PARAMETERS;
+		}
+		// The content directory doesn't need to have anything in it, but
+		// generating uses it for the lock and build manifest.
+		dstring_struct content_base_dir;
+		dstring_lazy_init(&content_base_dir);
+		if(settings.generate_site
+			&& (!dstring_append(&content_base_dir, configuration.content_base_dir)
+				|| !make_directory(&content_base_dir, ""))) {
+			fprintf(stderr, "Error, couldn't create content directory %s\n", configuration.content_base_dir);
+			dstring_free(&content_base_dir);
+			content_bundle_close(&content_bundle);
+			dstring_free(&configuration.raw_config_file);
+			return ERROR_GENERATING_SITE;
+		}
+		dstring_free(&content_base_dir);
+		use_content_bundle(&content_bundle);
+	}
+	if(settings.io_uring) {
+		io_ring_use(1);
+	}
 	int res = 0;
-	if(settings.generate_site) {
+	if(settings.pack != NULL) {
+		res = content_bundle_pack(configuration.content_base_dir, settings.pack);
+	} else if(settings.generate_site) {
 		res = generate_site(&configuration);
 	} else if(settings.validate_site) {
 		res = validate_site(&configuration);
+	} else if(settings.watch) {
+		res = watch_site(&configuration);
 	}
 
+	if(settings.io_uring) {
+		io_ring_use(0);
+	}
+	if(settings.content_bundle != NULL) {
+		use_content_bundle(NULL);
+		content_bundle_close(&content_bundle);
+	}
 	dstring_free(&configuration.raw_config_file);
 
-	if(!res && settings.generate_site) {
+	if(!res && settings.pack != NULL) {
+		return ERROR_OTHER;
+	} else if(!res && (settings.generate_site || settings.watch)) {
 		return ERROR_GENERATING_SITE;
 	} else if(!res &&settings.validate_site) {
 		return ERROR_VALIDATING_SITE;